@@ -0,0 +1,351 @@
+/**
+ * @file loadtest.c
+ * @brief Load generator for the /metrics endpoint: opens the given number of keep-alive
+ *        connections, each one in its own thread, sends GET requests back to back and reports
+ *        requests per second and latency percentiles.
+ *
+ * Usage: loadtest [host] [port] [connections] [requests_per_connection] [path]
+ */
+
+#define _GNU_SOURCE
+
+#include <arpa/inet.h>
+#include <netdb.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+//! \brief Size of the receive buffer of a connection.
+#define LT_BUFFER_SIZE (64 * 1024)
+//! \brief Max. number of connections.
+#define LT_MAX_CONNECTIONS 1024
+
+/**
+ * @brief State of one client connection.
+ */
+typedef struct lt_client
+{
+    const struct addrinfo* addr; /**< where to connect to */
+    const char* request;         /**< the request to send */
+    unsigned int requests;       /**< number of requests to send */
+    uint64_t* latency;           /**< latency of each request in ns */
+    unsigned int done;           /**< number of successful requests */
+    unsigned int errors;         /**< number of failed requests */
+    unsigned long long bytes;    /**< number of body bytes received */
+    int fd;                      /**< the socket, -1 if not connected */
+    char buf[LT_BUFFER_SIZE];    /**< receive buffer */
+    size_t len;                  /**< number of bytes in buf */
+} lt_client_t;
+
+/**
+ * @brief Get a monotonic timestamp in nanoseconds.
+ */
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/**
+ * @brief Make sure, that at least \c need bytes are buffered.
+ * @return 0 on success, -1 on error or EOF.
+ */
+static int fill(lt_client_t* c, size_t need)
+{
+    while (c->len < need)
+    {
+        if (c->len == LT_BUFFER_SIZE)
+        {
+            return -1;
+        }
+        ssize_t n = read(c->fd, c->buf + c->len, LT_BUFFER_SIZE - c->len);
+        if (n <= 0)
+        {
+            return -1;
+        }
+        c->len += n;
+    }
+    return 0;
+}
+
+/**
+ * @brief Drop the first \c n buffered bytes.
+ */
+static void consume(lt_client_t* c, size_t n)
+{
+    memmove(c->buf, c->buf + n, c->len - n);
+    c->len -= n;
+}
+
+/**
+ * @brief Read a line terminated by CRLF (without it) into the given buffer.
+ * @return 0 on success, -1 on error.
+ */
+static int read_line(lt_client_t* c, char* line, size_t max)
+{
+    char* end;
+    while ((end = memmem(c->buf, c->len, "\r\n", 2)) == NULL)
+    {
+        if (fill(c, c->len + 1))
+        {
+            return -1;
+        }
+    }
+    size_t n = end - c->buf;
+    if (n >= max)
+    {
+        return -1;
+    }
+    memcpy(line, c->buf, n);
+    line[n] = '\0';
+    consume(c, n + 2);
+    return 0;
+}
+
+/**
+ * @brief Skip the given number of body bytes.
+ */
+static int skip(lt_client_t* c, size_t n)
+{
+    c->bytes += n;
+    while (n > 0)
+    {
+        if (c->len == 0 && fill(c, 1))
+        {
+            return -1;
+        }
+        size_t k = n < c->len ? n : c->len;
+        consume(c, k);
+        n -= k;
+    }
+    return 0;
+}
+
+/**
+ * @brief Read a complete response, i.e. its header and its body (fixed length or chunked).
+ * @param keep_alive Set to 0 if the server closes the connection afterwards.
+ * @return 0 on success, -1 on error.
+ */
+static int read_response(lt_client_t* c, int* keep_alive)
+{
+    char line[1024];
+    long long length = -1;
+    int chunked = 0;
+    int status = 0;
+
+    if (read_line(c, line, sizeof(line)) || sscanf(line, "HTTP/1.%*d %d", &status) != 1)
+    {
+        return -1;
+    }
+    *keep_alive = 1;
+    while (1)
+    {
+        if (read_line(c, line, sizeof(line)))
+        {
+            return -1;
+        }
+        if (line[0] == '\0')
+        {
+            break;
+        }
+        if (strncasecmp(line, "Content-Length:", 15) == 0)
+        {
+            length = atoll(line + 15);
+        }
+        else if (strncasecmp(line, "Transfer-Encoding:", 18) == 0 && strstr(line, "chunked") != NULL)
+        {
+            chunked = 1;
+        }
+        else if (strncasecmp(line, "Connection:", 11) == 0 && strstr(line, "close") != NULL)
+        {
+            *keep_alive = 0;
+        }
+    }
+    if (chunked)
+    {
+        while (1)
+        {
+            if (read_line(c, line, sizeof(line)))
+            {
+                return -1;
+            }
+            size_t n = strtoul(line, NULL, 16);
+            if (n == 0)
+            {
+                // trailer (if any) up to the empty line
+                do
+                {
+                    if (read_line(c, line, sizeof(line)))
+                    {
+                        return -1;
+                    }
+                } while (line[0] != '\0');
+                break;
+            }
+            if (skip(c, n) || fill(c, 2))
+            {
+                return -1;
+            }
+            consume(c, 2);
+        }
+    }
+    else if (length >= 0)
+    {
+        if (skip(c, length))
+        {
+            return -1;
+        }
+    }
+    else
+    {
+        // body ends with the connection
+        while (fill(c, c->len + 1) == 0)
+        {
+            c->bytes += c->len;
+            c->len = 0;
+        }
+        *keep_alive = 0;
+    }
+    return status == 200 ? 0 : -1;
+}
+
+/**
+ * @brief (Re)connect the given client.
+ */
+static int connect_client(lt_client_t* c)
+{
+    if (c->fd >= 0)
+    {
+        close(c->fd);
+    }
+    c->len = 0;
+    c->fd = socket(c->addr->ai_family, c->addr->ai_socktype, c->addr->ai_protocol);
+    if (c->fd < 0 || connect(c->fd, c->addr->ai_addr, c->addr->ai_addrlen))
+    {
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * @brief Thread function: send the requests of the given client.
+ */
+static void* run_client(void* arg)
+{
+    lt_client_t* c = (lt_client_t*)arg;
+    size_t rlen = strlen(c->request);
+    int keep_alive = 0;
+
+    for (unsigned int i = 0; i < c->requests; i++)
+    {
+        uint64_t start = now_ns();
+        if ((!keep_alive && connect_client(c)) || write(c->fd, c->request, rlen) != (ssize_t)rlen ||
+            read_response(c, &keep_alive))
+        {
+            c->errors++;
+            keep_alive = 0;
+            continue;
+        }
+        c->latency[c->done++] = now_ns() - start;
+    }
+    if (c->fd >= 0)
+    {
+        close(c->fd);
+    }
+    return NULL;
+}
+
+/**
+ * @brief qsort() helper.
+ */
+static int cmp_u64(const void* a, const void* b)
+{
+    uint64_t x = *(const uint64_t*)a;
+    uint64_t y = *(const uint64_t*)b;
+    return x < y ? -1 : x > y;
+}
+
+//! \brief Main function of the load generator.
+int main(int argc, char* argv[])
+{
+    const char* host = argc > 1 ? argv[1] : "127.0.0.1";
+    const char* port = argc > 2 ? argv[2] : "8000";
+    unsigned int connections = argc > 3 ? atoi(argv[3]) : 8;
+    unsigned int requests = argc > 4 ? atoi(argv[4]) : 100;
+    const char* path = argc > 5 ? argv[5] : "/metrics";
+    struct addrinfo hints = {.ai_family = AF_UNSPEC, .ai_socktype = SOCK_STREAM};
+    struct addrinfo* addr;
+    char request[512];
+
+    if (connections == 0 || connections > LT_MAX_CONNECTIONS || requests == 0)
+    {
+        fprintf(stderr, "ERROR: 1..%d connections and at least 1 request needed.\n", LT_MAX_CONNECTIONS);
+        return EXIT_FAILURE;
+    }
+    if (getaddrinfo(host, port, &hints, &addr) != 0)
+    {
+        fprintf(stderr, "ERROR: Can't resolve %s:%s\n", host, port);
+        return EXIT_FAILURE;
+    }
+    snprintf(request, sizeof(request), "GET %s HTTP/1.1\r\nHost: %s\r\nConnection: keep-alive\r\n\r\n", path, host);
+
+    lt_client_t* client = calloc(connections, sizeof(lt_client_t));
+    pthread_t* tid = calloc(connections, sizeof(pthread_t));
+    uint64_t* latency = malloc((size_t)connections * requests * sizeof(uint64_t));
+    if (client == NULL || tid == NULL || latency == NULL)
+    {
+        fprintf(stderr, "ERROR: Out of memory\n");
+        return EXIT_FAILURE;
+    }
+
+    uint64_t start = now_ns();
+    for (unsigned int i = 0; i < connections; i++)
+    {
+        client[i].addr = addr;
+        client[i].request = request;
+        client[i].requests = requests;
+        client[i].latency = latency + (size_t)i * requests;
+        client[i].fd = -1;
+        pthread_create(&tid[i], NULL, run_client, &client[i]);
+    }
+    size_t done = 0;
+    unsigned int errors = 0;
+    unsigned long long bytes = 0;
+    for (unsigned int i = 0; i < connections; i++)
+    {
+        pthread_join(tid[i], NULL);
+        // compact the latencies of all clients
+        memmove(latency + done, client[i].latency, client[i].done * sizeof(uint64_t));
+        done += client[i].done;
+        errors += client[i].errors;
+        bytes += client[i].bytes;
+    }
+    double secs = (now_ns() - start) * 1e-9;
+
+    qsort(latency, done, sizeof(uint64_t), cmp_u64);
+    printf("%-12s %12s %10s %10s %10s %10s %10s %8s\n", "connections", "requests/s", "MB/s", "p50 ms", "p90 ms",
+           "p99 ms", "max ms", "errors");
+    if (done == 0)
+    {
+        printf("%-12u %12s %10s %10s %10s %10s %10s %8u\n", connections, "-", "-", "-", "-", "-", "-", errors);
+    }
+    else
+    {
+        printf("%-12u %12.0f %10.1f %10.3f %10.3f %10.3f %10.3f %8u\n", connections, done / secs,
+               bytes / secs / 1e6, latency[done / 2] * 1e-6, latency[done * 9 / 10] * 1e-6,
+               latency[done * 99 / 100] * 1e-6, latency[done - 1] * 1e-6, errors);
+    }
+
+    freeaddrinfo(addr);
+    free(latency);
+    free(tid);
+    free(client);
+    return errors > 0 ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,38 @@
+#!/bin/sh
+# Measures requests/s and tail latency of /metrics for each HTTP serving mode of the
+# metrics daemon. For every mode a JSON config gets written, the daemon started with it
+# and loaded by bench/loadtest with an increasing number of keep-alive connections.
+#
+# Usage: bench/loadtest.sh [path/to/metrics] [requests_per_connection]
+
+METRICS=${1:-build/metrics}
+REQUESTS=${2:-200}
+PORT=${PORT:-18000}
+THREADS=${THREADS:-$(nproc)}
+DIR=$(dirname "$0")
+TMP=$(mktemp -d)
+trap 'kill $PID 2>/dev/null; rm -rf "$TMP"' EXIT
+
+if [ ! -x "$METRICS" ]; then
+    echo "ERROR: metrics daemon '$METRICS' not found, build it first." >&2
+    exit 1
+fi
+cc -O2 -pthread -o "$TMP/loadtest" "$DIR/loadtest.c" || exit 1
+
+# mode threads
+for SETUP in "select 0" "poll 0" "epoll 0" "epoll $THREADS" "thread_per_connection 0"; do
+    set -- $SETUP
+    cat > "$TMP/config.json" << EOF
+{ "update_interval": 1, "metrics": { "cpu": true, "mem": true, "hdd": true, "net": true, "procs": true },
+  "http": { "address": "127.0.0.1", "port": $PORT, "mode": "$1", "threads": $2, "connection_limit": 0, "per_ip_limit": 0, "timeout": 10 } }
+EOF
+    "$METRICS" "$TMP/config.json" > /dev/null 2>&1 &
+    PID=$!
+    sleep 1
+    echo "== mode: $1, thread pool: $2"
+    for C in 1 4 16 64; do
+        "$TMP/loadtest" 127.0.0.1 $PORT $C $REQUESTS | tail -n +$([ $C -eq 1 ] && echo 1 || echo 2)
+    done
+    kill $PID
+    wait $PID 2> /dev/null
+done
@@ -0,0 +1,612 @@
+/**
+ * @file procsnap.c
+ * @brief Records timed sequences of the procfs/sysfs files read by the collectors of src/metrics.c into
+ *        a compact archive and serves them back, so that the collectors can be run against the same
+ *        data again, e.g. fixtures of 256-core or 10k-process machines recorded elsewhere.
+ *
+ * Usage:
+ *   procsnap record <archive> <count> <interval_ms> [path ...]
+ *       Record count snapshots of /proc/{meminfo,stat,diskstats,net/dev}, /proc/<pid>/stat of every
+ *       process and the given additional files (e.g. below /sys), interval_ms apart.
+ *   procsnap replay <archive> <root> [speed]
+ *       Materialize the snapshots one after another below root with the recorded timing divided by
+ *       speed (0 for no delays). Run the daemon with METRICS_FS_ROOT=<root> to read them.
+ *   procsnap extract <archive> <root> <index>
+ *       Materialize the given snapshot below root.
+ *   procsnap bench <archive> [passes]
+ *       Run all collectors against each snapshot, print their results of the first pass (to be diffed
+ *       against the ones of other builds) and the time per call over all passes.
+ *
+ * Archive (gzip compressed, native byte order): the magic "PROCSNAP" and the version (u32), then for each
+ * snapshot 'S', its time since the first one in ms (u64) and its number of files (u32), followed by the
+ * files sorted by path: the path length (u16), the path, and 0 with the length (u32) and the content,
+ * or 1 if the content equals the one of the previous snapshot. The archive ends with 'E'.
+ */
+
+#define _GNU_SOURCE
+
+#include "metrics.h"
+#include <stdint.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <zlib.h>
+
+//! \brief Magic at the start of an archive.
+#define SNAP_MAGIC "PROCSNAP"
+//! \brief Version of the archive format.
+#define SNAP_VERSION 1
+//! \brief Files recorded in each snapshot in addition to the /proc/<pid>/stat ones.
+#define SNAP_FILES {"/proc/meminfo", "/proc/stat", "/proc/diskstats", "/proc/net/dev"}
+
+/**
+ * @brief A recorded file.
+ */
+typedef struct snap_file
+{
+    char* path;   /**< absolute path, e.g. "/proc/1/stat" */
+    char* data;   /**< its content */
+    uint32_t len; /**< length of the content */
+} snap_file_t;
+
+/**
+ * @brief A snapshot: files sorted by path.
+ */
+typedef struct snap
+{
+    snap_file_t* file;
+    size_t count;
+    size_t cap;
+    uint64_t time; /**< ms since the first snapshot */
+} snap_t;
+
+/**
+ * @brief Get a monotonic timestamp in nanoseconds.
+ */
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/**
+ * @brief Release the files of the given snapshot.
+ */
+static void snap_clear(snap_t* s)
+{
+    for (size_t i = 0; i < s->count; i++)
+    {
+        free(s->file[i].path);
+        free(s->file[i].data);
+    }
+    s->count = 0;
+}
+
+/**
+ * @brief Append a file to the given snapshot; takes over path and data.
+ */
+static void snap_add(snap_t* s, char* path, char* data, uint32_t len)
+{
+    if (s->count == s->cap)
+    {
+        s->cap = s->cap == 0 ? 64 : s->cap * 2;
+        s->file = realloc(s->file, s->cap * sizeof(snap_file_t));
+        if (s->file == NULL)
+        {
+            fprintf(stderr, "ERROR: Out of memory\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+    s->file[s->count++] = (snap_file_t){path, data, len};
+}
+
+/**
+ * @brief Find the file with the given path in the given snapshot.
+ */
+static snap_file_t* snap_find(const snap_t* s, const char* path)
+{
+    size_t lo = 0, hi = s->count;
+    while (lo < hi)
+    {
+        size_t mid = (lo + hi) / 2;
+        int r = strcmp(s->file[mid].path, path);
+        if (r == 0)
+        {
+            return &s->file[mid];
+        }
+        if (r < 0)
+        {
+            lo = mid + 1;
+        }
+        else
+        {
+            hi = mid;
+        }
+    }
+    return NULL;
+}
+
+/**
+ * @brief qsort() helper: order files by path.
+ */
+static int cmp_file(const void* a, const void* b)
+{
+    return strcmp(((const snap_file_t*)a)->path, ((const snap_file_t*)b)->path);
+}
+
+/**
+ * @brief Read the given file below the configured root completely and add it to the snapshot.
+ * @return 0 on success, -1 if it can't be read (e.g. the process ended meanwhile).
+ */
+static int read_file(snap_t* s, const char* path)
+{
+    FILE* fp = open_fs_file(path);
+    size_t len = 0, cap = 4096;
+    char* data = malloc(cap);
+
+    if (fp == NULL || data == NULL)
+    {
+        free(data);
+        if (fp != NULL)
+        {
+            fclose(fp);
+        }
+        return -1;
+    }
+    // procfs files have no size, so read until EOF
+    size_t n;
+    while ((n = fread(data + len, 1, cap - len, fp)) > 0)
+    {
+        len += n;
+        if (len == cap)
+        {
+            data = realloc(data, cap *= 2);
+        }
+    }
+    fclose(fp);
+    snap_add(s, strdup(path), data, len);
+    return 0;
+}
+
+/**
+ * @brief Take a snapshot of the recorded files.
+ */
+static void take_snapshot(snap_t* s, int extra, char* extra_path[])
+{
+    static const char* files[] = SNAP_FILES;
+    char path[PATH_LEN];
+
+    for (size_t i = 0; i < sizeof(files) / sizeof(files[0]); i++)
+    {
+        read_file(s, files[i]);
+    }
+    for (int i = 0; i < extra; i++)
+    {
+        if (read_file(s, extra_path[i]) != 0)
+        {
+            fprintf(stderr, "WARNING: Can't read %s\n", extra_path[i]);
+        }
+    }
+    DIR* dir = fs_path(path, sizeof(path), "/proc") == NULL ? NULL : opendir(path);
+    struct dirent* entry;
+    while (dir != NULL && (entry = readdir(dir)) != NULL)
+    {
+        if (entry->d_name[0] >= '1' && entry->d_name[0] <= '9')
+        {
+            snprintf(path, sizeof(path), "/proc/%.32s/stat", entry->d_name);
+            read_file(s, path);
+        }
+    }
+    if (dir != NULL)
+    {
+        closedir(dir);
+    }
+    qsort(s->file, s->count, sizeof(snap_file_t), cmp_file);
+}
+
+/**
+ * @brief Write the given snapshot; files unchanged since the previous one get stored as reference only.
+ * @return 0 on success, -1 on write errors.
+ */
+static int write_snapshot(gzFile gz, const snap_t* s, const snap_t* prev)
+{
+    uint32_t count = s->count;
+    int ok = gzputc(gz, 'S') != -1 && gzwrite(gz, &s->time, sizeof(s->time)) > 0 &&
+             gzwrite(gz, &count, sizeof(count)) > 0;
+
+    for (size_t i = 0; ok && i < s->count; i++)
+    {
+        const snap_file_t* f = &s->file[i];
+        const snap_file_t* p = snap_find(prev, f->path);
+        uint16_t plen = strlen(f->path);
+        int same = p != NULL && p->len == f->len && memcmp(p->data, f->data, f->len) == 0;
+        ok = gzwrite(gz, &plen, sizeof(plen)) > 0 && gzwrite(gz, f->path, plen) > 0 && gzputc(gz, same) != -1;
+        if (ok && !same)
+        {
+            ok = gzwrite(gz, &f->len, sizeof(f->len)) > 0 && (f->len == 0 || gzwrite(gz, f->data, f->len) > 0);
+        }
+    }
+    return ok ? 0 : -1;
+}
+
+/**
+ * @brief Read exactly len bytes.
+ */
+static int read_exact(gzFile gz, void* buf, size_t len)
+{
+    return len == 0 || gzread(gz, buf, len) == (int)len ? 0 : -1;
+}
+
+/**
+ * @brief Read the next snapshot; unchanged files get their content moved over from prev.
+ * @return 1 if a snapshot was read, 0 at the end of the archive, -1 if it is corrupt.
+ */
+static int read_snapshot(gzFile gz, snap_t* s, snap_t* prev)
+{
+    uint32_t count;
+    int tag = gzgetc(gz);
+
+    if (tag == 'E')
+    {
+        return 0;
+    }
+    if (tag != 'S' || read_exact(gz, &s->time, sizeof(s->time)) || read_exact(gz, &count, sizeof(count)))
+    {
+        return -1;
+    }
+    for (uint32_t i = 0; i < count; i++)
+    {
+        uint16_t plen;
+        uint32_t len = 0;
+        char* data = NULL;
+        if (read_exact(gz, &plen, sizeof(plen)))
+        {
+            return -1;
+        }
+        char* path = malloc(plen + 1);
+        if (path == NULL || read_exact(gz, path, plen))
+        {
+            free(path);
+            return -1;
+        }
+        path[plen] = '\0';
+        int same = gzgetc(gz);
+        snap_file_t* p = same == 1 ? snap_find(prev, path) : NULL;
+        if (p != NULL)
+        {
+            // hand the content over instead of copying it
+            data = p->data;
+            len = p->len;
+            p->data = NULL;
+        }
+        else if (same != 0 || read_exact(gz, &len, sizeof(len)) || (data = malloc(len + 1)) == NULL ||
+                 read_exact(gz, data, len))
+        {
+            free(path);
+            free(data);
+            return -1;
+        }
+        snap_add(s, path, data, len);
+    }
+    return 1;
+}
+
+/**
+ * @brief Open an archive for reading and check its header.
+ */
+static gzFile open_archive(const char* archive)
+{
+    char magic[sizeof(SNAP_MAGIC) - 1];
+    uint32_t version;
+    gzFile gz = gzopen(archive, "rb");
+
+    if (gz == NULL || read_exact(gz, magic, sizeof(magic)) || memcmp(magic, SNAP_MAGIC, sizeof(magic)) != 0 ||
+        read_exact(gz, &version, sizeof(version)) || version != SNAP_VERSION)
+    {
+        fprintf(stderr, "ERROR: %s is not a snapshot archive\n", archive);
+        if (gz != NULL)
+        {
+            gzclose(gz);
+        }
+        return NULL;
+    }
+    return gz;
+}
+
+/**
+ * @brief Create the parent directories of the given path.
+ */
+static void make_parents(char* path)
+{
+    for (char* p = strchr(path + 1, '/'); p != NULL; p = strchr(p + 1, '/'))
+    {
+        *p = '\0';
+        mkdir(path, 0755);
+        *p = '/';
+    }
+}
+
+/**
+ * @brief Materialize the given snapshot below root: files get replaced atomically, so that a collector
+ *        reading concurrently sees either the old or the new content, and files of the previous snapshot
+ *        missing in this one (e.g. of ended processes) get removed.
+ * @return 0 on success, -1 on errors.
+ */
+static int apply_snapshot(const char* root, const snap_t* s, const snap_t* prev)
+{
+    char path[PATH_LEN + 16];
+
+    for (size_t i = 0; i < s->count; i++)
+    {
+        const snap_file_t* f = &s->file[i];
+        const snap_file_t* p = snap_find(prev, f->path);
+        // unchanged files are in place already (read_snapshot() moved their content to s)
+        if (p != NULL && p->data == NULL)
+        {
+            continue;
+        }
+        snprintf(path, sizeof(path), "%s%s.tmp", root, f->path);
+        make_parents(path);
+        FILE* fp = fopen(path, "w");
+        if (fp == NULL || fwrite(f->data, 1, f->len, fp) != f->len)
+        {
+            perror(path);
+            if (fp != NULL)
+            {
+                fclose(fp);
+            }
+            return -1;
+        }
+        fclose(fp);
+        char final[PATH_LEN + 16];
+        snprintf(final, sizeof(final), "%s%s", root, f->path);
+        if (rename(path, final) != 0)
+        {
+            perror(final);
+            return -1;
+        }
+    }
+    for (size_t i = 0; i < prev->count; i++)
+    {
+        if (snap_find(s, prev->file[i].path) == NULL)
+        {
+            snprintf(path, sizeof(path), "%s%s", root, prev->file[i].path);
+            unlink(path);
+            // the /proc/<pid> directory of an ended process
+            *strrchr(path, '/') = '\0';
+            rmdir(path);
+        }
+    }
+    return 0;
+}
+
+/**
+ * @brief The record command.
+ */
+static int record(const char* archive, int count, int interval, int extra, char* extra_path[])
+{
+    snap_t snap[2] = {{0}};
+    gzFile gz = gzopen(archive, "wb9");
+    uint32_t version = SNAP_VERSION;
+
+    if (gz == NULL || gzwrite(gz, SNAP_MAGIC, sizeof(SNAP_MAGIC) - 1) <= 0 ||
+        gzwrite(gz, &version, sizeof(version)) <= 0)
+    {
+        perror(archive);
+        return EXIT_FAILURE;
+    }
+    uint64_t start = now_ns();
+    for (int i = 0; i < count; i++)
+    {
+        snap_t* s = &snap[i % 2];
+        snap_t* prev = &snap[(i + 1) % 2];
+        // keep the interval between the starts of the snapshots
+        int64_t wait = (start + (uint64_t)i * interval * 1000000ULL) - now_ns();
+        if (wait > 0)
+        {
+            struct timespec ts = {wait / 1000000000, wait % 1000000000};
+            nanosleep(&ts, NULL);
+        }
+        s->time = (now_ns() - start) / 1000000;
+        take_snapshot(s, extra, extra_path);
+        if (write_snapshot(gz, s, prev) != 0)
+        {
+            fprintf(stderr, "ERROR: Can't write to %s\n", archive);
+            gzclose(gz);
+            return EXIT_FAILURE;
+        }
+        snap_clear(prev);
+        fprintf(stderr, "snapshot %d: %zu files\n", i, s->count);
+    }
+    if (gzputc(gz, 'E') == -1 || gzclose(gz) != Z_OK)
+    {
+        fprintf(stderr, "ERROR: Can't write to %s\n", archive);
+        return EXIT_FAILURE;
+    }
+    snap_clear(&snap[0]);
+    snap_clear(&snap[1]);
+    free(snap[0].file);
+    free(snap[1].file);
+    return EXIT_SUCCESS;
+}
+
+/**
+ * @brief Time one call of each collector.
+ * @param ns Gets the time of each call added.
+ * @param out NULL or where to print the results to.
+ */
+static void run_collectors(uint64_t ns[5], FILE* out)
+{
+    uint64_t t = now_ns();
+    double cpu = get_cpu_usage();
+    ns[0] += now_ns() - t;
+    t = now_ns();
+    double* mem = get_memory_usage();
+    double mem_used = mem == NULL ? -1 : mem[1];
+    ns[1] += now_ns() - t;
+    t = now_ns();
+    double* disk = get_disk_usage();
+    double disk_read = disk == NULL ? -1 : disk[0];
+    ns[2] += now_ns() - t;
+    t = now_ns();
+    double* net = get_network_usage();
+    double net_rx = net == NULL ? -1 : net[0];
+    ns[3] += now_ns() - t;
+    t = now_ns();
+    double* procs = get_processes_usage();
+    ns[4] += now_ns() - t;
+    if (out != NULL)
+    {
+        fprintf(out, "cpu %.4f mem_used %.0f disk_read %.4f net_rx %.0f procs %.0f running %.0f\n", cpu, mem_used,
+                disk_read, net_rx, procs == NULL ? -1 : procs[0], procs == NULL ? -1 : procs[1]);
+    }
+}
+
+/**
+ * @brief The replay, extract and bench commands: apply the snapshots of the archive one after another.
+ * @param root Where to materialize them, NULL for a temporary directory (bench).
+ * @param speed Divisor of the recorded delays, 0 for none.
+ * @param last Index of the last snapshot to apply, -1 for all.
+ * @param passes Number of collector runs over all snapshots, 0 for none.
+ */
+static int replay(const char* archive, const char* root, double speed, long last, int passes)
+{
+    char tmp[] = "/tmp/procsnap.XXXXXX";
+    snap_t snap[2] = {{0}};
+    uint64_t ns[5] = {0};
+    long calls = 0;
+    int ret = EXIT_SUCCESS;
+
+    if (root == NULL && (root = mkdtemp(tmp)) == NULL)
+    {
+        perror("mkdtemp");
+        return EXIT_FAILURE;
+    }
+    if (set_fs_root(root) != 0)
+    {
+        return EXIT_FAILURE;
+    }
+    for (int pass = 0; pass < (passes > 0 ? passes : 1); pass++)
+    {
+        gzFile gz = open_archive(archive);
+        if (gz == NULL)
+        {
+            return EXIT_FAILURE;
+        }
+        uint64_t start = now_ns();
+        for (long i = 0; last < 0 || i <= last; i++)
+        {
+            snap_t* s = &snap[i % 2];
+            snap_t* prev = &snap[(i + 1) % 2];
+            int r = read_snapshot(gz, s, prev);
+            if (r <= 0)
+            {
+                if (r < 0 || last >= 0)
+                {
+                    fprintf(stderr, "ERROR: %s ends in or before snapshot %ld\n", archive, i);
+                    ret = EXIT_FAILURE;
+                }
+                break;
+            }
+            if (speed > 0)
+            {
+                int64_t wait = start + (uint64_t)(s->time * 1000000 / speed) - now_ns();
+                if (wait > 0)
+                {
+                    struct timespec ts = {wait / 1000000000, wait % 1000000000};
+                    nanosleep(&ts, NULL);
+                }
+            }
+            if (apply_snapshot(root, s, prev) != 0)
+            {
+                ret = EXIT_FAILURE;
+                break;
+            }
+            snap_clear(prev);
+            if (passes > 0)
+            {
+                if (pass == 0)
+                {
+                    printf("snapshot %ld: ", i);
+                }
+                run_collectors(ns, pass == 0 ? stdout : NULL);
+                calls++;
+            }
+        }
+        gzclose(gz);
+        snap_clear(&snap[0]);
+        snap_clear(&snap[1]);
+        if (ret != EXIT_SUCCESS)
+        {
+            break;
+        }
+        // start the next pass with an empty root
+        if (passes > 1 && pass + 1 < passes)
+        {
+            char cmd[PATH_LEN + 16];
+            snprintf(cmd, sizeof(cmd), "rm -rf '%s/proc' '%s/sys'", root, root);
+            if (system(cmd) != 0)
+            {
+                ret = EXIT_FAILURE;
+                break;
+            }
+        }
+    }
+    if (passes > 0 && calls > 0)
+    {
+        const char* name[5] = {"cpu", "memory", "disk", "network", "processes"};
+        printf("\n%-12s %14s\n", "collector", "us/call");
+        for (int i = 0; i < 5; i++)
+        {
+            printf("%-12s %14.2f\n", name[i], ns[i] / 1e3 / calls);
+        }
+    }
+    if (root == tmp)
+    {
+        char cmd[PATH_LEN + 16];
+        snprintf(cmd, sizeof(cmd), "rm -rf '%s'", tmp);
+        if (system(cmd) != 0)
+        {
+            fprintf(stderr, "WARNING: Can't remove %s\n", tmp);
+        }
+    }
+    free(snap[0].file);
+    free(snap[1].file);
+    return ret;
+}
+
+//! \brief Main function of the snapshot tool.
+int main(int argc, char* argv[])
+{
+    const char* cmd = argc > 1 ? argv[1] : "";
+
+    if (strcmp(cmd, "record") == 0 && argc >= 5)
+    {
+        // recording from another root works as well, e.g. to re-record a fixture
+        const char* fs_root = getenv(FS_ROOT_ENV);
+        if (fs_root != NULL && set_fs_root(fs_root) != 0)
+        {
+            return EXIT_FAILURE;
+        }
+        return record(argv[2], atoi(argv[3]), atoi(argv[4]), argc - 5, argv + 5);
+    }
+    if (strcmp(cmd, "replay") == 0 && argc >= 4)
+    {
+        return replay(argv[2], argv[3], argc > 4 ? atof(argv[4]) : 1, -1, 0);
+    }
+    if (strcmp(cmd, "extract") == 0 && argc == 5)
+    {
+        return replay(argv[2], argv[3], 0, atol(argv[4]), 0);
+    }
+    if (strcmp(cmd, "bench") == 0 && argc >= 3)
+    {
+        return replay(argv[2], NULL, 0, -1, argc > 3 ? atoi(argv[3]) : 10);
+    }
+    fprintf(stderr,
+            "Usage: %s record <archive> <count> <interval_ms> [path ...]\n"
+            "       %s replay <archive> <root> [speed]\n"
+            "       %s extract <archive> <root> <index>\n"
+            "       %s bench <archive> [passes]\n",
+            argv[0], argv[0], argv[0], argv[0]);
+    return EXIT_FAILURE;
+}
@@ -0,0 +1,983 @@
+/**
+ * @file scrape_bench.c
+ * @brief Scrape benchmark of the exporter: forks a daemon serving a synthetic registry of
+ *        metrics x labels x series via libpromhttp, loads it over loopback with many concurrent
+ *        keep-alive clients driven by epoll and prints throughput, latency percentiles, bytes/s
+ *        and the CPU/RSS used by the daemon as JSON, so that the results of builds can be compared.
+ *
+ * Usage: scrape_bench [-m metrics] [-l labels] [-s series] [-c connections] [-j client_threads]
+ *                     [-d seconds] [-w warmup_seconds] [-f text|protobuf|openmetrics]
+ *                     [-z identity|gzip|zstd] [-t select|poll|epoll|thread_per_connection]
+ *                     [-T pool_threads] [-C coalescing_ms] [-a address] [-p port] [-P pid] [-o file]
+ *
+ * With -P the daemon listening on -a:-p with the given PID gets loaded instead, e.g. the metrics
+ * daemon itself; the registry and server options are ignored then. With -o the JSON gets written to
+ * the given file instead of stdout.
+ */
+
+#define _GNU_SOURCE
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <libprom/prom.h>
+#include <libprom/promhttp.h>
+#include <microhttpd.h>
+
+//! \brief Size of the receive buffer of a connection.
+#define SB_BUFFER_SIZE (64 * 1024)
+//! \brief Max. number of connections.
+#define SB_MAX_CONNECTIONS 4096
+//! \brief Max. length of the address and of label values.
+#define SB_NAME_LEN 64
+//! \brief Number of consecutive failures after which a connection gets abandoned.
+#define SB_MAX_FAILURES 100
+
+/**
+ * @brief Benchmark settings (command line options).
+ */
+typedef struct sb_config
+{
+    unsigned int metrics;     /**< number of metrics of the synthetic registry */
+    unsigned int labels;      /**< number of labels of each metric */
+    unsigned int series;      /**< number of series (label value sets) of each metric */
+    unsigned int connections; /**< number of keep-alive client connections */
+    unsigned int threads;     /**< number of client threads, each with its own epoll instance */
+    unsigned int duration;    /**< seconds to measure */
+    unsigned int warmup;      /**< seconds to load the daemon before measuring */
+    const char* format;       /**< exposition format to request */
+    const char* encoding;     /**< content coding to request */
+    const char* mode;         /**< serving mode of the daemon */
+    unsigned int pool;        /**< size of the thread pool of the daemon */
+    int coalescing;           /**< min. interval of coalesced scrapes in ms, -1 for none */
+    char address[SB_NAME_LEN];
+    unsigned short port;
+    pid_t pid;                /**< PID of an already running daemon, 0 to fork one */
+    const char* output;       /**< file to write the results to, NULL for stdout */
+} sb_config_t;
+
+//! \brief Parser states of a response.
+typedef enum sb_state
+{
+    SB_HEAD,       /**< status line and header fields */
+    SB_BODY,       /**< body with a Content-Length */
+    SB_BODY_EOF,   /**< body delimited by the end of the connection */
+    SB_CHUNK_SIZE, /**< size line of the next chunk */
+    SB_CHUNK_DATA, /**< data of the current chunk */
+    SB_CHUNK_END,  /**< CRLF after the data of a chunk */
+    SB_TRAILER     /**< trailer fields after the last chunk */
+} sb_state_t;
+
+/**
+ * @brief State of one client connection.
+ */
+typedef struct sb_conn
+{
+    int fd;                   /**< the socket, -1 if not connected */
+    size_t sent;              /**< number of request bytes written so far */
+    sb_state_t state;         /**< parser state of the current response */
+    int status;               /**< HTTP status of the current response */
+    int keep_alive;           /**< 0 if the server closes the connection after the response */
+    uint64_t remaining;       /**< bytes left of the body or of the current chunk */
+    uint64_t body;            /**< body bytes of the current response */
+    uint64_t start;           /**< time the current request got sent in ns */
+    unsigned int failures;    /**< number of consecutive failures */
+    size_t len;               /**< number of bytes in buf */
+    char buf[SB_BUFFER_SIZE]; /**< receive buffer */
+} sb_conn_t;
+
+/**
+ * @brief A client thread with its connections and results.
+ */
+typedef struct sb_client
+{
+    pthread_t tid;
+    sb_conn_t* conn;          /**< its connections */
+    unsigned int n;           /**< number of its connections */
+    uint64_t* latency;        /**< latency of each measured response in ns */
+    size_t done;              /**< number of measured responses */
+    size_t cap;               /**< capacity of latency */
+    uint64_t bytes;           /**< body bytes of the measured responses */
+    unsigned long errors;     /**< failed requests while measuring */
+    unsigned long reconnects; /**< connections (re)established while measuring */
+} sb_client_t;
+
+/* GLOBAL VARIABLES */
+//! \brief The benchmark settings.
+static sb_config_t cfg = {.metrics = 100,
+                          .labels = 3,
+                          .series = 10,
+                          .connections = 64,
+                          .threads = 2,
+                          .duration = 10,
+                          .warmup = 2,
+                          .format = "text",
+                          .encoding = "identity",
+                          .mode = "epoll",
+                          .coalescing = -1,
+                          .address = "127.0.0.1",
+                          .port = 18001};
+//! \brief Where to connect to.
+static struct sockaddr_storage addr;
+//! \brief Size of addr.
+static socklen_t addr_len;
+//! \brief The request all clients send.
+static char request[512];
+//! \brief Length of the request.
+static size_t request_len;
+//! \brief Start of the measurement in ns, 0 while warming up.
+static atomic_uint_fast64_t measure_start;
+//! \brief Set, when the clients should stop.
+static atomic_bool stop;
+
+/**
+ * @brief Get a monotonic timestamp in nanoseconds.
+ */
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/**
+ * @brief Map the given serving mode to the corresponding libmicrohttpd flags.
+ * @return The flags or 0 if unknown.
+ */
+static unsigned int mode_flags(const char* mode)
+{
+    if (strcmp(mode, "select") == 0)
+    {
+        return MHD_USE_SELECT_INTERNALLY;
+    }
+    if (strcmp(mode, "poll") == 0)
+    {
+        return MHD_USE_POLL_INTERNALLY;
+    }
+    if (strcmp(mode, "epoll") == 0)
+    {
+        return MHD_USE_EPOLL_INTERNALLY;
+    }
+    if (strcmp(mode, "thread_per_connection") == 0)
+    {
+        return MHD_USE_THREAD_PER_CONNECTION | MHD_USE_INTERNAL_POLLING_THREAD;
+    }
+    return 0;
+}
+
+/**
+ * @brief Create and register the synthetic metrics: every 4th one is a histogram with 8 buckets,
+ *        every 4th one (starting with the first) a gauge, all others counters. Each of them gets
+ *        all its series populated.
+ * @return 0 on success, -1 otherwise.
+ */
+static int create_registry(void)
+{
+    const char* key[cfg.labels > 0 ? cfg.labels : 1];
+    char keys[cfg.labels > 0 ? cfg.labels : 1][SB_NAME_LEN];
+    const char* value[cfg.labels > 0 ? cfg.labels : 1];
+    char values[cfg.labels > 0 ? cfg.labels : 1][SB_NAME_LEN];
+    char name[SB_NAME_LEN];
+
+    for (unsigned int i = 0; i < cfg.labels; i++)
+    {
+        snprintf(keys[i], SB_NAME_LEN, "label_%u", i);
+        key[i] = keys[i];
+        value[i] = values[i];
+    }
+    for (unsigned int k = 0; k < cfg.metrics; k++)
+    {
+        prom_metric_t* metric;
+        snprintf(name, sizeof(name), "bench_metric_%u", k);
+        if (k % 4 == 0)
+        {
+            metric = prom_gauge_new(name, "Synthetic gauge", cfg.labels, key);
+        }
+        else if (k % 4 == 3)
+        {
+            metric = prom_histogram_new(name, "Synthetic histogram", phb_exponential(0.001, 4, 8), cfg.labels, key);
+        }
+        else
+        {
+            metric = prom_counter_new(name, "Synthetic counter", cfg.labels, key);
+        }
+        if (metric == NULL || pcr_must_register_metric(metric) == NULL)
+        {
+            return -1;
+        }
+        for (unsigned int s = 0; s < cfg.series; s++)
+        {
+            // the 1st label makes the series unique, the others repeat a few values
+            for (unsigned int i = 0; i < cfg.labels; i++)
+            {
+                snprintf(values[i], SB_NAME_LEN, i == 0 ? "series_%u" : "value_%u", i == 0 ? s : s % (i + 4));
+            }
+            if (k % 4 == 0)
+            {
+                prom_gauge_set(metric, s * 0.25, value);
+            }
+            else if (k % 4 == 3)
+            {
+                for (unsigned int o = 0; o < 10; o++)
+                {
+                    prom_histogram_observe(metric, 0.0005 * (o + 1) * (s + 1), value);
+                }
+            }
+            else
+            {
+                prom_counter_add(metric, s + 1, value);
+            }
+        }
+    }
+    return 0;
+}
+
+/**
+ * @brief Body of the forked daemon: serve the synthetic registry until \c stop_fd reports EOF,
+ *        i.e. until the benchmark finished or died.
+ * @param ready_fd Gets 1 byte written once serving, or closed on failure.
+ */
+static void run_daemon(int ready_fd, int stop_fd)
+{
+    promhttp_config_t http = {.address = cfg.address,
+                              .port = cfg.port,
+                              .flags = mode_flags(cfg.mode),
+                              .threads = cfg.pool};
+    struct MHD_Daemon* daemon = NULL;
+    char c = 1;
+
+    if (pcr_default_init() != 0 || create_registry() != 0)
+    {
+        fprintf(stderr, "ERROR: Can't create the synthetic registry\n");
+        _exit(EXIT_FAILURE);
+    }
+    promhttp_set_active_collector_registry(NULL);
+    if (cfg.coalescing >= 0)
+    {
+        promhttp_set_coalescing(true, cfg.coalescing);
+    }
+    daemon = promhttp_start_daemon_config(&http, NULL, NULL);
+    if (daemon == NULL)
+    {
+        fprintf(stderr, "ERROR: Can't start the HTTP server on %s:%hu\n", cfg.address, cfg.port);
+        _exit(EXIT_FAILURE);
+    }
+    if (write(ready_fd, &c, 1) != 1)
+    {
+        _exit(EXIT_FAILURE);
+    }
+    close(ready_fd);
+    while (read(stop_fd, &c, 1) != 0 && errno == EINTR)
+    {
+    }
+    promhttp_stop_daemon(daemon);
+    pcr_destroy(PROM_COLLECTOR_REGISTRY);
+    _exit(EXIT_SUCCESS);
+}
+
+/**
+ * @brief Get the CPU time (user + system) the given process consumed so far.
+ * @return The time in seconds or -1 on error.
+ */
+static double process_cpu(pid_t pid)
+{
+    char path[64];
+    char buf[1024];
+    unsigned long utime, stime;
+
+    snprintf(path, sizeof(path), "/proc/%d/stat", (int)pid);
+    FILE* file = fopen(path, "r");
+    if (file == NULL)
+    {
+        return -1;
+    }
+    size_t n = fread(buf, 1, sizeof(buf) - 1, file);
+    fclose(file);
+    buf[n] = '\0';
+    // the command may contain blanks and parentheses, so skip to the last ')' - state is field 3
+    char* p = strrchr(buf, ')');
+    if (p == NULL ||
+        sscanf(p + 1, " %*c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u %lu %lu", &utime, &stime) != 2)
+    {
+        return -1;
+    }
+    return (double)(utime + stime) / sysconf(_SC_CLK_TCK);
+}
+
+/**
+ * @brief Get the value of the given field (in kB) of /proc/<pid>/status.
+ * @return The value or -1 on error.
+ */
+static long process_status(pid_t pid, const char* field)
+{
+    char path[64];
+    char line[256];
+    size_t len = strlen(field);
+    long value = -1;
+
+    snprintf(path, sizeof(path), "/proc/%d/status", (int)pid);
+    FILE* file = fopen(path, "r");
+    if (file == NULL)
+    {
+        return -1;
+    }
+    while (fgets(line, sizeof(line), file) != NULL)
+    {
+        if (strncmp(line, field, len) == 0 && line[len] == ':')
+        {
+            value = atol(line + len + 1);
+            break;
+        }
+    }
+    fclose(file);
+    return value;
+}
+
+/**
+ * @brief (Re)connect the given connection (non-blocking) and register it for writing.
+ */
+static void connect_conn(sb_client_t* client, int ep, sb_conn_t* c)
+{
+    int one = 1;
+    struct epoll_event ev = {.events = EPOLLOUT, .data.ptr = c};
+
+    if (c->fd >= 0)
+    {
+        close(c->fd);
+    }
+    c->len = 0;
+    c->sent = 0;
+    c->fd = socket(addr.ss_family, SOCK_STREAM | SOCK_NONBLOCK, 0);
+    if (c->fd < 0)
+    {
+        return;
+    }
+    setsockopt(c->fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    if ((connect(c->fd, (struct sockaddr*)&addr, addr_len) != 0 && errno != EINPROGRESS) ||
+        epoll_ctl(ep, EPOLL_CTL_ADD, c->fd, &ev) != 0)
+    {
+        close(c->fd);
+        c->fd = -1;
+        return;
+    }
+    if (atomic_load(&measure_start) > 0)
+    {
+        client->reconnects++;
+    }
+}
+
+/**
+ * @brief Start the next request on the given connection.
+ */
+static void start_request(sb_conn_t* c)
+{
+    c->sent = 0;
+    c->state = SB_HEAD;
+    c->status = 0;
+    c->keep_alive = 1;
+    c->body = 0;
+    c->start = now_ns();
+}
+
+/**
+ * @brief Find the end of the next CRLF terminated line in the buffer.
+ * @return The length of the line without CRLF, or -1 if not yet complete.
+ */
+static ssize_t line_end(const sb_conn_t* c)
+{
+    const char* end = memmem(c->buf, c->len, "\r\n", 2);
+    return end == NULL ? -1 : end - c->buf;
+}
+
+/**
+ * @brief Drop the first \c n buffered bytes.
+ */
+static void consume(sb_conn_t* c, size_t n)
+{
+    memmove(c->buf, c->buf + n, c->len - n);
+    c->len -= n;
+}
+
+/**
+ * @brief Parse the header of a response.
+ * @return 0 on success, -1 on a malformed header.
+ */
+static int parse_head(sb_conn_t* c, size_t len)
+{
+    char* line = c->buf;
+    char* end = c->buf + len;
+    uint64_t length = UINT64_MAX;
+    int chunked = 0;
+
+    *end = '\0';
+    if (sscanf(line, "HTTP/1.%*d %d", &c->status) != 1)
+    {
+        return -1;
+    }
+    while ((line = strstr(line, "\r\n")) != NULL && line < end)
+    {
+        line += 2;
+        if (strncasecmp(line, "Content-Length:", 15) == 0)
+        {
+            length = strtoull(line + 15, NULL, 10);
+        }
+        else if (strncasecmp(line, "Transfer-Encoding:", 18) == 0 && strstr(line, "chunked") != NULL)
+        {
+            chunked = 1;
+        }
+        else if (strncasecmp(line, "Connection:", 11) == 0 && strncasecmp(line + 11, " close", 6) == 0)
+        {
+            c->keep_alive = 0;
+        }
+    }
+    if (chunked)
+    {
+        c->state = SB_CHUNK_SIZE;
+    }
+    else if (length != UINT64_MAX)
+    {
+        c->state = SB_BODY;
+        c->remaining = length;
+    }
+    else
+    {
+        c->state = SB_BODY_EOF;
+        c->keep_alive = 0;
+    }
+    return 0;
+}
+
+/**
+ * @brief Process the buffered bytes of the current response.
+ * @return 1 if the response is complete, 0 if more bytes are needed, -1 on error.
+ */
+static int parse_response(sb_conn_t* c)
+{
+    while (1)
+    {
+        ssize_t n;
+        size_t k;
+        switch (c->state)
+        {
+            case SB_HEAD:
+            {
+                char* end = memmem(c->buf, c->len, "\r\n\r\n", 4);
+                if (end == NULL)
+                {
+                    return c->len == SB_BUFFER_SIZE ? -1 : 0;
+                }
+                if (parse_head(c, end - c->buf + 2) != 0)
+                {
+                    return -1;
+                }
+                consume(c, end - c->buf + 4);
+                break;
+            }
+            case SB_BODY:
+            case SB_CHUNK_DATA:
+                k = c->remaining < c->len ? c->remaining : c->len;
+                consume(c, k);
+                c->body += k;
+                c->remaining -= k;
+                if (c->remaining > 0)
+                {
+                    return 0;
+                }
+                if (c->state == SB_BODY)
+                {
+                    return 1;
+                }
+                c->state = SB_CHUNK_END;
+                break;
+            case SB_BODY_EOF:
+                c->body += c->len;
+                c->len = 0;
+                return 0;
+            case SB_CHUNK_SIZE:
+                if ((n = line_end(c)) < 0)
+                {
+                    return c->len == SB_BUFFER_SIZE ? -1 : 0;
+                }
+                c->buf[n] = '\0';
+                c->remaining = strtoull(c->buf, NULL, 16);
+                consume(c, n + 2);
+                c->state = c->remaining == 0 ? SB_TRAILER : SB_CHUNK_DATA;
+                break;
+            case SB_CHUNK_END:
+                if (c->len < 2)
+                {
+                    return 0;
+                }
+                consume(c, 2);
+                c->state = SB_CHUNK_SIZE;
+                break;
+            case SB_TRAILER:
+                if ((n = line_end(c)) < 0)
+                {
+                    return c->len == SB_BUFFER_SIZE ? -1 : 0;
+                }
+                consume(c, n + 2);
+                if (n == 0)
+                {
+                    return 1;
+                }
+                break;
+        }
+    }
+}
+
+/**
+ * @brief Account a finished (\c ok != 0) or failed request of the given connection.
+ */
+static void record(sb_client_t* client, sb_conn_t* c, int ok)
+{
+    uint64_t start = atomic_load(&measure_start);
+
+    c->failures = ok ? 0 : c->failures + 1;
+    // only requests sent after the warmup count
+    if (start == 0 || c->start < start)
+    {
+        return;
+    }
+    if (!ok)
+    {
+        client->errors++;
+        return;
+    }
+    if (client->done == client->cap)
+    {
+        client->cap = client->cap == 0 ? 4096 : client->cap * 2;
+        uint64_t* latency = realloc(client->latency, client->cap * sizeof(uint64_t));
+        if (latency == NULL)
+        {
+            client->errors++;
+            return;
+        }
+        client->latency = latency;
+    }
+    client->latency[client->done++] = now_ns() - c->start;
+    client->bytes += c->body;
+}
+
+/**
+ * @brief Reconnect the given connection after a failure or a closed connection and restart the request.
+ */
+static void reconnect(sb_client_t* client, int ep, sb_conn_t* c)
+{
+    if (c->failures >= SB_MAX_FAILURES)
+    {
+        fprintf(stderr, "ERROR: Giving up a connection after %d failures\n", SB_MAX_FAILURES);
+        close(c->fd);
+        c->fd = -1;
+        return;
+    }
+    connect_conn(client, ep, c);
+    start_request(c);
+}
+
+/**
+ * @brief Handle the readiness of the given connection.
+ */
+static void handle_conn(sb_client_t* client, int ep, sb_conn_t* c, uint32_t events)
+{
+    struct epoll_event ev = {.data.ptr = c};
+
+    if (c->sent < request_len)
+    {
+        if (events & (EPOLLERR | EPOLLHUP))
+        {
+            record(client, c, 0);
+            reconnect(client, ep, c);
+            return;
+        }
+        ssize_t n = send(c->fd, request + c->sent, request_len - c->sent, MSG_NOSIGNAL);
+        if (n < 0)
+        {
+            if (errno != EAGAIN)
+            {
+                record(client, c, 0);
+                reconnect(client, ep, c);
+            }
+            return;
+        }
+        c->sent += n;
+        if (c->sent == request_len)
+        {
+            ev.events = EPOLLIN;
+            epoll_ctl(ep, EPOLL_CTL_MOD, c->fd, &ev);
+        }
+        return;
+    }
+    while (1)
+    {
+        ssize_t n = read(c->fd, c->buf + c->len, SB_BUFFER_SIZE - c->len);
+        if (n < 0 && errno == EAGAIN)
+        {
+            return;
+        }
+        if (n <= 0)
+        {
+            // EOF completes a body delimited by the end of the connection only
+            record(client, c, n == 0 && c->state == SB_BODY_EOF && c->status == 200);
+            reconnect(client, ep, c);
+            return;
+        }
+        c->len += n;
+        int r = parse_response(c);
+        if (r < 0)
+        {
+            record(client, c, 0);
+            reconnect(client, ep, c);
+            return;
+        }
+        if (r > 0)
+        {
+            record(client, c, c->status == 200);
+            // no pipelining, so bytes beyond the response make the connection unusable as well
+            if (c->len > 0 || !c->keep_alive)
+            {
+                reconnect(client, ep, c);
+                return;
+            }
+            start_request(c);
+            ev.events = EPOLLOUT;
+            epoll_ctl(ep, EPOLL_CTL_MOD, c->fd, &ev);
+            return;
+        }
+    }
+}
+
+/**
+ * @brief Thread function: keep all connections of the given client busy until told to stop.
+ */
+static void* run_client(void* arg)
+{
+    sb_client_t* client = (sb_client_t*)arg;
+    struct epoll_event events[64];
+    int ep = epoll_create1(0);
+
+    if (ep < 0)
+    {
+        perror("ERROR: epoll_create1");
+        return NULL;
+    }
+    for (unsigned int i = 0; i < client->n; i++)
+    {
+        client->conn[i].fd = -1;
+        connect_conn(client, ep, &client->conn[i]);
+        start_request(&client->conn[i]);
+    }
+    while (!atomic_load(&stop))
+    {
+        int n = epoll_wait(ep, events, 64, 100);
+        for (int i = 0; i < n; i++)
+        {
+            handle_conn(client, ep, (sb_conn_t*)events[i].data.ptr, events[i].events);
+        }
+    }
+    for (unsigned int i = 0; i < client->n; i++)
+    {
+        if (client->conn[i].fd >= 0)
+        {
+            close(client->conn[i].fd);
+        }
+    }
+    close(ep);
+    return NULL;
+}
+
+/**
+ * @brief qsort() helper.
+ */
+static int cmp_u64(const void* a, const void* b)
+{
+    uint64_t x = *(const uint64_t*)a;
+    uint64_t y = *(const uint64_t*)b;
+    return x < y ? -1 : x > y;
+}
+
+/**
+ * @brief Parse the command line.
+ * @return 0 on success, -1 on invalid options.
+ */
+static int parse_options(int argc, char* argv[])
+{
+    int opt;
+    while ((opt = getopt(argc, argv, "m:l:s:c:j:d:w:f:z:t:T:C:a:p:P:o:")) != -1)
+    {
+        switch (opt)
+        {
+            case 'm': cfg.metrics = atoi(optarg); break;
+            case 'l': cfg.labels = atoi(optarg); break;
+            case 's': cfg.series = atoi(optarg); break;
+            case 'c': cfg.connections = atoi(optarg); break;
+            case 'j': cfg.threads = atoi(optarg); break;
+            case 'd': cfg.duration = atoi(optarg); break;
+            case 'w': cfg.warmup = atoi(optarg); break;
+            case 'f': cfg.format = optarg; break;
+            case 'z': cfg.encoding = optarg; break;
+            case 't': cfg.mode = optarg; break;
+            case 'T': cfg.pool = atoi(optarg); break;
+            case 'C': cfg.coalescing = atoi(optarg); break;
+            case 'a': snprintf(cfg.address, sizeof(cfg.address), "%s", optarg); break;
+            case 'p': cfg.port = atoi(optarg); break;
+            case 'P': cfg.pid = atoi(optarg); break;
+            case 'o': cfg.output = optarg; break;
+            default: return -1;
+        }
+    }
+    if (cfg.labels == 0)
+    {
+        // without labels a metric has a single series
+        cfg.series = 1;
+    }
+    if (cfg.metrics == 0 || cfg.series == 0 || cfg.connections == 0 || cfg.connections > SB_MAX_CONNECTIONS ||
+        cfg.threads == 0 || cfg.duration == 0 || mode_flags(cfg.mode) == 0)
+    {
+        return -1;
+    }
+    if (cfg.threads > cfg.connections)
+    {
+        cfg.threads = cfg.connections;
+    }
+    return 0;
+}
+
+/**
+ * @brief Build the request according to the format and encoding options.
+ * @return 0 on success, -1 on unknown ones.
+ */
+static int build_request(void)
+{
+    const char* accept;
+
+    if (strcmp(cfg.format, "text") == 0)
+    {
+        accept = "text/plain;version=0.0.4";
+    }
+    else if (strcmp(cfg.format, "protobuf") == 0)
+    {
+        accept = "application/vnd.google.protobuf;proto=io.prometheus.client.MetricFamily;encoding=delimited";
+    }
+    else if (strcmp(cfg.format, "openmetrics") == 0)
+    {
+        accept = "application/openmetrics-text;version=1.0.0";
+    }
+    else
+    {
+        return -1;
+    }
+    if (strcmp(cfg.encoding, "identity") != 0 && strcmp(cfg.encoding, "gzip") != 0 &&
+        strcmp(cfg.encoding, "zstd") != 0)
+    {
+        return -1;
+    }
+    request_len = snprintf(request, sizeof(request),
+                           "GET /metrics HTTP/1.1\r\nHost: %s\r\nAccept: %s\r\nAccept-Encoding: %s\r\n\r\n",
+                           cfg.address, accept, cfg.encoding);
+    return 0;
+}
+
+/**
+ * @brief Resolve the numeric listen address of the daemon.
+ * @return 0 on success, -1 otherwise.
+ */
+static int resolve_address(void)
+{
+    struct sockaddr_in* v4 = (struct sockaddr_in*)&addr;
+    struct sockaddr_in6* v6 = (struct sockaddr_in6*)&addr;
+
+    memset(&addr, 0, sizeof(addr));
+    if (inet_pton(AF_INET, cfg.address, &v4->sin_addr) == 1)
+    {
+        v4->sin_family = AF_INET;
+        v4->sin_port = htons(cfg.port);
+        addr_len = sizeof(*v4);
+        return 0;
+    }
+    if (inet_pton(AF_INET6, cfg.address, &v6->sin6_addr) == 1)
+    {
+        v6->sin6_family = AF_INET6;
+        v6->sin6_port = htons(cfg.port);
+        addr_len = sizeof(*v6);
+        return 0;
+    }
+    return -1;
+}
+
+/**
+ * @brief Start the daemon serving the synthetic registry in a child process.
+ * @param stop_fd Gets the write end of the pipe, which stops the daemon when closed.
+ * @return Its PID or -1 on error.
+ */
+static pid_t fork_daemon(int* stop_fd)
+{
+    int ready[2], halt[2];
+    char c;
+
+    if (pipe(ready) != 0 || pipe(halt) != 0)
+    {
+        return -1;
+    }
+    pid_t pid = fork();
+    if (pid == 0)
+    {
+        close(ready[0]);
+        close(halt[1]);
+        run_daemon(ready[1], halt[0]);
+    }
+    close(ready[1]);
+    close(halt[0]);
+    *stop_fd = halt[1];
+    if (pid < 0 || read(ready[0], &c, 1) != 1)
+    {
+        close(ready[0]);
+        close(halt[1]);
+        if (pid > 0)
+        {
+            waitpid(pid, NULL, 0);
+        }
+        return -1;
+    }
+    close(ready[0]);
+    return pid;
+}
+
+//! \brief Main function of the scrape benchmark.
+int main(int argc, char* argv[])
+{
+    int stop_fd = -1;
+    pid_t pid;
+
+    if (parse_options(argc, argv) != 0 || build_request() != 0 || resolve_address() != 0)
+    {
+        fprintf(stderr,
+                "Usage: %s [-m metrics] [-l labels] [-s series] [-c connections] [-j client_threads]\n"
+                "\t[-d seconds] [-w warmup_seconds] [-f text|protobuf|openmetrics] [-z identity|gzip|zstd]\n"
+                "\t[-t select|poll|epoll|thread_per_connection] [-T pool_threads] [-C coalescing_ms]\n"
+                "\t[-a numeric_address] [-p port] [-P pid_of_running_daemon] [-o file]\n",
+                argv[0]);
+        return EXIT_FAILURE;
+    }
+    if (cfg.output != NULL && freopen(cfg.output, "w", stdout) == NULL)
+    {
+        perror("ERROR: Can't open the output file");
+        return EXIT_FAILURE;
+    }
+    pid = cfg.pid > 0 ? cfg.pid : fork_daemon(&stop_fd);
+    if (pid < 0)
+    {
+        fprintf(stderr, "ERROR: Can't start the daemon\n");
+        return EXIT_FAILURE;
+    }
+
+    sb_client_t* client = calloc(cfg.threads, sizeof(sb_client_t));
+    sb_conn_t* conn = calloc(cfg.connections, sizeof(sb_conn_t));
+    if (client == NULL || conn == NULL)
+    {
+        fprintf(stderr, "ERROR: Out of memory\n");
+        return EXIT_FAILURE;
+    }
+    for (unsigned int i = 0, first = 0; i < cfg.threads; i++)
+    {
+        // spread the connections evenly
+        client[i].n = cfg.connections / cfg.threads + (i < cfg.connections % cfg.threads);
+        client[i].conn = conn + first;
+        first += client[i].n;
+        pthread_create(&client[i].tid, NULL, run_client, &client[i]);
+    }
+
+    sleep(cfg.warmup);
+    struct rusage usage_start, usage_end;
+    getrusage(RUSAGE_SELF, &usage_start);
+    double cpu_start = process_cpu(pid);
+    uint64_t start = now_ns();
+    atomic_store(&measure_start, start);
+    sleep(cfg.duration);
+    double cpu = process_cpu(pid) - cpu_start;
+    double secs = (now_ns() - start) * 1e-9;
+    getrusage(RUSAGE_SELF, &usage_end);
+    long rss = process_status(pid, "VmRSS");
+    long max_rss = process_status(pid, "VmHWM");
+    atomic_store(&stop, true);
+
+    // collect the results of all clients
+    size_t done = 0;
+    uint64_t bytes = 0;
+    unsigned long errors = 0, reconnects = 0;
+    for (unsigned int i = 0; i < cfg.threads; i++)
+    {
+        pthread_join(client[i].tid, NULL);
+        done += client[i].done;
+        bytes += client[i].bytes;
+        errors += client[i].errors;
+        reconnects += client[i].reconnects;
+    }
+    uint64_t* latency = malloc((done > 0 ? done : 1) * sizeof(uint64_t));
+    double sum = 0;
+    for (unsigned int i = 0, n = 0; i < cfg.threads; i++)
+    {
+        memcpy(latency + n, client[i].latency, client[i].done * sizeof(uint64_t));
+        n += client[i].done;
+        free(client[i].latency);
+    }
+    for (size_t i = 0; i < done; i++)
+    {
+        sum += latency[i];
+    }
+    qsort(latency, done, sizeof(uint64_t), cmp_u64);
+    if (stop_fd >= 0)
+    {
+        close(stop_fd);
+        waitpid(pid, NULL, 0);
+    }
+
+    double client_cpu = (usage_end.ru_utime.tv_sec - usage_start.ru_utime.tv_sec) +
+                        (usage_end.ru_stime.tv_sec - usage_start.ru_stime.tv_sec) +
+                        ((usage_end.ru_utime.tv_usec - usage_start.ru_utime.tv_usec) +
+                         (usage_end.ru_stime.tv_usec - usage_start.ru_stime.tv_usec)) * 1e-6;
+    printf("{\n");
+    printf("  \"config\": {\"metrics\": %u, \"labels\": %u, \"series\": %u, \"connections\": %u, "
+           "\"client_threads\": %u, \"duration_s\": %u, \"warmup_s\": %u, \"format\": \"%s\", "
+           "\"encoding\": \"%s\", \"mode\": \"%s\", \"pool_threads\": %u, \"coalescing_ms\": %d, "
+           "\"external\": %s},\n",
+           cfg.metrics, cfg.labels, cfg.series, cfg.connections, cfg.threads, cfg.duration, cfg.warmup,
+           cfg.format, cfg.encoding, cfg.mode, cfg.pool, cfg.coalescing, cfg.pid > 0 ? "true" : "false");
+    printf("  \"requests\": %zu,\n  \"errors\": %lu,\n  \"reconnects\": %lu,\n", done, errors, reconnects);
+    printf("  \"requests_per_s\": %.1f,\n  \"bytes_per_s\": %.0f,\n  \"body_bytes\": %.0f,\n", done / secs,
+           bytes / secs, done > 0 ? (double)bytes / done : 0.0);
+    if (done > 0)
+    {
+        printf("  \"latency_ms\": {\"mean\": %.3f, \"p50\": %.3f, \"p99\": %.3f, \"p999\": %.3f, \"max\": %.3f},\n",
+               sum / done * 1e-6, latency[done / 2] * 1e-6, latency[done * 99 / 100] * 1e-6,
+               latency[done * 999 / 1000] * 1e-6, latency[done - 1] * 1e-6);
+    }
+    else
+    {
+        printf("  \"latency_ms\": null,\n");
+    }
+    printf("  \"exporter\": {\"pid\": %d, \"cpu_s\": %.2f, \"cpu_percent\": %.1f, \"rss_kb\": %ld, "
+           "\"max_rss_kb\": %ld},\n",
+           (int)pid, cpu, cpu / secs * 100, rss, max_rss);
+    printf("  \"client\": {\"cpu_percent\": %.1f}\n}\n", client_cpu / secs * 100);
+
+    free(latency);
+    free(conn);
+    free(client);
+    return errors > 0 || done == 0 ? EXIT_FAILURE : EXIT_SUCCESS;
+}
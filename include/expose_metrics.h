@@ -52,7 +52,7 @@ void update_network_gauges(void);
 void update_processes_gauge(void);
 
 /**
- * @brief Función del hilo para exponer las métricas vía HTTP en el puerto 8000.
+ * @brief Función del hilo para exponer las métricas vía HTTP, según http_config (por defecto en el puerto 8000).
  * @param arg Argumento no utilizado.
  * @return NULL
  */
@@ -3,17 +3,43 @@
  * @brief Funciones para obtener el uso de CPU y memoria desde el sistema de archivos /proc.
  */
 
-#include <fcntl.h>
+#include <dirent.h>
+#include <errno.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <sys/wait.h>
 #include <unistd.h>
 
 //! \brief Used to hold each line read from files.
 #define BUFFER_SIZE 256
-//! \brief Temporary processes metrics file absolute path.
-#define TEMP_PROC_METRICS_FILE "/tmp/proc_metrics.txt"
+//! \brief Max. length of a path below the file system root.
+#define PATH_LEN 512
+//! \brief Default file system root, i.e. the paths get used as is.
+#define DEFAULT_FS_ROOT ""
+//! \brief Environment variable to read the procfs/sysfs files below another root, e.g. a recorded snapshot.
+#define FS_ROOT_ENV "METRICS_FS_ROOT"
+
+/**
+ * @brief Establece el directorio contra el que se resuelven las rutas de procfs/sysfs (p. ej. "/proc/meminfo").
+ *
+ * Permite leer las métricas de un snapshot grabado (ver bench/procsnap.c) en lugar del sistema en vivo.
+ *
+ * @param root Directorio que contiene proc/ (y sys/), "" o "/" para el sistema en vivo.
+ * @return 0 en caso de éxito, -1 si la ruta es demasiado larga.
+ */
+int set_fs_root(const char* root);
+
+/**
+ * @brief Resuelve la ruta absoluta de procfs/sysfs dada contra la raíz configurada.
+ * @return buf, o NULL si el resultado no entra en él.
+ */
+char* fs_path(char* buf, size_t size, const char* path);
+
+/**
+ * @brief Abre para lectura la ruta absoluta de procfs/sysfs dada, debajo de la raíz configurada.
+ * @return El stream, o NULL en caso de error (con errno establecido).
+ */
+FILE* open_fs_file(const char* path);
 
 /**
  * @brief Obtiene datos de la memoria principal desde /proc/meminfo.
@@ -73,10 +99,10 @@ double* get_disk_usage(void);
 double* get_network_usage(void);
 
 /**
- * @brief Obtiene datos de uso de procesos utilizando el comando top.
+ * @brief Obtiene datos de uso de procesos desde /proc.
  *
- * Se vuelca el contenido del comando top en un archivo temporario,
- * luego se scrapea para obtener la información deseada.
+ * Cuenta los procesos igual que el comando top: cada directorio /proc/<pid> es
+ * un proceso, y está running si el estado en /proc/<pid>/stat es 'R'.
  *
  * @return Un puntero a array de 2 elementos double:
  *   0: Procesos existentes.
@@ -0,0 +1,80 @@
+/**
+ * Copyright 2021 Jens Elkner <jel+libprom@cs.uni-magdeburg.de>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * @file bench.h
+ * @brief Tiny helpers shared by the libprom benchmarks.
+ */
+
+#ifndef PROM_BENCH_H
+#define PROM_BENCH_H
+
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+/** @brief Get a monotonic timestamp in nanoseconds. */
+static inline uint64_t
+bench_now(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/** @brief The function each benchmark thread runs \c ops times. */
+typedef void bench_fn(void *arg, uint64_t ops);
+
+typedef struct bench_job {
+	bench_fn *fn;
+	void *arg;
+	uint64_t ops;
+	pthread_barrier_t *barrier;
+} bench_job_t;
+
+static void *
+bench_thread(void *arg) {
+	bench_job_t *job = (bench_job_t *) arg;
+	pthread_barrier_wait(job->barrier);
+	job->fn(job->arg, job->ops);
+	return NULL;
+}
+
+/**
+ * @brief Run \c fn in \c threads threads concurrently, each \c ops times.
+ * @return The wall clock time needed in nanoseconds.
+ */
+static inline uint64_t
+bench_run(int threads, bench_fn *fn, void *arg, uint64_t ops) {
+	pthread_t tid[threads];
+	bench_job_t job = { fn, arg, ops, NULL };
+	pthread_barrier_t barrier;
+
+	pthread_barrier_init(&barrier, NULL, threads + 1);
+	job.barrier = &barrier;
+	for (int i = 0; i < threads; i++)
+		pthread_create(&tid[i], NULL, bench_thread, &job);
+	uint64_t start = bench_now();
+	pthread_barrier_wait(&barrier);
+	for (int i = 0; i < threads; i++)
+		pthread_join(tid[i], NULL);
+	uint64_t t = bench_now() - start;
+	pthread_barrier_destroy(&barrier);
+	return t;
+}
+
+#endif  // PROM_BENCH_H
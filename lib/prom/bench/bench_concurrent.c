@@ -0,0 +1,220 @@
+/**
+ * Copyright 2021 Jens Elkner <jel+libprom@cs.uni-magdeburg.de>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Stress test for concurrent scrapes: 1 .. 32 threads export the same
+// registry at once while another thread keeps updating its metrics. Each
+// thread alternates between pcr_bridge() and streams read in small pieces
+// in all formats and encodings, i.e. what libmicrohttpd does with one
+// thread per connection. Every export gets checked for integrity: the
+// number of lines must match, OpenMetrics must end with "# EOF", gzip must
+// inflate and protobuf messages must tile the body. Prints scrapes/s and
+// exits with 1 if any export was corrupted.
+// Usage: bench_concurrent [scrapes_per_thread]
+
+#include <stdatomic.h>
+#include <string.h>
+#include <zlib.h>
+
+#include "prom.h"
+#include "bench.h"
+
+#define METRICS 20
+#define SERIES 100
+
+static prom_metric_t *metric[METRICS];
+static const char *values[SERIES][1];
+static size_t text_lines, om_lines;
+static atomic_bool stop;
+static atomic_ulong corrupted;
+
+static size_t
+count_lines(const char *s, size_t len) {
+	size_t n = 0;
+	for (size_t i = 0; i < len; i++)
+		n += s[i] == '\n';
+	return n;
+}
+
+/** @brief Read the whole export of a new stream in pieces of 1000 bytes. */
+static char *
+stream(prom_format_t format, prom_encoding_t encoding, size_t *len) {
+	pcr_stream_t *s = pcr_stream_new_format(PROM_COLLECTOR_REGISTRY, format,
+		encoding);
+	size_t cap = 1 << 20;
+	char *buf = malloc(cap);
+	ssize_t n;
+
+	*len = 0;
+	while ((n = pcr_stream_read(s, buf + *len, 1000)) > 0) {
+		*len += n;
+		if (cap - *len < 1000)
+			buf = realloc(buf, cap <<= 1);
+	}
+	pcr_stream_destroy(s);
+	return buf;
+}
+
+static bool
+check_protobuf(const unsigned char *p, size_t len) {
+	size_t off = 0;
+	while (off < len) {
+		uint64_t v = 0;
+		for (int shift = 0; off < len; shift += 7) {
+			v |= (uint64_t) (p[off] & 0x7f) << shift;
+			if (!(p[off++] & 0x80))
+				break;
+		}
+		off += v;
+	}
+	return off == len && len > 0;
+}
+
+static bool
+check_gzip(const char *z, size_t zlen) {
+	z_stream zs;
+	memset(&zs, 0, sizeof(zs));
+	if (inflateInit2(&zs, 16 + MAX_WBITS) != Z_OK)
+		return false;
+	size_t cap = 8 << 20;
+	char *out = malloc(cap);
+	zs.next_in = (unsigned char *) z;
+	zs.avail_in = zlen;
+	zs.next_out = (unsigned char *) out;
+	zs.avail_out = cap;
+	int r = inflate(&zs, Z_FINISH);
+	bool ok = r == Z_STREAM_END
+		&& count_lines(out, zs.total_out) == text_lines;
+	inflateEnd(&zs);
+	free(out);
+	return ok;
+}
+
+static void
+scrape(void *arg, uint64_t ops) {
+	(void) arg;
+	for (uint64_t i = 0; i < ops; i++) {
+		size_t len;
+		char *s;
+		bool ok;
+		switch (i % 5) {
+			case 0:
+				s = pcr_bridge(PROM_COLLECTOR_REGISTRY);
+				len = strlen(s);
+				ok = count_lines(s, len) == text_lines;
+				break;
+			case 1:
+				s = stream(PROM_FORMAT_TEXT, PROM_ENCODING_IDENTITY, &len);
+				ok = count_lines(s, len) == text_lines;
+				break;
+			case 2:
+				s = stream(PROM_FORMAT_OPENMETRICS, PROM_ENCODING_IDENTITY,
+					&len);
+				ok = count_lines(s, len) == om_lines
+					&& len > 6 && memcmp(s + len - 6, "# EOF\n", 6) == 0;
+				break;
+			case 3:
+				s = stream(PROM_FORMAT_PROTOBUF, PROM_ENCODING_IDENTITY, &len);
+				ok = check_protobuf((unsigned char *) s, len);
+				break;
+			default:
+				s = stream(PROM_FORMAT_TEXT, PROM_ENCODING_GZIP, &len);
+				ok = check_gzip(s, len);
+		}
+		if (!ok)
+			atomic_fetch_add(&corrupted, 1);
+		free(s);
+	}
+}
+
+static void *
+update(void *arg) {
+	(void) arg;
+	for (unsigned long i = 0; !atomic_load(&stop); i++) {
+		int k = i % METRICS;
+		const char **v = values[(i / METRICS) % SERIES];
+		if (k % 4 == 0)
+			prom_gauge_set(metric[k], i, v);
+		else if (k % 4 == 3)
+			prom_histogram_observe(metric[k], (i % 100) / 10.0, v);
+		else
+			prom_counter_add(metric[k], 1, v);
+	}
+	return NULL;
+}
+
+int
+main(int argc, char **argv) {
+	uint64_t ops = argc > 1 ? strtoull(argv[1], NULL, 10) : 50;
+	const char *key[] = { "series" };
+	char name[32];
+
+	pcr_init(PROM_SCRAPETIME, "st_");
+	for (int i = 0; i < SERIES; i++) {
+		char *v = malloc(8);
+		snprintf(v, 8, "%d", i);
+		values[i][0] = v;
+	}
+	for (int k = 0; k < METRICS; k++) {
+		snprintf(name, sizeof(name), "metric_%d", k);
+		if (k % 4 == 0)
+			metric[k] = prom_gauge_new(name, "a gauge", 1, key);
+		else if (k % 4 == 3)
+			metric[k] = prom_histogram_new(name, "a histogram",
+				phb_linear(1, 1, 8), 1, key);
+		else
+			metric[k] = prom_counter_new(name, "a counter", 1, key);
+		pcr_must_register_metric(metric[k]);
+	}
+	// create all series, so that the number of lines stays constant
+	atomic_store(&stop, true);
+	for (int i = 0; i < SERIES; i++) {
+		for (int k = 0; k < METRICS; k++) {
+			if (k % 4 == 0)
+				prom_gauge_set(metric[k], 0, values[i]);
+			else if (k % 4 == 3)
+				prom_histogram_observe(metric[k], 0, values[i]);
+			else
+				prom_counter_add(metric[k], 0, values[i]);
+		}
+	}
+	size_t len;
+	char *s = stream(PROM_FORMAT_TEXT, PROM_ENCODING_IDENTITY, &len);
+	text_lines = count_lines(s, len);
+	free(s);
+	s = stream(PROM_FORMAT_OPENMETRICS, PROM_ENCODING_IDENTITY, &len);
+	om_lines = count_lines(s, len);
+	free(s);
+
+	atomic_store(&stop, false);
+	pthread_t updater;
+	pthread_create(&updater, NULL, update, NULL);
+	printf("%-8s %12s %12s\n", "threads", "scrapes/s", "corrupted");
+	for (int t = 1; t <= 32; t <<= 1) {
+		atomic_store(&corrupted, 0);
+		uint64_t ns = bench_run(t, scrape, NULL, ops);
+		printf("%-8d %12.0f %12lu\n", t, (double) ops * t * 1e9 / ns,
+			atomic_load(&corrupted));
+		if (atomic_load(&corrupted) > 0)
+			break;
+	}
+	atomic_store(&stop, true);
+	pthread_join(updater, NULL);
+	unsigned long bad = atomic_load(&corrupted);
+	pcr_destroy(PROM_COLLECTOR_REGISTRY);
+	for (int i = 0; i < SERIES; i++)
+		free((char *) values[i][0]);
+	return bad > 0 ? 1 : 0;
+}
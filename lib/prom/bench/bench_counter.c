@@ -0,0 +1,70 @@
+/**
+ * Copyright 2021 Jens Elkner <jel+libprom@cs.uni-magdeburg.de>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Compares plain, striped and integral counters incremented concurrently by
+// 1 .. 64 threads. Usage: bench_counter [ops_per_thread]
+
+#include "prom.h"
+#include "bench.h"
+
+static void
+inc(void *arg, uint64_t ops) {
+	prom_counter_t *c = (prom_counter_t *) arg;
+	for (uint64_t i = 0; i < ops; i++)
+		prom_counter_inc(c, NULL);
+}
+
+static void
+add(void *arg, uint64_t ops) {
+	pms_t *s = (pms_t *) arg;
+	for (uint64_t i = 0; i < ops; i++)
+		pms_add(s, 1.0);
+}
+
+static void
+add_int(void *arg, uint64_t ops) {
+	pms_t *s = (pms_t *) arg;
+	for (uint64_t i = 0; i < ops; i++)
+		pms_add_int(s, 1);
+}
+
+int
+main(int argc, char **argv) {
+	uint64_t ops = argc > 1 ? strtoull(argv[1], NULL, 10) : 1000000;
+	prom_counter_t *plain = prom_counter_new("plain", "plain", 0, NULL);
+	prom_counter_t *striped = prom_counter_new_striped("striped", "striped",
+		0, NULL);
+	prom_counter_t *integral = prom_counter_new_int("int", "int", 0, NULL);
+	pms_t *ps = pms_from_labels(plain, NULL);
+	pms_t *ss = pms_from_labels(striped, NULL);
+	pms_t *is = pms_from_labels(integral, NULL);
+
+	printf("%-8s %14s %14s %14s %14s %14s\n", "threads", "inc ns/op",
+		"inc_striped", "add ns/op", "add_striped", "add_int");
+	for (int t = 1; t <= 64; t <<= 1) {
+		double n = (double) ops * t;
+		printf("%-8d %14.2f %14.2f %14.2f %14.2f %14.2f\n", t,
+			bench_run(t, inc, plain, ops) / n,
+			bench_run(t, inc, striped, ops) / n,
+			bench_run(t, add, ps, ops) / n,
+			bench_run(t, add, ss, ops) / n,
+			bench_run(t, add_int, is, ops) / n);
+	}
+	prom_counter_destroy(plain);
+	prom_counter_destroy(striped);
+	prom_counter_destroy(integral);
+	return 0;
+}
@@ -0,0 +1,143 @@
+/**
+ * Copyright 2021 Jens Elkner <jel+libprom@cs.uni-magdeburg.de>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Stress test for deleting series while they get updated: 1 .. 8 threads
+// keep updating all series of a counter, an integral counter, a gauge, a
+// histogram and a summary (and so re-create deleted ones), while the main
+// thread deletes every third series of each metric, calls pcr_evict() twice
+// and scrapes the registry, round by round. The gauge has a TTL of one pass
+// as well. Build libprom with -fsanitize=address or -fsanitize=thread to
+// catch updates of released samples. Afterwards all series get deleted and
+// released twice in a row: the bytes libprom has allocated for samples must
+// be the same both times. Prints rounds/s and exits with 1 if not.
+// Usage: bench_delete [rounds_per_thread_count]
+
+#include <stdatomic.h>
+#include <string.h>
+
+#include "prom.h"
+#include "bench.h"
+
+#define METRICS 5
+#define SERIES 60
+
+static prom_metric_t *metric[METRICS];
+static const char *values[SERIES][1];
+static atomic_bool stop;
+
+static void
+update(prom_metric_t *m, int k, unsigned long i, const char **v) {
+	switch (k) {
+		case 0: prom_counter_add(m, 1, v); break;
+		case 1: prom_counter_add_int(m, 1, v); break;
+		case 2: prom_gauge_set(m, i, v); break;
+		case 3: prom_histogram_observe(m, (i % 100) / 10.0, v); break;
+		default: prom_summary_observe(m, i % 100, v);
+	}
+}
+
+static void *
+updater(void *arg) {
+	unsigned long offset = (unsigned long) arg;
+	for (unsigned long i = offset; !atomic_load(&stop); i++)
+		update(metric[i % METRICS], i % METRICS, i,
+			values[(i / METRICS) % SERIES]);
+	return NULL;
+}
+
+static void
+delete_series(int first, int step) {
+	for (int i = first; i < SERIES; i += step)
+		for (int k = 0; k < METRICS; k++)
+			prom_metric_delete(metric[k], values[i]);
+}
+
+/** @brief Delete all series and release them. */
+static uint64_t
+release_all(void) {
+	prom_alloc_stats_t s;
+	delete_series(0, 1);
+	// each pass advances the epoch at least once
+	for (int i = 0; i < 3; i++)
+		pcr_evict(PROM_COLLECTOR_REGISTRY);
+	prom_alloc_stats(PROM_ALLOC_SAMPLE, &s);
+	return s.live;
+}
+
+int
+main(int argc, char **argv) {
+	uint64_t rounds = argc > 1 ? strtoull(argv[1], NULL, 10) : 200;
+	const char *key[] = { "series" };
+
+	if (prom_allocator_set(prom_allocator_counting())) {
+		fprintf(stderr, "Failed to install the counting allocator.\n");
+		return 1;
+	}
+	pcr_init(PROM_SCRAPETIME, "st_");
+	for (int i = 0; i < SERIES; i++) {
+		char *v = malloc(8);
+		snprintf(v, 8, "%d", i);
+		values[i][0] = v;
+	}
+	metric[0] = prom_counter_new("deleted_counter", "a counter", 1, key);
+	metric[1] = prom_counter_new_int("deleted_int_counter", "a counter", 1,
+		key);
+	metric[2] = prom_gauge_new("deleted_gauge", "a gauge", 1, key);
+	metric[3] = prom_histogram_new("deleted_histogram", "a histogram",
+		phb_linear(1, 1, 8), 1, key);
+	metric[4] = prom_summary_new("deleted_summary", "a summary", 0, NULL, 0,
+		1, key);
+	for (int k = 0; k < METRICS; k++)
+		pcr_must_register_metric(metric[k]);
+	prom_metric_set_ttl(metric[2], 1);
+
+	printf("%-8s %12s %12s\n", "threads", "rounds/s", "evicted");
+	for (int t = 1; t <= 8; t <<= 1) {
+		pthread_t tid[t];
+		size_t evicted = 0;
+		atomic_store(&stop, false);
+		for (int i = 0; i < t; i++)
+			pthread_create(&tid[i], NULL, updater,
+				(void *) (unsigned long) (i * 7));
+		uint64_t start = bench_now();
+		for (uint64_t r = 0; r < rounds; r++) {
+			delete_series(r % 3, 3);
+			evicted += pcr_evict(PROM_COLLECTOR_REGISTRY);
+			evicted += pcr_evict(PROM_COLLECTOR_REGISTRY);
+			free(pcr_bridge(PROM_COLLECTOR_REGISTRY));
+		}
+		uint64_t ns = bench_now() - start;
+		atomic_store(&stop, true);
+		for (int i = 0; i < t; i++)
+			pthread_join(tid[i], NULL);
+		printf("%-8d %12.0f %12zu\n", t, (double) rounds * 1e9 / ns, evicted);
+	}
+
+	// the series store has grown to its final size by now
+	uint64_t live = release_all();
+	for (unsigned long i = 0; i < METRICS * SERIES; i++)
+		update(metric[i % METRICS], i % METRICS, i,
+			values[(i / METRICS) % SERIES]);
+	uint64_t again = release_all();
+	if (again != live)
+		printf("sample bytes after releasing all series: %lu, then %lu\n",
+			(unsigned long) live, (unsigned long) again);
+
+	pcr_destroy(PROM_COLLECTOR_REGISTRY);
+	for (int i = 0; i < SERIES; i++)
+		free((char *) values[i][0]);
+	return again == live ? 0 : 1;
+}
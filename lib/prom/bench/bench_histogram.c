@@ -0,0 +1,80 @@
+/**
+ * Copyright 2021 Jens Elkner <jel+libprom@cs.uni-magdeburg.de>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Measures histogram observes per second with the default (11) and with 64
+// linear buckets, with 1 .. 64 concurrent threads, observing one value per
+// call, one value per call with an exemplar via
+// prom_histogram_observe_exemplar() or batches of 64 values via
+// prom_histogram_observe_many().
+// Usage: bench_histogram [ops_per_thread]
+
+#include "prom.h"
+#include "bench.h"
+
+#define VALUES 4096
+
+static double values[VALUES];
+
+static void
+observe(void *arg, uint64_t ops) {
+	prom_histogram_t *h = (prom_histogram_t *) arg;
+	for (uint64_t i = 0; i < ops; i++)
+		prom_histogram_observe(h, values[i & (VALUES - 1)], NULL);
+}
+
+static void
+observe_exemplar(void *arg, uint64_t ops) {
+	prom_histogram_t *h = (prom_histogram_t *) arg;
+	for (uint64_t i = 0; i < ops; i++)
+		prom_histogram_observe_exemplar(h, values[i & (VALUES - 1)], NULL,
+			"trace_id=\"4bf92f3577b34da6a3ce929d0e0e4736\"");
+}
+
+static void
+observe_many(void *arg, uint64_t ops) {
+	prom_histogram_t *h = (prom_histogram_t *) arg;
+	for (uint64_t i = 0; i < ops; i += 64)
+		prom_histogram_observe_many(h, values + (i & (VALUES - 1)), 64, NULL);
+}
+
+int
+main(int argc, char **argv) {
+	uint64_t ops = argc > 1 ? strtoull(argv[1], NULL, 10) : 1000000;
+	prom_histogram_t *dflt = prom_histogram_new("dflt", "dflt", NULL, 0, NULL);
+	prom_histogram_t *lin = prom_histogram_new("lin", "lin",
+		phb_linear(0.2, 0.2, 64), 0, NULL);
+
+	uint64_t x = 88172645463325252ULL;
+	for (int i = 0; i < VALUES; i++) {
+		x ^= x << 13; x ^= x >> 7; x ^= x << 17;	// xorshift64
+		values[i] = (x % 12000) / 1000.0;
+	}
+	ops = (ops + 63) & ~63ULL;
+	printf("%-8s %14s %14s %14s %14s %14s\n", "threads", "11 buckets/s",
+		"64 buckets/s", "11 exemplar/s", "11 batched/s", "64 batched/s");
+	for (int t = 1; t <= 64; t <<= 1) {
+		double n = (double) ops * t * 1e9;
+		printf("%-8d %14.0f %14.0f %14.0f %14.0f %14.0f\n", t,
+			n / bench_run(t, observe, dflt, ops),
+			n / bench_run(t, observe, lin, ops),
+			n / bench_run(t, observe_exemplar, dflt, ops),
+			n / bench_run(t, observe_many, dflt, ops),
+			n / bench_run(t, observe_many, lin, ops));
+	}
+	prom_histogram_destroy(dflt);
+	prom_histogram_destroy(lin);
+	return 0;
+}
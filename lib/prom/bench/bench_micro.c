@@ -0,0 +1,358 @@
+/**
+ * Copyright 2021 Jens Elkner <jel+libprom@cs.uni-magdeburg.de>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Microbenchmarks of the hot paths of libprom: map lookups and updates,
+// series lookup by label values, gauge/counter updates (the counter under
+// contention of 1 .. max threads), histogram observations, rendering a
+// metric into a formatter (template reused and freshly rendered) and
+// pcr_bridge() with registries of 100 .. 10000 series. Each case runs its
+// warmup ops first, then the given number of repetitions and reports the
+// median and best ns/op, and the heap allocations and bytes allocated per op
+// (all threads, glibc only).
+// Usage: bench_micro [-n ops] [-r reps] [-w warmup_ops] [-t max_threads]
+//	[case_prefix ...]
+
+#include <errno.h>
+#include <stdatomic.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "prom.h"
+#include "bench.h"
+
+// Private
+#include "prom_map_i.h"
+#include "prom_metric_formatter_i.h"
+
+#define SERIES 100
+#define BRIDGE_SERIES 10
+
+static atomic_uint_fast64_t allocs, alloc_bytes;
+
+#ifdef __GLIBC__
+#include <malloc.h>
+
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t n, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+extern void *__libc_memalign(size_t alignment, size_t size);
+extern void __libc_free(void *ptr);
+
+static inline void
+count(size_t size) {
+	atomic_fetch_add_explicit(&allocs, 1, memory_order_relaxed);
+	atomic_fetch_add_explicit(&alloc_bytes, size, memory_order_relaxed);
+}
+
+void *
+malloc(size_t size) {
+	count(size);
+	return __libc_malloc(size);
+}
+
+void *
+calloc(size_t n, size_t size) {
+	count(n * size);
+	return __libc_calloc(n, size);
+}
+
+void *
+realloc(void *ptr, size_t size) {
+	size_t old = (ptr == NULL) ? 0 : malloc_usable_size(ptr);
+	count(size > old ? size - old : 0);
+	return __libc_realloc(ptr, size);
+}
+
+void *
+aligned_alloc(size_t alignment, size_t size) {
+	count(size);
+	return __libc_memalign(alignment, size);
+}
+
+int
+posix_memalign(void **ptr, size_t alignment, size_t size) {
+	count(size);
+	*ptr = __libc_memalign(alignment, size);
+	return *ptr == NULL ? ENOMEM : 0;
+}
+
+void
+free(void *ptr) {
+	__libc_free(ptr);
+}
+#endif
+
+/** @brief A benchmark case. */
+typedef struct micro_case {
+	const char *name;
+	bench_fn *fn;
+	void *(*setup)(intptr_t param);	/**< returns the arg of fn */
+	intptr_t param;					/**< passed to setup */
+	uint64_t div;					/**< run ops/div ops per repetition */
+	bool contended;					/**< run with 1 .. max threads */
+} micro_case_t;
+
+static const char *keys[] = { "instance", "path" };
+static char instances[SERIES][16], paths[SERIES][16];
+static const char *values[SERIES][2];
+
+/** @brief Get the label values of series i. */
+static const char **
+series(uint64_t i) {
+	return values[i % SERIES];
+}
+
+static void *
+setup_map(intptr_t param) {
+	static prom_map_t *map;
+	(void) param;
+	if (map == NULL) {
+		map = prom_map_new();
+		for (int i = 0; i < SERIES; i++)
+			prom_map_set(map, instances[i], instances[i]);
+	}
+	return map;
+}
+
+static void
+map_get(void *arg, uint64_t ops) {
+	for (uint64_t i = 0; i < ops; i++)
+		if (prom_map_get((prom_map_t *) arg, instances[i % SERIES]) == NULL)
+			abort();
+}
+
+static void
+map_set(void *arg, uint64_t ops) {
+	for (uint64_t i = 0; i < ops; i++)
+		prom_map_set((prom_map_t *) arg, instances[i % SERIES],
+			instances[i % SERIES]);
+}
+
+/** @brief Create a metric of the given type with all SERIES series. */
+static prom_metric_t *
+populate(prom_metric_type_t type, const char *name) {
+	prom_metric_t *m;
+	if (type == PROM_GAUGE)
+		m = prom_gauge_new(name, "gauge", 2, keys);
+	else if (type == PROM_HISTOGRAM)
+		m = prom_histogram_new(name, "histogram", phb_exponential(0.001, 2, 16),
+			2, keys);
+	else
+		m = prom_counter_new(name, "counter", 2, keys);
+	for (int i = 0; i < SERIES; i++) {
+		if (type == PROM_HISTOGRAM)
+			prom_histogram_observe(m, i, values[i]);
+		else
+			pms_from_labels(m, values[i]);
+	}
+	return m;
+}
+
+static void *
+setup_gauge(intptr_t param) {
+	static prom_metric_t *m;
+	(void) param;
+	if (m == NULL)
+		m = populate(PROM_GAUGE, "gauge");
+	return m;
+}
+
+static void *
+setup_counter(intptr_t param) {
+	static prom_metric_t *m;
+	(void) param;
+	if (m == NULL)
+		m = populate(PROM_COUNTER, "counter");
+	return m;
+}
+
+static void *
+setup_histogram_sample(intptr_t param) {
+	static pms_histogram_t *h;
+	(void) param;
+	if (h == NULL)
+		h = pms_histogram_from_labels(populate(PROM_HISTOGRAM, "histogram"),
+			values[0]);
+	return h;
+}
+
+static void
+from_labels(void *arg, uint64_t ops) {
+	for (uint64_t i = 0; i < ops; i++)
+		if (pms_from_labels((prom_metric_t *) arg, series(i)) == NULL)
+			abort();
+}
+
+static void
+gauge_set(void *arg, uint64_t ops) {
+	for (uint64_t i = 0; i < ops; i++)
+		prom_gauge_set((prom_gauge_t *) arg, i, series(i));
+}
+
+static void
+counter_inc(void *arg, uint64_t ops) {
+	// all threads hit the same series
+	for (uint64_t i = 0; i < ops; i++)
+		prom_counter_inc((prom_counter_t *) arg, values[0]);
+}
+
+static void
+histogram_observe(void *arg, uint64_t ops) {
+	for (uint64_t i = 0; i < ops; i++)
+		pms_histogram_observe((pms_histogram_t *) arg, (i & 1023) * 0.0001);
+}
+
+/** @brief The metric to render and the formatter to render it into. */
+typedef struct render_arg {
+	prom_metric_t *metric;
+	pmf_t *pmf;
+	bool dirty;
+} render_arg_t;
+
+static void *
+setup_render(intptr_t dirty) {
+	static render_arg_t arg[2];
+	if (arg[dirty].metric == NULL) {
+		arg[dirty].metric = populate(PROM_GAUGE, dirty ? "dirty" : "clean");
+		arg[dirty].pmf = pmf_new();
+		arg[dirty].dirty = dirty;
+	}
+	return &arg[dirty];
+}
+
+static void
+load_metric(void *arg, uint64_t ops) {
+	render_arg_t *r = (render_arg_t *) arg;
+	for (uint64_t i = 0; i < ops; i++) {
+		// a modified series makes the template render the metric again
+		if (r->dirty)
+			prom_gauge_set(r->metric, i, values[i % SERIES]);
+		pmf_load_metric(r->pmf, r->metric, NULL, false);
+		pmf_clear(r->pmf);
+	}
+}
+
+/** @brief Grow the default registry to the given number of series. */
+static void *
+setup_bridge(intptr_t total) {
+	static int metrics;
+	char name[32];
+	for (; metrics * BRIDGE_SERIES < total; metrics++) {
+		snprintf(name, sizeof(name), "bridge_%d", metrics);
+		prom_metric_t *m = prom_counter_new(name, "counter", 2, keys);
+		for (int i = 0; i < BRIDGE_SERIES; i++)
+			prom_counter_add(m, i, values[i]);
+		pcr_must_register_metric(m);
+	}
+	return NULL;
+}
+
+static void
+bridge(void *arg, uint64_t ops) {
+	(void) arg;
+	for (uint64_t i = 0; i < ops; i++)
+		free(pcr_bridge(PROM_COLLECTOR_REGISTRY));
+}
+
+static const micro_case_t cases[] = {
+	{ "prom_map_get", map_get, setup_map, 0, 1, false },
+	{ "prom_map_set", map_set, setup_map, 0, 1, false },
+	{ "pms_from_labels", from_labels, setup_counter, 0, 1, false },
+	{ "prom_gauge_set", gauge_set, setup_gauge, 0, 1, false },
+	{ "prom_counter_inc", counter_inc, setup_counter, 0, 1, true },
+	{ "pms_histogram_observe", histogram_observe, setup_histogram_sample, 0,
+		1, false },
+	{ "pmf_load_metric/reused", load_metric, setup_render, 0, 100, false },
+	{ "pmf_load_metric/dirty", load_metric, setup_render, 1, 100, false },
+	{ "pcr_bridge/100", bridge, setup_bridge, 100, 1000, false },
+	{ "pcr_bridge/1000", bridge, setup_bridge, 1000, 10000, false },
+	{ "pcr_bridge/10000", bridge, setup_bridge, 10000, 100000, false },
+};
+
+static int
+cmp_u64(const void *a, const void *b) {
+	uint64_t x = *(const uint64_t *) a, y = *(const uint64_t *) b;
+	return x < y ? -1 : x > y;
+}
+
+/** @brief Run and report the given case with the given number of threads. */
+static void
+measure(const micro_case_t *c, void *arg, int threads, uint64_t ops,
+	uint64_t warmup, int reps)
+{
+	uint64_t ns[reps];
+
+	ops = ops / c->div > 0 ? ops / c->div : 1;
+	warmup /= c->div;
+	if (warmup > 0)
+		bench_run(threads, c->fn, arg, warmup);
+	uint64_t a = atomic_load(&allocs), b = atomic_load(&alloc_bytes);
+	for (int i = 0; i < reps; i++)
+		ns[i] = bench_run(threads, c->fn, arg, ops);
+	double n = (double) ops * reps * threads;
+	a = atomic_load(&allocs) - a;
+	b = atomic_load(&alloc_bytes) - b;
+	qsort(ns, reps, sizeof(uint64_t), cmp_u64);
+	// wall clock time per op of a single thread, i.e. all threads together
+	// for contended cases
+	printf("%-24s %7d %12.2f %12.2f %10.2f %10.1f\n", c->name, threads,
+		(double) ns[reps / 2] / ops, (double) ns[0] / ops, a / n, b / n);
+}
+
+int
+main(int argc, char **argv) {
+	uint64_t ops = 1000000, warmup = 100000;
+	int reps = 5, max_threads = 8, opt;
+
+	while ((opt = getopt(argc, argv, "n:r:w:t:")) != -1) {
+		switch (opt) {
+			case 'n': ops = strtoull(optarg, NULL, 10); break;
+			case 'r': reps = atoi(optarg); break;
+			case 'w': warmup = strtoull(optarg, NULL, 10); break;
+			case 't': max_threads = atoi(optarg); break;
+			default:
+				fprintf(stderr, "Usage: %s [-n ops] [-r reps] [-w warmup_ops] "
+					"[-t max_threads] [case_prefix ...]\n", argv[0]);
+				return 1;
+		}
+	}
+	if (ops == 0 || reps < 1 || max_threads < 1)
+		return 1;
+	if (pcr_init(0, NULL))
+		return 1;
+	for (int i = 0; i < SERIES; i++) {
+		snprintf(instances[i], sizeof(instances[i]), "host%d", i);
+		snprintf(paths[i], sizeof(paths[i]), "/p%d", i % 10);
+		values[i][0] = instances[i];
+		values[i][1] = paths[i];
+	}
+
+	printf("%-24s %7s %12s %12s %10s %10s\n", "benchmark", "threads",
+		"ns/op", "best ns/op", "allocs/op", "bytes/op");
+	for (size_t k = 0; k < sizeof(cases) / sizeof(cases[0]); k++) {
+		const micro_case_t *c = &cases[k];
+		bool selected = optind == argc;
+		for (int i = optind; i < argc && !selected; i++)
+			selected = strncmp(c->name, argv[i], strlen(argv[i])) == 0;
+		if (!selected)
+			continue;
+		void *arg = c->setup(c->param);
+		for (int t = 1; t <= (c->contended ? max_threads : 1); t <<= 1)
+			measure(c, arg, t, ops, warmup, reps);
+	}
+	pcr_destroy(PROM_COLLECTOR_REGISTRY);
+	return 0;
+}
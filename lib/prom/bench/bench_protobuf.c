@@ -0,0 +1,248 @@
+/**
+ * Copyright 2021 Jens Elkner <jel+libprom@cs.uni-magdeburg.de>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Compares the text and the protobuf exposition format: the time needed to
+// export a registry with 100 metrics of 1000 series each (100k samples, 10%
+// of them in histograms) and the time a scraper needs to parse the result,
+// i.e. to extract name, labels and value of each sample. The parsers are
+// minimal, i.e. a lower bound of what a real scraper spends.
+// Usage: bench_protobuf [reps]
+
+#include <math.h>
+#include <string.h>
+
+#include "prom.h"
+#include "bench.h"
+
+#define METRICS 100
+#define SERIES 1000
+
+typedef struct result {
+	uint64_t samples;	/**< number of values parsed */
+	double sum;			/**< sum of all finite values parsed */
+	uint64_t labels;	/**< number of label pairs parsed */
+} result_t;
+
+/**
+ * @brief Export the whole registry in the given format.
+ */
+static char *
+export(prom_format_t format, size_t *len) {
+	pcr_stream_t *s = pcr_stream_new_format(PROM_COLLECTOR_REGISTRY, format,
+		PROM_ENCODING_IDENTITY);
+	size_t cap = 8 << 20, n = 0;
+	char *buf = malloc(cap);
+	ssize_t r;
+
+	while ((r = pcr_stream_read(s, buf + n, cap - n)) > 0) {
+		n += r;
+		if (n == cap)
+			buf = realloc(buf, cap <<= 1);
+	}
+	pcr_stream_destroy(s);
+	*len = n;
+	return buf;
+}
+
+static void
+add_value(result_t *r, double v) {
+	r->samples++;
+	if (isfinite(v))
+		r->sum += v;
+}
+
+/**
+ * @brief Parse the text format: skip comments, split each sample line into
+ *	name, label pairs and value.
+ */
+static void
+parse_text(const char *s, size_t len, result_t *r) {
+	const char *end = s + len;
+
+	while (s < end) {
+		const char *eol = memchr(s, '\n', end - s);
+		if (eol == NULL)
+			eol = end;
+		if (eol > s && *s != '#') {
+			const char *p = s;
+			while (p < eol && *p != '{' && *p != ' ')
+				p++;
+			if (*p == '{') {
+				// label values may contain anything but an unescaped quote
+				while (*p != '}') {
+					p = memchr(p, '"', eol - p);
+					for (p++; *p != '"'; p++) {
+						if (*p == '\\')
+							p++;
+					}
+					p++;
+					r->labels++;
+				}
+				p++;
+			}
+			add_value(r, strtod(p + 1, NULL));
+		}
+		s = eol + 1;
+	}
+}
+
+static const uint8_t *
+varint(const uint8_t *p, uint64_t *v) {
+	uint64_t x = 0;
+	for (int shift = 0; ; shift += 7) {
+		x |= (uint64_t) (*p & 0x7f) << shift;
+		if (*p++ < 0x80)
+			break;
+	}
+	*v = x;
+	return p;
+}
+
+static double
+fixed64(const uint8_t *p) {
+	double d;
+	memcpy(&d, p, sizeof(d));
+	return d;
+}
+
+/**
+ * @brief Walk the fields of the message in [p, end). Values of fields 1
+ *	(gauge, counter, untyped value, bucket cumulative count, quantile
+ *	quantile) and 2 get counted, submessages get descended into, except for
+ *	label pairs, which get counted.
+ */
+static void
+parse_message(const uint8_t *p, const uint8_t *end, int depth, result_t *r) {
+	uint64_t key, v;
+
+	while (p < end) {
+		p = varint(p, &key);
+		switch (key & 7) {
+			case 0:
+				p = varint(p, &v);
+				if (depth >= 2)
+					add_value(r, (double) v);
+				break;
+			case 1:
+				if (depth >= 2)
+					add_value(r, fixed64(p));
+				p += 8;
+				break;
+			case 2:
+				p = varint(p, &v);
+				if (depth == 1 && (key >> 3) == 1)
+					r->labels++;		// Metric.label
+				else if ((depth == 0 && (key >> 3) == 4) || depth >= 1)
+					parse_message(p, p + v, depth + 1, r);
+				p += v;
+				break;
+			default:
+				p += 4;
+		}
+	}
+}
+
+/**
+ * @brief Parse a stream of length delimited MetricFamily messages.
+ */
+static void
+parse_protobuf(const char *s, size_t len, result_t *r) {
+	const uint8_t *p = (const uint8_t *) s, *end = p + len;
+	uint64_t n;
+
+	while (p < end) {
+		p = varint(p, &n);
+		parse_message(p, p + n, 0, r);
+		p += n;
+	}
+}
+
+typedef void parse_fn(const char *s, size_t len, result_t *r);
+
+static void
+run(const char *name, prom_format_t format, parse_fn *parse,
+	prom_metric_t **m, int reps)
+{
+	uint64_t enc = UINT64_MAX, dec = UINT64_MAX;
+	size_t len = 0;
+	result_t r = { 0 };
+
+	for (int i = 0; i <= reps; i++) {
+		// force a full render
+		for (int k = 0; k < METRICS; k++) {
+			if (k % 10 == 9)
+				prom_histogram_observe(m[k], i, (const char *[]) { "h0", "/p0" });
+			else
+				prom_gauge_set(m[k], i, (const char *[]) { "host0", "/p0" });
+		}
+		uint64_t start = bench_now();
+		char *s = export(format, &len);
+		uint64_t t = bench_now() - start;
+		if (i > 0 && t < enc)
+			enc = t;
+		memset(&r, 0, sizeof(r));
+		start = bench_now();
+		parse(s, len, &r);
+		t = bench_now() - start;
+		if (i > 0 && t < dec)
+			dec = t;
+		free(s);
+	}
+	printf("%-8s %9zu bytes, encode %6.2f ms, parse %6.2f ms "
+		"(%lu numbers, %lu label pairs)\n", name, len, enc / 1e6, dec / 1e6,
+		(unsigned long) r.samples, (unsigned long) r.labels);
+}
+
+int
+main(int argc, char **argv) {
+	int reps = argc > 1 ? atoi(argv[1]) : 10;
+	const char *keys[] = { "instance", "path" };
+	char name[32], instance[16], path[16];
+	const char *values[] = { instance, path };
+	prom_metric_t *m[METRICS];
+	uint64_t x = 88172645463325252ULL;
+
+	if (pcr_init(0, NULL))
+		return 1;
+	// 90% gauges, 10% histograms with 11 buckets
+	for (int i = 0; i < METRICS; i++) {
+		sprintf(name, "metric_%d", i);
+		bool h = (i % 10 == 9);
+		m[i] = h
+			? prom_histogram_new(name, "histogram",
+				phb_exponential(0.005, 2, 11), 2, keys)
+			: prom_gauge_new(name, "gauge", 2, keys);
+		pcr_must_register_metric(m[i]);
+		for (int k = 0; k < (h ? SERIES / 10 : SERIES); k++) {
+			x ^= x << 13; x ^= x >> 7; x ^= x << 17;
+			double v = (x >> 11) / 9007199254740992.0 * 10;
+			if (h) {
+				sprintf(instance, "h%d", k / 10);
+				sprintf(path, "/p%d", k % 10);
+				for (int j = 0; j < 10; j++)
+					prom_histogram_observe(m[i], v * j, values);
+			} else {
+				sprintf(instance, "host%d", k / 10);
+				sprintf(path, "/p%d", k % 10);
+				prom_gauge_set(m[i], v * 100, values);
+			}
+		}
+	}
+	run("text", PROM_FORMAT_TEXT, parse_text, m, reps);
+	run("protobuf", PROM_FORMAT_PROTOBUF, parse_protobuf, m, reps);
+	pcr_destroy(PROM_COLLECTOR_REGISTRY);
+	return 0;
+}
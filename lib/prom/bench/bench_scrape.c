@@ -0,0 +1,237 @@
+/**
+ * Copyright 2021 Jens Elkner <jel+libprom@cs.uni-magdeburg.de>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Measures the time needed to render a registry with 100 metrics of 1000
+// series each (100k samples) into the text exposition format, i.e. what a
+// scrape of /metrics costs without the HTTP part, depending on how many
+// metrics got modified since the last scrape. With glibc heap allocations
+// per scrape and the bytes realloc() had to move get counted as well.
+// Finally the streamed export gets measured plain and gzip compressed, and
+// compared to compressing the whole exposition at once.
+// Usage: bench_scrape [reps]
+
+#include <string.h>
+#include <zlib.h>
+
+#include "prom.h"
+#include "bench.h"
+
+#define METRICS 100
+#define SERIES 1000
+
+#ifdef __GLIBC__
+#include <malloc.h>
+
+extern void *__libc_malloc(size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+extern void __libc_free(void *ptr);
+
+// not thread safe, but pcr_bridge() runs in the main thread only
+static uint64_t allocs, alloc_bytes, moved_bytes;
+
+void *
+malloc(size_t size) {
+	allocs++;
+	alloc_bytes += size;
+	return __libc_malloc(size);
+}
+
+void *
+realloc(void *ptr, size_t size) {
+	size_t old = (ptr == NULL) ? 0 : malloc_usable_size(ptr);
+	void *p = __libc_realloc(ptr, size);
+	allocs++;
+	if (size > old)
+		alloc_bytes += size - old;
+	if (ptr != NULL && p != ptr)
+		moved_bytes += (old < size) ? old : size;
+	return p;
+}
+
+void
+free(void *ptr) {
+	__libc_free(ptr);
+}
+#else
+static uint64_t allocs, alloc_bytes, moved_bytes;
+#endif
+
+static void
+modify(prom_metric_t **m, int k, int value, const char **values) {
+	if (k % 5 < 2)
+		prom_gauge_set(m[k], value, values);
+	else if (k % 5 < 4)
+		prom_counter_add(m[k], 1, values);
+	else
+		prom_counter_add_int(m[k], 1, values);
+}
+
+/**
+ * @brief Export the registry streamed in 64 KiB blocks as promhttp does,
+ *	after modifying the given percentage of the metrics.
+ */
+static void
+stream(prom_metric_t **m, const char **values, prom_encoding_t encoding,
+	int dirty, int reps)
+{
+	char *buf = malloc(64 * 1024);
+	uint64_t best = UINT64_MAX, total = 0, ab = 0;
+	size_t len = 0;
+	ssize_t n;
+
+	for (int i = 0; i <= reps; i++) {
+		for (int k = 0; k < METRICS * dirty / 100; k++)
+			modify(m, k, i, values);
+		uint64_t ab0 = alloc_bytes;
+		uint64_t start = bench_now();
+		pcr_stream_t *s = pcr_stream_new_encoded(PROM_COLLECTOR_REGISTRY,
+			encoding);
+		len = 0;
+		while ((n = pcr_stream_read(s, buf, 64 * 1024)) > 0)
+			len += n;
+		pcr_stream_destroy(s);
+		uint64_t t = bench_now() - start;
+		if (i == 0)
+			continue;
+		ab += alloc_bytes - ab0;
+		total += t;
+		if (t < best)
+			best = t;
+	}
+	printf("streamed %-8s %3d%% of the metrics modified: avg %.2f ms, "
+		"best %.2f ms per scrape, %zu bytes on the wire, %.0f bytes "
+		"allocated\n", encoding == PROM_ENCODING_GZIP ? "gzip," : "plain,",
+		dirty, total / 1e6 / reps, best / 1e6, len, (double) ab / reps);
+	free(buf);
+}
+
+/**
+ * @brief Export the registry and gzip it at once with the same level as
+ *	libprom does, i.e. what compressing the response outside of libprom
+ *	would cost.
+ */
+static void
+gzip_at_once(int reps) {
+	uint64_t best = UINT64_MAX, total = 0;
+	size_t len = 0, zlen = 0;
+	char *z = NULL;
+
+	for (int i = 0; i <= reps; i++) {
+		uint64_t start = bench_now();
+		char *s = pcr_bridge(PROM_COLLECTOR_REGISTRY);
+		len = strlen(s);
+		z_stream zs = { 0 };
+		if (deflateInit2(&zs, 1, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY))
+			exit(1);
+		zlen = deflateBound(&zs, len);
+		z = realloc(z, zlen);
+		zs.next_in = (Bytef *) s;
+		zs.avail_in = len;
+		zs.next_out = (Bytef *) z;
+		zs.avail_out = zlen;
+		if (deflate(&zs, Z_FINISH) != Z_STREAM_END)
+			exit(1);
+		zlen = zs.total_out;
+		deflateEnd(&zs);
+		free(s);
+		uint64_t t = bench_now() - start;
+		if (i == 0)
+			continue;
+		total += t;
+		if (t < best)
+			best = t;
+	}
+	printf("gzip at once,  no metric modified: avg %.2f ms, best %.2f ms "
+		"per scrape, %zu bytes on the wire (ratio %.1f)\n", total / 1e6 / reps,
+		best / 1e6, zlen, (double) len / zlen);
+	free(z);
+}
+
+int
+main(int argc, char **argv) {
+	int reps = argc > 1 ? atoi(argv[1]) : 20;
+	const char *keys[] = { "instance", "path" };
+	char name[32], instance[16], path[16];
+	const char *values[] = { instance, path };
+	prom_metric_t *m[METRICS];
+	uint64_t x = 88172645463325252ULL;
+
+	if (pcr_init(0, NULL))
+		return 1;
+	// 40% fractional gauges, 40% double counters, 20% integral counters
+	for (int i = 0; i < METRICS; i++) {
+		sprintf(name, "metric_%d", i);
+		if (i % 5 < 2)
+			m[i] = prom_gauge_new(name, "gauge", 2, keys);
+		else if (i % 5 < 4)
+			m[i] = prom_counter_new(name, "counter", 2, keys);
+		else
+			m[i] = prom_counter_new_int(name, "int counter", 2, keys);
+		pcr_must_register_metric(m[i]);
+		for (int k = 0; k < SERIES; k++) {
+			x ^= x << 13; x ^= x >> 7; x ^= x << 17;
+			sprintf(instance, "host%d", k / 10);
+			sprintf(path, "/p%d", k % 10);
+			if (i % 5 < 2)
+				prom_gauge_set(m[i], (x >> 11) / 9007199254740992.0 * 1e3,
+					values);
+			else if (i % 5 < 4)
+				prom_counter_add(m[i], (double) (x >> 40), values);
+			else
+				prom_counter_add_int(m[i], x >> 30, values);
+		}
+	}
+
+	// modify one series of 0, 10 and 100 % of the metrics before a scrape
+	const int dirty[] = { 0, 10, 100 };
+	for (int d = 0; d < 3; d++) {
+		size_t len = 0;
+		uint64_t best = UINT64_MAX, total = 0;
+		uint64_t a = 0, ab = 0, mb = 0;
+		for (int i = 0; i <= reps; i++) {
+			for (int k = 0; k < METRICS * dirty[d] / 100; k++)
+				modify(m, k, i, values);
+			uint64_t a0 = allocs, ab0 = alloc_bytes, mb0 = moved_bytes;
+			uint64_t start = bench_now();
+			char *s = pcr_bridge(PROM_COLLECTOR_REGISTRY);
+			uint64_t t = bench_now() - start;
+			len = strlen(s);
+			free(s);
+			if (i == 0)
+				continue;	// warmup
+			a += allocs - a0;
+			ab += alloc_bytes - ab0;
+			mb += moved_bytes - mb0;
+			total += t;
+			if (t < best)
+				best = t;
+		}
+		printf("%d samples, %zu bytes, %3d%% of the metrics modified: "
+			"avg %.2f ms, best %.2f ms per scrape\n", METRICS * SERIES, len,
+			dirty[d], total / 1e6 / reps, best / 1e6);
+		printf("    per scrape: %.1f allocations, %.0f bytes allocated, "
+			"%.0f bytes moved by realloc\n", (double) a / reps,
+			(double) ab / reps, (double) mb / reps);
+	}
+	// the same, but streamed in 64 KiB blocks as promhttp does
+	for (int d = 0; d < 3; d += 2) {
+		stream(m, values, PROM_ENCODING_IDENTITY, dirty[d], reps);
+		stream(m, values, PROM_ENCODING_GZIP, dirty[d], reps);
+	}
+	gzip_at_once(reps);
+	pcr_destroy(PROM_COLLECTOR_REGISTRY);
+	return 0;
+}
@@ -0,0 +1,161 @@
+/**
+ * Copyright 2021 Jens Elkner <jel+libprom@cs.uni-magdeburg.de>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Measures the memory footprint of series and the time needed to create and
+// to scrape them: creates the given number of metrics with the given number
+// of series each (40% gauges, 40% double counters, 20% integral counters,
+// 2 labels), reports the resident set size grown and the bytes per series,
+// and the time needed to render the whole registry with all respectively no
+// metric modified since the last scrape. With -a the counting allocator gets
+// installed and the bytes libprom has allocated per subsystem get reported
+// as well - note that the allocator itself adds a header to each block.
+// Usage: bench_series [-a] [-m metrics] [-s series_per_metric] [-r reps]
+
+#include <getopt.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "prom.h"
+#include "bench.h"
+
+/** @brief Get the resident set size of this process in bytes. */
+static size_t
+rss(void) {
+	unsigned long size, resident = 0;
+	FILE *f = fopen("/proc/self/statm", "r");
+	if (f == NULL)
+		return 0;
+	if (fscanf(f, "%lu %lu", &size, &resident) != 2)
+		resident = 0;
+	fclose(f);
+	return resident * sysconf(_SC_PAGESIZE);
+}
+
+static void
+update(prom_metric_t *m, int i, double value, const char **values) {
+	if (i % 5 < 2)
+		prom_gauge_set(m, value, values);
+	else if (i % 5 < 4)
+		prom_counter_add(m, value, values);
+	else
+		prom_counter_add_int(m, (uint64_t) value, values);
+}
+
+/** @brief Scrape the registry \c reps times and print avg and best time. */
+static void
+scrape(prom_metric_t **m, int metrics, int reps, bool modify) {
+	const char *values[] = { "host0", "/p0" };
+	uint64_t best = UINT64_MAX, total = 0;
+	size_t len = 0;
+
+	for (int r = 0; r <= reps; r++) {
+		if (modify)
+			for (int i = 0; i < metrics; i++)
+				update(m[i], i, r, values);
+		uint64_t start = bench_now();
+		char *s = pcr_bridge(PROM_COLLECTOR_REGISTRY);
+		uint64_t t = bench_now() - start;
+		len = strlen(s);
+		free(s);
+		if (r == 0)
+			continue;
+		total += t;
+		if (t < best)
+			best = t;
+	}
+	printf("scrape, %s metrics modified: avg %.2f ms, best %.2f ms, "
+		"%zu bytes\n", modify ? "all" : " no", total / 1e6 / reps, best / 1e6,
+		len);
+}
+
+int
+main(int argc, char **argv) {
+	int metrics = 100, series = 1000, reps = 10, c;
+	bool counting = false;
+	const char *keys[] = { "instance", "path" };
+	char name[32], instance[16], path[16];
+	const char *values[] = { instance, path };
+
+	while ((c = getopt(argc, argv, "am:s:r:")) != -1) {
+		switch (c) {
+			case 'a': counting = true; break;
+			case 'm': metrics = atoi(optarg); break;
+			case 's': series = atoi(optarg); break;
+			case 'r': reps = atoi(optarg); break;
+			default:
+				fprintf(stderr, "Usage: %s [-a] [-m metrics] "
+					"[-s series_per_metric] [-r reps]\n", argv[0]);
+				return 1;
+		}
+	}
+	if (metrics < 1 || series < 1 || reps < 1)
+		return 1;
+	if (counting && prom_allocator_set(prom_allocator_counting())) {
+		fprintf(stderr, "Failed to install the counting allocator.\n");
+		return 1;
+	}
+	prom_metric_t **m = malloc(metrics * sizeof(prom_metric_t *));
+	if (m == NULL || pcr_init(0, NULL))
+		return 1;
+
+	size_t rss0 = rss();
+	uint64_t start = bench_now();
+	for (int i = 0; i < metrics; i++) {
+		sprintf(name, "metric_%d", i);
+		if (i % 5 < 2)
+			m[i] = prom_gauge_new(name, "gauge", 2, keys);
+		else if (i % 5 < 4)
+			m[i] = prom_counter_new(name, "counter", 2, keys);
+		else
+			m[i] = prom_counter_new_int(name, "int counter", 2, keys);
+		pcr_must_register_metric(m[i]);
+		for (int k = 0; k < series; k++) {
+			sprintf(instance, "host%d", k / 10);
+			sprintf(path, "/p%d", k % 10);
+			update(m[i], i, k, values);
+		}
+	}
+	uint64_t t = bench_now() - start;
+	size_t total = (size_t) metrics * series;
+	// the first scrape renders and caches the expositions
+	free(pcr_bridge(PROM_COLLECTOR_REGISTRY));
+	size_t rss1 = rss();
+
+	printf("%d metrics x %d series: created in %.2f ms (%.0f ns/series)\n",
+		metrics, series, t / 1e6, (double) t / total);
+	printf("rss grown by %.2f MiB, %.0f bytes/series\n",
+		(rss1 - rss0) / 1048576.0, (double) (rss1 - rss0) / total);
+	if (counting) {
+		prom_alloc_stats_t s;
+		uint64_t live = 0;
+		for (int i = 0; i < PROM_ALLOC_SUBSYSTEMS; i++) {
+			if (prom_alloc_stats(i, &s))
+				continue;
+			printf("  %-8s %12lu bytes live, %8.1f bytes/series\n",
+				prom_alloc_subsystem_name(i), (unsigned long) s.live,
+				(double) s.live / total);
+			live += s.live;
+		}
+		printf("  %-8s %12lu bytes live, %8.1f bytes/series\n", "total",
+			(unsigned long) live, (double) live / total);
+	}
+	scrape(m, metrics, reps, true);
+	scrape(m, metrics, reps, false);
+
+	pcr_destroy(PROM_COLLECTOR_REGISTRY);
+	free(m);
+	return 0;
+}
@@ -0,0 +1,89 @@
+/**
+ * Copyright 2021 Jens Elkner <jel+libprom@cs.uni-magdeburg.de>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Compares the quantiles estimated by a summary with the exact quantiles of
+// log-normally distributed values and measures observes per second with
+// 1 .. 64 concurrent threads. Usage: bench_summary [ops_per_thread]
+
+#include <math.h>
+
+#include "prom.h"
+#include "bench.h"
+
+#define VALUES (1 << 20)
+
+static double values[VALUES];
+
+static int
+cmp(const void *a, const void *b) {
+	double x = *(const double *) a, y = *(const double *) b;
+	return (x > y) - (x < y);
+}
+
+static void
+observe(void *arg, uint64_t ops) {
+	prom_summary_t *s = (prom_summary_t *) arg;
+	uint64_t off = (uint64_t) &ops;
+	for (uint64_t i = 0; i < ops; i++)
+		prom_summary_observe(s, values[(off + i) & (VALUES - 1)], NULL);
+}
+
+int
+main(int argc, char **argv) {
+	uint64_t ops = argc > 1 ? strtoull(argv[1], NULL, 10) : 1000000;
+	const double q[] = { 0.5, 0.9, 0.99, 0.999 };
+	prom_summary_t *acc = prom_summary_new("acc", "acc", 4, q, 0, 0, NULL);
+	prom_summary_t *tp = prom_summary_new("tp", "tp", 4, q, 0, 0, NULL);
+
+	// log-normal latencies around 1 ms (Box-Muller)
+	uint64_t x = 88172645463325252ULL;
+	for (int i = 0; i < VALUES; i += 2) {
+		double u[2];
+		for (int k = 0; k < 2; k++) {
+			x ^= x << 13; x ^= x >> 7; x ^= x << 17;
+			u[k] = ((x >> 11) + 0.5) / 9007199254740992.0;
+		}
+		double r = sqrt(-2 * log(u[0]));
+		values[i] = 1e-3 * exp(r * cos(2 * M_PI * u[1]));
+		values[i + 1] = 1e-3 * exp(r * sin(2 * M_PI * u[1]));
+	}
+	for (int i = 0; i < VALUES; i++)
+		prom_summary_observe(acc, values[i], NULL);
+	pms_summary_t *sample = pms_summary_from_labels(acc, NULL);
+	qsort(values, VALUES, sizeof(double), cmp);
+	printf("%-9s %14s %14s %10s\n", "quantile", "exact", "estimated",
+		"rel.error");
+	for (int i = 0; i < 4; i++) {
+		double exact = values[(size_t) (q[i] * (VALUES - 1))];
+		double est = pms_summary_quantile(sample, q[i]);
+		printf("%-9g %14.9f %14.9f %9.3f%%\n", q[i], exact, est,
+			100 * fabs(est - exact) / exact);
+	}
+
+	printf("\n%-8s %14s\n", "threads", "observes/s");
+	for (int t = 1; t <= 64; t <<= 1) {
+		double n = (double) ops * t * 1e9;
+		printf("%-8d %14.0f\n", t, n / bench_run(t, observe, tp, ops));
+	}
+	uint64_t start = bench_now();
+	pms_summary_quantile(pms_summary_from_labels(tp, NULL), 0.99);
+	printf("\nquantile query after %.0f observes: %.1f us\n",
+		(double) ops * 127, (bench_now() - start) / 1e3);
+
+	prom_summary_destroy(acc);
+	prom_summary_destroy(tp);
+	return 0;
+}
@@ -99,6 +99,7 @@ limitations under the License.
  * * [Counter](https://prometheus.io/docs/concepts/metric_types/#counter)
  * * [Gauge](https://prometheus.io/docs/concepts/metric_types/#gauge)
  * * [Histogram](https://prometheus.io/docs/concepts/metric_types/#histogram)
+ * * [Summary](https://prometheus.io/docs/concepts/metric_types/#summary)
  *
  *
  * @section Updating-Metric-Sample-Values Updating Metric Sample Values
@@ -127,19 +128,30 @@ limitations under the License.
  * registry at a time is active.
  *
  * After firing up the HTTP handler via \c promhttp_start_daemon(), the
- * HTTP handler calls the \c pcr_bridge() on \c /metrics
- * request. This in turn instructs the registry's prom metric formatter (pmf)
- * to reset its internal stringbuilder, i.e. clear its buffer via
- * \c pmf_clear() and populate the response by calling
- * \c pmf_load_metrics(). This function calls the
+ * HTTP handler starts a \c pcr_stream_new_format() on \c /metrics
+ * request and lets libmicrohttpd pull the response via
+ * \c pcr_stream_read() . The stream calls the
  * \c collect_fn() function of each registered collector to get the list of
- * metrics to include in the HTTP response. Finally the formatter iterates
- * through the returned list of metrics, and appends them in Prometheus
- * exposition format to its internal stringbuilder. When all prom collectors of
- * the registry have been processed, the contents of the formmatter's
- * stringbuilder gets dumped as a single string via
- * \c pmf_dump() and append to the HTTP response of the
- * request - the http handler takes care of the rest.
+ * metrics to include in the HTTP response and renders one metric at a time
+ * in Prometheus exposition format into its own prom metric formatter (pmf),
+ * whenever libmicrohttpd needs more data to send. So the size of the
+ * response does not matter wrt. memory usage. \c pcr_bridge() does the same,
+ * but renders all metrics into a single string.
+ *
+ * The format of the response depends on the \c Accept header of the
+ * request: the delimited protobuf, the OpenMetrics or the text format gets
+ * used, whichever the scraper prefers (text if it does not tell). Only the
+ * OpenMetrics format exposes units (see \c prom_metric_set_unit() ), the
+ * \c _created series of counters, histograms and summaries and exemplars
+ * (see \c prom_counter_add_exemplar() and
+ * \c prom_histogram_observe_exemplar() ). Similarly the \c Accept-Encoding header
+ * decides, whether the response gets compressed using zstd, gzip or not at
+ * all.
+ *
+ * If several scrapers hit \c /metrics at the same time, e.g. a HA pair of
+ * Prometheus servers, \c promhttp_set_coalescing() lets requests arriving
+ * while an export gets rendered wait for it and share the result instead of
+ * running all collectors again.
  *
  * So basically do something like this:
  *
@@ -218,5 +230,7 @@ limitations under the License.
 #include "prom_metric.h"
 #include "prom_metric_sample.h"
 #include "prom_metric_sample_histogram.h"
+#include "prom_metric_sample_summary.h"
+#include "prom_summary.h"
 
 #endif //  PROM_INCLUDED
@@ -17,32 +17,176 @@ limitations under the License.
 /**
  * @file prom_alloc.h
  * @brief memory management
+ *
+ * All memory libprom allocates goes through the allocator set via
+ * \c prom_allocator_set() - per default the one of the C library. Each
+ * allocation gets tagged with the libprom subsystem requesting it, so that
+ * e.g. the counting allocator returned by \c prom_allocator_counting() is
+ * able to tell, how much memory maps, lists, string builders and samples
+ * use. \c pcr_init(PROM_ALLOC_STATS, ...) installs the latter and exposes
+ * its numbers as metrics.
+ *
+ * The only exception are string builder buffers: strings libprom hands over
+ * to the application, e.g. the result of \c pcr_bridge() , get released via
+ * free(), so they always come from the C library. The counting allocator
+ * accounts them to the \c string subsystem nevertheless.
  */
 
 #ifndef PROM_ALLOC_H
 #define PROM_ALLOC_H
 
+#include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
 
 /**
- * @brief Redefine this macro if you wish to override it. The default value is malloc.
+ * @brief The libprom subsystems allocations get accounted to.
  */
-#define prom_malloc malloc
+typedef enum prom_alloc_subsystem {
+	/** hash maps incl. their nodes and keys */
+	PROM_ALLOC_MAP = 0,
+	/** linked lists and their nodes */
+	PROM_ALLOC_LIST,
+	/** string builders and metric formatters incl. their buffers */
+	PROM_ALLOC_STRING,
+	/** metric samples incl. their stripes, exemplars and label values */
+	PROM_ALLOC_SAMPLE,
+	/** metrics, their templates and histogram buckets */
+	PROM_ALLOC_METRIC,
+	/** everything else, e.g. registries, collectors and compressors */
+	PROM_ALLOC_OTHER,
+	/** number of subsystems - required to be last */
+	PROM_ALLOC_SUBSYSTEMS
+} prom_alloc_subsystem_t;
 
 /**
- * @brief Redefine this macro if you wish to override it. The default value is realloc.
+ * @brief The subsystem allocations via \c prom_malloc() and friends get
+ *	accounted to. Define it before including any libprom header to use
+ *	another one.
  */
-#define prom_realloc realloc
+#ifndef PROM_ALLOC_SUBSYSTEM
+#define PROM_ALLOC_SUBSYSTEM PROM_ALLOC_OTHER
+#endif
 
 /**
- * @brief Redefine this macro if you wish to override it. The default value is strdup.
+ * @brief A pluggable allocator. All functions get the subsystem requesting
+ *	the memory and the allocator's \c ctx passed. They are required to be
+ *	thread-safe and to behave like their C library counterparts.
  */
-#define prom_strdup strdup
+typedef struct prom_allocator {
+	/** Allocate \c size bytes. */
+	void *(*malloc_fn)(size_t size, prom_alloc_subsystem_t subsystem,
+		void *ctx);
+	/** Resize the given block, which got allocated by \c malloc_fn , to
+		\c size bytes. */
+	void *(*realloc_fn)(void *ptr, size_t size,
+		prom_alloc_subsystem_t subsystem, void *ctx);
+	/** Allocate \c size bytes aligned to \c alignment , a power of 2. */
+	void *(*aligned_alloc_fn)(size_t alignment, size_t size,
+		prom_alloc_subsystem_t subsystem, void *ctx);
+	/** Release the given block, which got allocated by one of the functions
+		above. \c ptr may be \c NULL . */
+	void (*free_fn)(void *ptr, void *ctx);
+	/** Passed as is to all functions above. */
+	void *ctx;
+} prom_allocator_t;
 
 /**
- * @brief Redefine this macro if you wish to override it. The default value is free.
+ * @brief Allocation statistics of a subsystem as recorded by the counting
+ *	allocator.
  */
-#define prom_free free
+typedef struct prom_alloc_stats {
+	uint64_t allocs;	/**< number of allocations incl. reallocations */
+	uint64_t frees;		/**< number of releases incl. reallocations */
+	uint64_t bytes;		/**< number of bytes allocated in total */
+	uint64_t live;		/**< number of bytes currently allocated */
+	uint64_t peak;		/**< high-water mark of \c live */
+} prom_alloc_stats_t;
+
+/**
+ * @brief Set the allocator libprom should use from now on.
+ * @param allocator	The allocator to use, or \c NULL for the one of the C
+ *	library. It gets copied, so it needs not to be kept.
+ * @return \c 0 on success, a non-zero integer value if libprom already
+ *	allocated memory or any allocator function is \c NULL .
+ * @note	Because blocks must be released by the allocator, which allocated
+ *	them, the allocator can be set only before libprom allocates anything,
+ *	i.e. before \c pcr_init() and before any metric gets created.
+ */
+int prom_allocator_set(const prom_allocator_t *allocator);
+
+/**
+ * @brief Get the allocator in use.
+ * @return \c NULL if the one of the C library is in use, the allocator
+ *	otherwise.
+ */
+const prom_allocator_t *prom_allocator_get(void);
+
+/**
+ * @brief Get the counting allocator. It uses the C library to allocate
+ *	memory and records per subsystem, how many blocks and bytes got allocated
+ *	and released. Use \c prom_allocator_set() to install it.
+ * @see \c prom_alloc_stats()
+ */
+const prom_allocator_t *prom_allocator_counting(void);
+
+/**
+ * @brief Get the allocation statistics of the given subsystem.
+ * @param subsystem	The subsystem to query.
+ * @param stats		Where to store the statistics.
+ * @return \c 0 on success, a non-zero integer value if the counting allocator
+ *	is not in use or the given subsystem is invalid.
+ */
+int prom_alloc_stats(prom_alloc_subsystem_t subsystem, prom_alloc_stats_t *stats);
+
+/**
+ * @brief Get the name of the given subsystem as used for the \c subsystem
+ *	label of the allocation metrics.
+ * @return \c NULL if the given subsystem is invalid, its name otherwise.
+ */
+const char *prom_alloc_subsystem_name(prom_alloc_subsystem_t subsystem);
+
+/** @brief Allocate via the current allocator. Use \c prom_malloc() instead. */
+void *prom_alloc_malloc(size_t size, prom_alloc_subsystem_t subsystem);
+/** @brief Reallocate via the current allocator. Use \c prom_realloc()
+	instead. */
+void *prom_alloc_realloc(void *ptr, size_t size, prom_alloc_subsystem_t subsystem);
+/** @brief Allocate aligned memory via the current allocator. Use
+	\c prom_aligned_alloc() instead. */
+void *prom_alloc_aligned(size_t alignment, size_t size, prom_alloc_subsystem_t subsystem);
+/** @brief Duplicate a string via the current allocator. Use \c prom_strdup()
+	instead. */
+char *prom_alloc_strdup(const char *s, prom_alloc_subsystem_t subsystem);
+/** @brief Release memory via the current allocator. Use \c prom_free()
+	instead. */
+void prom_alloc_free(void *ptr);
+
+/**
+ * @brief Allocate memory via the current allocator. Same as malloc().
+ */
+#define prom_malloc(size) prom_alloc_malloc((size), PROM_ALLOC_SUBSYSTEM)
+
+/**
+ * @brief Resize memory via the current allocator. Same as realloc().
+ */
+#define prom_realloc(ptr, size) \
+	prom_alloc_realloc((ptr), (size), PROM_ALLOC_SUBSYSTEM)
+
+/**
+ * @brief Allocate aligned memory via the current allocator. Same as
+ *	aligned_alloc(), but \c size needs not to be a multiple of \c alignment .
+ */
+#define prom_aligned_alloc(alignment, size) \
+	prom_alloc_aligned((alignment), (size), PROM_ALLOC_SUBSYSTEM)
+
+/**
+ * @brief Duplicate a string via the current allocator. Same as strdup().
+ */
+#define prom_strdup(s) prom_alloc_strdup((s), PROM_ALLOC_SUBSYSTEM)
+
+/**
+ * @brief Release memory allocated via one of the macros above. Same as free().
+ */
+#define prom_free(ptr) prom_alloc_free(ptr)
 
 #endif  // PROM_ALLOC_H
@@ -82,6 +82,14 @@ prom_collector_t *prom_collector_new(const char *name);
  */
 prom_collector_t *ppc_new(const char *limits_path, const char *stat_path, pid_t pid, const char **label_keys, const char **label_vals);
 
+/**
+ * @brief Create a prom collector which exposes the per subsystem statistics
+ *	of the counting allocator (see \c prom_alloc_stats()).
+ * @return The new collector on success, \c NULL otherwise, e.g. if the
+ *	counting allocator is not in use.
+ */
+prom_collector_t *pac_new(void);
+
 /**
  * @brief Destroy the given collector including all attached metrics.
  * @param self collector to destroy.
@@ -24,6 +24,8 @@ limitations under the License.
 #define PROM_REGISTRY_H
 
 #include <stdbool.h>
+#include <sys/types.h>
+
 #include "prom_collector.h"
 #include "prom_metric.h"
 
@@ -33,6 +35,14 @@ limitations under the License.
 /** @brief	Reserved name for libprom's own scrape duration metric.
 	@note Do not use unless you know, what you are doing. */
 #define METRIC_NAME_SCRAPE "scrape_duration_seconds"
+/** @brief	Reserved name for libprom's own metric counting the metrics, whose
+		cached exposition got reused respectively re-rendered on scrapes.
+	@note Do not use unless you know, what you are doing. */
+#define METRIC_NAME_FRAGMENTS "scrape_fragments_total"
+/** @brief	Reserved name for libprom's own metric counting the samples deleted
+		by \c pcr_evict() because they have not been updated in time.
+	@note Do not use unless you know, what you are doing. */
+#define METRIC_NAME_EVICTED "series_evicted_total"
 /** @brief	Reserved name for libprom's own default prom collector, where
 		usually new metrics get attached.
 	@note	Do not use unless you know, what you are doing. */
@@ -40,6 +50,17 @@ limitations under the License.
 /** @brief	Reserved name for libprom's own process stats prom collector.
 	@note	Do not use unless you know, what you are doing. */
 #define COLLECTOR_NAME_PROCESS "process"
+/** @brief	Reserved name for libprom's own allocation stats prom collector.
+	@note	Do not use unless you know, what you are doing. */
+#define COLLECTOR_NAME_ALLOC "alloc"
+/** @brief	Reserved names for libprom's own allocation metrics, labeled with
+		the \c subsystem the allocations got accounted to.
+	@note Do not use unless you know, what you are doing. */
+#define METRIC_NAME_ALLOC_CALLS "alloc_calls_total"
+#define METRIC_NAME_ALLOC_FREES "alloc_frees_total"
+#define METRIC_NAME_ALLOC_BYTES "alloc_bytes_total"
+#define METRIC_NAME_ALLOC_LIVE "alloc_live_bytes"
+#define METRIC_NAME_ALLOC_PEAK "alloc_peak_bytes"
 /** @brief	Reserved name for libprom's own default prom collector registry.
 	@note Do not use unless you know, what you are doing. */
 #define REGISTRY_NAME_DEFAULT "default"
@@ -69,7 +90,14 @@ enum prom_init_flag {
 		wrt. the Prometheus exposition format optional and e.g. Victoria-Metrics
 		vmagent as well as timeseries DB ignore them completely because simply
 		not needed. So allows less trash and communication overhead. */
-	PROM_COMPACT = 8
+	PROM_COMPACT = 8,
+	/** Install the counting allocator (see \c prom_allocator_counting())
+		and attach a collector named \c COLLECTOR_NAME_ALLOC , which exposes
+		the number of allocations, releases and bytes allocated as well as
+		the bytes currently allocated and their high-water mark per libprom
+		subsystem. Ignored with a warning if libprom already allocated
+		memory or another allocator is in use. */
+	PROM_ALLOC_STATS = 16
 };
 
 /** @brief collection of prom collector registry features.
@@ -77,6 +105,33 @@ enum prom_init_flag {
  */
 typedef unsigned int PROM_INIT_FLAGS;
 
+/**
+ * @brief Exposition formats a registry export can be produced in.
+ * @see \c pcr_stream_new_format()
+ */
+typedef enum prom_format {
+	/** Prometheus text format version 0.0.4 */
+	PROM_FORMAT_TEXT = 0,
+	/** length delimited io.prometheus.client.MetricFamily protobuf messages */
+	PROM_FORMAT_PROTOBUF,
+	/** OpenMetrics text format version 1.0.0 incl. exemplars */
+	PROM_FORMAT_OPENMETRICS
+} prom_format_t;
+
+/**
+ * @brief Content encodings a registry export can be produced with.
+ * @see \c pcr_stream_new_encoded()
+ */
+typedef enum prom_encoding {
+	/** plain text, no compression */
+	PROM_ENCODING_IDENTITY = 0,
+	/** gzip (RFC 1952) compressed */
+	PROM_ENCODING_GZIP,
+	/** zstd (RFC 8878) compressed - available only if libprom got built
+		with PROM_WITH_ZSTD */
+	PROM_ENCODING_ZSTD
+} prom_encoding_t;
+
 /**
  * @brief A prom_registry_t is responsible for registering metrics and briding them to the string exposition format
  */
@@ -128,8 +183,8 @@ pcr_t *pcr_new(const char *name);
  * @param self	Registry to destroy.
  * @return A non-zero integer value upon failure, 0 otherwise.
  * @note	No matter what is returned, one should always set the pointer of
- *	the given registry to \c NULL because it gets always passed to \c free()
- *	and thus points to an invalid memory location on return.
+ *	the given registry to \c NULL because it gets always released and thus
+ *	points to an invalid memory location on return.
  */
 int pcr_destroy(pcr_t *self);
 
@@ -140,17 +195,45 @@ int pcr_destroy(pcr_t *self);
  */
 int pcr_enable_process_metrics(pcr_t *self);
 
+/**
+ * @brief Enable allocation metrics on the given collector registry.
+ * @param self The registry, where to attach the allocation metrics.
+ * @return A non-zero integer value upon failure, \c 0 otherwise.
+ * @note	Requires the counting allocator to be in use. Because it must be
+ *	installed before libprom allocates anything, pass \c PROM_ALLOC_STATS to
+ *	\c pcr_init() or call \c prom_allocator_set() before.
+ */
+int pcr_enable_alloc_metrics(pcr_t *self);
+
 /**
  * @brief Create a scrape duration gauge metric and attach it to the given
  *	prom collector registry. If available, \c pcr_bridge()
  *	measures the time needed to collect and export all metrics of the registry,
- *	updates the metric and appends it to the export.
+ *	updates the metric and appends it to the export. Furthermore a
+ *	\c METRIC_NAME_FRAGMENTS counter gets attached, which counts the metrics
+ *	with the label \c state="reused" , whose last rendered exposition could be
+ *	reused because none of their samples got modified since the last scrape,
+ *	and with \c state="rendered" the ones, which needed to be rendered.
+ *	Finally a \c METRIC_NAME_EVICTED counter gets attached, which counts the
+ *	samples \c pcr_evict() deleted.
  * @param self Where to enable scrape duration monitoring.
  * @return A non-zero integer if the given registry is \c NULL, or the metric
  *	could not be added to its \c default collector, 0 otherwise.
  */
 int pcr_enable_scrape_metrics(pcr_t *self);
 
+/**
+ * @brief Run an eviction pass via \c prom_metric_evict() on each metric
+ *	registered with any collector of the given registry. Metrics of custom
+ *	collectors, which get created on collect only, are not affected. Should
+ *	be called once per update interval of the application. Samples deleted
+ *	via \c prom_metric_delete() get released by eviction passes only.
+ * @param self The registry to clean up.
+ * @return The number of samples deleted because of their TTL.
+ * @see \c prom_metric_set_ttl()
+ */
+size_t pcr_evict(pcr_t *self);
+
 /**
  * @brief Registers a metric with the default collector on
  *	PROM_COLLECTOR_REGISTRY.
@@ -203,11 +286,87 @@ prom_collector_t *pcr_get(pcr_t *self, const char *name);
  *
  * Reference: https://prometheus.io/docs/instrumenting/exposition_formats/
  *
+ * Several exports of the same registry may run concurrently, each one
+ * renders into its own buffer.
+ *
  * @param self The registry containing the collectors with the relevant metrics.
  * @return \c NULL on failure, the export otherwise.
  */
 char *pcr_bridge(pcr_t *self);
 
+/** @brief An export of a registry in progress. */
+struct pcr_stream;
+/** @brief An export of a registry in progress. */
+typedef struct pcr_stream pcr_stream_t;
+
+/**
+ * @brief Start an export of all relevant metrics registered with the given
+ *	registry, which gets produced piecemeal on \c pcr_stream_read() instead
+ *	of being rendered into a single string like \c pcr_bridge() does. The
+ *	memory needed is bounded by the size of the biggest single metric,
+ *	not by the size of the registry. Several streams may be read
+ *	concurrently, e.g. one per connection thread of an HTTP server.
+ * @param self The registry containing the collectors with the relevant metrics.
+ * @return \c NULL on failure, a new stream otherwise. It must be destroyed
+ *	via \c pcr_stream_destroy() when no longer needed.
+ */
+pcr_stream_t *pcr_stream_new(pcr_t *self);
+
+/**
+ * @brief Same as \c pcr_stream_new() , but produce the export compressed
+ *	with the given encoding. Metrics get compressed independently of each
+ *	other and the compressed exposition of a metric gets cached and reused
+ *	as long as it does not change. Compression is tuned for speed.
+ * @param self The registry containing the collectors with the relevant metrics.
+ * @param encoding	The encoding to use.
+ * @return \c NULL on failure or if the given encoding is not supported, a
+ *	new stream otherwise.
+ */
+pcr_stream_t *pcr_stream_new_encoded(pcr_t *self, prom_encoding_t encoding);
+
+/**
+ * @brief Same as \c pcr_stream_new_encoded() , but produce the export in the
+ *	given format. In the protobuf format native histograms get exported
+ *	with all their sparse buckets, and PROM_COMPACT omits the help text,
+ *	only. The OpenMetrics format adds units, \c _created series and
+ *	exemplars and gets terminated by \c "# EOF" .
+ * @param self The registry containing the collectors with the relevant metrics.
+ * @param format	The exposition format to use.
+ * @param encoding	The encoding to use.
+ * @return \c NULL on failure or if the given encoding is not supported, a
+ *	new stream otherwise.
+ */
+pcr_stream_t *pcr_stream_new_format(pcr_t *self, prom_format_t format, prom_encoding_t encoding);
+
+/**
+ * @brief Check whether the given encoding is supported by
+ *	\c pcr_stream_new_encoded() .
+ * @param encoding	The encoding to check.
+ * @return \c true if supported, \c false otherwise.
+ */
+bool pcr_stream_supports(prom_encoding_t encoding);
+
+/**
+ * @brief Copy the next part of the export of the given stream into the given
+ *	buffer. Collectors get asked for their metrics and metrics get rendered
+ *	as needed to fill the buffer.
+ * @param self	The stream to read from.
+ * @param buf	Where to store the data.
+ * @param max	The size of the given buffer in bytes.
+ * @return The number of bytes stored in \c buf , \c 0 if the export is
+ *	complete, \c -1 on error.
+ */
+ssize_t pcr_stream_read(pcr_stream_t *self, char *buf, size_t max);
+
+/**
+ * @brief Destroy the given stream. Metrics not yet read get skipped. Must be
+ *	called before the registry of the stream gets destroyed, because its
+ *	buffers get handed back to the registry for reuse by the next export.
+ * @param self	The stream to destroy.
+ * @return \c 0 .
+ */
+int pcr_stream_destroy(pcr_stream_t *self);
+
 /**
  *@brief Validates that the given metric name complies with the specification:
  *
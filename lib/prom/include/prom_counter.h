@@ -18,6 +18,7 @@ limitations under the License.
 #ifndef PROM_COUNTER_H
 #define PROM_COUNTER_H
 
+#include <stdint.h>
 #include <stdlib.h>
 
 #include "prom_metric.h"
@@ -56,6 +57,49 @@ typedef prom_metric_t prom_counter_t;
  */
 prom_counter_t *prom_counter_new(const char *name, const char *help, size_t label_key_count, const char **label_keys);
 
+/**
+ * @brief Same as \c prom_counter_new() but the samples of the new counter
+ *	get striped: instead of updating a single value, each thread adds to its
+ *	own, cache line sized stripe of the sample, and all stripes get merged
+ *	when the sample gets exposed. This avoids cache line bouncing and
+ *	retries if many threads increment the same counter sample concurrently
+ *	at a high rate, but costs one cache line per stripe (usually one per CPU)
+ *	and sample and makes reading the sample a little bit more expensive.
+ * @param name	Name of the counter.
+ * @param help	Short counter description.
+ * @param label_key_count	The number of labels associated with the given
+ *	counter. Pass \c 0 if the counter does not require labels.
+ * @param label_keys A collection of label keys. The number of keys MUST match
+ *	the value passed as \c label_key_count. If no labels are required, pass
+ *	\c NULL. Otherwise, it may be convenient to pass this value as a literal.
+ * @return The new prom counter on success, \c NULL otherwise.
+ * @note Striping pays off only, if the time spent to lookup the sample is
+ *	small compared to the update itself, i.e. for counters without labels or
+ *	samples obtained via \c pms_from_labels() once and updated directly via
+ *	\c pms_add().
+ */
+prom_counter_t *prom_counter_new_striped(const char *name, const char *help, size_t label_key_count, const char **label_keys);
+
+/**
+ * @brief Same as \c prom_counter_new() but the samples of the new counter
+ *	store unsigned 64-bit integers instead of doubles. So values get exposed
+ *	exactly even above 2^53, and additions are a single \c atomic_fetch_add
+ *	instead of a compare-and-swap loop. Use it for integral quantities like
+ *	bytes, packets or page faults.
+ * @param name	Name of the counter.
+ * @param help	Short counter description.
+ * @param label_key_count	The number of labels associated with the given
+ *	counter. Pass \c 0 if the counter does not require labels.
+ * @param label_keys A collection of label keys. The number of keys MUST match
+ *	the value passed as \c label_key_count. If no labels are required, pass
+ *	\c NULL. Otherwise, it may be convenient to pass this value as a literal.
+ * @return The new prom counter on success, \c NULL otherwise.
+ * @note \c prom_counter_add() and \c prom_counter_reset() work as well, but
+ *	truncate the given value to an integer. Prefer \c prom_counter_add_int()
+ *	and \c prom_counter_reset_int() .
+ */
+prom_counter_t *prom_counter_new_int(const char *name, const char *help, size_t label_key_count, const char **label_keys);
+
 /**
  * @brief Destroys the given counter.
  * @param self	Counter to destroy.
@@ -107,7 +151,22 @@ int prom_counter_inc(prom_counter_t *self, const char **label_values);
 int prom_counter_add(prom_counter_t *self, double r_value, const char **label_values);
 
 /**
- * @brief Reset the given counter to the given value.
+ * @brief Same as \c prom_counter_add() , but additionally record an exemplar
+ *	of the update, e.g. the trace which caused it. It gets exposed in the
+ *	OpenMetrics format, only. Only the last exemplar per sample gets kept.
+ * @param self	Where to add the value.
+ * @param r_value	Value to add. MUST be >= 0.
+ * @param label_values	The label values associated with the counter sample
+ *	being updated. See \c prom_counter_add().
+ * @param exemplar	\c NULL or the label set of the exemplar in text form,
+ *	e.g. \c trace_id="4bf92f3577b34da6" . At most 192 bytes.
+ * @return A non-zero integer value upon failure, \c 0 otherwise.
+ */
+int prom_counter_add_exemplar(prom_counter_t *self, double r_value, const char **label_values, const char *exemplar);
+
+/**
+ * @brief Reset the given counter to the given value. Its creation time as
+ *	exposed in the OpenMetrics format gets set to now.
  * @param self	Where to set the given value.
  * @param r_value	Value to set. MUST be >= 0.
  * @param label_values	The label values associated with the counter sample
@@ -119,4 +178,32 @@ int prom_counter_add(prom_counter_t *self, double r_value, const char **label_va
  */
 int prom_counter_reset(prom_counter_t *self, double r_value, const char **label_values);
 
+/**
+ * @brief Add the value to the given integral counter (see
+ *	\c prom_counter_new_int()).
+ * @param self	Where to add the value.
+ * @param i_value	Value to add.
+ * @param label_values	The label values associated with the counter sample
+ *	being updated. The number of labels must match the value passed as
+ *	\c label_key_count in the counter's constructor. If no label values are
+ *	necessary, pass \c NULL. Otherwise, it may be convenient to pass this value
+ *	as a literal.
+ * @return A non-zero integer value upon failure, \c 0 otherwise.
+ */
+int prom_counter_add_int(prom_counter_t *self, uint64_t i_value, const char **label_values);
+
+/**
+ * @brief Reset the given integral counter (see \c prom_counter_new_int()) to
+ *	the given value.
+ * @param self	Where to set the given value.
+ * @param i_value	Value to set. \c PMS_INT_NAN gets exposed as \c NaN .
+ * @param label_values	The label values associated with the counter sample
+ *	being updated. The number of labels must match the value passed as
+ *	\c label_key_count in the counter's constructor. If no label values are
+ *	necessary, pass \c NULL. Otherwise, it may be convenient to pass this value
+ *	as a literal.
+ * @return A non-zero integer value upon failure, \c 0 otherwise.
+ */
+int prom_counter_reset_int(prom_counter_t *self, uint64_t i_value, const char **label_values);
+
 #endif  // PROM_COUNTER_H
@@ -37,6 +37,21 @@ limitations under the License.
  */
 typedef prom_metric_t prom_histogram_t;
 
+/** @brief The lowest schema supported by native histograms. */
+#define PROM_NATIVE_SCHEMA_MIN -4
+/** @brief The highest schema supported by native histograms. */
+#define PROM_NATIVE_SCHEMA_MAX 8
+/**
+ * @brief The number of buckets a native histogram sample populates by default,
+ *	before its resolution gets reduced.
+ */
+#define PROM_NATIVE_MAX_BUCKETS 160
+/**
+ * @brief Observed values with an absolute value <= this threshold (2^-128)
+ *	get counted in the zero bucket of a native histogram.
+ */
+#define PROM_NATIVE_ZERO_THRESHOLD 2.938735877055719e-39
+
 /**
  * @brief Construct a new metric of type \c histogram (or short: histogram)
  * @param name Name of the histogram.
@@ -61,6 +76,36 @@ typedef prom_metric_t prom_histogram_t;
  */
 prom_histogram_t *prom_histogram_new(const char *name, const char *help, phb_t *buckets, size_t label_key_count, const char **label_keys);
 
+/**
+ * @brief Construct a new native histogram, i.e. a histogram with sparse
+ *	exponential buckets. The upper bound of bucket \c i is
+ *	\c 2^(i/2^schema) , i.e. each bucket is \c 2^(2^-schema) times wider
+ *	than the previous one (e.g. ~1.09 for schema 3). Buckets get allocated
+ *	when a value falls into them, so memory per sample depends on the range
+ *	of observed values, only. If more than \c max_buckets would be needed,
+ *	the schema of the sample gets reduced (halving its resolution) until the
+ *	buckets fit. Values with an absolute value <= PROM_NATIVE_ZERO_THRESHOLD
+ *	get counted in a dedicated zero bucket.
+ * @param name Name of the histogram.
+ * @param help Sort histogram description.
+ * @param schema	Initial resolution of the buckets. Must be in
+ *	[PROM_NATIVE_SCHEMA_MIN, PROM_NATIVE_SCHEMA_MAX].
+ * @param max_buckets	Max. number of buckets to populate per sample. \c 0
+ *	means PROM_NATIVE_MAX_BUCKETS.
+ * @param label_key_count	The number of labels associated with the given
+ *	histogram. Pass \c 0 if the histogram does not require labels.
+ * @param label_keys A collection of label keys. The number of keys MUST match
+ *	the value passed as \c label_key_count. If no labels are required, pass
+ *	\c NULL. Otherwise, it may be convenient to pass this value as a literal.
+ * @return The new prom histogram on success, \c NULL otherwise.
+ * @note The text exposition format cannot express sparse buckets, so there
+ *	native histograms show up with their \c +Inf bucket, count and sum, only.
+ *	The protobuf exposition format (see \c pcr_stream_new_format() ) contains
+ *	all sparse buckets. \c NaN and infinite values get reflected in the count and sum, but not in
+ *	any sparse bucket.
+ */
+prom_histogram_t *prom_histogram_new_native(const char *name, const char *help, int schema, unsigned int max_buckets, size_t label_key_count, const char **label_keys);
+
 /**
  * @brief Destroy the given histogram.
  * @return Non-zero value upon failure, \c 0 otherwise.
@@ -82,4 +127,39 @@ int prom_histogram_destroy(prom_histogram_t *self);
  */
 int prom_histogram_observe(prom_histogram_t *self, double value, const char **label_values);
 
+/**
+ * @brief Same as \c prom_histogram_observe() , but additionally record an
+ *	exemplar of the observation for the bucket the value falls into, e.g. the
+ *	trace of the request measured. It gets exposed in the OpenMetrics format,
+ *	only. Only the last exemplar per bucket gets kept. Storing it needs no
+ *	lock; if another thread stores an exemplar for the same bucket at the
+ *	same time, one of them gets dropped.
+ * @param self	Histogram to observe.
+ * @param value Value to observe.
+ * @param label_values	The label values associated with the histogram sample
+ *	being updated. See \c prom_histogram_observe().
+ * @param exemplar	\c NULL or the label set of the exemplar in text form,
+ *	e.g. \c trace_id="4bf92f3577b34da6" . At most 192 bytes.
+ * @return A non-zero integer value upon failure, \c 0 otherwise.
+ */
+int prom_histogram_observe_exemplar(prom_histogram_t *self, double value, const char **label_values, const char *exemplar);
+
+/**
+ * @brief Observe the given values of the given histogram with the given labels.
+ *	The result is the same as calling \c prom_histogram_observe() for each
+ *	value, but the sample gets looked up once, and each bucket counter gets
+ *	updated at most once per call. So use it to record a batch of
+ *	measurements, e.g. the latencies of a batch of requests.
+ * @param self	Histogram to observe.
+ * @param values	Values to observe.
+ * @param count	Number of values to observe.
+ * @param label_values	The label values associated with the histogram sample
+ *	being updated. The number of labels must match the value passed as
+ *	\c label_key_count in the histogram's constructor. If no label values are
+ *	necessary, pass \c NULL. Otherwise, it may be convenient to pass this value
+ *	as a literal.
+ * @return A non-zero integer value upon failure, \c 0 otherwise.
+ */
+int prom_histogram_observe_many(prom_histogram_t *self, const double *values, size_t count, const char **label_values);
+
 #endif  // PROM_HISTOGRAM_INCLUDED
@@ -34,6 +34,7 @@ limitations under the License.
 
 #include "prom_metric_sample.h"
 #include "prom_metric_sample_histogram.h"
+#include "prom_metric_sample_summary.h"
 
 struct prom_metric;
 /**
@@ -49,7 +50,10 @@ typedef struct prom_metric prom_metric_t;
  * You may use this function to cache metric samples to avoid sample lookup.
  * Metric samples are stored in a hash map with O(1) lookups in average case.
  * Nonethless, caching metric samples and updating them directly might be
- * preferrable in performance-sensitive situations.
+ * preferrable in performance-sensitive situations. Unlike updates via
+ * \c prom_counter_add() and friends, direct updates are not protected against
+ * the release of deleted samples: a cached sample must not be deleted via
+ * \c prom_metric_delete() or a TTL while it is in use.
  *
  * @param self Metric to use for lookup.
  * @param label_values	label values associated with the metric sample being
@@ -68,7 +72,10 @@ pms_t *pms_from_labels(prom_metric_t *self, const char **label_values);
  * You may use this function to cache metric samples to avoid sample lookup.
  * Metric samples are stored in a hash map with O(1) lookups in average case.
  * Nonethless, caching metric samples and updating them directly might be
- * preferrable in performance-sensitive situations.
+ * preferrable in performance-sensitive situations. Unlike updates via
+ * \c prom_counter_add() and friends, direct updates are not protected against
+ * the release of deleted samples: a cached sample must not be deleted via
+ * \c prom_metric_delete() or a TTL while it is in use.
  *
  * @param self	Metric to use for lookup.
  * @param label_values	label values associated with the metric sample being
@@ -80,4 +87,73 @@ pms_t *pms_from_labels(prom_metric_t *self, const char **label_values);
  */
 pms_histogram_t *pms_histogram_from_labels(prom_metric_t *self, const char **label_values);
 
+/**
+ * @brief Get a prom summary metric sample by label values. The order of
+ *	label_values is significant.
+ *
+ * You may use this function to cache metric samples to avoid sample lookup.
+ *
+ * @param self	Metric to use for lookup.
+ * @param label_values	label values associated with the metric sample being
+ *	searched. The number of labels must match the value passed to
+ *	label_key_count in the summary's constructor. If no label values are
+ *	necessary, pass \c NULL. Otherwise, it may be convenient to pass this value
+ *	as a literal.
+ * @return The summary sample found, \c NULL otherwise.
+ */
+pms_summary_t *pms_summary_from_labels(prom_metric_t *self, const char **label_values);
+
+/**
+ * @brief Set the unit of the given metric, which gets exposed in the
+ *	OpenMetrics format. The name of the metric must end with an underscore
+ *	followed by the unit (for counters before the \c _total suffix), e.g.
+ *	\c request_duration_seconds or \c sent_bytes_total .
+ * @param self	The metric to annotate.
+ * @param unit	The unit, e.g. \c seconds . \c NULL removes it.
+ * @return Non-zero integer value upon failure, \c 0 otherwise.
+ */
+int prom_metric_set_unit(prom_metric_t *self, const char *unit);
+
+/**
+ * @brief Delete the sample with the given label values from the given metric,
+ *	so that it does not get exposed anymore. Use it for series of transient
+ *	things like network interfaces, processes or mount points, which are gone.
+ *	Its memory gets released only by \c prom_metric_evict() (or when the
+ *	metric gets destroyed), once no update, which may have looked it up
+ *	before, is running anymore. So an application deleting samples MUST call
+ *	\c prom_metric_evict() or \c pcr_evict() periodically, e.g. once per
+ *	update interval. Pointers to the sample obtained via \c pms_from_labels()
+ *	and friends must not be used after the deletion.
+ * @param self	The metric to modify.
+ * @param label_values	The label values of the sample to delete as passed to
+ *	\c pms_from_labels() .
+ * @return Non-zero integer value upon failure or if there is no such sample,
+ *	\c 0 otherwise.
+ */
+int prom_metric_delete(prom_metric_t *self, const char **label_values);
+
+/**
+ * @brief Let \c prom_metric_evict() delete samples of the given metric, which
+ *	have not been updated for the given number of eviction passes.
+ * @param self	The metric to modify.
+ * @param intervals	Number of passes in a row a sample may stay without
+ *	update, at most 65535. \c 0 disables eviction (the default).
+ * @return Non-zero integer value upon failure, \c 0 otherwise.
+ */
+int prom_metric_set_ttl(prom_metric_t *self, unsigned int intervals);
+
+/**
+ * @brief If a TTL has been set via \c prom_metric_set_ttl() , delete all
+ *	samples of the given metric, which have not been updated for that many
+ *	calls in a row. Furthermore release the deleted samples, which no update
+ *	may use anymore. That takes a few calls after their deletion: each call
+ *	advances a global epoch, if all updates entered before the last advance
+ *	have finished, and a sample gets released three epochs after its
+ *	deletion. Should be called once per update interval of the application,
+ *	e.g. via \c pcr_evict() .
+ * @param self	The metric to clean up.
+ * @return The number of samples deleted because of their TTL.
+ */
+size_t prom_metric_evict(prom_metric_t *self);
+
 #endif  // PROM_METRIC_H
@@ -24,6 +24,8 @@ limitations under the License.
 #ifndef PROM_METRIC_SAMPLE_H
 #define PROM_METRIC_SAMPLE_H
 
+#include <stdint.h>
+
 struct pms;
 /**
  * @brief Contains the specific metric and value given the name and label set
@@ -32,14 +34,33 @@ struct pms;
  */
 typedef struct pms pms_t;
 
+/**
+ * @brief The value of an integral sample, which represents \c NaN , i.e. gets
+ *	exposed as \c NaN .
+ */
+#define PMS_INT_NAN UINT64_MAX
+
 /**
  * @brief Add the given r_value to the given sample.
  * @param self		Where to add the given value.
- * @param r_value	Value to add. Must be >= 0.
+ * @param r_value	Value to add. Must be >= 0, for integral samples also a
+ *	whole number < 2^64 (so neither \c NaN nor \c Inf ).
  * @return Non-zero integer value upon failure, \c 0 otherwise.
  */
 int pms_add(pms_t *self, double r_value);
 
+/**
+ * @brief Same as \c pms_add() , but additionally record an exemplar of the
+ *	update, which gets exposed in the OpenMetrics format. Only the last
+ *	exemplar per sample gets kept.
+ * @param self		Where to add the given value.
+ * @param r_value	Value to add. Must be >= 0.
+ * @param exemplar	\c NULL or the label set of the exemplar in text form,
+ *	e.g. \c trace_id="4bf92f3577b34da6" . At most 192 bytes.
+ * @return Non-zero integer value upon failure, \c 0 otherwise.
+ */
+int pms_add_exemplar(pms_t *self, double r_value, const char *exemplar);
+
 /**
  * @brief Subtract the given r_value from the given sample.
  * @param self		Where to add the given value.
@@ -51,9 +72,29 @@ int pms_sub(pms_t *self, double r_value);
 /**
  * @brief Set the given r_value to the given ample.
  * @param self		Where to set the given value.
- * @param r_value	Value to set.
+ * @param r_value	Value to set. Must be a whole number in [0, 2^64) or
+ *	\c NaN for integral samples. \c NaN marks an integral sample as unknown
+ *	until the next set.
  * @return Non-zero integer value upon failure, \c 0 otherwise.
  */
 int pms_set(pms_t *self, double r_value);
 
+/**
+ * @brief Add the given i_value to the given integral sample, i.e. a sample of
+ *	a counter created via \c prom_counter_new_int() .
+ * @param self		Where to add the given value.
+ * @param i_value	Value to add.
+ * @return Non-zero integer value upon failure, \c 0 otherwise.
+ */
+int pms_add_int(pms_t *self, uint64_t i_value);
+
+/**
+ * @brief Set the given i_value to the given integral sample, i.e. a sample of
+ *	a counter created via \c prom_counter_new_int() .
+ * @param self		Where to set the given value.
+ * @param i_value	Value to set. Use \c PMS_INT_NAN to mark it as unknown.
+ * @return Non-zero integer value upon failure, \c 0 otherwise.
+ */
+int pms_set_int(pms_t *self, uint64_t i_value);
+
 #endif  // PROM_METRIC_SAMPLE_H
@@ -23,6 +23,8 @@ limitations under the License.
 #ifndef PROM_METRIC_SAMPLE_HISOTGRAM_H
 #define PROM_METRIC_SAMPLE_HISOTGRAM_H
 
+#include <stdlib.h>
+
 struct pms_histogram;
 /**
  * @brief A histogram metric sample.
@@ -39,4 +41,27 @@ typedef struct pms_histogram pms_histogram_t;
  */
 int pms_histogram_observe(pms_histogram_t *self, double value);
 
+/**
+ * @brief Same as \c pms_histogram_observe() for each of the given values, but
+ *	the bucket counters and sum get updated only once per call.
+ * @param self		Where to lockup the buckets and sample.
+ * @param values	The values to observe.
+ * @param count		The number of values to observe.
+ * @return Non-zero integer value upon failure, \c 0 otherwise.
+ */
+int pms_histogram_observe_many(pms_histogram_t *self, const double *values, size_t count);
+
+/**
+ * @brief Same as \c pms_histogram_observe() , but additionally record an
+ *	exemplar of the observation for the bucket it falls into, which gets
+ *	exposed in the OpenMetrics format. Only the last exemplar per bucket gets
+ *	kept.
+ * @param self		Where to lockup the bucket and sample.
+ * @param value		The value to find.
+ * @param exemplar	\c NULL or the label set of the exemplar in text form,
+ *	e.g. \c trace_id="4bf92f3577b34da6" . At most 192 bytes.
+ * @return Non-zero integer value upon failure, \c 0 otherwise.
+ */
+int pms_histogram_observe_exemplar(pms_histogram_t *self, double value, const char *exemplar);
+
 #endif  // PROM_METRIC_SAMPLE_HISOTGRAM_H
@@ -0,0 +1,50 @@
+/**
+ * Copyright 2021 Jens Elkner <jel+libprom@cs.uni-magdeburg.de>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * @file prom_metric_sample_summary.h
+ * @brief Functions for interacting with summary metric samples directly
+ */
+
+#ifndef PROM_METRIC_SAMPLE_SUMMARY_H
+#define PROM_METRIC_SAMPLE_SUMMARY_H
+
+struct pms_summary;
+/**
+ * @brief A summary metric sample.
+ */
+typedef struct pms_summary pms_summary_t;
+
+/**
+ * @brief Add the given value to the given summary sample, i.e. to its sum,
+ *	count and quantile sketch.
+ * @param self		The sample to update.
+ * @param value		The value to observe.
+ * @return Non-zero integer value upon failure, \c 0 otherwise.
+ */
+int pms_summary_observe(pms_summary_t *self, double value);
+
+/**
+ * @brief Get the estimated value of the given quantile of all values observed
+ *	within the max. age of the given summary sample.
+ * @param self		The sample to query.
+ * @param q			The quantile to estimate, must be in [0, 1].
+ * @return \c NaN if no values have been observed within the max. age, the
+ *	estimated quantile otherwise.
+ */
+double pms_summary_quantile(pms_summary_t *self, double q);
+
+#endif  // PROM_METRIC_SAMPLE_SUMMARY_H
@@ -56,6 +56,16 @@ int psb_destroy(psb_t *self);
  */
 int psb_add_str(psb_t *self, const char *str);
 
+/**
+ * @brief Append the first \c len bytes of the given string to the buffered
+ *	string of the given string builder.
+ * @param self	Where to append the string.
+ * @param str	String to append. Must have at least \c len bytes.
+ * @param len	Number of bytes to append.
+ * @return \c 0 on success, a number > 0 otherwise.
+ */
+int psb_add_strn(psb_t *self, const char *str, size_t len);
+
 /**
  * @brief Append the given character to the buffered string of the given
  *	string builder.
@@ -66,9 +76,10 @@ int psb_add_str(psb_t *self, const char *str);
 int psb_add_char(psb_t *self, char c);
 
 /**
- * @brief Free the allocated string buffer area of the given string builder,
- * allocate a new one with a default initial size and set its length to \c 0.
- * @param self	String builder to free.
+ * @brief Set the length of the buffered string of the given string builder
+ *	to \c 0 . The allocated buffer gets kept, so that building a string of
+ *	the same size again does not need to grow it.
+ * @param self	String builder to clear.
  * @return \c 0 on success, a number > 0 otherwise.
  */
 int psb_clear(psb_t *self);
@@ -83,6 +94,38 @@ int psb_clear(psb_t *self);
  */
 int psb_truncate(psb_t *self, size_t len);
 
+/**
+ * @brief Make sure, that the given string builder has room for \c len more
+ *	bytes and return a pointer to the end of its buffered string, so that
+ *	callers can write into the buffer directly. Use \c psb_commit() to make
+ *	the written bytes part of the buffered string.
+ * @param self	String builder to prepare.
+ * @param len	Number of bytes to reserve.
+ * @return \c NULL on error, where to write the bytes otherwise. The pointer
+ *	gets invalid on the next modification of the string builder.
+ */
+char *psb_reserve(psb_t *self, size_t len);
+
+/**
+ * @brief Release most of the unused capacity of the given string builder.
+ *	Room for the buffered string plus 1/8 of its length is kept, so that
+ *	refilling it with a string of about the same length does not need to
+ *	grow it again. Does nothing, if the capacity exceeds that by 1/8 at
+ *	most.
+ * @param self	String builder to shrink.
+ * @return \c 0 on success, a number > 0 otherwise.
+ */
+int psb_trim(psb_t *self);
+
+/**
+ * @brief Append \c len bytes, which have been written into the space returned
+ *	by the last \c psb_reserve() call, to the buffered string.
+ * @param self	String builder to modify.
+ * @param len	Number of bytes written. Must not exceed the reserved length.
+ * @return \c 0 .
+ */
+int psb_commit(psb_t *self, size_t len);
+
 /**
  * @brief Get the length of the buffered string of the given string builder.
  * @param self	String builder to query.
@@ -98,6 +141,19 @@ size_t psb_len(psb_t *self);
  */
 char *psb_dump(psb_t *self);
 
+/**
+ * @brief Hand over the buffered string of the given string builder to the
+ *	caller without copying it. Afterwards the string builder is empty. Its
+ *	next modification allocates a new buffer with the capacity of the old
+ *	one, so that building a string of the same size again needs a single
+ *	allocation.
+ * @param self	String builder to ask.
+ * @param len	If not \c NULL , where to store the length of the string.
+ * @return The buffered string or \c NULL if it is empty and has no buffer.
+ * @note	The returned string must be freed when no longer needed.
+ */
+char *psb_detach(psb_t *self, size_t *len);
+
 /**
  * @brief Get a reference to the buffered string. One should **NOT** modify
  * the string, treat it as a read-only and never ever free() it, otherwise
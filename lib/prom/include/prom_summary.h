@@ -0,0 +1,103 @@
+/**
+ * Copyright 2021 Jens Elkner <jel+libprom@cs.uni-magdeburg.de>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * @file prom_summary.h
+ * @brief https://prometheus.io/docs/concepts/metric_types/#summary
+ */
+
+#ifndef PROM_SUMMARY_INCLUDED
+#define PROM_SUMMARY_INCLUDED
+
+#include <stdlib.h>
+
+#include "prom_metric.h"
+
+/**
+ * @brief Prometheus metric: summary
+ *
+ * References
+ * * See https://prometheus.io/docs/concepts/metric_types/#summary
+ */
+typedef prom_metric_t prom_summary_t;
+
+/** @brief Default max. age of observations in seconds (10 min). */
+#define PROM_SUMMARY_MAX_AGE 600
+/**
+ * @brief The number of windows the max. age gets split into. Every
+ *	max_age/PROM_SUMMARY_AGE_BUCKETS seconds the oldest window gets dropped.
+ */
+#define PROM_SUMMARY_AGE_BUCKETS 5
+/** @brief Relative accuracy of the estimated quantiles (1%). */
+#define PROM_SUMMARY_ACCURACY 0.01
+
+/**
+ * @brief Construct a new metric of type \c summary (or short: summary). For
+ *	each quantile a sample with the label \c quantile gets exposed with the
+ *	estimated value of this quantile over all values observed within the
+ *	last \c max_age seconds. The \c _sum and \c _count samples cover all
+ *	values ever observed.
+ *
+ * Quantiles get estimated using a DDSketch, i.e. the relative error of each
+ *	estimate is <= PROM_SUMMARY_ACCURACY and the memory needed per sample is
+ *	bounded. Observed values get buffered in up to 8 per sample buffers,
+ *	which threads get spread over, and merged into the sketch of the time
+ *	window they got observed in, when the buffer is full or the sample gets
+ *	exposed.
+ *
+ * @param name Name of the summary.
+ * @param help Short summary description.
+ * @param quantile_count	Number of quantiles to expose. If \c 0 , the
+ *	quantiles 0.5, 0.9, 0.99 and 0.999 get exposed.
+ * @param quantiles	The quantiles to expose, each in [0, 1]. Gets copied.
+ * @param max_age	Max. age of the values in seconds to consider when
+ *	estimating quantiles. \c 0 means PROM_SUMMARY_MAX_AGE.
+ * @param label_key_count	The number of labels associated with the given
+ *	summary. Pass \c 0 if the summary does not require labels.
+ * @param label_keys A collection of label keys. The number of keys MUST match
+ *	the value passed as \c label_key_count. If no labels are required, pass
+ *	\c NULL. Otherwise, it may be convenient to pass this value as a literal.
+ * @return The new prom summary on success, \c NULL otherwise.
+ *
+ * *Example*
+ *
+ *	// request latencies over the last 5 minutes
+ *	prom_summary_new("foo_seconds", "foo latencies", 3, (const double[]) { 0.5, 0.9, 0.99 }, 300, 0, NULL);
+ */
+prom_summary_t *prom_summary_new(const char *name, const char *help, size_t quantile_count, const double *quantiles, unsigned int max_age, size_t label_key_count, const char **label_keys);
+
+/**
+ * @brief Destroy the given summary.
+ * @return Non-zero value upon failure, \c 0 otherwise.
+ * @note No matter what gets returned, you should never use any metric
+ *	passed to this function but set it to \c NULL .
+ */
+int prom_summary_destroy(prom_summary_t *self);
+
+/**
+ * @brief Observe the given value of the given summary with the given labels.
+ * @param self	Summary to observe.
+ * @param value Value to observe.
+ * @param label_values	The label values associated with the summary sample
+ *	being updated. The number of labels must match the value passed as
+ *	\c label_key_count in the summary's constructor. If no label values are
+ *	necessary, pass \c NULL. Otherwise, it may be convenient to pass this value
+ *	as a literal.
+ * @return A non-zero integer value upon failure, \c 0 otherwise.
+ */
+int prom_summary_observe(prom_summary_t *self, double value, const char **label_values);
+
+#endif  // PROM_SUMMARY_INCLUDED
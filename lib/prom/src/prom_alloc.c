@@ -0,0 +1,276 @@
+/**
+ * Copyright 2021 Jens Elkner <jel+libprom@cs.uni-magdeburg.de>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdalign.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+// Public
+#include "../include/prom_alloc.h"
+
+// Private
+#include "prom_alloc_i.h"
+
+/** Cache line size to keep the stats of different subsystems apart. */
+#define PA_CACHE_LINE 64
+
+/** Prepended to each block by the counting allocator. */
+typedef struct pa_header {
+	size_t size;			/**< the size requested */
+	uint32_t subsystem;		/**< the subsystem it got accounted to */
+	uint32_t offset;		/**< from the start of the block to the user data */
+} pa_header_t;
+
+/** The offset of the user data of blocks not allocated aligned. */
+#define PA_OFFSET (((sizeof(pa_header_t) + alignof(max_align_t) - 1) \
+	/ alignof(max_align_t)) * alignof(max_align_t))
+
+typedef struct pa_stats {
+	atomic_uint_fast64_t allocs;
+	atomic_uint_fast64_t frees;
+	atomic_uint_fast64_t bytes;
+	atomic_uint_fast64_t live;
+	atomic_uint_fast64_t peak;
+} __attribute__((aligned(PA_CACHE_LINE))) pa_stats_t;
+
+static pa_stats_t stats[PROM_ALLOC_SUBSYSTEMS];
+
+static const char *subsystem_name[PROM_ALLOC_SUBSYSTEMS] = {
+	"map", "list", "string", "sample", "metric", "other"
+};
+
+/** The allocator in use, NULL for the one of the C library. */
+static const prom_allocator_t *_Atomic current;
+/** A copy of the allocator set. */
+static prom_allocator_t installed;
+/** Whether libprom allocated anything yet. */
+static atomic_bool used;
+
+static inline const prom_allocator_t *
+pa_current(void) {
+	if (!atomic_load_explicit(&used, memory_order_relaxed))
+		atomic_store_explicit(&used, true, memory_order_relaxed);
+	return atomic_load_explicit(&current, memory_order_acquire);
+}
+
+static void
+pa_account_alloc(uint32_t subsystem, size_t size) {
+	pa_stats_t *s = &stats[subsystem];
+	atomic_fetch_add_explicit(&s->allocs, 1, memory_order_relaxed);
+	atomic_fetch_add_explicit(&s->bytes, size, memory_order_relaxed);
+	uint64_t live = size
+		+ atomic_fetch_add_explicit(&s->live, size, memory_order_relaxed);
+	uint64_t peak = atomic_load_explicit(&s->peak, memory_order_relaxed);
+	while (live > peak && !atomic_compare_exchange_weak_explicit(&s->peak,
+		&peak, live, memory_order_relaxed, memory_order_relaxed))
+		;
+}
+
+static void
+pa_account_free(uint32_t subsystem, size_t size) {
+	pa_stats_t *s = &stats[subsystem];
+	atomic_fetch_add_explicit(&s->frees, 1, memory_order_relaxed);
+	atomic_fetch_sub_explicit(&s->live, size, memory_order_relaxed);
+}
+
+static inline void *
+pa_init_block(char *block, uint32_t offset, size_t size, uint32_t subsystem) {
+	pa_header_t *h = (pa_header_t *) (block + offset) - 1;
+	h->size = size;
+	h->subsystem = subsystem;
+	h->offset = offset;
+	pa_account_alloc(subsystem, size);
+	return block + offset;
+}
+
+static void *
+pa_counting_malloc(size_t size, prom_alloc_subsystem_t subsystem, void *ctx) {
+	char *block = malloc(PA_OFFSET + size);
+	return block == NULL
+		? NULL
+		: pa_init_block(block, PA_OFFSET, size, subsystem);
+}
+
+static void *
+pa_counting_aligned_alloc(size_t alignment, size_t size,
+	prom_alloc_subsystem_t subsystem, void *ctx)
+{
+	if (alignment < PA_OFFSET)
+		alignment = PA_OFFSET;
+	// aligned_alloc() wants a multiple of the alignment
+	size_t total = alignment + ((size + alignment - 1) & ~(alignment - 1));
+	char *block = aligned_alloc(alignment, total);
+	return block == NULL
+		? NULL
+		: pa_init_block(block, alignment, size, subsystem);
+}
+
+static void
+pa_counting_free(void *ptr, void *ctx) {
+	if (ptr == NULL)
+		return;
+	pa_header_t *h = (pa_header_t *) ptr - 1;
+	pa_account_free(h->subsystem, h->size);
+	free((char *) ptr - h->offset);
+}
+
+static void *
+pa_counting_realloc(void *ptr, size_t size, prom_alloc_subsystem_t subsystem,
+	void *ctx)
+{
+	if (ptr == NULL)
+		return pa_counting_malloc(size, subsystem, ctx);
+
+	pa_header_t *h = (pa_header_t *) ptr - 1;
+	if (h->offset != PA_OFFSET) {
+		// got allocated aligned, so realloc() would loose the alignment
+		void *p = pa_counting_malloc(size, h->subsystem, ctx);
+		if (p != NULL) {
+			memcpy(p, ptr, h->size < size ? h->size : size);
+			pa_counting_free(ptr, ctx);
+		}
+		return p;
+	}
+	// the block keeps the subsystem it was allocated for
+	uint32_t s = h->subsystem;
+	size_t old = h->size;
+	char *block = realloc((char *) ptr - PA_OFFSET, PA_OFFSET + size);
+	if (block == NULL)
+		return NULL;
+	pa_account_free(s, old);
+	return pa_init_block(block, PA_OFFSET, size, s);
+}
+
+static const prom_allocator_t counting = {
+	.malloc_fn = pa_counting_malloc,
+	.realloc_fn = pa_counting_realloc,
+	.aligned_alloc_fn = pa_counting_aligned_alloc,
+	.free_fn = pa_counting_free,
+	.ctx = NULL
+};
+
+int
+prom_allocator_set(const prom_allocator_t *allocator) {
+	if (atomic_load(&used))
+		return 1;
+	if (allocator == NULL) {
+		atomic_store(&current, NULL);
+		return 0;
+	}
+	if (allocator->malloc_fn == NULL || allocator->realloc_fn == NULL
+		|| allocator->aligned_alloc_fn == NULL || allocator->free_fn == NULL)
+	{
+		return 1;
+	}
+	installed = *allocator;
+	atomic_store(&current, &installed);
+	return 0;
+}
+
+const prom_allocator_t *
+prom_allocator_get(void) {
+	return atomic_load(&current);
+}
+
+const prom_allocator_t *
+prom_allocator_counting(void) {
+	return &counting;
+}
+
+int
+prom_alloc_stats(prom_alloc_subsystem_t subsystem, prom_alloc_stats_t *s) {
+	const prom_allocator_t *a = atomic_load(&current);
+	if (a == NULL || a->malloc_fn != pa_counting_malloc || s == NULL
+		|| subsystem < 0 || subsystem >= PROM_ALLOC_SUBSYSTEMS)
+	{
+		return 1;
+	}
+	pa_stats_t *st = &stats[subsystem];
+	s->allocs = atomic_load_explicit(&st->allocs, memory_order_relaxed);
+	s->frees = atomic_load_explicit(&st->frees, memory_order_relaxed);
+	s->bytes = atomic_load_explicit(&st->bytes, memory_order_relaxed);
+	s->live = atomic_load_explicit(&st->live, memory_order_relaxed);
+	s->peak = atomic_load_explicit(&st->peak, memory_order_relaxed);
+	return 0;
+}
+
+const char *
+prom_alloc_subsystem_name(prom_alloc_subsystem_t subsystem) {
+	return (subsystem < 0 || subsystem >= PROM_ALLOC_SUBSYSTEMS)
+		? NULL
+		: subsystem_name[subsystem];
+}
+
+void *
+prom_alloc_malloc(size_t size, prom_alloc_subsystem_t subsystem) {
+	const prom_allocator_t *a = pa_current();
+	return a == NULL ? malloc(size) : a->malloc_fn(size, subsystem, a->ctx);
+}
+
+void *
+prom_alloc_realloc(void *ptr, size_t size, prom_alloc_subsystem_t subsystem) {
+	const prom_allocator_t *a = pa_current();
+	return a == NULL
+		? realloc(ptr, size)
+		: a->realloc_fn(ptr, size, subsystem, a->ctx);
+}
+
+void *
+prom_alloc_aligned(size_t alignment, size_t size,
+	prom_alloc_subsystem_t subsystem)
+{
+	const prom_allocator_t *a = pa_current();
+	if (a != NULL)
+		return a->aligned_alloc_fn(alignment, size, subsystem, a->ctx);
+	return aligned_alloc(alignment, (size + alignment - 1) & ~(alignment - 1));
+}
+
+char *
+prom_alloc_strdup(const char *s, prom_alloc_subsystem_t subsystem) {
+	if (s == NULL)
+		return NULL;
+	size_t len = strlen(s) + 1;
+	char *p = prom_alloc_malloc(len, subsystem);
+	if (p != NULL)
+		memcpy(p, s, len);
+	return p;
+}
+
+void
+prom_alloc_free(void *ptr) {
+	if (ptr == NULL)
+		return;
+	const prom_allocator_t *a = atomic_load_explicit(&current,
+		memory_order_acquire);
+	if (a == NULL)
+		free(ptr);
+	else
+		a->free_fn(ptr, a->ctx);
+}
+
+void
+prom_alloc_account(prom_alloc_subsystem_t subsystem, size_t old_size,
+	size_t new_size)
+{
+	const prom_allocator_t *a = pa_current();
+	if (a == NULL || a->malloc_fn != pa_counting_malloc)
+		return;
+	if (old_size > 0)
+		pa_account_free(subsystem, old_size);
+	if (new_size > 0)
+		pa_account_alloc(subsystem, new_size);
+}
@@ -0,0 +1,113 @@
+/**
+ * Copyright 2021 Jens Elkner <jel+libprom@cs.uni-magdeburg.de>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Public
+#include "../include/prom_alloc.h"
+#include "../include/prom_collector.h"
+#include "../include/prom_collector_registry.h"
+#include "../include/prom_counter.h"
+#include "../include/prom_gauge.h"
+
+// Private
+#include "../include/prom_log.h"
+
+typedef enum pac_metric {
+	PAC_ALLOCS = 0,
+	PAC_FREES,
+	PAC_BYTES,
+	PAC_LIVE,
+	PAC_PEAK,
+	PAC_COUNT /* required to be last */
+} pac_metric_t;
+
+static prom_map_t *pac_collect(prom_collector_t *self);
+
+static void
+pac_free_data(prom_collector_t *self) {
+	if (self == NULL)
+		return;
+	// the metrics get destroyed with the collector
+	prom_free(prom_collector_data_get(self));
+}
+
+prom_collector_t *
+pac_new(void) {
+	const char *key[] = { "subsystem" };
+
+	if (prom_alloc_stats(PROM_ALLOC_OTHER, &(prom_alloc_stats_t) { 0 })) {
+		PROM_WARN("The counting allocator is not in use.", "");
+		return NULL;
+	}
+	prom_collector_t *self = prom_collector_new(COLLECTOR_NAME_ALLOC);
+	if (self == NULL)
+		return NULL;
+	prom_metric_t **m = prom_malloc(PAC_COUNT * sizeof(prom_metric_t *));
+	if (m == NULL) {
+		prom_collector_destroy(self);
+		return NULL;
+	}
+	prom_collector_data_set(self, m, &pac_free_data);
+
+	m[PAC_ALLOCS] = prom_counter_new_int(METRIC_NAME_ALLOC_CALLS,
+		"Number of memory allocations by libprom", 1, key);
+	m[PAC_FREES] = prom_counter_new_int(METRIC_NAME_ALLOC_FREES,
+		"Number of memory releases by libprom", 1, key);
+	m[PAC_BYTES] = prom_counter_new_int(METRIC_NAME_ALLOC_BYTES,
+		"Number of bytes allocated by libprom", 1, key);
+	m[PAC_LIVE] = prom_gauge_new(METRIC_NAME_ALLOC_LIVE,
+		"Number of bytes currently allocated by libprom", 1, key);
+	m[PAC_PEAK] = prom_gauge_new(METRIC_NAME_ALLOC_PEAK,
+		"Max. number of bytes allocated by libprom at the same time", 1, key);
+
+	int err = 0;
+	for (int i = 0; i < PAC_COUNT; i++) {
+		if (m[i] == NULL || prom_collector_add_metric(self, m[i]) != 0) {
+			// not owned by the collector yet
+			prom_gauge_destroy(m[i]);
+			m[i] = NULL;
+			err++;
+		}
+	}
+	if (err) {
+		prom_collector_destroy(self);
+		return NULL;
+	}
+	prom_collector_set_collect_fn(self, &pac_collect);
+	return self;
+}
+
+static prom_map_t *
+pac_collect(prom_collector_t *self) {
+	if (self == NULL)
+		return NULL;
+
+	prom_metric_t **m = prom_collector_data_get(self);
+	if (m == NULL)
+		return NULL;
+
+	prom_alloc_stats_t s;
+	for (int i = 0; i < PROM_ALLOC_SUBSYSTEMS; i++) {
+		if (prom_alloc_stats(i, &s))
+			continue;
+		const char *lval[] = { prom_alloc_subsystem_name(i) };
+		prom_counter_reset_int(m[PAC_ALLOCS], s.allocs, lval);
+		prom_counter_reset_int(m[PAC_FREES], s.frees, lval);
+		prom_counter_reset_int(m[PAC_BYTES], s.bytes, lval);
+		prom_gauge_set(m[PAC_LIVE], s.live, lval);
+		prom_gauge_set(m[PAC_PEAK], s.peak, lval);
+	}
+	return prom_collector_metrics_get(self);
+}
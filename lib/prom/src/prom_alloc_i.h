@@ -0,0 +1,38 @@
+/**
+ * Copyright 2021 Jens Elkner <jel+libprom@cs.uni-magdeburg.de>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef PROM_ALLOC_I_H
+#define PROM_ALLOC_I_H
+
+#include <stddef.h>
+
+// Public
+#include "../include/prom_alloc.h"
+
+/**
+ * @brief PRIVATE Account a block, which got allocated, resized or released
+ *	via the C library instead of the allocator in use, to the given
+ *	subsystem. Strings which may get handed over to the application live in
+ *	such blocks, so that it can release them via free(). Does nothing unless
+ *	the counting allocator is in use.
+ * @param subsystem	The subsystem owning the block.
+ * @param old_size	The size of the block before, \c 0 if it got allocated.
+ * @param new_size	The size of the block after, \c 0 if it got released or
+ *	handed over to the application.
+ */
+void prom_alloc_account(prom_alloc_subsystem_t subsystem, size_t old_size, size_t new_size);
+
+#endif  // PROM_ALLOC_I_H
@@ -24,12 +24,14 @@
 #include "../include/prom_alloc.h"
 #include "../include/prom_collector.h"
 #include "../include/prom_collector_registry.h"
+#include "../include/prom_counter.h"
 #include "../include/prom_gauge.h"
 
 // Private
 #include "prom_assert.h"
 #include "prom_collector_registry_t.h"
 #include "prom_collector_t.h"
+#include "prom_compress_i.h"
 #include "prom_errors.h"
 #include "../include/prom_log.h"
 #include "prom_map_i.h"
@@ -49,7 +51,10 @@ pcr_new(const char *name) {
 
 	self->features = 0;
 	self->scrape_duration = NULL;
+	self->scrape_fragments = NULL;
+	self->series_evicted = NULL;
 	self->mprefix = NULL;
+	self->pooled = 0;
 
 	self->name = prom_strdup(name);
 	self->collectors = prom_map_new();
@@ -60,12 +65,11 @@ pcr_new(const char *name) {
 			prom_collector_new(COLLECTOR_NAME_DEFAULT));
 	}
 
-	self->metric_formatter = pmf_new();
 	self->string_builder = psb_new();
 	self->lock = (pthread_rwlock_t *) prom_malloc(sizeof(pthread_rwlock_t));
 	if (pthread_rwlock_init(self->lock, NULL) != 0 || self->name == NULL
-		|| self->collectors == NULL || self->metric_formatter == 0
-		|| self->string_builder == NULL)
+		|| pthread_mutex_init(&self->pool_lock, NULL) != 0
+		|| self->collectors == NULL || self->string_builder == NULL)
 	{
 		PROM_WARN("failed to initialize rwlock for pcr '%s'", name);
 		pcr_destroy(self);
@@ -95,6 +99,28 @@ pcr_enable_process_metrics(pcr_t *self) {
 	return 0;
 }
 
+int
+pcr_enable_alloc_metrics(pcr_t *self) {
+	if (self == NULL)
+		return 0;
+
+	const char *cname = COLLECTOR_NAME_ALLOC;
+	if (prom_map_get(self->collectors, cname) != NULL) {
+		PROM_WARN("A collector named '%s' is already registered.", cname);
+		return 1;
+	}
+	prom_collector_t *c = pac_new();
+	if (c == NULL)
+		return 2;
+	if (prom_map_set(self->collectors, cname, c) != 0) {
+		prom_collector_destroy(c);
+		return 3;
+	}
+
+	self->features |= PROM_ALLOC_STATS;
+	return 0;
+}
+
 int
 pcr_enable_scrape_metrics(pcr_t *self) {
 	const char *mname = METRIC_NAME_SCRAPE;
@@ -105,7 +131,20 @@ pcr_enable_scrape_metrics(pcr_t *self) {
 		1, (const char *[]) {"collector"});
 	if (g == NULL)
 		return 1;
+	prom_counter_t *c = prom_counter_new_int(METRIC_NAME_FRAGMENTS,
+		"Metrics reused from the last scrape or rendered during a scrape",
+		1, (const char *[]) {"state"});
+	prom_counter_t *e = prom_counter_new_int(METRIC_NAME_EVICTED,
+		"Series deleted because they have not been updated in time", 0, NULL);
+	if (c == NULL || e == NULL || prom_counter_add_int(e, 0, NULL)) {
+		prom_gauge_destroy(g);
+		prom_counter_destroy(c);
+		prom_counter_destroy(e);
+		return 1;
+	}
 	self->scrape_duration = g;
+	self->scrape_fragments = c;
+	self->series_evicted = e;
 	self->features |= PROM_SCRAPETIME;
 	return 0;
 }
@@ -152,12 +191,24 @@ pcr_init(PROM_INIT_FLAGS features, const char *mprefix) {
 		return 1;
 	}
 
+	if ((features & PROM_ALLOC_STATS) && prom_allocator_get() == NULL
+		&& prom_allocator_set(prom_allocator_counting()) != 0)
+	{
+		PROM_WARN("Too late to install the counting allocator.", "");
+		features &= ~PROM_ALLOC_STATS;
+	}
+
 	PROM_COLLECTOR_REGISTRY = pcr_new(cname);
 	if (PROM_COLLECTOR_REGISTRY == NULL)
 		return 1;
 
 	if (features & PROM_PROCESS)
 		err += pcr_enable_process_metrics(PROM_COLLECTOR_REGISTRY);
+	if ((err == 0) && (features & PROM_ALLOC_STATS)
+		&& pcr_enable_alloc_metrics(PROM_COLLECTOR_REGISTRY) != 0)
+	{
+		PROM_WARN("Allocation metrics are not available.", "");
+	}
 	if (features & PROM_SCRAPETIME_ALL)
 		features |= PROM_SCRAPETIME;
 	if ((err == 0) && (features & PROM_SCRAPETIME))
@@ -192,7 +243,11 @@ pcr_destroy(pcr_t *self) {
 		PROM_COLLECTOR_REGISTRY = NULL;
 	int err = prom_map_destroy(self->collectors);
 	err += prom_gauge_destroy(self->scrape_duration);
-	err += pmf_destroy(self->metric_formatter);
+	err += prom_counter_destroy(self->scrape_fragments);
+	err += prom_counter_destroy(self->series_evicted);
+	for (size_t i = 0; i < self->pooled; i++)
+		err += pmf_destroy(self->pool[i]);
+	pthread_mutex_destroy(&self->pool_lock);
 	err += psb_destroy(self->string_builder);
 	err += pthread_rwlock_destroy(self->lock);
 	prom_free(self->lock);
@@ -259,6 +314,32 @@ pcr_get(pcr_t *self, const char *name) {
 		: prom_map_get(self->collectors, name);
 }
 
+size_t
+pcr_evict(pcr_t *self) {
+	size_t evicted = 0;
+	if (self == NULL)
+		return 0;
+
+	if (pthread_rwlock_rdlock(self->lock)) {
+		PROM_WARN(PROM_PTHREAD_RWLOCK_LOCK_ERROR, NULL);
+		return 0;
+	}
+	for (prom_map_node_t *n = self->collectors->head; n != NULL; n = n->after)
+	{
+		prom_collector_t *c = (prom_collector_t *) n->value;
+		if (c == NULL || c->metrics == NULL || prom_map_rdlock(c->metrics))
+			continue;
+		for (prom_map_node_t *m = c->metrics->head; m != NULL; m = m->after)
+			evicted += prom_metric_evict((prom_metric_t *) m->value);
+		prom_map_unlock(c->metrics);
+	}
+	if (pthread_rwlock_unlock(self->lock))
+		PROM_WARN(PROM_PTHREAD_RWLOCK_UNLOCK_ERROR, NULL);
+	if (evicted > 0 && self->series_evicted != NULL)
+		prom_counter_add_int(self->series_evicted, evicted, NULL);
+	return evicted;
+}
+
 int
 pcr_validate_metric_name(pcr_t *self, const char *metric_name) {
 	return pcr_check_name(metric_name, 0);
@@ -277,33 +358,316 @@ pcr_check_name(const char *name, bool is_label) {
 	return ret;
 }
 
+/**
+ * @brief PRIVATE Get a monotonic timestamp in nanoseconds.
+ */
+static uint64_t
+now_ns(void) {
+	struct timespec ts;
+	if (clock_gettime(CLOCK_MONOTONIC, &ts))
+		return 0;
+	return (uint64_t) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/**
+ * @brief PRIVATE Take an idle formatter from the pool of the given registry
+ *	or create a new one, if there is none. Every export renders into its own
+ *	formatter, so concurrent scrapes share no mutable state but the metrics
+ *	themselves, whose templates are guarded by their own locks.
+ * @return \c NULL on error, an empty formatter otherwise.
+ */
+static pmf_t *
+pcr_formatter_take(pcr_t *self) {
+	pmf_t *f = NULL;
+	if (pthread_mutex_lock(&self->pool_lock) == 0) {
+		if (self->pooled > 0)
+			f = self->pool[--self->pooled];
+		pthread_mutex_unlock(&self->pool_lock);
+	}
+	if (f == NULL)
+		return pmf_new();
+	pmf_clear(f);
+	return f;
+}
+
+/**
+ * @brief PRIVATE Put the given formatter back into the pool of the given
+ *	registry, so that the next export can reuse its buffers. It gets
+ *	destroyed, if the pool is full.
+ */
+static void
+pcr_formatter_give(pcr_t *self, pmf_t *f) {
+	f->compressor = NULL;
+	f->format = PROM_FORMAT_TEXT;
+	if (pthread_mutex_lock(&self->pool_lock) == 0) {
+		if (self->pooled < PCR_FORMATTER_POOL) {
+			self->pool[self->pooled++] = f;
+			f = NULL;
+		}
+		pthread_mutex_unlock(&self->pool_lock);
+	}
+	pmf_destroy(f);
+}
+
+/**
+ * @brief PRIVATE Setup the given stream to export the given registry using
+ *	the given formatter.
+ */
+static void
+pcr_stream_init(pcr_stream_t *s, pcr_t *registry, pmf_t *formatter) {
+	memset(s, 0, sizeof(pcr_stream_t));
+	s->registry = registry;
+	s->formatter = formatter;
+	s->state = PCR_STREAM_COLLECTOR;
+}
+
+/**
+ * @brief PRIVATE Append the scrape metrics of the registry of the given
+ *	stream to its formatter.
+ */
+static void
+pcr_stream_finish(pcr_stream_t *s) {
+	pcr_t *self = s->registry;
+	bool compact = (self->features & PROM_COMPACT) ? true : false;
+
+	if (self->scrape_duration == NULL || !(self->features & PROM_SCRAPETIME))
+		return;
+	prom_gauge_set(self->scrape_duration, s->total_ns * 1e-9,
+		(const char *[]) { METRIC_LABEL_SCRAPE });
+	prom_counter_add_int(self->scrape_fragments, s->formatter->reused,
+		(const char *[]) {"reused"});
+	prom_counter_add_int(self->scrape_fragments, s->formatter->rendered,
+		(const char *[]) {"rendered"});
+	pmf_load_metric(s->formatter, self->scrape_duration, self->mprefix,
+		compact);
+	pmf_load_metric(s->formatter, self->scrape_fragments, self->mprefix,
+		compact);
+	pmf_load_metric(s->formatter, self->series_evicted, self->mprefix,
+		compact);
+}
+
+/**
+ * @brief PRIVATE Set the given key copy to a copy of the given key.
+ * @return \c 0 on success, \c 1 if out of memory.
+ */
+static int
+pcr_stream_key(char **copy, const char *key) {
+	char *k = (key == NULL) ? NULL : prom_strdup(key);
+	if (key != NULL && k == NULL)
+		return 1;
+	prom_free(*copy);
+	*copy = k;
+	return 0;
+}
+
+/**
+ * @brief PRIVATE Append the metric following the one rendered last by the
+ *	given stream to its formatter. Collectors and metrics may come and go
+ *	between two steps, so both get looked up again by name. The caller must
+ *	hold the registry lock.
+ * @return \c 0 if a metric got rendered, \c 1 if the collector is done.
+ */
+static int
+pcr_stream_metric(pcr_stream_t *s, bool compact) {
+	pcr_t *self = s->registry;
+	int done = 1;
+
+	if (s->metrics == NULL
+		|| prom_map_get(self->collectors, s->collector) != s->source
+		|| prom_map_rdlock(s->metrics))
+		return 1;
+	prom_map_node_t *node = prom_map_next(s->metrics, s->metric);
+	for (; node != NULL; node = node->after) {
+		if (pcr_stream_key(&s->metric, node->key))
+			break;
+		prom_metric_t *metric = (prom_metric_t *) node->value;
+		if (metric == NULL) {
+			PROM_WARN("Collector '%s' has no metric named '%s'.",
+				s->collector, node->key);
+			continue;
+		}
+		pmf_load_metric(s->formatter, metric, self->mprefix, compact);
+		done = 0;
+		break;
+	}
+	prom_map_unlock(s->metrics);
+	return done;
+}
+
+/**
+ * @brief PRIVATE Append the next metric of the given stream to its formatter.
+ *	Collectors get asked for their metrics as needed. After the last metric
+ *	the scrape metrics get appended. The registry gets locked for the step
+ *	only, so that a slow reader does not block registrations.
+ * @return \c 0 if something got rendered, \c 1 if the export is complete.
+ */
+static int
+pcr_stream_step(pcr_stream_t *s) {
+	pcr_t *self = s->registry;
+	bool compact = (self->features & PROM_COMPACT) ? true : false;
+	uint64_t start = now_ns();
+
+	if (s->state == PCR_STREAM_DONE)
+		return 1;
+	if (pthread_rwlock_rdlock(self->lock)) {
+		PROM_WARN(PROM_PTHREAD_RWLOCK_LOCK_ERROR, NULL);
+		return 1;
+	}
+	while (s->state != PCR_STREAM_DONE) {
+		if (s->state == PCR_STREAM_METRIC) {
+			if (pcr_stream_metric(s, compact) == 0)
+				break;
+			// all metrics of the collector done
+			if ((self->features & PROM_SCRAPETIME_ALL)
+				&& self->scrape_duration != NULL)
+			{
+				uint64_t t = now_ns();
+				s->collector_ns += t - start;
+				s->total_ns += t - start;
+				start = t;
+				prom_gauge_set(self->scrape_duration, s->collector_ns * 1e-9,
+					(const char *[]) { s->collector });
+			}
+			s->state = PCR_STREAM_COLLECTOR;
+		}
+		prom_map_node_t *node = prom_map_next(self->collectors, s->collector);
+		if (node == NULL || pcr_stream_key(&s->collector, node->key)) {
+			s->total_ns += now_ns() - start;
+			pcr_stream_finish(s);
+			pmf_load_eof(s->formatter);
+			pcz_t *z = s->formatter->compressor;
+			if (z != NULL)
+				pcz_trailer(z, s->formatter->string_builder);
+			pcr_stream_key(&s->collector, NULL);
+			pcr_stream_key(&s->metric, NULL);
+			s->state = PCR_STREAM_DONE;
+			break;
+		}
+		prom_collector_t *c = (prom_collector_t *) node->value;
+		if (c == NULL) {
+			PROM_WARN("Collector '%s' not found.", node->key);
+			continue;
+		}
+		s->collector_ns = 0;
+		s->source = c;
+		s->metrics = c->collect_fn(c);
+		pcr_stream_key(&s->metric, NULL);
+		s->state = PCR_STREAM_METRIC;
+	}
+	if (pthread_rwlock_unlock(self->lock))
+		PROM_WARN(PROM_PTHREAD_RWLOCK_UNLOCK_ERROR, NULL);
+	uint64_t t = now_ns() - start;
+	s->collector_ns += t;
+	s->total_ns += t;
+	return 0;
+}
+
 char *
 pcr_bridge(pcr_t *self) {
 	if (self == NULL)
 		return strdup("# pcr_bridge(NULL)");
 
-	struct timespec start, end;
-	static const char *labels[] = { METRIC_LABEL_SCRAPE };
-	bool scrape = (self->scrape_duration != NULL)
-		&& (self->features & PROM_SCRAPETIME);
-	bool compact = (self->features & PROM_COMPACT) ? true : false;
+	pmf_t *f = pcr_formatter_take(self);
+	if (f == NULL)
+		return NULL;
+	pcr_stream_t s;
+	pcr_stream_init(&s, self, f);
+	while (pcr_stream_step(&s) == 0)
+		;
+	size_t len;
+	char *data = pmf_detach(f, &len);
+	pcr_formatter_give(self, f);
+	// a C library block, see psb_detach()
+	return data;
+}
+
+pcr_stream_t *
+pcr_stream_new(pcr_t *self) {
+	return pcr_stream_new_encoded(self, PROM_ENCODING_IDENTITY);
+}
+
+pcr_stream_t *
+pcr_stream_new_encoded(pcr_t *self, prom_encoding_t encoding) {
+	return pcr_stream_new_format(self, PROM_FORMAT_TEXT, encoding);
+}
+
+pcr_stream_t *
+pcr_stream_new_format(pcr_t *self, prom_format_t format,
+	prom_encoding_t encoding)
+{
+	if (self == NULL || !pcr_stream_supports(encoding)
+		|| (format != PROM_FORMAT_TEXT && format != PROM_FORMAT_PROTOBUF
+			&& format != PROM_FORMAT_OPENMETRICS))
+		return NULL;
+	pcr_stream_t *s = (pcr_stream_t *) prom_malloc(sizeof(pcr_stream_t));
+	if (s == NULL)
+		return NULL;
+	pmf_t *f = pcr_formatter_take(self);
+	if (f == NULL) {
+		prom_free(s);
+		return NULL;
+	}
+	pcr_stream_init(s, self, f);
+	s->own_formatter = true;
+	f->format = format;
+	if (encoding == PROM_ENCODING_IDENTITY)
+		return s;
+	if ((f->compressor = pcz_new(encoding)) == NULL
+		|| pcz_header(f->compressor, f->string_builder))
+	{
+		pcr_stream_destroy(s);
+		return NULL;
+	}
+	return s;
+}
+
+bool
+pcr_stream_supports(prom_encoding_t encoding) {
+	if (encoding == PROM_ENCODING_IDENTITY || encoding == PROM_ENCODING_GZIP)
+		return true;
+#ifdef PROM_WITH_ZSTD
+	if (encoding == PROM_ENCODING_ZSTD)
+		return true;
+#endif
+	return false;
+}
+
+ssize_t
+pcr_stream_read(pcr_stream_t *self, char *buf, size_t max) {
+	if (self == NULL || buf == NULL)
+		return -1;
+	psb_t *sb = self->formatter->string_builder;
+	size_t n = 0;
+	while (n < max) {
+		size_t len = psb_len(sb);
+		if (self->sent < len) {
+			size_t c = len - self->sent;
+			if (c > max - n)
+				c = max - n;
+			memcpy(buf + n, psb_str(sb) + self->sent, c);
+			self->sent += c;
+			n += c;
+			continue;
+		}
+		// keep the capacity: the next metric has likely a similar size
+		psb_clear(sb);
+		self->sent = 0;
+		if (pcr_stream_step(self))
+			break;
+	}
+	return n;
+}
 
-	if (scrape)
-		clock_gettime(CLOCK_MONOTONIC, &start);
-
-	pmf_clear(self->metric_formatter);
-	pmf_load_metrics(self->metric_formatter, self->collectors,
-		 (self->features & PROM_SCRAPETIME_ALL) ? self->scrape_duration : NULL,
-		 self->mprefix, compact);
-
-	if (scrape) {
-		int r = clock_gettime(CLOCK_MONOTONIC, &end);
-		time_t s = (r == 0) ? end.tv_sec - start.tv_sec : 0;
-		long ns = (r == 0) ? end.tv_nsec - start.tv_nsec : 0;
-		double duration = s + ns*1e-9;
-		prom_gauge_set(self->scrape_duration, duration, labels);
-		pmf_load_metric(self->metric_formatter, self->scrape_duration,
-			self->mprefix, compact);
+int
+pcr_stream_destroy(pcr_stream_t *self) {
+	if (self == NULL)
+		return 0;
+	if (self->own_formatter) {
+		pcz_destroy(self->formatter->compressor);
+		pcr_formatter_give(self->registry, self->formatter);
 	}
-	return pmf_dump(self->metric_formatter);
+	prom_free(self->collector);
+	prom_free(self->metric);
+	prom_free(self);
+	return 0;
 }
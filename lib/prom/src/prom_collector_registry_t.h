@@ -20,8 +20,10 @@
 
 #include <pthread.h>
 #include <stdbool.h>
+#include <stdint.h>
 
 // Public
+#include "../include/prom_collector.h"
 #include "../include/prom_collector_registry.h"
 
 // Private
@@ -29,15 +31,45 @@
 #include "prom_metric_formatter_t.h"
 #include "../include/prom_string_builder.h"
 
+/** @brief PRIVATE Max. number of idle formatters a registry keeps. */
+#define PCR_FORMATTER_POOL 8
+
 struct pcr {
 	const char *name;				/**< name of the registry. Do not modify! */
 	const char *mprefix;			/**< prefix each metric name with this */
 	PROM_INIT_FLAGS features;		/**< enabled registry features */
 	prom_metric_t *scrape_duration;	/**< scrape duration metric to use */
+	prom_metric_t *scrape_fragments;	/**< reused/rendered fragments */
+	prom_metric_t *series_evicted;	/**< samples deleted by pcr_evict() */
 	prom_map_t *collectors;			/**< Map of collectors keyed by name */
 	psb_t *string_builder;			/**< string building */
-	pmf_t *metric_formatter;		/**< export metric(s) */
 	pthread_rwlock_t *lock;		/**< mutex to guard concurrent modfications */
+	pthread_mutex_t pool_lock;		/**< guards pool and pooled */
+	pmf_t *pool[PCR_FORMATTER_POOL];	/**< idle formatters for exports */
+	size_t pooled;					/**< number of formatters in pool */
+};
+
+/**
+ * @brief PRIVATE Where a registry export stopped rendering.
+ */
+typedef enum pcr_stream_state {
+	PCR_STREAM_COLLECTOR,	/**< next thing to do is to ask a collector */
+	PCR_STREAM_METRIC,		/**< next thing to do is to render a metric */
+	PCR_STREAM_DONE			/**< everything has been rendered */
+} pcr_stream_state_t;
+
+struct pcr_stream {
+	pcr_t *registry;			/**< the registry to export */
+	pmf_t *formatter;			/**< where the next part gets rendered */
+	bool own_formatter;			/**< if true, pool formatter with the stream */
+	pcr_stream_state_t state;	/**< what to render next */
+	char *collector;			/**< NULL or name of the current collector */
+	prom_collector_t *source;	/**< the current collector */
+	prom_map_t *metrics;		/**< metrics of the current collector */
+	char *metric;				/**< NULL or name of the last metric rendered */
+	uint64_t collector_ns;		/**< time spent on the current collector */
+	uint64_t total_ns;			/**< time spent on the export so far */
+	size_t sent;				/**< number of rendered bytes already read */
 };
 
 #endif  // PROM_REGISTRY_T_H
@@ -0,0 +1,150 @@
+/**
+ * Copyright 2021 Jens Elkner <jel+libprom@cs.uni-magdeburg.de>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <string.h>
+#include <zlib.h>
+
+// Public
+#include "../include/prom_alloc.h"
+
+// Private
+#include "prom_assert.h"
+#include "../include/prom_log.h"
+#include "prom_compress_i.h"
+
+pcz_t *
+pcz_new(prom_encoding_t encoding) {
+#ifndef PROM_WITH_ZSTD
+	if (encoding == PROM_ENCODING_ZSTD)
+		return NULL;
+#endif
+	pcz_t *self = (pcz_t *) prom_malloc(sizeof(pcz_t));
+	if (self == NULL)
+		return NULL;
+	memset(self, 0, sizeof(pcz_t));
+	self->encoding = encoding;
+	self->crc = crc32(0L, Z_NULL, 0);
+	if (encoding == PROM_ENCODING_GZIP) {
+		// raw deflate, the gzip framing gets done by pcz_{header,trailer}
+		if (deflateInit2(&self->zs, PCZ_GZIP_LEVEL, Z_DEFLATED, -15, 8,
+			Z_DEFAULT_STRATEGY) != Z_OK)
+		{
+			PROM_WARN("deflateInit2 failed: %s", self->zs.msg);
+			prom_free(self);
+			return NULL;
+		}
+		self->zs_init = true;
+	}
+#ifdef PROM_WITH_ZSTD
+	if (encoding == PROM_ENCODING_ZSTD
+		&& (self->zc = ZSTD_createCCtx()) == NULL)
+	{
+		prom_free(self);
+		return NULL;
+	}
+#endif
+	return self;
+}
+
+int
+pcz_destroy(pcz_t *self) {
+	if (self == NULL)
+		return 0;
+	if (self->zs_init)
+		deflateEnd(&self->zs);
+#ifdef PROM_WITH_ZSTD
+	ZSTD_freeCCtx(self->zc);
+#endif
+	prom_free(self);
+	return 0;
+}
+
+int
+pcz_header(pcz_t *self, psb_t *out) {
+	PROM_ASSERT(self != NULL);
+	if (self->encoding != PROM_ENCODING_GZIP)
+		return 0;
+	// magic, deflate, no flags, no mtime, fastest, OS unknown
+	static const char header[10] =
+		{ 0x1f, (char) 0x8b, 8, 0, 0, 0, 0, 0, 4, (char) 0xff };
+	return psb_add_strn(out, header, sizeof(header));
+}
+
+int
+pcz_segment(pcz_t *self, const char *in, size_t len, psb_t *out,
+	uint32_t *crc)
+{
+	PROM_ASSERT(self != NULL);
+	*crc = 0;
+	if (self->encoding == PROM_ENCODING_GZIP) {
+		*crc = crc32(0L, (const Bytef *) in, len);
+		// fresh state, so that the segment does not refer to others
+		if (deflateReset(&self->zs) != Z_OK)
+			return 1;
+		size_t max = deflateBound(&self->zs, len) + 16;
+		char *p = psb_reserve(out, max);
+		if (p == NULL)
+			return 2;
+		self->zs.next_in = (Bytef *) in;
+		self->zs.avail_in = len;
+		self->zs.next_out = (Bytef *) p;
+		self->zs.avail_out = max;
+		if (deflate(&self->zs, Z_FULL_FLUSH) != Z_OK
+			|| self->zs.avail_in != 0)
+		{
+			return 3;
+		}
+		psb_commit(out, max - self->zs.avail_out);
+		return 0;
+	}
+#ifdef PROM_WITH_ZSTD
+	if (self->encoding == PROM_ENCODING_ZSTD) {
+		size_t max = ZSTD_compressBound(len);
+		char *p = psb_reserve(out, max);
+		if (p == NULL)
+			return 2;
+		size_t n = ZSTD_compressCCtx(self->zc, p, max, in, len,
+			PCZ_ZSTD_LEVEL);
+		if (ZSTD_isError(n))
+			return 3;
+		psb_commit(out, n);
+		return 0;
+	}
+#endif
+	return psb_add_strn(out, in, len) ? 2 : 0;
+}
+
+void
+pcz_add(pcz_t *self, uint32_t crc, size_t len) {
+	PROM_ASSERT(self != NULL);
+	if (self->encoding == PROM_ENCODING_GZIP)
+		self->crc = crc32_combine(self->crc, crc, len);
+	self->len += len;
+}
+
+int
+pcz_trailer(pcz_t *self, psb_t *out) {
+	PROM_ASSERT(self != NULL);
+	if (self->encoding != PROM_ENCODING_GZIP)
+		return 0;
+	// empty fixed huffman block with BFINAL set, CRC32 and ISIZE (LE)
+	char t[10] = { 3, 0 };
+	for (int i = 0; i < 4; i++) {
+		t[2 + i] = (char) (self->crc >> (8 * i));
+		t[6 + i] = (char) (self->len >> (8 * i));
+	}
+	return psb_add_strn(out, t, sizeof(t));
+}
@@ -0,0 +1,71 @@
+/**
+ * Copyright 2021 Jens Elkner <jel+libprom@cs.uni-magdeburg.de>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef PROM_COMPRESS_I_H
+#define PROM_COMPRESS_I_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Public
+#include "../include/prom_string_builder.h"
+
+// Private
+#include "prom_compress_t.h"
+
+/**
+ * @brief PRIVATE Create a new compressor for the given encoding.
+ * @return \c NULL on error or if the encoding is not supported, the new
+ *	compressor otherwise.
+ */
+pcz_t *pcz_new(prom_encoding_t encoding);
+
+/**
+ * @brief PRIVATE Destroy the given compressor.
+ */
+int pcz_destroy(pcz_t *self);
+
+/**
+ * @brief PRIVATE Append what needs to preceed all segments to \c out .
+ * @return Non-zero integer value upon failure, \c 0 otherwise.
+ */
+int pcz_header(pcz_t *self, psb_t *out);
+
+/**
+ * @brief PRIVATE Compress the given data into a new segment, which gets
+ *	appended to \c out . The segment is not accounted, see \c pcz_add() .
+ * @param in	The data to compress.
+ * @param len	The length of the data in bytes.
+ * @param out	Where to append the segment.
+ * @param crc	Where to store the CRC32 of the data.
+ * @return Non-zero integer value upon failure, \c 0 otherwise.
+ */
+int pcz_segment(pcz_t *self, const char *in, size_t len, psb_t *out, uint32_t *crc);
+
+/**
+ * @brief PRIVATE Account a segment, which is part of the output.
+ * @param crc	The CRC32 of the segment's uncompressed data.
+ * @param len	The length of the segment's uncompressed data.
+ */
+void pcz_add(pcz_t *self, uint32_t crc, size_t len);
+
+/**
+ * @brief PRIVATE Append what needs to follow all segments to \c out .
+ * @return Non-zero integer value upon failure, \c 0 otherwise.
+ */
+int pcz_trailer(pcz_t *self, psb_t *out);
+
+#endif  // PROM_COMPRESS_I_H
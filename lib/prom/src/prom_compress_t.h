@@ -0,0 +1,55 @@
+/**
+ * Copyright 2021 Jens Elkner <jel+libprom@cs.uni-magdeburg.de>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef PROM_COMPRESS_T_H
+#define PROM_COMPRESS_T_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <zlib.h>
+#ifdef PROM_WITH_ZSTD
+#include <zstd.h>
+#endif
+
+// Public
+#include "../include/prom_collector_registry.h"
+
+/** @brief PRIVATE zlib compression level used for gzip: fastest. */
+#define PCZ_GZIP_LEVEL 1
+
+/** @brief PRIVATE zstd compression level used: fastest regular one. */
+#define PCZ_ZSTD_LEVEL 1
+
+/**
+ * @brief PRIVATE A compressor, which compresses independent segments (the
+ *	exposition of single metrics), which can be concatenated in any order.
+ *	For gzip each segment is a raw deflate stream ending with a full flush
+ *	(byte aligned, no final block), so that a gzip header, any sequence of
+ *	segments, an empty final block and the gzip trailer make a valid gzip
+ *	member. For zstd each segment is a complete frame.
+ */
+typedef struct pcz {
+	prom_encoding_t encoding;	/**< the encoding to produce */
+	z_stream zs;				/**< deflate state (gzip) */
+	bool zs_init;				/**< true if zs got initialized */
+#ifdef PROM_WITH_ZSTD
+	ZSTD_CCtx *zc;				/**< compression context (zstd) */
+#endif
+	uint32_t crc;				/**< CRC32 of all segments so far (gzip) */
+	uint64_t len;				/**< uncompressed length of all segments */
+} pcz_t;
+
+#endif  // PROM_COMPRESS_T_H
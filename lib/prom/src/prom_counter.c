@@ -15,6 +15,10 @@
  * limitations under the License.
  */
 
+#define PROM_ALLOC_SUBSYSTEM PROM_ALLOC_METRIC
+
+#include <pthread.h>
+
 // Public
 #include "../include/prom_counter.h"
 
@@ -22,12 +26,14 @@
 
 // Private
 #include "prom_assert.h"
+#include "prom_epoch_i.h"
 #include "prom_errors.h"
 #include "../include/prom_log.h"
 #include "prom_metric_i.h"
 #include "prom_metric_sample_i.h"
 #include "prom_metric_sample_t.h"
 #include "prom_metric_t.h"
+#include "prom_series_i.h"
 
 prom_counter_t *
 prom_counter_new(const char *name, const char *help, size_t label_key_count,
@@ -37,6 +43,28 @@ prom_counter_new(const char *name, const char *help, size_t label_key_count,
 		prom_metric_new(PROM_COUNTER, name, help, label_key_count, label_keys);
 }
 
+prom_counter_t *
+prom_counter_new_striped(const char *name, const char *help,
+	size_t label_key_count, const char **label_keys)
+{
+	prom_counter_t *self = (prom_counter_t *)
+		prom_metric_new(PROM_COUNTER, name, help, label_key_count, label_keys);
+	if (self != NULL)
+		self->series.stripes = pms_stripe_count();
+	return self;
+}
+
+prom_counter_t *
+prom_counter_new_int(const char *name, const char *help,
+	size_t label_key_count, const char **label_keys)
+{
+	prom_counter_t *self = (prom_counter_t *)
+		prom_metric_new(PROM_COUNTER, name, help, label_key_count, label_keys);
+	if (self != NULL)
+		self->integral = true;
+	return self;
+}
+
 int
 prom_counter_destroy(prom_counter_t *self) {
 	return (self == NULL) ? 0 : prom_metric_destroy(self);
@@ -51,8 +79,11 @@ prom_counter_inc(prom_counter_t *self, const char **label_vals) {
 			self->type, self->name);
 		return 1;
 	}
+	unsigned int guard = pep_enter();
 	pms_t *s = pms_from_labels(self, label_vals);
-	return (s == NULL) ? 1 : pms_add(s, 1.0);
+	int err = (s == NULL) ? 1 : pms_add(s, 1.0);
+	pep_leave(guard);
+	return err;
 }
 
 int
@@ -65,8 +96,46 @@ prom_counter_add(prom_counter_t *self, double r_value, const char **label_vals)
 			self->type, self->name);
 		return 1;
 	}
+	unsigned int guard = pep_enter();
 	pms_t *s = pms_from_labels(self, label_vals);
-	return (s == NULL) ? 1 : pms_add(s, r_value);
+	int err = (s == NULL) ? 1 : pms_add(s, r_value);
+	pep_leave(guard);
+	return err;
+}
+
+int
+prom_counter_add_exemplar(prom_counter_t *self, double r_value,
+	const char **label_vals, const char *exemplar)
+{
+	if (self == NULL)
+		return 1;
+	if (self->type != PROM_COUNTER) {
+		PROM_WARN(PROM_METRIC_INCORRECT_TYPE " (%d) - %s",
+			self->type, self->name);
+		return 1;
+	}
+	unsigned int guard = pep_enter();
+	pms_t *s = pms_from_labels(self, label_vals);
+	int err = (s == NULL) ? 1 : pms_add_exemplar(s, r_value, exemplar);
+	pep_leave(guard);
+	return err;
+}
+
+/**
+ * @brief PRIVATE Record the given sample of the given counter as created now.
+ *	The creation time is part of the pre-rendered exposition, so the
+ *	template needs to be rebuilt.
+ */
+static int
+renew(prom_counter_t *self, pms_t *s) {
+	if (pthread_rwlock_wrlock(&self->rwlock)) {
+		PROM_WARN(PROM_PTHREAD_RWLOCK_LOCK_ERROR, NULL);
+		return 1;
+	}
+	*pss_created(&self->series, pss_id(&self->series, s)) = pms_now();
+	self->generation++;
+	pthread_rwlock_unlock(&self->rwlock);
+	return 0;
 }
 
 int
@@ -78,6 +147,49 @@ prom_counter_reset(prom_counter_t *self, double r_value, const char **label_vals
 			self->type, self->name);
 		return 1;
 	}
+	unsigned int guard = pep_enter();
+	pms_t *s = pms_from_labels(self, label_vals);
+	int err = (s == NULL || renew(self, s))
+		? 1
+		: pms_set(s, r_value);	// pms_set handles vals < 0
+	pep_leave(guard);
+	return err;
+}
+
+int
+prom_counter_add_int(prom_counter_t *self, uint64_t i_value,
+	const char **label_vals)
+{
+	if (self == NULL)
+		return 1;
+	if (self->type != PROM_COUNTER) {
+		PROM_WARN(PROM_METRIC_INCORRECT_TYPE " (%d) - %s",
+			self->type, self->name);
+		return 1;
+	}
+	unsigned int guard = pep_enter();
+	pms_t *s = pms_from_labels(self, label_vals);
+	int err = (s == NULL) ? 1 : pms_add_int(s, i_value);
+	pep_leave(guard);
+	return err;
+}
+
+int
+prom_counter_reset_int(prom_counter_t *self, uint64_t i_value,
+	const char **label_vals)
+{
+	if (self == NULL)
+		return 1;
+	if (self->type != PROM_COUNTER) {
+		PROM_WARN(PROM_METRIC_INCORRECT_TYPE " (%d) - %s",
+			self->type, self->name);
+		return 1;
+	}
+	unsigned int guard = pep_enter();
 	pms_t *s = pms_from_labels(self, label_vals);
-	return (s == NULL) ? 1 : pms_set(s, r_value);	// pms_set handles vals < 0
+	int err = (s == NULL || renew(self, s))
+		? 1
+		: pms_set_int(s, i_value);
+	pep_leave(guard);
+	return err;
 }
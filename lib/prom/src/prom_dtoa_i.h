@@ -0,0 +1,51 @@
+/**
+ * Copyright 2021 Jens Elkner <jel+libprom@cs.uni-magdeburg.de>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef PROM_DTOA_I_H
+#define PROM_DTOA_I_H
+
+#include <stdint.h>
+
+/**
+ * @brief PRIVATE Min. size of a buffer to pass to prom_dtoa() or prom_utoa().
+ */
+#define PROM_DTOA_SIZE 32
+
+/**
+ * @brief PRIVATE Format the given value into the given buffer using the
+ *	shortest representation, which reads back as the same double. Integral
+ *	values with an absolute value < 2^53 get formatted as integers, NaN and
+ *	infinite values as \c NaN , \c +Inf , and \c -Inf . Otherwise the format
+ *	is the same as printf's \c %g would produce with enough precision, i.e.
+ *	scientific notation gets used for exponents < -4 or >= 17. The result
+ *	does not depend on the locale.
+ * @param buf	Where to store the '\0' terminated string. Must have room for
+ *	at least PROM_DTOA_SIZE bytes.
+ * @param value	The value to format.
+ * @return The length of the string stored in \c buf .
+ */
+int prom_dtoa(char *buf, double value);
+
+/**
+ * @brief PRIVATE Format the given unsigned integer into the given buffer.
+ * @param buf	Where to store the '\0' terminated string. Must have room for
+ *	at least PROM_DTOA_SIZE bytes.
+ * @param value	The value to format.
+ * @return The length of the string stored in \c buf .
+ */
+int prom_utoa(char *buf, uint64_t value);
+
+#endif  // PROM_DTOA_I_H
@@ -0,0 +1,162 @@
+/**
+ * Copyright 2021 Jens Elkner <jel+libprom@cs.uni-magdeburg.de>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#ifdef __linux__
+#include <linux/membarrier.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+// Public
+#include "../include/prom_alloc.h"
+
+// Private
+#include "prom_epoch_i.h"
+#include "prom_metric_sample_t.h"
+
+/** The epoch a thread is in, one per thread on a cache line of its own. */
+typedef struct pep_slot {
+	_Atomic uint64_t in;	/**< the epoch entered + 1, 0 if outside */
+	atomic_bool used;		/**< whether a thread owns the slot */
+	struct pep_slot *next;	/**< the next slot ever allocated */
+} pep_slot_t;
+
+/** All slots ever allocated. They get reused, but never freed. */
+static _Atomic(pep_slot_t *) slots;
+
+/** The current epoch, on a cache line of its own. */
+static _Atomic uint64_t epoch __attribute__((aligned(PROM_CACHE_LINE)));
+
+/** Sections entered per epoch parity by threads, which got no slot. */
+static atomic_uint_fast64_t unslotted[2];
+
+/** Whether pep_advance() may serialize all threads via membarrier(2). */
+static bool expedited;
+
+static __thread pep_slot_t *own;
+
+static pthread_once_t key_once = PTHREAD_ONCE_INIT;
+static pthread_key_t key;
+
+/** Hand the slot of an exiting thread over to the next new one. */
+static void
+pep_release(void *arg) {
+	pep_slot_t *s = (pep_slot_t *) arg;
+	atomic_store_explicit(&s->used, false, memory_order_release);
+}
+
+static void
+pep_init(void) {
+	pthread_key_create(&key, pep_release);
+#ifdef MEMBARRIER_CMD_PRIVATE_EXPEDITED
+	expedited = syscall(__NR_membarrier,
+		MEMBARRIER_CMD_REGISTER_PRIVATE_EXPEDITED, 0) == 0;
+#endif
+}
+
+/** Get a slot for the calling thread or NULL if out of memory. */
+static pep_slot_t *
+pep_register(void) {
+	pep_slot_t *s;
+
+	pthread_once(&key_once, pep_init);
+	for (s = atomic_load(&slots); s != NULL; s = s->next) {
+		bool unused = false;
+		if (!atomic_load_explicit(&s->used, memory_order_relaxed)
+			&& atomic_compare_exchange_strong(&s->used, &unused, true))
+			break;
+	}
+	if (s == NULL) {
+		// a whole cache line, so that no other data share it
+		s = (pep_slot_t *) prom_aligned_alloc(PROM_CACHE_LINE,
+			PROM_CACHE_LINE);
+		if (s == NULL)
+			return NULL;
+		atomic_init(&s->in, 0);
+		atomic_init(&s->used, true);
+		s->next = atomic_load(&slots);
+		while (!atomic_compare_exchange_weak(&slots, &s->next, s))
+			;
+	}
+	pthread_setspecific(key, s);
+	own = s;
+	return s;
+}
+
+unsigned int
+pep_enter(void) {
+	pep_slot_t *s = (own != NULL) ? own : pep_register();
+	uint64_t e = atomic_load_explicit(&epoch, memory_order_relaxed);
+
+	if (s == NULL) {
+		// seq_cst, so that lookups after it see removals the reclaimer missed
+		atomic_fetch_add(&unslotted[e & 1], 1);
+		return 2 | (e & 1);
+	}
+	if (atomic_load_explicit(&s->in, memory_order_relaxed) != 0)
+		return 0;
+	// A stale epoch is fine: it blocks the next advance until left.
+	atomic_store_explicit(&s->in, e + 1, memory_order_relaxed);
+	// Lookups after it must see removals the reclaimer missed. The
+	// membarrier(2) in pep_advance() makes a compiler barrier enough.
+	if (expedited)
+		atomic_signal_fence(memory_order_seq_cst);
+	else
+		atomic_thread_fence(memory_order_seq_cst);
+	return 1;
+}
+
+void
+pep_leave(unsigned int guard) {
+	if (guard == 1)
+		atomic_store_explicit(&own->in, 0, memory_order_release);
+	else if (guard != 0)
+		atomic_fetch_sub_explicit(&unslotted[guard & 1], 1,
+			memory_order_release);
+}
+
+uint64_t
+pep_epoch(void) {
+	return atomic_load(&epoch);
+}
+
+uint64_t
+pep_advance(void) {
+	pthread_once(&key_once, pep_init);
+	uint64_t e = atomic_load(&epoch);
+	// orders removals before this call before the checks below, on all
+	// threads in a section
+#ifdef MEMBARRIER_CMD_PRIVATE_EXPEDITED
+	if (expedited)
+		syscall(__NR_membarrier, MEMBARRIER_CMD_PRIVATE_EXPEDITED, 0);
+	else
+#endif
+		atomic_thread_fence(memory_order_seq_cst);
+	for (pep_slot_t *s = atomic_load(&slots); s != NULL; s = s->next) {
+		uint64_t in = atomic_load_explicit(&s->in, memory_order_acquire);
+		if (in != 0 && in != e + 1)
+			return e;
+	}
+	if (atomic_load_explicit(&unslotted[(e + 1) & 1], memory_order_acquire))
+		return e;
+	// a failed exchange means another thread advanced it meanwhile
+	if (atomic_compare_exchange_strong(&epoch, &e, e + 1))
+		e++;
+	return e;
+}
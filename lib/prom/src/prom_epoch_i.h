@@ -0,0 +1,65 @@
+/**
+ * Copyright 2021 Jens Elkner <jel+libprom@cs.uni-magdeburg.de>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef PROM_EPOCH_I_H
+#define PROM_EPOCH_I_H
+
+#include <stdint.h>
+
+/**
+ * @brief PRIVATE Number of epochs a sample removed from a metric has to age,
+ *	before it may be freed. An epoch advances only if no update entered in
+ *	the one before the current epoch is still running. The advance from the
+ *	epoch a sample got removed in may have checked that before the removal,
+ *	so the following two advances are needed to cover updates entered in
+ *	either epoch.
+ */
+#define PEP_GRACE 3
+
+/**
+ * @brief PRIVATE Enter a section, in which the calling thread may look up a
+ *	sample of a metric and update it. Samples removed from a metric after
+ *	this call do not get freed before the matching \c pep_leave() call.
+ *	Sections may be nested. Each thread announces the epoch it is in via a
+ *	plain store to a cache line of its own. Only if no slot can be allocated
+ *	for the thread, it falls back to shared counters.
+ * @return The guard to pass to \c pep_leave() .
+ */
+unsigned int pep_enter(void);
+
+/**
+ * @brief PRIVATE Leave a section entered via \c pep_enter() .
+ * @param guard	The value returned by \c pep_enter() .
+ */
+void pep_leave(unsigned int guard);
+
+/**
+ * @brief PRIVATE Get the current epoch. A sample removed from a metric gets
+ *	tagged with the epoch read after its removal and may be freed, once the
+ *	epoch is \c PEP_GRACE ahead of it.
+ */
+uint64_t pep_epoch(void);
+
+/**
+ * @brief PRIVATE Advance the epoch by one, if all updates entered in the
+ *	previous epoch have left their section. On Linux it serializes all
+ *	threads of the process via membarrier(2) first, which keeps the fence
+ *	off \c pep_enter() .
+ * @return The current epoch.
+ */
+uint64_t pep_advance(void);
+
+#endif  // PROM_EPOCH_I_H
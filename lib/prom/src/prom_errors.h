@@ -18,6 +18,7 @@
 #define PROM_STDIO_OPEN_DIR_ERROR "failed to open dir"
 #define PROM_METRIC_INCORRECT_TYPE "incorrect metric type"
 #define PROM_METRIC_INVALID_LABEL_NAME "invalid label name"
+#define PROM_PTHREAD_MUTEX_LOCK_ERROR "failed to lock the pthread_mutex_t*"
 #define PROM_PTHREAD_RWLOCK_DESTROY_ERROR "failed to destroy the pthread_rwlock_t*"
 #define PROM_PTHREAD_RWLOCK_INIT_ERROR "failed to initialize the pthread_rwlock_t*"
 #define PROM_PTHREAD_RWLOCK_LOCK_ERROR "failed to lock the pthread_rwlock_t*"
@@ -0,0 +1,110 @@
+/**
+ * Copyright 2021 Jens Elkner <jel+libprom@cs.uni-magdeburg.de>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define PROM_ALLOC_SUBSYSTEM PROM_ALLOC_SAMPLE
+
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+// Public
+#include "../include/prom_alloc.h"
+
+// Private
+#include "prom_assert.h"
+#include "prom_exemplar_i.h"
+
+/** @brief PRIVATE How often a reader retries a slot being written. */
+#define PEX_RETRIES 3
+
+pex_t *
+pex_attach(_Atomic(pex_t *) *where, size_t count) {
+	pex_t *slots = atomic_load_explicit(where, memory_order_acquire);
+	if (slots != NULL)
+		return slots;
+	pex_t *fresh = (pex_t *) prom_malloc(count * sizeof(pex_t));
+	if (fresh == NULL)
+		return NULL;
+	memset(fresh, 0, count * sizeof(pex_t));
+	if (atomic_compare_exchange_strong_explicit(where, &slots, fresh,
+		memory_order_acq_rel, memory_order_acquire))
+	{
+		return fresh;
+	}
+	// another thread won
+	prom_free(fresh);
+	return slots;
+}
+
+int
+pex_set(pex_t *self, const char *labels, double value) {
+	PROM_ASSERT(self != NULL);
+	size_t len = strlen(labels);
+	if (len > PEX_LABELS_MAX)
+		return 1;
+	// tick resolution is good enough to correlate with a trace and it is
+	// several times cheaper than a precise timestamp
+	struct timespec ts;
+	clock_gettime(CLOCK_REALTIME_COARSE, &ts);
+
+	uint32_t seq = atomic_load_explicit(&self->seq, memory_order_relaxed);
+	if ((seq & 1) || !atomic_compare_exchange_strong_explicit(&self->seq,
+		&seq, seq + 1, memory_order_acquire, memory_order_relaxed))
+	{
+		return 0;	// busy: an exemplar is a sample, dropping one is fine
+	}
+	// readers must see the odd sequence number before any new data
+	atomic_thread_fence(memory_order_release);
+	self->len = len;
+	memcpy(self->labels, labels, len);
+	atomic_store_explicit(&self->value, value, memory_order_relaxed);
+	atomic_store_explicit(&self->ts, ts.tv_sec + ts.tv_nsec * 1e-9,
+		memory_order_relaxed);
+	atomic_store_explicit(&self->seq, seq + 2, memory_order_release);
+	return 0;
+}
+
+size_t
+pex_format(pex_t *self, char *buf) {
+	PROM_ASSERT(self != NULL);
+	for (int i = 0; i < PEX_RETRIES; i++) {
+		uint32_t seq = atomic_load_explicit(&self->seq, memory_order_acquire);
+		if (seq == 0)
+			return 0;
+		if (seq & 1)
+			continue;
+		uint32_t len = self->len;
+		if (len > PEX_LABELS_MAX)
+			continue;
+		char *p = buf;
+		memcpy(p, " # {", 4);
+		p += 4;
+		memcpy(p, self->labels, len);
+		p += len;
+		*p++ = '}';
+		*p++ = ' ';
+		p += prom_dtoa(p, atomic_load_explicit(&self->value,
+			memory_order_relaxed));
+		*p++ = ' ';
+		p += prom_dtoa(p, atomic_load_explicit(&self->ts,
+			memory_order_relaxed));
+		// the copy is valid only, if no writer interfered meanwhile
+		atomic_thread_fence(memory_order_acquire);
+		if (atomic_load_explicit(&self->seq, memory_order_relaxed) == seq)
+			return p - buf;
+	}
+	return 0;
+}
@@ -0,0 +1,60 @@
+/**
+ * Copyright 2021 Jens Elkner <jel+libprom@cs.uni-magdeburg.de>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef PROM_EXEMPLAR_I_H
+#define PROM_EXEMPLAR_I_H
+
+#include <stddef.h>
+
+// Private
+#include "prom_dtoa_i.h"
+#include "prom_exemplar_t.h"
+
+/**
+ * @brief PRIVATE Max. number of bytes \c pex_format() writes.
+ */
+#define PEX_SIZE (PEX_LABELS_MAX + 2 * PROM_DTOA_SIZE + 8)
+
+/**
+ * @brief PRIVATE Get the exemplar slots stored in the given place, create
+ *	them if not yet done.
+ * @param where	Where the slots are stored.
+ * @param count	Number of slots to create.
+ * @return \c NULL on error, the slots otherwise.
+ */
+pex_t *pex_attach(_Atomic(pex_t *) *where, size_t count);
+
+/**
+ * @brief PRIVATE Replace the exemplar in the given slot. If another thread
+ *	is updating the slot right now, the exemplar gets dropped.
+ * @param self	The slot to update.
+ * @param labels	The label set of the exemplar, e.g. \c trace_id="abc" .
+ * @param value	The observed value.
+ * @return Non-zero integer value if the label set is too long, \c 0
+ *	otherwise.
+ */
+int pex_set(pex_t *self, const char *labels, double value);
+
+/**
+ * @brief PRIVATE Write the exemplar in the given slot in OpenMetrics text
+ *	format, i.e. <tt> # {labels} value timestamp</tt> .
+ * @param self	The slot to read.
+ * @param buf	Where to write it. Must have room for PEX_SIZE bytes.
+ * @return The number of bytes written, \c 0 if the slot is empty.
+ */
+size_t pex_format(pex_t *self, char *buf);
+
+#endif  // PROM_EXEMPLAR_I_H
@@ -0,0 +1,45 @@
+/**
+ * Copyright 2021 Jens Elkner <jel+libprom@cs.uni-magdeburg.de>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef PROM_EXEMPLAR_T_H
+#define PROM_EXEMPLAR_T_H
+
+#include <stdatomic.h>
+#include <stdint.h>
+
+/**
+ * @brief PRIVATE Max. length of the label set of an exemplar in its text
+ *	form, e.g. \c trace_id="4bf92f3577b34da6" . OpenMetrics limits the label
+ *	names and values to 128 characters in total.
+ */
+#define PEX_LABELS_MAX 192
+
+/**
+ * @brief PRIVATE The last exemplar of a counter sample or histogram bucket.
+ *	A slot gets written and read without locks: the sequence number is odd
+ *	while a writer updates the slot. Writers which find the slot busy drop
+ *	their exemplar, readers which find it busy or changed retry a few times
+ *	and skip it afterwards.
+ */
+typedef struct pex {
+	_Atomic uint32_t seq;		/**< 0 if empty, odd while being written */
+	uint32_t len;				/**< length of labels */
+	_Atomic double value;		/**< the observed value */
+	_Atomic double ts;			/**< when it got observed (s since epoch) */
+	char labels[PEX_LABELS_MAX];	/**< the label set, not 0-terminated */
+} pex_t;
+
+#endif  // PROM_EXEMPLAR_T_H
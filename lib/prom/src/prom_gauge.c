@@ -15,6 +15,8 @@
  * limitations under the License.
  */
 
+#define PROM_ALLOC_SUBSYSTEM PROM_ALLOC_METRIC
+
 // Public
 #include "../include/prom_gauge.h"
 
@@ -22,6 +24,7 @@
 
 // Private
 #include "prom_assert.h"
+#include "prom_epoch_i.h"
 #include "prom_errors.h"
 #include "../include/prom_log.h"
 #include "prom_metric_i.h"
@@ -51,8 +54,11 @@ prom_gauge_inc(prom_gauge_t *self, const char **label_vals) {
 			self->type, self->name);
 		return 1;
 	}
+	unsigned int guard = pep_enter();
 	pms_t *s = pms_from_labels(self, label_vals);
-	return (s == NULL) ? 1 : pms_add(s, 1.0);
+	int err = (s == NULL) ? 1 : pms_add(s, 1.0);
+	pep_leave(guard);
+	return err;
 }
 
 int
@@ -64,8 +70,11 @@ prom_gauge_dec(prom_gauge_t *self, const char **label_vals) {
 			self->type, self->name);
 		return 1;
 	}
+	unsigned int guard = pep_enter();
 	pms_t *s = pms_from_labels(self, label_vals);
-	return (s == NULL) ? 1 : pms_sub(s, 1.0);
+	int err = (s == NULL) ? 1 : pms_sub(s, 1.0);
+	pep_leave(guard);
+	return err;
 }
 
 int
@@ -77,8 +86,11 @@ prom_gauge_add(prom_gauge_t *self, double r_value, const char **label_vals) {
 			self->type, self->name);
 		return 1;
 	}
+	unsigned int guard = pep_enter();
 	pms_t *s = pms_from_labels(self, label_vals);
-	return (s == NULL) ? 1 : pms_add(s, r_value);
+	int err = (s == NULL) ? 1 : pms_add(s, r_value);
+	pep_leave(guard);
+	return err;
 }
 
 int
@@ -90,8 +102,11 @@ prom_gauge_sub(prom_gauge_t *self, double r_value, const char **label_vals) {
 			self->type, self->name);
 		return 1;
 	}
+	unsigned int guard = pep_enter();
 	pms_t *s = pms_from_labels(self, label_vals);
-	return (s == NULL) ? 1 : pms_sub(s, r_value);
+	int err = (s == NULL) ? 1 : pms_sub(s, r_value);
+	pep_leave(guard);
+	return err;
 }
 
 int
@@ -103,7 +118,10 @@ prom_gauge_set(prom_gauge_t *self, double r_value, const char **label_vals) {
 			self->type, self->name);
 		return 1;
 	}
+	unsigned int guard = pep_enter();
 	pms_t *s = pms_from_labels(self, label_vals);
-	return (s == NULL) ? 1 : pms_set(s, r_value);
+	int err = (s == NULL) ? 1 : pms_set(s, r_value);
+	pep_leave(guard);
+	return err;
 }
 
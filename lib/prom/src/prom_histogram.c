@@ -15,6 +15,10 @@
  * limitations under the License.
  */
 
+#define PROM_ALLOC_SUBSYSTEM PROM_ALLOC_METRIC
+
+#include <string.h>
+
 // Public
 #include "../include/prom_histogram.h"
 
@@ -23,6 +27,7 @@
 
 // Private
 #include "prom_assert.h"
+#include "prom_epoch_i.h"
 #include "prom_errors.h"
 #include "../include/prom_log.h"
 #include "prom_map_i.h"
@@ -57,6 +62,33 @@ prom_histogram_new(const char *name, const char *help, phb_t *buckets,
 	return self;
 }
 
+prom_histogram_t *
+prom_histogram_new_native(const char *name, const char *help, int schema,
+	unsigned int max_buckets, size_t label_key_count, const char **label_keys)
+{
+	if (schema < PROM_NATIVE_SCHEMA_MIN || schema > PROM_NATIVE_SCHEMA_MAX) {
+		PROM_WARN("schema must be in [%d, %d]", PROM_NATIVE_SCHEMA_MIN,
+			PROM_NATIVE_SCHEMA_MAX);
+		return NULL;
+	}
+	prom_histogram_t *self = (prom_histogram_t *)
+		prom_metric_new(PROM_HISTOGRAM,name, help, label_key_count, label_keys);
+	if (self == NULL)
+		return NULL;
+	// no classic buckets, i.e. just +Inf
+	self->buckets = (phb_t *) prom_malloc(sizeof(phb_t));
+	if (self->buckets == NULL) {
+		prom_metric_destroy(self);
+		return NULL;
+	}
+	memset(self->buckets, 0, sizeof(phb_t));
+	self->native_schema = schema;
+	self->native_max_buckets = (max_buckets == 0)
+		? PROM_NATIVE_MAX_BUCKETS
+		: max_buckets;
+	return self;
+}
+
 int
 prom_histogram_destroy(prom_histogram_t *self) {
 	return (self == NULL) ? 0 : prom_metric_destroy(self);
@@ -73,6 +105,45 @@ prom_histogram_observe(prom_histogram_t *self, double val,
 			self->type, self->name);
 		return 1;
 	}
+	unsigned int guard = pep_enter();
+	pms_histogram_t *s = pms_histogram_from_labels(self, label_vals);
+	int err = (s == NULL) ? 1 : pms_histogram_observe(s, val);
+	pep_leave(guard);
+	return err;
+}
+
+int
+prom_histogram_observe_exemplar(prom_histogram_t *self, double val,
+	const char **label_vals, const char *exemplar)
+{
+	if (self == NULL)
+		return 1;
+	if (self->type != PROM_HISTOGRAM) {
+		PROM_WARN(PROM_METRIC_INCORRECT_TYPE " (%d) - %s",
+			self->type, self->name);
+		return 1;
+	}
+	unsigned int guard = pep_enter();
+	pms_histogram_t *s = pms_histogram_from_labels(self, label_vals);
+	int err = (s == NULL) ? 1 : pms_histogram_observe_exemplar(s, val, exemplar);
+	pep_leave(guard);
+	return err;
+}
+
+int
+prom_histogram_observe_many(prom_histogram_t *self, const double *vals,
+	size_t count, const char **label_vals)
+{
+	if (self == NULL || (vals == NULL && count > 0))
+		return 1;
+	if (self->type != PROM_HISTOGRAM) {
+		PROM_WARN(PROM_METRIC_INCORRECT_TYPE " (%d) - %s",
+			self->type, self->name);
+		return 1;
+	}
+	unsigned int guard = pep_enter();
 	pms_histogram_t *s = pms_histogram_from_labels(self, label_vals);
-	return (s == NULL) ? 1 : pms_histogram_observe(s, val);
+	int err = (s == NULL) ? 1 : pms_histogram_observe_many(s, vals, count);
+	pep_leave(guard);
+	return err;
 }
@@ -15,8 +15,11 @@
  * limitations under the License.
  */
 
+#define PROM_ALLOC_SUBSYSTEM PROM_ALLOC_METRIC
+
 #include <stdarg.h>
 #include <stdlib.h>
+#include <string.h>
 
 // Public
 #include "../include/prom_alloc.h"
@@ -24,18 +27,20 @@
 
 // Private
 #include "prom_assert.h"
+#include "prom_dtoa_i.h"
 #include "../include/prom_log.h"
 
 phb_t *prom_histogram_default_buckets = NULL;
 
 static char *
 double_to_str(double value) {
-	char buf[32];
-	int len = sprintf(buf, "%.17g", value);
-	if (!strchr(buf, '.') && len < 30) {
+	char buf[PROM_DTOA_SIZE + 2];
+	int len = prom_dtoa(buf, value);
+	// plain integers get a ".0" suffix, so that keys always look like floats
+	if (strspn(buf + (buf[0] == '-'), "0123456789") == len - (buf[0] == '-')) {
 		buf[len] = '.'; buf[len+1] = '0'; len += 2; buf[len] = '\0';
 	}
-	return strdup(buf);
+	return prom_strdup(buf);
 }
 
 phb_t *
@@ -145,7 +150,7 @@ phb_destroy(phb_t *self) {
 	if (self == NULL)
 		return 0;
 	for (int i=0; i < self->count; i++)
-		free((char *) self->key[i]);
+		prom_free((char *) self->key[i]);
 	prom_free((double *) self->upper_bound);
 	prom_free((char **) self->key);
 	prom_free(self);
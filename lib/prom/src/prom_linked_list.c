@@ -15,6 +15,8 @@
  * limitations under the License.
  */
 
+#define PROM_ALLOC_SUBSYSTEM PROM_ALLOC_LIST
+
 // Public
 #include "../include/prom_alloc.h"
 
@@ -23,10 +25,11 @@
 #include "prom_linked_list_i.h"
 #include "prom_linked_list_t.h"
 #include "../include/prom_log.h"
+#include "prom_slab_i.h"
 
 pll_t *
 pll_new(void) {
-	pll_t *self = (pll_t *) prom_malloc(sizeof(pll_t));
+	pll_t *self = (pll_t *) psl_alloc(PSL_LIST);
 	if (self == NULL)
 		return NULL;
 	self->head = NULL;
@@ -52,7 +55,7 @@ pll_purge(pll_t *self) {
 				prom_free(node->item);
 			}
 		}
-		prom_free(node);
+		psl_free(PSL_LIST_NODE, node);
 		node = NULL;
 		node = next;
 	}
@@ -66,7 +69,7 @@ int
 pll_destroy(pll_t *self) {
 	PROM_ASSERT(self != NULL);
 	pll_purge(self);
-	prom_free(self);
+	psl_free(PSL_LIST, self);
 	return 0;
 }
 
@@ -86,7 +89,7 @@ int
 pll_append(pll_t *self, void *item) {
 	if (self == NULL)
 		return 1;
-	pll_node_t *node = (pll_node_t *) prom_malloc(sizeof(pll_node_t));
+	pll_node_t *node = (pll_node_t *) psl_alloc(PSL_LIST_NODE);
 	if (node == NULL)
 		return 2;
 
@@ -106,7 +109,7 @@ int
 pll_push(pll_t *self, void *item) {
 	if (self == NULL)
 		return 1;
-	pll_node_t *node = (pll_node_t *) prom_malloc(sizeof(pll_node_t));
+	pll_node_t *node = (pll_node_t *) psl_alloc(PSL_LIST_NODE);
 	if (node == NULL)
 		return 2;
 
@@ -139,6 +142,7 @@ pll_pop(pll_t *self) {
 		}
 	}
 	node->item = NULL;
+	psl_free(PSL_LIST_NODE, node);
 	node = NULL;
 	self->size--;
 	return item;
@@ -182,7 +186,7 @@ pll_remove(pll_t *self, void *item) {
 	}
 
 	node->item = NULL;
-	prom_free(node);
+	psl_free(PSL_LIST_NODE, node);
 	node = NULL;
 	self->size--;
 	return 0;
@@ -21,6 +21,11 @@
 
 prom_map_t *prom_map_new(void);
 
+/**
+ * @brief PRIVATE FNV-1a hash of the given key.
+ */
+size_t prom_map_hash(const char *key);
+
 int prom_map_set_free_value_fn(prom_map_t *self, prom_map_node_free_value_fn free_value_fn);
 
 void *prom_map_get(prom_map_t *self, const char *key);
@@ -29,10 +34,30 @@ int prom_map_set(prom_map_t *self, const char *key, void *value);
 
 int prom_map_delete(prom_map_t *self, const char *key);
 
+/**
+ * @brief PRIVATE Lock the given map for reading: its nodes and their values
+ *	stay as they are until \c prom_map_unlock() gets called.
+ * @return \c 0 on success, \c 1 otherwise.
+ */
+int prom_map_rdlock(prom_map_t *self);
+
+/**
+ * @brief PRIVATE Release the lock taken via \c prom_map_rdlock() .
+ */
+void prom_map_unlock(prom_map_t *self);
+
+/**
+ * @brief PRIVATE Get the node following the one with the given key in
+ *	insertion order, so that an iteration can be resumed after the map got
+ *	unlocked. The caller must hold a lock, which keeps the map unchanged.
+ * @param key	\c NULL to get the first node.
+ * @return \c NULL if the key is the last one or not in the map anymore, the
+ *	next node otherwise.
+ */
+prom_map_node_t *prom_map_next(prom_map_t *self, const char *key);
+
 int prom_map_destroy(prom_map_t *self);
 
 size_t prom_map_size(prom_map_t *self);
 
-prom_map_node_t *prom_map_node_new(const char *key, void *value, prom_map_node_free_value_fn free_value_fn);
-
 #endif  // PROM_MAP_I_INCLUDED
@@ -19,27 +19,28 @@
 #define PROM_MAP_T_H
 
 #include <pthread.h>
+#include <stdbool.h>
 
 // Public
 #include "../include/prom_map.h"
 
-// Private
-#include "prom_linked_list_t.h"
-
 typedef void (*prom_map_node_free_value_fn) (void *);
 
 struct prom_map_node {
 	const char *key;
 	void *value;
-	prom_map_node_free_value_fn free_value_fn;
+	struct prom_map_node *next;	/**< next node in the same bucket */
+	struct prom_map_node *before;	/**< previous node in insertion order */
+	struct prom_map_node *after;	/**< next node in insertion order */
 };
 
 struct prom_map {
 	size_t size;		/**< contains the size of the map */
-	size_t max_size;	/**< stores the current max_size */
-	pll_t *keys;		/**< linked list containing all keys present */
-	pll_t **addrs;		/**< Sequence of linked lists. Each list contains nodes with the same index */
-	pthread_rwlock_t *rwlock;
+	size_t max_size;	/**< number of buckets, a power of 2 */
+	prom_map_node_t *head;	/**< first node in insertion order */
+	prom_map_node_t *tail;	/**< last node in insertion order */
+	prom_map_node_t **addrs;	/**< NULL or max_size bucket chains */
+	pthread_rwlock_t rwlock;
 	prom_map_node_free_value_fn free_value_fn;
 };
 
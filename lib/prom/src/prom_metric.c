@@ -15,7 +15,11 @@
  * limitations under the License.
  */
 
+#define PROM_ALLOC_SUBSYSTEM PROM_ALLOC_METRIC
+
 #include <pthread.h>
+#include <stdatomic.h>
+#include <string.h>
 
 // Public
 #include "../include/prom_alloc.h"
@@ -23,17 +27,42 @@
 
 // Private
 #include "prom_assert.h"
+#include "prom_epoch_i.h"
 #include "prom_errors.h"
+#include "prom_linked_list_i.h"
 #include "../include/prom_log.h"
-#include "prom_map_i.h"
 #include "prom_metric_formatter_i.h"
 #include "prom_metric_i.h"
 #include "prom_metric_sample_histogram_i.h"
 #include "prom_metric_sample_i.h"
+#include "prom_metric_sample_summary_i.h"
+#include "prom_metric_template_i.h"
+#include "prom_series_i.h"
+
+/**
+ * @brief PRIVATE Size of the stack buffer sample l_values get formatted into.
+ *	Longer ones go to the heap.
+ */
+#define PROM_METRIC_L_VALUE_SIZE 256
 
 const char *prom_metric_type_map[5] =
 	{ "counter", "gauge", "histogram", "summary", "untyped" };
 
+/**
+ * @brief PRIVATE Get the function to free the sample objects of the given
+ *	metric with.
+ * @return \c NULL if its series have no sample object, the function
+ *	otherwise.
+ */
+static pll_free_item_fn
+prom_metric_free_fn(prom_metric_t *self) {
+	if (self->type == PROM_HISTOGRAM)
+		return &pms_histogram_free_generic;
+	if (self->type == PROM_SUMMARY)
+		return &pms_summary_free_generic;
+	return NULL;
+}
+
 prom_metric_t *
 prom_metric_new(prom_metric_type_t metric_type, const char *name,
 	const char *help, size_t label_key_count, const char **label_keys)
@@ -44,12 +73,34 @@ prom_metric_new(prom_metric_type_t metric_type, const char *name,
 	self->type = metric_type;
 	self->name = name;
 	self->help = help;
+	self->unit = NULL;
 	self->buckets = NULL;
-	self->formatter = NULL;
+	self->integral = false;
+	self->native_schema = 0;
+	self->native_max_buckets = 0;
+	self->quantiles = NULL;
+	self->quantile_count = 0;
+	self->max_age = 0;
+	atomic_init(&self->unlabeled, NULL);
+	self->generation = 0;
+	self->ttl = 0;
+	self->retired = NULL;
+	self->tmpl = NULL;
+	atomic_init(&self->dirty, true);
+	pss_init(&self->series);
+	self->label_keys = NULL;
+	self->label_key_count = 0;
+	if (pthread_rwlock_init(&self->rwlock, NULL) != 0) {
+		PROM_WARN(PROM_PTHREAD_RWLOCK_INIT_ERROR, NULL);
+		prom_free(self);
+		return NULL;
+	}
 
 	const char **k = (const char **)
 		prom_malloc(sizeof(const char *) * label_key_count);
-
+	if (k == NULL && label_key_count > 0)
+		goto fail;
+	self->label_keys = k;
 	for (int i = 0; i < label_key_count; i++) {
 		if (strcmp(label_keys[i], "le") == 0) {
 			PROM_WARN(PROM_METRIC_INVALID_LABEL_NAME "(%s)", "le");
@@ -59,30 +110,12 @@ prom_metric_new(prom_metric_type_t metric_type, const char *name,
 			PROM_WARN(PROM_METRIC_INVALID_LABEL_NAME "(%s)", "quantile");
 			goto fail;
 		}
-		k[i] = prom_strdup(label_keys[i]);
-	}
-	self->label_keys = k;
-	self->label_key_count = label_key_count;
-	self->samples = prom_map_new();
-
-	if (metric_type == PROM_HISTOGRAM) {
-		if (prom_map_set_free_value_fn(self->samples,
-			&pms_histogram_free_generic))
-		{
+		if ((k[i] = prom_strdup(label_keys[i])) == NULL)
 			goto fail;
-		}
-	} else if (prom_map_set_free_value_fn(self->samples, &pms_free_generic)) {
-		goto fail;
+		self->label_key_count = i + 1;
 	}
-
-	if ((self->formatter = pmf_new()) == NULL)
+	if ((self->tmpl = pmt_new()) == NULL)
 		goto fail;
-
-	self->rwlock = (pthread_rwlock_t *) prom_malloc(sizeof(pthread_rwlock_t));
-	if (self->rwlock == NULL || pthread_rwlock_init(self->rwlock, NULL) != 0) {
-		PROM_WARN(PROM_PTHREAD_RWLOCK_INIT_ERROR, NULL);
-		return NULL;
-	}
 	return self;
 
 fail:
@@ -95,21 +128,29 @@ prom_metric_destroy(prom_metric_t *self) {
 	if (self == NULL)
 		return 0;
 
+	// histogram samples refer to the buckets
+	pll_destroy(self->retired);
+	self->retired = NULL;
+	pll_free_item_fn free_fn = prom_metric_free_fn(self);
+	for (size_t id = 0; free_fn != NULL && id < self->series.count; id++) {
+		void *sample = pss_sample(&self->series, id);
+		if (sample != NULL)
+			free_fn(sample);
+	}
+	pss_destroy(&self->series);
+
 	phb_destroy(self->buckets);
 	self->buckets = NULL;
 
-	prom_map_destroy(self->samples);
-	self->samples = NULL;
+	prom_free((double *) self->quantiles);
+	self->quantiles = NULL;
 
-	pmf_destroy(self->formatter);
-	self->formatter = NULL;
+	pmt_destroy(self->tmpl);
+	self->tmpl = NULL;
 
-	if (pthread_rwlock_destroy(self->rwlock))
+	if (pthread_rwlock_destroy(&self->rwlock))
 		PROM_WARN(PROM_PTHREAD_RWLOCK_DESTROY_ERROR, NULL);
 
-	prom_free(self->rwlock);
-	self->rwlock = NULL;
-
 	for (int i = 0; i < self->label_key_count; i++) {
 		prom_free((void *) self->label_keys[i]);
 		self->label_keys[i] = NULL;
@@ -117,6 +158,9 @@ prom_metric_destroy(prom_metric_t *self) {
 	prom_free(self->label_keys);
 	self->label_keys = NULL;
 
+	prom_free(self->unit);
+	self->unit = NULL;
+
 	prom_free(self);
 	return 0;
 }
@@ -131,80 +175,337 @@ prom_metric_free_generic(void *item) {
 	prom_metric_destroy((prom_metric_t *) item);
 }
 
+/**
+ * @brief PRIVATE Formats the l_value of the sample with the given label values
+ *	into buf, or into a buffer allocated via prom_malloc() if it does not fit.
+ * @return NULL on error, buf or the allocated buffer otherwise.
+ */
+static char *
+prom_metric_l_value(prom_metric_t *self, const char **label_values,
+	char *buf, size_t size)
+{
+	size_t len = pmf_l_value(buf, size, self->name, NULL,
+		self->label_key_count, self->label_keys, label_values);
+	if (len < size)
+		return buf;
+	return pmf_l_value_dup(self->name, NULL, self->label_key_count,
+		self->label_keys, label_values);
+}
+
+/**
+ * @brief PRIVATE Make the given sample the one of the new series with the
+ *	given id. The caller must hold the write lock of the metric.
+ */
+static void
+prom_metric_add_sample(prom_metric_t *self, size_t id, void *sample) {
+	*pss_created(&self->series, id) = pms_now();
+	atomic_store(&pss_slot(&self->series, id)->ref, sample);
+	self->generation++;
+}
+
 pms_t *
 pms_from_labels(prom_metric_t *self, const char **label_values) {
 	PROM_ASSERT(self != NULL);
-	if (pthread_rwlock_wrlock(self->rwlock)) {
-		PROM_WARN(PROM_PTHREAD_RWLOCK_LOCK_ERROR, NULL);
+	// A metric without labels has at most one sample: once created, it
+	// never changes, so skip the lock, l_value formatting and index lookup.
+	pms_t *sample = (pms_t *) atomic_load(&self->unlabeled);
+	if (sample != NULL)
+		return sample;
+
+	char buf[PROM_METRIC_L_VALUE_SIZE];
+	char *l_value = prom_metric_l_value(self, label_values, buf, sizeof(buf));
+	if (l_value == NULL)
 		return NULL;
-	}
 
-	// Get l_value
-	if (pmf_load_l_value(self->formatter, self->name, NULL,
-		self->label_key_count, self->label_keys, label_values))
-	{
-		goto fail;
+	if (pthread_rwlock_wrlock(&self->rwlock)) {
+		PROM_WARN(PROM_PTHREAD_RWLOCK_LOCK_ERROR, NULL);
+		goto end;
+	}
+	// counters and gauges keep their series in the store only
+	size_t id;
+	if (pss_find(&self->series, l_value, &id) == 0) {
+		sample = pss_slot(&self->series, id);
+	} else if (pss_add(&self->series, l_value, &id) == 0) {
+		sample = pss_slot(&self->series, id);
+		prom_metric_add_sample(self, id, self);
 	}
+	if (sample != NULL && self->label_key_count == 0)
+		atomic_store(&self->unlabeled, sample);
+	if (pthread_rwlock_unlock(&self->rwlock))
+		PROM_WARN(PROM_PTHREAD_RWLOCK_UNLOCK_ERROR, NULL);
 
-	// This must be freed before returning
-	const char *l_value = pmf_dump(self->formatter);
+end:
+	if (l_value != buf)
+		prom_free(l_value);
+	return sample;
+}
+
+pms_histogram_t *
+pms_histogram_from_labels(prom_metric_t *self, const char **label_values) {
+	PROM_ASSERT(self != NULL);
+	pms_histogram_t *sample = (pms_histogram_t *) atomic_load(&self->unlabeled);
+	if (sample != NULL)
+		return sample;
+
+	char buf[PROM_METRIC_L_VALUE_SIZE];
+	char *l_value = prom_metric_l_value(self, label_values, buf, sizeof(buf));
 	if (l_value == NULL)
-		goto fail;
+		return NULL;
 
-	// Get sample
-	pms_t *sample = (pms_t *) prom_map_get(self->samples, l_value);
-	if (sample == NULL) {
-		sample = pms_new(self->type, l_value, 0.0);
-		if (prom_map_set(self->samples, l_value, sample))
-			goto fail;
+	if (pthread_rwlock_wrlock(&self->rwlock)) {
+		PROM_WARN(PROM_PTHREAD_RWLOCK_LOCK_ERROR, NULL);
+		goto end;
 	}
-	pthread_rwlock_unlock(self->rwlock);
-	prom_free((void *) l_value);
+	size_t id;
+	if (pss_find(&self->series, l_value, &id) == 0) {
+		sample = (pms_histogram_t *) pss_sample(&self->series, id);
+	} else if (pss_add(&self->series, l_value, &id) == 0) {
+		sample = pms_histogram_new(self->name, self->buckets,
+			self->label_key_count, self->label_keys, label_values);
+		if (sample != NULL && self->native_max_buckets > 0
+			&& pms_histogram_native(sample, self->native_schema,
+				self->native_max_buckets))
+		{
+			pms_histogram_destroy(sample);
+			sample = NULL;
+		}
+		if (sample != NULL) {
+			sample->id = id;
+			sample->dirty = &self->dirty;
+			prom_metric_add_sample(self, id, sample);
+		} else {
+			pss_unlink(&self->series, id);
+			pss_remove(&self->series, id);
+		}
+	}
+	if (sample != NULL && self->label_key_count == 0)
+		atomic_store(&self->unlabeled, sample);
+	if (pthread_rwlock_unlock(&self->rwlock))
+		PROM_WARN(PROM_PTHREAD_RWLOCK_UNLOCK_ERROR, NULL);
+
+end:
+	if (l_value != buf)
+		prom_free(l_value);
 	return sample;
+}
 
-fail:
-	if (pthread_rwlock_unlock(self->rwlock))
+pms_summary_t *
+pms_summary_from_labels(prom_metric_t *self, const char **label_values) {
+	PROM_ASSERT(self != NULL);
+	pms_summary_t *sample = (pms_summary_t *) atomic_load(&self->unlabeled);
+	if (sample != NULL)
+		return sample;
+
+	char buf[PROM_METRIC_L_VALUE_SIZE];
+	char *l_value = prom_metric_l_value(self, label_values, buf, sizeof(buf));
+	if (l_value == NULL)
+		return NULL;
+
+	if (pthread_rwlock_wrlock(&self->rwlock)) {
+		PROM_WARN(PROM_PTHREAD_RWLOCK_LOCK_ERROR, NULL);
+		goto end;
+	}
+	size_t id;
+	if (pss_find(&self->series, l_value, &id) == 0) {
+		sample = (pms_summary_t *) pss_sample(&self->series, id);
+	} else if (pss_add(&self->series, l_value, &id) == 0) {
+		sample = pms_summary_new(self->name, self->quantile_count,
+			self->quantiles, self->max_age, self->label_key_count,
+			self->label_keys, label_values);
+		if (sample != NULL) {
+			sample->id = id;
+			prom_metric_add_sample(self, id, sample);
+		} else {
+			pss_unlink(&self->series, id);
+			pss_remove(&self->series, id);
+		}
+	}
+	if (sample != NULL && self->label_key_count == 0)
+		atomic_store(&self->unlabeled, sample);
+	if (pthread_rwlock_unlock(&self->rwlock))
 		PROM_WARN(PROM_PTHREAD_RWLOCK_UNLOCK_ERROR, NULL);
-	return NULL;
+
+end:
+	if (l_value != buf)
+		prom_free(l_value);
+	return sample;
 }
 
-pms_histogram_t *
-pms_histogram_from_labels(prom_metric_t *self, const char **label_values) {
-	PROM_ASSERT(self != NULL);
-	if (pthread_rwlock_wrlock(self->rwlock)) {
+int
+prom_metric_set_unit(prom_metric_t *self, const char *unit) {
+	if (self == NULL)
+		return 1;
+	char *u = NULL;
+	if (unit != NULL) {
+		size_t nlen = strlen(self->name), ulen = strlen(unit);
+		if (self->type == PROM_COUNTER && nlen > 6
+			&& strcmp(self->name + nlen - 6, "_total") == 0)
+		{
+			nlen -= 6;
+		}
+		if (ulen == 0 || nlen <= ulen + 1 || self->name[nlen - ulen - 1] != '_'
+			|| strncmp(self->name + nlen - ulen, unit, ulen) != 0)
+		{
+			PROM_WARN("Name of metric '%s' does not end with unit '%s'",
+				self->name, unit);
+			return 1;
+		}
+		if ((u = prom_strdup(unit)) == NULL)
+			return 2;
+	}
+	if (pthread_rwlock_wrlock(&self->rwlock)) {
 		PROM_WARN(PROM_PTHREAD_RWLOCK_LOCK_ERROR, NULL);
-		return NULL;
+		prom_free(u);
+		return 3;
 	}
+	prom_free(self->unit);
+	self->unit = u;
+	self->generation++;		// the unit is part of the template
+	pthread_rwlock_unlock(&self->rwlock);
+	return 0;
+}
 
-	// Load the l_value
-	if (pmf_load_l_value(self->formatter, self->name, NULL,
-		self->label_key_count, self->label_keys, label_values))
-	{
-		goto fail;
+/**
+ * @brief PRIVATE Get the id of the series of the given retired item of the
+ *	given metric.
+ */
+static size_t
+prom_metric_retired_id(prom_metric_t *self, void *item) {
+	if (self->type == PROM_HISTOGRAM)
+		return ((pms_histogram_t *) item)->id;
+	if (self->type == PROM_SUMMARY)
+		return ((pms_summary_t *) item)->id;
+	return (uintptr_t) item - 1;
+}
+
+/**
+ * @brief PRIVATE Check, whether the series with the given id of the given
+ *	metric has not been updated for \c ttl eviction passes in a row, and
+ *	start a new pass. The caller must hold the write lock of the metric.
+ */
+static bool
+prom_metric_sample_expired(prom_metric_t *self, size_t id, void *sample) {
+	atomic_bool *touched;
+	if (self->type == PROM_HISTOGRAM)
+		touched = &((pms_histogram_t *) sample)->touched;
+	else if (self->type == PROM_SUMMARY)
+		touched = &((pms_summary_t *) sample)->touched;
+	else
+		touched = pss_touched(&self->series, id);
+	uint16_t *idle = pss_idle(&self->series, id);
+	if (atomic_load_explicit(touched, memory_order_relaxed)) {
+		atomic_store_explicit(touched, false, memory_order_relaxed);
+		*idle = 0;
+		return false;
 	}
+	return ++(*idle) >= self->ttl;
+}
 
-	// This must be freed before returning
-	const char *l_value = pmf_dump(self->formatter);
+/**
+ * @brief PRIVATE Remove the series with the given id and sample from the
+ *	given metric. Updates, which looked it up before, may still use its
+ *	sample and slots, so both get released by an eviction pass only, after
+ *	the epoch advanced \c PEP_GRACE times. Until then the idle counter of
+ *	the series holds the epoch it got removed in. The caller must hold the
+ *	write lock of the metric.
+ */
+static int
+prom_metric_retire(prom_metric_t *self, size_t id, void *sample) {
+	if (self->retired == NULL) {
+		if ((self->retired = pll_new()) == NULL)
+			return 1;
+		pll_free_item_fn free_fn = prom_metric_free_fn(self);
+		pll_set_free_fn(self->retired,
+			(free_fn == NULL) ? &pll_no_op_free : free_fn);
+	}
+	// counters and gauges have no sample object, so keep their id
+	void *item = (self->type == PROM_HISTOGRAM || self->type == PROM_SUMMARY)
+		? sample
+		: (void *) (uintptr_t) (id + 1);
+	if (pll_append(self->retired, item))
+		return 2;
+	pss_unlink(&self->series, id);
+	pms_t *slot = pss_slot(&self->series, id);
+	atomic_store(&slot->ref, NULL);
+	void *unlabeled = atomic_load(&self->unlabeled);
+	if (unlabeled == sample || unlabeled == slot)
+		atomic_store(&self->unlabeled, NULL);
+	*pss_idle(&self->series, id) = (uint16_t) pep_epoch();
+	self->generation++;
+	return 0;
+}
+
+int
+prom_metric_delete(prom_metric_t *self, const char **label_values) {
+	if (self == NULL)
+		return 1;
+
+	char buf[PROM_METRIC_L_VALUE_SIZE];
+	char *l_value = prom_metric_l_value(self, label_values, buf, sizeof(buf));
 	if (l_value == NULL)
-		goto fail;
+		return 2;
 
-	// Get sample
-	pms_histogram_t *sample = (pms_histogram_t *)
-		prom_map_get(self->samples, l_value);
-	if (sample == NULL) {
-		sample = pms_histogram_new(self->name, self->buckets,
-			self->label_key_count, self->label_keys, label_values);
-		if (sample == NULL || prom_map_set(self->samples, l_value, sample)) {
-			prom_free((void *) l_value);
-			goto fail;
-		}
+	int err = 3;
+	if (pthread_rwlock_wrlock(&self->rwlock)) {
+		PROM_WARN(PROM_PTHREAD_RWLOCK_LOCK_ERROR, NULL);
+		goto end;
 	}
-	pthread_rwlock_unlock(self->rwlock);
-	prom_free((void *) l_value);
-	return sample;
+	size_t id;
+	if (pss_find(&self->series, l_value, &id) == 0)
+		err = prom_metric_retire(self, id, pss_sample(&self->series, id));
+	if (pthread_rwlock_unlock(&self->rwlock))
+		PROM_WARN(PROM_PTHREAD_RWLOCK_UNLOCK_ERROR, NULL);
 
-fail:
-	if (pthread_rwlock_unlock(self->rwlock))
+end:
+	if (l_value != buf)
+		prom_free(l_value);
+	return err;
+}
+
+int
+prom_metric_set_ttl(prom_metric_t *self, unsigned int intervals) {
+	if (self == NULL || intervals > UINT16_MAX)
+		return 1;
+	if (pthread_rwlock_wrlock(&self->rwlock)) {
+		PROM_WARN(PROM_PTHREAD_RWLOCK_LOCK_ERROR, NULL);
+		return 2;
+	}
+	self->ttl = intervals;
+	pthread_rwlock_unlock(&self->rwlock);
+	return 0;
+}
+
+size_t
+prom_metric_evict(prom_metric_t *self) {
+	if (self == NULL)
+		return 0;
+	if (pthread_rwlock_wrlock(&self->rwlock)) {
+		PROM_WARN(PROM_PTHREAD_RWLOCK_LOCK_ERROR, NULL);
+		return 0;
+	}
+	size_t evicted = 0;
+	for (size_t id = 0; self->ttl > 0 && id < self->series.count; id++) {
+		void *sample = pss_sample(&self->series, id);
+		if (sample != NULL && prom_metric_sample_expired(self, id, sample)
+			&& prom_metric_retire(self, id, sample) == 0)
+		{
+			evicted++;
+		}
+	}
+	// Series got retired in epoch order. The epoch wraps in the 16 bits of
+	// their tag, which may only delay their release.
+	if (self->retired != NULL && pll_size(self->retired) > 0) {
+		uint16_t now = (uint16_t) pep_advance();
+		void *item;
+		while ((item = pll_first(self->retired)) != NULL) {
+			size_t id = prom_metric_retired_id(self, item);
+			if ((uint16_t) (now - *pss_idle(&self->series, id)) < PEP_GRACE)
+				break;
+			pss_remove(&self->series, id);
+			pll_pop(self->retired);
+		}
+	}
+	if (pthread_rwlock_unlock(&self->rwlock))
 		PROM_WARN(PROM_PTHREAD_RWLOCK_UNLOCK_ERROR, NULL);
-	return NULL;
+	return evicted;
 }
@@ -15,22 +15,19 @@
  * limitations under the License.
  */
 
-#include <stdio.h>
+#define PROM_ALLOC_SUBSYSTEM PROM_ALLOC_STRING
+
+#include <string.h>
 
 // Public
 #include "../include/prom_alloc.h"
-#include "../include/prom_gauge.h"
 
 // Private
 #include "prom_assert.h"
-#include "prom_collector_t.h"
-#include "prom_linked_list_t.h"
-#include "../include/prom_log.h"
-#include "prom_map_i.h"
+#include "prom_compress_i.h"
 #include "prom_metric_formatter_i.h"
-#include "prom_metric_sample_histogram_t.h"
-#include "prom_metric_sample_t.h"
 #include "prom_metric_t.h"
+#include "prom_metric_template_i.h"
 #include "../include/prom_string_builder.h"
 
 pmf_t *
@@ -38,12 +35,11 @@ pmf_new() {
 	pmf_t *self = (pmf_t *) prom_malloc(sizeof(pmf_t));
 	if (self == NULL)
 		return NULL;
-	if ((self->string_builder = psb_new()) == NULL) {
-		self->err_builder = NULL;
-		goto fail;
-	}
-	if ((self->err_builder = psb_new()) == NULL)
+	if ((self->string_builder = psb_new()) == NULL)
 		goto fail;
+	self->reused = self->rendered = 0;
+	self->compressor = NULL;
+	self->format = PROM_FORMAT_TEXT;
 	return self;
 
 fail:
@@ -59,111 +55,64 @@ pmf_destroy(pmf_t *self) {
 	psb_destroy(self->string_builder);
 	self->string_builder = NULL;
 
-	psb_destroy(self->err_builder);
-	self->err_builder = NULL;
-
 	prom_free(self);
 	return 0;
 }
 
-int
-pmf_load_help(pmf_t *self, const char *prefix, const char *name,
-	const char *help)
-{
-	if (self == NULL)
-		return 1;
-	if (help == NULL)
-		return 0;
-
-	if (psb_add_str(self->string_builder, "# HELP "))
-		return 2;
-	if (prefix != NULL && psb_add_str(self->string_builder, prefix))
-		return 3;
-	if (psb_add_str(self->string_builder, name))
-		return 4;
-	if (psb_add_char(self->string_builder, ' '))
-		return 5;
-	if (psb_add_str(self->string_builder, help))
-		return 6;
-	return psb_add_char(self->string_builder, '\n') ? 7 : 0;
+// Appends str to buf at pos as far as it fits, and returns pos + strlen(str).
+static size_t
+pmf_put(char *buf, size_t size, size_t pos, const char *str) {
+	if (str == NULL)
+		return pos;
+	size_t len = strlen(str);
+	if (pos < size)
+		memcpy(buf + pos, str, (pos + len < size) ? len : size - pos);
+	return pos + len;
 }
 
-int
-pmf_load_type(pmf_t *self, const char *prefix, const char *name,
-	prom_metric_type_t metric_type)
-{
-	if (self == NULL)
-		return 1;
-
-	if (psb_add_str(self->string_builder, "# TYPE "))
-		return 2;
-	if (prefix != NULL && psb_add_str(self->string_builder, prefix))
-		return 3;
-	if (psb_add_str(self->string_builder, name))
-		return 4;
-	if (psb_add_char(self->string_builder, ' '))
-		return 5;
-	if (psb_add_str(self->string_builder, prom_metric_type_map[metric_type]))
-		return 6;
-
-	return psb_add_char(self->string_builder, '\n') ? 7 : 0;
-}
-
-int
-pmf_load_l_value(pmf_t *self, const char *name, const char *suffix,
+size_t
+pmf_l_value(char *buf, size_t size, const char *name, const char *suffix,
 	size_t label_count, const char **label_keys, const char **label_values)
 {
-	if (self == NULL || name == NULL)
-		return 1;
-
-	if (psb_add_str(self->string_builder, name))
-		return 3;
+	PROM_ASSERT(name != NULL);
+	size_t pos = pmf_put(buf, size, 0, name);
 	if (suffix != NULL) {
-		if (psb_add_char(self->string_builder, '_'))
-			return 4;
-		if (psb_add_str(self->string_builder, suffix))
-			return 5;
+		pos = pmf_put(buf, size, pos, "_");
+		pos = pmf_put(buf, size, pos, suffix);
 	}
-	if (label_count == 0)
-		return 0;
-
-	if (psb_add_char(self->string_builder, '{'))
-		return 6;
-	for (int i = 0; i < label_count; i++) {
-		if (psb_add_str(self->string_builder, (const char *) label_keys[i]))
-			return 7;
-		if (psb_add_str(self->string_builder, "=\""))
-			return 9;
-		if (psb_add_str(self->string_builder, (const char *) label_values[i]))
-			return 10;
-		if (psb_add_str(self->string_builder, "\","))
-			return 11;
+	for (size_t i = 0; i < label_count; i++) {
+		pos = pmf_put(buf, size, pos, (i == 0) ? "{" : ",");
+		pos = pmf_put(buf, size, pos, label_keys[i]);
+		pos = pmf_put(buf, size, pos, "=\"");
+		pos = pmf_put(buf, size, pos, label_values[i]);
+		pos = pmf_put(buf, size, pos, "\"");
 	}
-	psb_truncate(self->string_builder, psb_len(self->string_builder) - 1);
-	if (psb_add_char(self->string_builder, '}'))
-		return 20;
-
-	return 0;
+	if (label_count > 0)
+		pos = pmf_put(buf, size, pos, "}");
+	if (size > 0)
+		buf[(pos < size) ? pos : size - 1] = '\0';
+	return pos;
 }
 
-int
-pmf_load_sample(pmf_t *self, pms_t *sample, const char *prefix) {
-	if (self == NULL)
-		return 1;
-	if (prefix != NULL)
-		psb_add_str(self->string_builder, prefix);
-	if (psb_add_str(self->string_builder, sample->l_value))
-		return 2;
-	char buffer[64];
-	sprintf(buffer, " %.17g", sample->r_value);
-	if (psb_add_str(self->string_builder, buffer))
-		return 3;
-	return psb_add_char(self->string_builder, '\n') ? 4 : 0;
+char *
+pmf_l_value_dup(const char *name, const char *suffix, size_t label_count,
+	const char **label_keys, const char **label_values)
+{
+	if (name == NULL)
+		return NULL;
+	size_t len = pmf_l_value(NULL, 0, name, suffix, label_count, label_keys,
+		label_values);
+	char *s = (char *) prom_malloc(len + 1);
+	if (s != NULL)
+		pmf_l_value(s, len + 1, name, suffix, label_count, label_keys,
+			label_values);
+	return s;
 }
 
 int
 pmf_clear(pmf_t *self) {
 	PROM_ASSERT(self != NULL);
+	self->reused = self->rendered = 0;
 	return psb_clear(self->string_builder);
 }
 
@@ -176,6 +125,15 @@ pmf_dump(pmf_t *self) {
 	return data;
 }
 
+char *
+pmf_detach(pmf_t *self, size_t *len) {
+	if (self == NULL)
+		return NULL;
+	char *data = psb_detach(self->string_builder, len);
+	// handed over to the application, which free()s it
+	return (data == NULL) ? strdup("") : data;
+}
+
 int
 pmf_load_metric(pmf_t *self, prom_metric_t *metric, const char *prefix,
 	bool compact)
@@ -183,94 +141,31 @@ pmf_load_metric(pmf_t *self, prom_metric_t *metric, const char *prefix,
 	if (self == NULL)
 		return 1;
 	const char *p = (prefix != NULL && strlen(prefix) == 0) ? NULL : prefix;
+	bool reused = false;
 
-	if (!compact) {
-		if (pmf_load_help(self,p,metric->name,metric->help))
-			return 2;
-		if (pmf_load_type(self,p,metric->name,metric->type))
-			return 3;
-	}
-	for (pll_node_t *current_node = metric->samples->keys->head;
-		current_node != NULL; current_node = current_node->next)
-	{
-		const char *key = (const char *) current_node->item;
-		if (metric->type == PROM_HISTOGRAM) {
-			pms_histogram_t *hist_sample = (pms_histogram_t *)
-				prom_map_get(metric->samples, key);
-			if (hist_sample == NULL)
-				return 4;
-			for (pll_node_t *current_hist_node =
-				hist_sample->l_value_list->head; current_hist_node != NULL;
-				current_hist_node = current_hist_node->next)
-			{
-				const char *hist_key = (const char *) current_hist_node->item;
-				pms_t *sample = (pms_t *)
-					prom_map_get(hist_sample->samples, hist_key);
-				if (sample == NULL)
-					return 5;
-				if (pmf_load_sample(self, sample, p))
-					return 6;
-			}
-		} else {
-			pms_t *sample = (pms_t *) prom_map_get(metric->samples, key);
-			if (sample == NULL)
-				return 7;
-			if (pmf_load_sample(self, sample, p))
-				return 8;
-		}
-	}
-	return psb_add_char(self->string_builder, '\n') ? 9 : 0;
+	if (pmt_render(metric, p, compact, self->format, self->string_builder,
+		&reused, self->compressor))
+		return 2;
+	if (reused)
+		self->reused++;
+	else
+		self->rendered++;
+	return 0;
 }
 
 int
-pmf_load_metrics(pmf_t *self, prom_map_t *collectors,
-	prom_metric_t *scrape_metric, const char *mprefix, bool compact)
-{
-	PROM_ASSERT(self != NULL);
-	int r = 0;
-	struct timespec start, end;
-	static const char *labels[] = { "" };
-
-	for (pll_node_t *current_node = collectors->keys->head;
-		current_node != NULL; current_node = current_node->next)
-	{
-		if (scrape_metric != NULL)
-			clock_gettime(CLOCK_MONOTONIC, &start);
-
-		const char *cname = (const char *) current_node->item;
-		prom_collector_t *c = (prom_collector_t *)
-			prom_map_get(collectors, cname);
-		if (c == NULL) {
-			PROM_WARN("Collector '%s' not found.", cname);
-			r++;
-			continue;
-		}
-
-		prom_map_t *metrics = c->collect_fn(c);
-		if (metrics != NULL) {
-			for (pll_node_t *current_node = metrics->keys->head;
-				current_node != NULL; current_node = current_node->next)
-			{
-				const char *mname = (const char *) current_node->item;
-				prom_metric_t *metric = (prom_metric_t *)
-					prom_map_get(metrics, mname);
-				if (metric == NULL) {
-					PROM_WARN("Collector '%s' has no metric named '%s'.", cname,
-						mname);
-					r++;
-					continue;
-				}
-				r += pmf_load_metric(self,metric,mprefix,compact);
-			}
-		}
-		if (scrape_metric != NULL) {
-			int r = clock_gettime(CLOCK_MONOTONIC, &end);
-			time_t s = (r == 0) ? end.tv_sec - start.tv_sec : 0;
-			long ns = (r == 0) ? end.tv_nsec - start.tv_nsec : 0;
-			double duration = s + ns*1e-9;
-			labels[0] = cname;
-			prom_gauge_set(scrape_metric, duration, labels);
-		}
-	}
-	return r;
+pmf_load_eof(pmf_t *self) {
+	static const char eof[] = "# EOF\n";
+	if (self == NULL)
+		return 1;
+	if (self->format != PROM_FORMAT_OPENMETRICS)
+		return 0;
+	if (self->compressor == NULL)
+		return psb_add_strn(self->string_builder, eof, sizeof(eof) - 1) ? 2 : 0;
+	uint32_t crc;
+	if (pcz_segment(self->compressor, eof, sizeof(eof) - 1,
+		self->string_builder, &crc))
+		return 3;
+	pcz_add(self->compressor, crc, sizeof(eof) - 1);
+	return 0;
 }
@@ -37,41 +37,40 @@ pmf_t *pmf_new();
 int pmf_destroy(pmf_t *self);
 
 /**
- * @brief PRIVATE Loads the help text
- */
-int pmf_load_help(pmf_t *self, const char *prefix, const char *name, const char *help);
-
-/**
- * @brief PRIVATE Loads the type text
- */
-int pmf_load_type(pmf_t *self, const char *prefix, const char *name, prom_metric_type_t metric_type);
-
-/**
- * @brief PRIVATE Loads the formatter with a metric sample L-value
+ * @brief PRIVATE Formats a metric sample L-value like snprintf(), i.e. writes
+ *	at most \c size bytes incl. the terminating NUL to \c buf .
+ * @param buf Where to store the L-value. May be \c NULL if \c size is 0.
+ * @param size The size of \c buf .
  * @param name The metric name
  * @param suffix The metric suffix for Summary and Histogram metric types.
  * @param label_count The number of labels for the given metric.
  * @param label_keys An array of constant strings.
  * @param label_values An array of constant strings.
+ * @return The length of the L-value excl. the terminating NUL. If it
+ *	is \c >= size , the L-value got truncated.
  *
- * The number of const char **and prom_label_value must be the same.
+ * The number of label_keys and label_values must be the same.
  */
-int pmf_load_l_value(pmf_t *metric_formatter, const char *name, const char *suffix, size_t label_count, const char **label_keys, const char **label_values);
+size_t pmf_l_value(char *buf, size_t size, const char *name, const char *suffix, size_t label_count, const char **label_keys, const char **label_values);
 
 /**
- * @brief PRIVATE Loads the formatter with a metric sample
+ * @brief PRIVATE Same as \c pmf_l_value() , but returns the L-value in a
+ *	buffer of the required size allocated via \c prom_malloc() .
+ * @return \c NULL on error, the L-value otherwise.
  */
-int pmf_load_sample(pmf_t *metric_formatter, pms_t *sample, const char *prefix);
+char *pmf_l_value_dup(const char *name, const char *suffix, size_t label_count, const char **label_keys, const char **label_values);
 
 /**
- * @brief PRIVATE Loads a metric in the string exposition format
+ * @brief PRIVATE Loads a metric in the format set for the formatter (text by
+ *	default), compressed if a compressor is set.
  */
 int pmf_load_metric(pmf_t *self, prom_metric_t *metric, const char *prefix, bool compact);
 
 /**
- * @brief PRIVATE Loads the given metrics
+ * @brief PRIVATE Loads what terminates an export in the format set for the
+ *	formatter, i.e. \c "# EOF" for OpenMetrics, nothing for other formats.
  */
-int pmf_load_metrics(pmf_t *self, prom_map_t *collectors, prom_metric_t *scrape_metric, const char *prefix, bool compact);
+int pmf_load_eof(pmf_t *self);
 
 /**
  * @brief PRIVATE Clear the underlying string_builder
@@ -83,4 +82,12 @@ int pmf_clear(pmf_t *self);
  */
 char *pmf_dump(pmf_t *metric_formatter);
 
+/**
+ * @brief PRIVATE Same as \c pmf_dump() , but hands over the buffer of the
+ *	underlying string_builder instead of copying it. Use this for big
+ *	strings like the exposition of a whole registry.
+ * @param len	If not \c NULL , where to store the length of the string.
+ */
+char *pmf_detach(pmf_t *self, size_t *len);
+
 #endif  // PROM_METRIC_FORMATTER_I_H
@@ -18,11 +18,17 @@
 #ifndef PROM_METRIC_FORMATTER_T_H
 #define PROM_METRIC_FORMATTER_T_H
 
+#include <stddef.h>
+
 #include "../include/prom_string_builder.h"
+#include "prom_compress_t.h"
 
 typedef struct pmf {
 	psb_t *string_builder;
-	psb_t *err_builder;
+	size_t reused;		/**< metrics reused since the last pmf_clear() */
+	size_t rendered;	/**< metrics rendered since the last pmf_clear() */
+	pcz_t *compressor;	/**< NULL or how to compress loaded metrics */
+	prom_format_t format;	/**< exposition format of loaded metrics */
 } pmf_t;
 
 #endif  // PROM_METRIC_FORMATTER_T_H
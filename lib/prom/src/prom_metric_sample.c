@@ -15,7 +15,13 @@
  * limitations under the License.
  */
 
+#define PROM_ALLOC_SUBSYSTEM PROM_ALLOC_SAMPLE
+
+#include <math.h>
+#include <pthread.h>
 #include <stdatomic.h>
+#include <time.h>
+#include <unistd.h>
 
 // Public
 #include "../include/prom_alloc.h"
@@ -23,39 +29,84 @@
 // Private
 #include "prom_assert.h"
 #include "prom_errors.h"
+#include "prom_exemplar_i.h"
 #include "../include/prom_log.h"
 #include "prom_metric_sample_i.h"
 #include "prom_metric_sample_t.h"
+#include "prom_series_i.h"
 
-pms_t *
-pms_new(prom_metric_type_t type, const char *l_val, double r_val) {
-	pms_t *self = (pms_t *) prom_malloc(sizeof(pms_t));
-	if (self == NULL)
-		return NULL;
-	self->type = type;
-	self->l_value = prom_strdup(l_val);
-	self->r_value = ATOMIC_VAR_INIT(r_val);
-	return self;
+double
+pms_now(void) {
+	struct timespec ts;
+	if (clock_gettime(CLOCK_REALTIME, &ts))
+		return 0;
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
 }
 
-int
-pms_destroy(pms_t *self) {
-	if (self == NULL)
-		return 0;
-	prom_free((void *) self->l_value);
-	self->l_value = NULL;
-	prom_free((void *) self);
-	return 0;
+static unsigned int stripe_count;
+
+static pthread_once_t stripe_count_once = PTHREAD_ONCE_INIT;
+
+static void
+init_stripe_count(void) {
+	long n = sysconf(_SC_NPROCESSORS_CONF);
+	unsigned int c = 1;
+	while (c < n && c < PMS_STRIPES_MAX)
+		c <<= 1;
+	stripe_count = c;
 }
 
-int
-pms_destroy_generic(void *gen) {
-	return pms_destroy((pms_t *) gen);
+unsigned int
+pms_stripe_count(void) {
+	pthread_once(&stripe_count_once, init_stripe_count);
+	return stripe_count;
+}
+
+unsigned int
+pms_stripe_index(void) {
+	static _Atomic unsigned int next = ATOMIC_VAR_INIT(0);
+	static __thread unsigned int idx = 0;
+
+	if (idx == 0)
+		idx = atomic_fetch_add_explicit(&next, 1, memory_order_relaxed) + 1;
+	return idx - 1;
 }
 
-void
-pms_free_generic(void *gen) {
-	pms_destroy((pms_t *) gen);
+double
+pms_value(prom_metric_t *metric, size_t id) {
+	PROM_ASSERT(metric != NULL);
+	pss_value_t *value = pss_value(&metric->series, id);
+	if (metric->integral) {
+		uint64_t i = atomic_load(&value->i);
+		return (i == PMS_INT_NAN) ? NAN : (double) i;
+	}
+	double v = atomic_load(&value->r);
+	pms_stripe_t *s = pss_stripes(&metric->series, id);
+	for (unsigned int i = 0; i < metric->series.stripes; i++)
+		v += atomic_load_explicit(&s[i].value, memory_order_relaxed);
+	return v;
+}
+
+/**
+ * @brief PRIVATE Get the metric of the given sample and the id of its series.
+ * @return \c NULL if the sample got removed, the metric otherwise.
+ */
+static inline prom_metric_t *
+pms_metric(pms_t *self, size_t *id) {
+	prom_metric_t *metric = (prom_metric_t *)
+		atomic_load_explicit(&self->ref, memory_order_relaxed);
+	if (metric != NULL)
+		*id = pss_id(&metric->series, self);
+	return metric;
+}
+
+/**
+ * @brief PRIVATE Mark the series with the given id of the given metric as
+ *	modified, see \c pms_touch() .
+ */
+static inline void
+pms_touch_series(prom_metric_t *metric, size_t id) {
+	pms_touch(&metric->dirty, pss_touched(&metric->series, id));
 }
 
 int
@@ -63,38 +114,132 @@ pms_add(pms_t *self, double r_value) {
 	PROM_ASSERT(self != NULL);
 	if (r_value < 0)
 		return 1;
-	_Atomic double old = atomic_load(&self->r_value);
+	size_t id;
+	prom_metric_t *metric = pms_metric(self, &id);
+	if (metric == NULL)
+		return 1;
+	if (metric->integral) {
+		// converting NaN, +Inf or anything >= 2^64 to uint64_t is undefined,
+		// fractions would get truncated
+		if (!(r_value < 0x1p64) || r_value != floor(r_value))
+			return 1;
+		return pms_add_int(self, (uint64_t) r_value);
+	}
+	pms_stripe_t *s = pss_stripes(&metric->series, id);
+	_Atomic double *target = (s == NULL)
+		? &pss_value(&metric->series, id)->r
+		: &s[pms_stripe_index() & (metric->series.stripes - 1)].value;
+	_Atomic double old = atomic_load_explicit(target, memory_order_relaxed);
 	for (;;) {
 		_Atomic double new = ATOMIC_VAR_INIT(old + r_value);
-		if (atomic_compare_exchange_weak(&self->r_value, &old, new))
-			return 0;
+		if (atomic_compare_exchange_weak(target, &old, new))
+			break;
 	}
+	pms_touch_series(metric, id);
+	return 0;
+}
+
+int
+pms_add_exemplar(pms_t *self, double r_value, const char *exemplar) {
+	PROM_ASSERT(self != NULL);
+	if (exemplar != NULL && r_value >= 0) {
+		size_t id;
+		prom_metric_t *metric = pms_metric(self, &id);
+		if (metric == NULL)
+			return 1;
+		// before the update, which marks the metric dirty
+		pex_t *slot = pex_attach(pss_exemplar(&metric->series, id), 1);
+		if (slot == NULL || pex_set(slot, exemplar, r_value))
+			return 1;
+	}
+	return pms_add(self, r_value);
 }
 
 int
 pms_sub(pms_t *self, double r_value) {
 	PROM_ASSERT(self != NULL);
-	if (self->type != PROM_GAUGE) {
-		PROM_WARN(PROM_METRIC_INCORRECT_TYPE " (%d) - %s = %s",
-			self->type, self->l_value, self->r_value);
+	size_t id;
+	prom_metric_t *metric = pms_metric(self, &id);
+	if (metric == NULL)
+		return 1;
+	if (metric->type != PROM_GAUGE) {
+		PROM_WARN(PROM_METRIC_INCORRECT_TYPE " (%d) - %s = %g", metric->type,
+			pss_l_value(&metric->series, id), pms_value(metric, id));
 		return 1;
 	}
-	_Atomic double old = atomic_load(&self->r_value);
+	pss_value_t *value = pss_value(&metric->series, id);
+	_Atomic double old = atomic_load(&value->r);
 	for (;;) {
 		_Atomic double new = ATOMIC_VAR_INIT(old - r_value);
-		if (atomic_compare_exchange_weak(&self->r_value, &old, new))
-			return 0;
+		if (atomic_compare_exchange_weak(&value->r, &old, new))
+			break;
 	}
+	pms_touch_series(metric, id);
+	return 0;
 }
 
 int
 pms_set(pms_t *self, double r_value) {
-	if (self->type != PROM_GAUGE && (self->type != PROM_COUNTER || r_value < 0))
+	PROM_ASSERT(self != NULL);
+	size_t id;
+	prom_metric_t *metric = pms_metric(self, &id);
+	if (metric == NULL)
+		return 1;
+	if (metric->type != PROM_GAUGE
+		&& (metric->type != PROM_COUNTER || r_value < 0))
 	{
-		PROM_WARN(PROM_METRIC_INCORRECT_TYPE " (%d) - %s = %s",
-			self->type, self->l_value, self->r_value);
+		PROM_WARN(PROM_METRIC_INCORRECT_TYPE " (%d) - %s = %g", metric->type,
+			pss_l_value(&metric->series, id), pms_value(metric, id));
+		return 1;
+	}
+	if (metric->integral) {
+		if (isnan(r_value))
+			return pms_set_int(self, PMS_INT_NAN);
+		if (r_value < 0 || !(r_value < 0x1p64) || r_value != floor(r_value))
+			return 1;
+		return pms_set_int(self, (uint64_t) r_value);
+	}
+	pms_stripe_t *s = pss_stripes(&metric->series, id);
+	// Stripes get never reset, so compensate them: concurrent additions not
+	// yet seen here get still counted on top of the new value.
+	for (unsigned int i = 0; i < metric->series.stripes; i++)
+		r_value -= atomic_load(&s[i].value);
+	atomic_store(&pss_value(&metric->series, id)->r, r_value);
+	pms_touch_series(metric, id);
+	return 0;
+}
+
+int
+pms_add_int(pms_t *self, uint64_t i_value) {
+	PROM_ASSERT(self != NULL);
+	size_t id;
+	prom_metric_t *metric = pms_metric(self, &id);
+	if (metric == NULL)
+		return 1;
+	if (!metric->integral) {
+		PROM_WARN(PROM_METRIC_INCORRECT_TYPE " (%d) - %s", metric->type,
+			pss_l_value(&metric->series, id));
+		return 1;
+	}
+	// seq_cst, see pms_touch()
+	atomic_fetch_add(&pss_value(&metric->series, id)->i, i_value);
+	pms_touch_series(metric, id);
+	return 0;
+}
+
+int
+pms_set_int(pms_t *self, uint64_t i_value) {
+	PROM_ASSERT(self != NULL);
+	size_t id;
+	prom_metric_t *metric = pms_metric(self, &id);
+	if (metric == NULL)
+		return 1;
+	if (!metric->integral) {
+		PROM_WARN(PROM_METRIC_INCORRECT_TYPE " (%d) - %s", metric->type,
+			pss_l_value(&metric->series, id));
 		return 1;
 	}
-	atomic_store(&self->r_value, r_value);
+	atomic_store(&pss_value(&metric->series, id)->i, i_value);
+	pms_touch_series(metric, id);
 	return 0;
 }
@@ -15,8 +15,11 @@
  * limitations under the License.
  */
 
-#include <pthread.h>
+#define PROM_ALLOC_SUBSYSTEM PROM_ALLOC_SAMPLE
+
+#include <stdatomic.h>
 #include <stdio.h>
+#include <string.h>
 
 // Public
 #include "../include/prom_alloc.h"
@@ -25,30 +28,39 @@
 // Private
 #include "prom_assert.h"
 #include "prom_errors.h"
-#include "prom_linked_list_i.h"
+#include "prom_exemplar_i.h"
 #include "../include/prom_log.h"
-#include "prom_map_i.h"
 #include "prom_metric_formatter_i.h"
 #include "prom_metric_sample_histogram_i.h"
 #include "prom_metric_sample_i.h"
+#include "prom_metric_sample_native_i.h"
 
-//////////////////////////////////////////////////////////////////////////////
-// Static Declarations
-//////////////////////////////////////////////////////////////////////////////
-
-static const char *l_value_for_bucket(pms_histogram_t *self, const char *name, size_t label_count, const char **label_keys, const char **label_values, const char *bucket_key);
-
-static const char *l_value_for_inf(pms_histogram_t *self, const char *name, size_t label_count, const char **label_keys, const char **label_values);
+/**
+ * @brief PRIVATE Up to this number of buckets the bucket index gets
+ *	determined by comparing the value with all upper bounds (which the
+ *	compiler is able to vectorize), a binary search gets used otherwise.
+ */
+#define PHB_LINEAR_MAX 16
 
-static void free_str_generic(void *gen);
+/**
+ * @brief PRIVATE Number of values pms_histogram_observe_many() assigns to
+ *	buckets in one go.
+ */
+#define PHB_CHUNK 64
 
-static int init_bucket_samples(pms_histogram_t *self, const char *name, size_t label_count, const char **label_keys, const char **label_values);
+/**
+ * @brief PRIVATE Max. number of buckets pms_histogram_observe_many() counts
+ *	on the stack. Histograms with more buckets need a temporary array.
+ */
+#define PHB_STACK_MAX 128
 
-static int init_inf(pms_histogram_t *self, const char *name, size_t label_count, const char **label_keys, const char **label_values);
+//////////////////////////////////////////////////////////////////////////////
+// Static Declarations
+//////////////////////////////////////////////////////////////////////////////
 
-static int init_count(pms_histogram_t *self, const char *name, size_t label_count, const char **label_keys, const char **label_values);
+static const char *l_value_for_bucket(const char *name, size_t label_count, const char **label_keys, const char **label_values, const char *bucket_key);
 
-static int init_summary(pms_histogram_t *self, const char *name, size_t label_count, const char **label_keys, const char **label_values);
+static const char *l_value_for(const char *name, const char *suffix, size_t label_count, const char **label_keys, const char **label_values);
 
 //////////////////////////////////////////////////////////////////////////////
 // End static declarations
@@ -64,152 +76,59 @@ pms_histogram_new(const char *name, phb_t *buckets, size_t label_count,
 	if (self == NULL)
 		return NULL;
 	memset(self, 0, sizeof(pms_histogram_t));
-
-	// Allocate and set the l_value_list
-	if ((self->l_value_list = pll_new()) == NULL)
-		goto fail;
-	// Allocate and set the metric formatter
-	if ((self->metric_formatter = pmf_new()) == NULL)
-		goto fail;
-	// Store map of l_value/pms_t
-	if ((self->samples = prom_map_new()) == NULL)
-		goto fail;
-	// Set the free value function on the samples map
-	if (prom_map_set_free_value_fn(self->samples, &pms_free_generic))
-		goto fail;
-	// Store map of bucket/l_value
-	if ((self->l_values = prom_map_new()) == NULL)
-		goto fail;
-	// Set the free value function for thhe l_values map
-	if (prom_map_set_free_value_fn(self->l_values, free_str_generic))
-		goto fail;
 	self->buckets = buckets;
-	// Allocate and initialize the lock
-	self->rwlock = (pthread_rwlock_t *) prom_malloc(sizeof(pthread_rwlock_t));
-	if (self->rwlock == NULL || pthread_rwlock_init(self->rwlock, NULL))
-		goto fail;
-	// Allocate and initialize bucket metric samples
-	if (init_bucket_samples(self, name, label_count, label_keys, label_values))
-		goto fail;
-	// Allocate and initialize the +Inf metric sample
-	if (init_inf(self, name, label_count, label_keys, label_values))
+	atomic_init(&self->sum, 0.0);
+	self->created = pms_now();
+
+	int bucket_count = phb_count(buckets);
+	self->bucket = (_Atomic uint64_t *)
+		prom_malloc((bucket_count + 1) * sizeof(_Atomic uint64_t));
+	self->l_value = (const char **)
+		prom_malloc((bucket_count + 3) * sizeof(char *));
+	if (self->bucket == NULL || self->l_value == NULL)
 		goto fail;
-	// Allocate and initialize the count metric sample
-	if (init_count(self, name, label_count, label_keys, label_values))
-		goto fail;
-	// Add summary sample
-	if (init_summary(self, name, label_count, label_keys, label_values))
-		goto fail;
-	// The value of nodes in this map will be simple pms pointers
-	if (prom_map_set_free_value_fn(self->samples, &pms_free_generic))
-		goto fail;
-
-	return self;
-
-fail:
-	pms_histogram_destroy(self);
-	return NULL;
-}
+	for (int i = 0; i <= bucket_count; i++)
+		atomic_init(&self->bucket[i], 0);
+	memset(self->l_value, 0, (bucket_count + 3) * sizeof(char *));
 
-static int
-init_bucket_samples(pms_histogram_t *self, const char *name, size_t label_count,
-	const char **label_keys, const char **label_values)
-{
-	PROM_ASSERT(self);
-	int bucket_count = phb_count(self->buckets);
-
-	// For each bucket, create an pms_t with an appropriate
-	// l_value and default value of 0.0. The l_value will contain the metric
-	// name, user labels, and finally, the le label and bucket value.
-	for (int i = 0; i < bucket_count; i++) {
-		const char *bucket_key = self->buckets->key[i];
+	int i;
+	for (i = 0; i < bucket_count; i++) {
+		const char *bucket_key = buckets->key[i];
 		if (bucket_key == NULL)
-			return 3;
-		const char *l_value = l_value_for_bucket(self, name, label_count,
+			break;
+		self->l_value[i] = l_value_for_bucket(name, label_count,
 			label_keys, label_values, bucket_key);
-		if (l_value == NULL)
-			return 1;
-		if (pll_append(self->l_value_list, prom_strdup(l_value)))
-			return 2;
-		if (prom_map_set(self->l_values, bucket_key, (char *) l_value))
-			return 4;
-		pms_t *sample = pms_new(PROM_HISTOGRAM, l_value, 0.0);
-		if (sample == NULL)
-			return 5;
-		if (prom_map_set(self->samples, l_value, sample))
-			return 6;
+		if (self->l_value[i] == NULL)
+			break;
 	}
-	return 0;
-}
-
-static int
-init_inf(pms_histogram_t *self, const char *name, size_t label_count,
-	const char **label_keys, const char **label_values)
-{
-	PROM_ASSERT(self != NULL);
-	const char *inf_l_value =
-		l_value_for_inf(self, name, label_count, label_keys, label_values);
-	if (inf_l_value == NULL)
-		return 1;
-
-	if (pll_append(self->l_value_list, prom_strdup(inf_l_value)))
-		return 2;
-	if (prom_map_set(self->l_values, "+Inf", (char *) inf_l_value))
-		return 3;
-	pms_t *inf_sample = pms_new(PROM_HISTOGRAM, (char *) inf_l_value, 0.0);
-	if (inf_sample == NULL)
-		return 4;
-	return prom_map_set(self->samples, inf_l_value, inf_sample);
-}
-
-static int
-init_count(pms_histogram_t *self, const char *name,
-	size_t label_count, const char **label_keys, const char **label_values)
-{
-	PROM_ASSERT(self != NULL);
-	if (pmf_load_l_value(self->metric_formatter, name, "count", label_count,
-			label_keys, label_values))
-	{
-		return 1;
+	if (i == bucket_count) {
+		self->l_value[bucket_count] = l_value_for_bucket(name, label_count,
+			label_keys, label_values, "+Inf");
+		self->l_value[bucket_count + 1] = l_value_for(name, "count",
+			label_count, label_keys, label_values);
+		self->l_value[bucket_count + 2] = l_value_for(name, "sum",
+			label_count, label_keys, label_values);
 	}
+	for (i = 0; i < bucket_count + 3; i++)
+		if (self->l_value[i] == NULL)
+			goto fail;
+	return self;
 
-	const char *count_l_val = pmf_dump(self->metric_formatter);
-	if (count_l_val == NULL)
-		return 1;
-	if (pll_append(self->l_value_list, prom_strdup(count_l_val)))
-		return 2;
-	if (prom_map_set(self->l_values, "count", (char *) count_l_val))
-		return 3;
-	pms_t *count_sample = pms_new(PROM_HISTOGRAM, count_l_val, 0.0);
-	if (count_sample == NULL)
-		return 1;
-	return prom_map_set(self->samples, count_l_val, count_sample);
+fail:
+	pms_histogram_destroy(self);
+	return NULL;
 }
 
-static int
-init_summary(pms_histogram_t *self, const char *name, size_t label_count,
-	const char **label_keys, const char **label_values)
+int
+pms_histogram_native(pms_histogram_t *self, int schema,
+	unsigned int max_buckets)
 {
 	PROM_ASSERT(self != NULL);
-	if (pmf_load_l_value(self->metric_formatter, name, "sum", label_count,
-		label_keys, label_values))
-	{
-		return 1;
-	}
-	const char *sum_l_val = pmf_dump(self->metric_formatter);
-	if (sum_l_val == NULL)
-		return 2;
-
-	if (pll_append(self->l_value_list, prom_strdup(sum_l_val)))
-		return 3;
-	if (prom_map_set(self->l_values, "sum", (char *) sum_l_val))
-		return 4;
-
-	pms_t *sum_sample = pms_new(PROM_HISTOGRAM, sum_l_val, 0.0);
-	if (sum_sample == NULL)
-		return 1;
-
-	return prom_map_set(self->samples, sum_l_val, sum_sample);
+	if (self->native != NULL)
+		return 0;
+	self->native = pms_native_new(schema, max_buckets,
+		PROM_NATIVE_ZERO_THRESHOLD);
+	return (self->native == NULL) ? 1 : 0;
 }
 
 int
@@ -217,21 +136,19 @@ pms_histogram_destroy(pms_histogram_t *self) {
 	if (self == NULL)
 		return 0;
 
-	pll_destroy(self->l_value_list);
-	self->l_value_list = NULL;
-
-	prom_map_destroy(self->samples);
-	self->samples = NULL;
-
-	prom_map_destroy(self->l_values);
-	self->l_values = NULL;
+	pms_native_destroy(self->native);
+	self->native = NULL;
 
-	pmf_destroy(self->metric_formatter);
-	self->metric_formatter = NULL;
-
-	pthread_rwlock_destroy(self->rwlock);
-	prom_free(self->rwlock);
-	self->rwlock = NULL;
+	if (self->l_value != NULL) {
+		int n = phb_count(self->buckets) + 3;
+		for (int i = 0; i < n; i++)
+			prom_free((char *) self->l_value[i]);
+		prom_free(self->l_value);
+		self->l_value = NULL;
+	}
+	prom_free(self->bucket);
+	self->bucket = NULL;
+	prom_free(atomic_load(&self->exemplar));
 
 	prom_free(self);
 	return 0;
@@ -247,152 +164,145 @@ pms_histogram_free_generic(void *gen) {
 	pms_histogram_destroy((pms_histogram_t *) gen);
 }
 
-int
-pms_histogram_observe(pms_histogram_t *self, double value) {
-	int err = 2;
-	if (pthread_rwlock_wrlock(self->rwlock)) {
-		PROM_WARN(PROM_PTHREAD_RWLOCK_LOCK_ERROR, NULL);
-		return 1;
+/**
+ * @brief PRIVATE Get the index of the first upper bound >= the given value,
+ *	i.e. the bucket the value belongs to. Returns \c count if there is none
+ *	(value > all bounds or NaN), i.e. the value belongs to the \c +Inf bucket.
+ */
+static inline size_t
+bucket_index(const double *ub, size_t count, double value) {
+	size_t idx = 0;
+	if (count <= PHB_LINEAR_MAX) {
+		for (size_t i = 0; i < count; i++)
+			idx += !(value <= ub[i]);
+		return idx;
 	}
-
-	// Update the counter for the proper bucket if found
-	int bucket_count = phb_count(self->buckets);
-	for (int i = (bucket_count - 1); i >= 0; i--) {
-		if (value > self->buckets->upper_bound[i])
-			break;
-		const char *bucket_key = self->buckets->key[i];
-		if (bucket_key == NULL)
-			goto end;
-		const char *l_value = prom_map_get(self->l_values, bucket_key);
-		if (l_value == NULL)
-			goto end;
-
-		pms_t *sample = prom_map_get(self->samples, l_value);
-		if (sample == NULL)
-			goto end;
-
-		if (pms_add(sample, 1.0))
-			goto end;
+	// branchless lower bound search
+	size_t len = count;
+	while (len > 1) {
+		size_t half = len >> 1;
+		idx += !(value <= ub[idx + half - 1]) ? half : 0;
+		len -= half;
 	}
+	return idx + !(value <= ub[idx]);
+}
 
-	// Update the +Inf and count samples
-	const char *inf_l_value = prom_map_get(self->l_values, "+Inf");
-	if (inf_l_value == NULL)
-		goto end;
-	pms_t *inf_sample = prom_map_get(self->samples, inf_l_value);
-	if (inf_sample == NULL)
-		goto end;
-	if (pms_add(inf_sample, 1.0))
-		goto end;
-	const char *count_l_value = prom_map_get(self->l_values, "count");
-	if (count_l_value == NULL)
-		goto end;
-	pms_t *count_sample = prom_map_get(self->samples, count_l_value);
-	if (count_sample == NULL)
-		goto end;
-	if (pms_add(count_sample, 1.0))
-		goto end;
-
-	// Update the sum sample
-	const char *sum_l_value = prom_map_get(self->l_values, "sum");
-	if (sum_l_value == NULL)
-		goto end;
-	pms_t *sum_sample = prom_map_get(self->samples, sum_l_value);
-	if (sum_sample == NULL)
-		goto end;
-	if (pms_add(sum_sample, value))
-		goto end;
-
-	err = 0;
-
-end:
-	if (pthread_rwlock_unlock(self->rwlock)) {
-		PROM_WARN(PROM_PTHREAD_RWLOCK_UNLOCK_ERROR, NULL);
-		err = 3;
+/**
+ * @brief PRIVATE Observe the given value and record the given exemplar.
+ */
+static inline int
+observe(pms_histogram_t *self, double value, const char *exemplar) {
+	if (self->native != NULL && pms_native_observe(self->native, &value, 1))
+		return 1;
+	size_t i = bucket_index(self->buckets->upper_bound,
+		self->buckets->count, value);
+	if (exemplar != NULL) {
+		// before the update, which marks the metric dirty
+		pex_t *slot = pex_attach(&self->exemplar, self->buckets->count + 1);
+		if (slot == NULL || pex_set(&slot[i], exemplar, value))
+			return 1;
 	}
-	return err;
+	atomic_fetch_add(&self->bucket[i], 1);	// seq_cst, see pms_touch()
+
+	double old = atomic_load_explicit(&self->sum, memory_order_relaxed);
+	while (!atomic_compare_exchange_weak(&self->sum, &old, old + value))
+		;
+	pms_touch(self->dirty, &self->touched);
+	return 0;
 }
 
-static const char *
-l_value_for_bucket(pms_histogram_t *self, const char *name, size_t label_count,
-	const char **label_keys, const char **label_values, const char *bucket_key)
+int
+pms_histogram_observe(pms_histogram_t *self, double value) {
+	PROM_ASSERT(self != NULL);
+	return observe(self, value, NULL);
+}
+
+int
+pms_histogram_observe_exemplar(pms_histogram_t *self, double value,
+	const char *exemplar)
 {
 	PROM_ASSERT(self != NULL);
+	return observe(self, value, exemplar);
+}
 
-	// Make new array to hold label_keys with le label key
-	const char **new_keys = (const char **)
-		prom_malloc((label_count + 1) * sizeof(char *));
-	if (new_keys == NULL)
-		return NULL;
-	// Make new array to hold label_values with le label value
-	const char **new_values = (const char **)
-		prom_malloc((label_count + 1) * sizeof(char *));
-	if (new_keys == NULL) {
-		prom_free(new_keys);
-		return NULL;
+int
+pms_histogram_observe_many(pms_histogram_t *self, const double *values,
+	size_t n)
+{
+	PROM_ASSERT(self != NULL);
+	const double *ub = self->buckets->upper_bound;
+	size_t count = self->buckets->count;
+	uint64_t stack[PHB_STACK_MAX + 1];
+	uint64_t *cnt = stack;
+	uint64_t idx[PHB_CHUNK];
+	double sum = 0;
+
+	if (n == 0)
+		return 0;
+	if (self->native != NULL && pms_native_observe(self->native, values, n))
+		return 1;
+	if (count > PHB_STACK_MAX) {
+		cnt = (uint64_t *) prom_malloc((count + 1) * sizeof(uint64_t));
+		if (cnt == NULL)
+			return 1;
 	}
-	for (size_t i = 0; i < label_count; i++) {
-		new_keys[i] = prom_strdup(label_keys[i]);
-		new_values[i] = prom_strdup(label_values[i]);
+	memset(cnt, 0, (count + 1) * sizeof(uint64_t));
+
+	for (size_t off = 0; off < n; off += PHB_CHUNK) {
+		const double *v = values + off;
+		size_t m = (n - off < PHB_CHUNK) ? n - off : PHB_CHUNK;
+		if (count <= PHB_LINEAR_MAX) {
+			// compare all values of the chunk with one bound at a time, so
+			// that the inner loop gets vectorized over the values.
+			memset(idx, 0, sizeof(idx));
+			for (size_t j = 0; j < count; j++) {
+				double b = ub[j];
+				for (size_t i = 0; i < m; i++)
+					idx[i] += !(v[i] <= b);
+			}
+		} else {
+			for (size_t i = 0; i < m; i++)
+				idx[i] = bucket_index(ub, count, v[i]);
+		}
+		for (size_t i = 0; i < m; i++) {
+			cnt[idx[i]]++;
+			sum += v[i];
+		}
 	}
-	new_keys[label_count] = prom_strdup("le");
-	new_values[label_count] = prom_strdup(bucket_key);
 
-	const char *ret = pmf_load_l_value(self->metric_formatter, name, "bucket",
-		label_count + 1, new_keys, new_values)
-		? NULL
-		: (const char *) pmf_dump(self->metric_formatter);
-
-	for (size_t i = 0; i < label_count + 1; i++) {
-		prom_free((char *) new_keys[i]);
-		prom_free((char *) new_values[i]);
-	}
-	prom_free(new_keys);
-	prom_free(new_values);
-	return ret;
+	// seq_cst, see pms_touch()
+	for (size_t i = 0; i <= count; i++)
+		if (cnt[i] != 0)
+			atomic_fetch_add(&self->bucket[i], cnt[i]);
+	double old = atomic_load_explicit(&self->sum, memory_order_relaxed);
+	while (!atomic_compare_exchange_weak(&self->sum, &old, old + sum))
+		;
+	pms_touch(self->dirty, &self->touched);
+	if (cnt != stack)
+		prom_free(cnt);
+	return 0;
 }
 
 static const char *
-l_value_for_inf(pms_histogram_t *self, const char *name, size_t label_count,
-	const char **label_keys, const char **label_values)
+l_value_for_bucket(const char *name, size_t label_count,
+	const char **label_keys, const char **label_values, const char *bucket_key)
 {
-	PROM_ASSERT(self != NULL);
-
-	// Make new array to hold label_keys with le label key
-	const char **new_keys = (const char **)
-		prom_malloc((label_count + 1) * sizeof(char *));
-	if (new_keys == NULL)
-		return NULL;
-	// Make new array to hold label_values with le label value
-	const char **new_values = (const char **)
-		prom_malloc((label_count + 1) * sizeof(char *));
-	if (new_keys == NULL) {
-		prom_free(new_keys);
-		return NULL;
-	}
-
+	// label_keys and label_values with the le label appended
+	const char *keys[label_count + 1];
+	const char *values[label_count + 1];
 	for (size_t i = 0; i < label_count; i++) {
-		new_keys[i] = prom_strdup(label_keys[i]);
-		new_values[i] = prom_strdup(label_values[i]);
-	}
-	new_keys[label_count] = prom_strdup("le");
-	new_values[label_count] = prom_strdup("+Inf");
-
-	const char *ret = pmf_load_l_value(self->metric_formatter, name, "bucket",
-		label_count + 1, new_keys, new_values)
-		? NULL
-		: (const char *) pmf_dump(self->metric_formatter);
-
-	for (size_t i = 0; i < label_count + 1; i++) {
-		prom_free((char *) new_keys[i]);
-		prom_free((char *) new_values[i]);
+		keys[i] = label_keys[i];
+		values[i] = label_values[i];
 	}
-	prom_free(new_keys);
-	prom_free(new_values);
-	return ret;
+	keys[label_count] = "le";
+	values[label_count] = bucket_key;
+	return l_value_for(name, "bucket", label_count + 1, keys, values);
 }
 
-static void
-free_str_generic(void *gen) {
-	prom_free((void *) gen);
+static const char *
+l_value_for(const char *name, const char *suffix,
+	size_t label_count, const char **label_keys, const char **label_values)
+{
+	return pmf_l_value_dup(name, suffix, label_count, label_keys,
+		label_values);
 }
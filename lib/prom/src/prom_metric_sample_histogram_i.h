@@ -29,6 +29,15 @@
  */
 pms_histogram_t *pms_histogram_new(const char *name, phb_t *buckets, size_t label_count, const char **label_keys, const char **label_vales);
 
+/**
+ * @brief PRIVATE Let the given histogram sample track sparse exponential
+ *	buckets in addition to its classic buckets.
+ * @param schema		Initial schema of the sparse buckets.
+ * @param max_buckets	Max. number of sparse buckets to populate.
+ * @return Non-zero integer value upon failure, \c 0 otherwise.
+ */
+int pms_histogram_native(pms_histogram_t *self, int schema, unsigned int max_buckets);
+
 /**
  * @brief PRIVATE Destroy a pms_histogram_t
  */
@@ -15,26 +15,37 @@
  * limitations under the License.
  */
 
-#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
 
 // Public
 #include "../include/prom_histogram_buckets.h"
 #include "../include/prom_metric_sample_histogram.h"
 
 // Private
-#include "prom_map_t.h"
-#include "prom_metric_formatter_t.h"
+#include "prom_exemplar_t.h"
+#include "prom_metric_sample_native_t.h"
 
 #ifndef PROM_METRIC_HISTOGRAM_SAMPLE_T_H
 #define PROM_METRIC_HISTOGRAM_SAMPLE_T_H
 
+/**
+ * @brief PRIVATE A histogram sample. Bucket counters are not cumulative, i.e.
+ *	an observation increments exactly one of them, and get cumulated when the
+ *	sample gets exposed. The last one is the \c +Inf bucket.
+ */
 struct pms_histogram {
-	pll_t *l_value_list;
-	prom_map_t *l_values;
-	prom_map_t *samples;
-	pmf_t *metric_formatter;
-	phb_t *buckets;
-	pthread_rwlock_t *rwlock;
+	phb_t *buckets;				/**< upper bounds (shared with the metric) */
+	const char **l_value;		/**< buckets->count + 3 l_values in exposition
+									 order: buckets, +Inf, count, sum */
+	_Atomic uint64_t *bucket;	/**< buckets->count + 1 bucket counters */
+	_Atomic double sum;			/**< sum of all observed values */
+	pms_native_t *native;		/**< NULL or sparse buckets */
+	atomic_bool *dirty;			/**< NULL or dirty flag of the metric */
+	uint32_t id;				/**< id in the series store of the metric */
+	atomic_bool touched;		/**< set, when the sample gets modified */
+	double created;				/**< creation time (s since epoch) */
+	_Atomic(pex_t *) exemplar;	/**< NULL or one exemplar slot per bucket */
 };
 
 #endif  // PROM_METRIC_HISTOGRAM_SAMPLE_T_H
@@ -21,32 +21,56 @@
 #ifndef PROM_METRIC_SAMPLE_I_H
 #define PROM_METRIC_SAMPLE_I_H
 
+/** @brief PRIVATE Max. number of stripes per series. */
+#define PMS_STRIPES_MAX 64
+
 /**
- * @brief PRIVATE Return a pms_t*
- *
- * @param type The type of metric sample
- * @param l_value The entire left value of the metric e.g metric_name{foo="bar"}
- * @param r_value A double representing the value of the sample
+ * @brief PRIVATE Get the current value of the series with the given id of
+ *	the given counter or gauge, i.e. its r_value plus the sum of all its
+ *	stripes (if any).
  */
-pms_t *pms_new(prom_metric_type_t type, const char *l_value, double r_value);
+double pms_value(prom_metric_t *metric, size_t id);
 
 /**
- * @brief PRIVATE Destroy the pms
+ * @brief PRIVATE Get the number of stripes to use for a striped sample by
+ *	default, i.e. the number of configured CPUs rounded up to the next
+ *	power of 2.
  */
-int pms_destroy(pms_t *self);
+unsigned int pms_stripe_count(void);
 
 /**
- * @brief PRIVATE A pll_free_item_fn to enable item destruction
- *	within a linked list's destructor
+ * @brief PRIVATE Get the stripe index of the calling thread. Threads get
+ *	numbered round robin on their first striped update, so the first
+ *	\c PMS_STRIPES_MAX threads never share a stripe.
  */
-int pms_destroy_generic(void *);
+unsigned int pms_stripe_index(void);
 
 /**
- * @brief PRIVATE A pll_free_item_fn to enable item destruction
- *	within a linked list's destructor.
- *
- * This function ignores any errors.
+ * @brief PRIVATE Mark a sample and the metric owning it as modified, so that
+ *	the next scrape renders it again and the next eviction pass keeps it.
+ *	Must be called right after the seq_cst read-modify-write or store, which
+ *	modified the sample. The flags get written only if not yet set, so
+ *	frequent writes do not bounce their cache lines between CPUs. No fence
+ *	is needed: the update and the seq_cst load of the dirty flag are ordered
+ *	wrt. the scrape, which clears the flag and fences before reading any
+ *	value. So either the scrape sees the update, or this call sees the
+ *	cleared flag and sets it again via a release store, which pairs with the
+ *	acquire exchange of the next scrape.
+ * @param dirty	\c NULL or the dirty flag of the metric.
+ * @param touched	The touched flag of the sample.
+ */
+static inline void
+pms_touch(atomic_bool *dirty, atomic_bool *touched) {
+	if (!atomic_load_explicit(touched, memory_order_relaxed))
+		atomic_store_explicit(touched, true, memory_order_relaxed);
+	if (dirty != NULL && !atomic_load(dirty))
+		atomic_store_explicit(dirty, true, memory_order_release);
+}
+
+/**
+ * @brief PRIVATE Get the current time in seconds since the epoch, i.e. what
+ *	samples record as creation time.
  */
-void pms_free_generic(void *gen);
+double pms_now(void);
 
 #endif  // PROM_METRIC_SAMPLE_I_H
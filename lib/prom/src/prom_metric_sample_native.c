@@ -0,0 +1,239 @@
+/**
+ * Copyright 2021 Jens Elkner <jel+libprom@cs.uni-magdeburg.de>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define PROM_ALLOC_SUBSYSTEM PROM_ALLOC_SAMPLE
+
+#include <math.h>
+#include <pthread.h>
+#include <string.h>
+
+// Public
+#include "../include/prom_alloc.h"
+#include "../include/prom_histogram.h"
+
+// Private
+#include "prom_assert.h"
+#include "prom_errors.h"
+#include "../include/prom_log.h"
+#include "prom_metric_sample_native_i.h"
+
+/**
+ * @brief PRIVATE bounds[s][i] = 2^(i/2^s - 1) for i in [0, 2^s), i.e. the
+ *	upper bounds of the buckets of schema s for the fraction returned by
+ *	frexp() (which is in [0.5, 1)).
+ */
+static double *bounds[PROM_NATIVE_SCHEMA_MAX + 1];
+
+static pthread_once_t bounds_once = PTHREAD_ONCE_INIT;
+
+static void
+init_bounds(void) {
+	static double table[(2 << PROM_NATIVE_SCHEMA_MAX) - 1];
+	double *b = table;
+
+	for (int s = 0; s <= PROM_NATIVE_SCHEMA_MAX; s++) {
+		int n = 1 << s;
+		bounds[s] = b;
+		for (int i = 0; i < n; i++)
+			b[i] = exp2((double) i / n - 1);
+		b += n;
+	}
+}
+
+pms_native_t *
+pms_native_new(int schema, unsigned int max_buckets, double zero_threshold) {
+	if (schema < PROM_NATIVE_SCHEMA_MIN || schema > PROM_NATIVE_SCHEMA_MAX) {
+		PROM_WARN("schema must be in [%d, %d]", PROM_NATIVE_SCHEMA_MIN,
+			PROM_NATIVE_SCHEMA_MAX);
+		return NULL;
+	}
+	pthread_once(&bounds_once, init_bounds);
+
+	pms_native_t *self = (pms_native_t *) prom_malloc(sizeof(pms_native_t));
+	if (self == NULL)
+		return NULL;
+	memset(self, 0, sizeof(pms_native_t));
+	if (pthread_mutex_init(&self->lock, NULL)) {
+		prom_free(self);
+		return NULL;
+	}
+	self->schema = schema;
+	self->base_schema = (schema > 0) ? schema : 0;
+	self->max_buckets = (max_buckets == 0) ? 1 : max_buckets;
+	self->zero_threshold = zero_threshold;
+	return self;
+}
+
+int
+pms_native_destroy(pms_native_t *self) {
+	if (self == NULL)
+		return 0;
+	pthread_mutex_destroy(&self->lock);
+	prom_free(self->pos.count);
+	prom_free(self->neg.count);
+	prom_free(self);
+	return 0;
+}
+
+/**
+ * @brief PRIVATE Get the index of the bucket the given absolute value belongs
+ *	to wrt. to the given schema, which must be >= 0.
+ */
+static int32_t
+bucket_key(double value, int schema) {
+	int exp;
+	double frac = frexp(value, &exp);
+
+	if (schema == 0)
+		return (frac == 0.5) ? exp - 1 : exp;
+	const double *b = bounds[schema];
+	int32_t lo = 0, len = 1 << schema;
+	while (len > 0) {
+		int32_t half = len >> 1;
+		if (b[lo + half] < frac) {
+			lo += half + 1;
+			len -= half + 1;
+		} else {
+			len = half;
+		}
+	}
+	return lo + (exp - 1) * (1 << schema);
+}
+
+/**
+ * @brief PRIVATE Get ceil(key / 2^shift), i.e. the index of the bucket of the
+ *	schema reduced by \c shift the bucket \c key belongs to.
+ */
+static inline int32_t
+reduce_key(int32_t key, int shift) {
+	return (key >= 0)
+		? (int32_t) (((int64_t) key + (1 << shift) - 1) >> shift)
+		: -((-key) >> shift);
+}
+
+/**
+ * @brief PRIVATE Merge the given buckets into the buckets of the next lower
+ *	schema, in place.
+ */
+static void
+reduce_buckets(pms_native_buckets_t *b) {
+	if (b->len == 0)
+		return;
+	int32_t offset = reduce_key(b->offset, 1);
+	uint32_t len = 0;
+	for (uint32_t i = 0; i < b->len; i++) {
+		uint32_t j = reduce_key(b->offset + (int32_t) i, 1) - offset;
+		if (j == len) {
+			b->count[j] = b->count[i];
+			len++;
+		} else {
+			b->count[j] += b->count[i];
+		}
+	}
+	b->offset = offset;
+	b->len = len;
+}
+
+/**
+ * @brief PRIVATE Get the number of buckets needed to cover the given buckets
+ *	and the bucket with the given index.
+ */
+static inline int64_t
+span(pms_native_buckets_t *b, int32_t key) {
+	if (b->len == 0)
+		return 1;
+	int64_t lo = (key < b->offset) ? key : b->offset;
+	int64_t hi = b->offset + (int64_t) b->len - 1;
+	if (key > hi)
+		hi = key;
+	return hi - lo + 1;
+}
+
+/**
+ * @brief PRIVATE Increment the bucket with the given index, allocate
+ *	buckets as needed.
+ */
+static int
+increment(pms_native_buckets_t *b, int32_t key) {
+	if (b->len == 0)
+		b->offset = key;
+	int64_t n = span(b, key);
+	if (n > b->cap) {
+		uint32_t cap = (b->cap == 0) ? 8 : b->cap;
+		while (cap < n)
+			cap <<= 1;
+		uint64_t *c = (uint64_t *) prom_realloc(b->count, cap * sizeof(uint64_t));
+		if (c == NULL)
+			return 1;
+		b->count = c;
+		b->cap = cap;
+	}
+	if (key < b->offset) {
+		uint32_t shift = b->offset - key;
+		memmove(b->count + shift, b->count, b->len * sizeof(uint64_t));
+		memset(b->count, 0, shift * sizeof(uint64_t));
+		b->offset = key;
+		b->len += shift;
+	} else if (key >= b->offset + (int64_t) b->len) {
+		uint32_t end = key - b->offset + 1;
+		memset(b->count + b->len, 0, (end - b->len) * sizeof(uint64_t));
+		b->len = end;
+	}
+	b->count[key - b->offset]++;
+	return 0;
+}
+
+/**
+ * @brief PRIVATE Count the given value. Must be called with the lock held.
+ */
+static int
+observe(pms_native_t *self, double value) {
+	if (isnan(value) || isinf(value))
+		return 0;
+	if (fabs(value) <= self->zero_threshold) {
+		self->zero_count++;
+		return 0;
+	}
+	pms_native_buckets_t *b = (value > 0) ? &self->pos : &self->neg;
+	pms_native_buckets_t *other = (value > 0) ? &self->neg : &self->pos;
+	int32_t base = bucket_key(fabs(value), self->base_schema);
+	int32_t key = reduce_key(base, self->base_schema - self->schema);
+
+	// Reduce the resolution until the new bucket fits into the limit.
+	while (self->schema > PROM_NATIVE_SCHEMA_MIN
+		&& span(b, key) + other->len > self->max_buckets)
+	{
+		reduce_buckets(&self->pos);
+		reduce_buckets(&self->neg);
+		self->schema--;
+		key = reduce_key(base, self->base_schema - self->schema);
+	}
+	return increment(b, key);
+}
+
+int
+pms_native_observe(pms_native_t *self, const double *values, size_t count) {
+	PROM_ASSERT(self != NULL);
+	int err = 0;
+	if (pthread_mutex_lock(&self->lock)) {
+		PROM_WARN(PROM_PTHREAD_MUTEX_LOCK_ERROR, NULL);
+		return 1;
+	}
+	for (size_t i = 0; i < count; i++)
+		err |= observe(self, values[i]);
+	pthread_mutex_unlock(&self->lock);
+	return err;
+}
@@ -0,0 +1,51 @@
+/**
+ * Copyright 2021 Jens Elkner <jel+libprom@cs.uni-magdeburg.de>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef PROM_METRIC_SAMPLE_NATIVE_I_H
+#define PROM_METRIC_SAMPLE_NATIVE_I_H
+
+#include <stdlib.h>
+
+// Private
+#include "prom_metric_sample_native_t.h"
+
+/**
+ * @brief PRIVATE Create new, empty native histogram buckets.
+ * @param schema		Initial schema to use. See \c prom_histogram_new_native().
+ * @param max_buckets	Max. number of buckets to populate.
+ * @param zero_threshold	Values with an absolute value <= this threshold get
+ *	counted in the zero bucket.
+ * @return \c NULL on error, the new buckets otherwise.
+ */
+pms_native_t *pms_native_new(int schema, unsigned int max_buckets, double zero_threshold);
+
+/**
+ * @brief PRIVATE Destroy the given native histogram buckets.
+ */
+int pms_native_destroy(pms_native_t *self);
+
+/**
+ * @brief PRIVATE Increment the bucket the given values belong to. \c NaN and
+ *	infinite values get ignored, i.e. they are reflected in the count and
+ *	sum of the histogram, only.
+ * @param self		Where to count the values.
+ * @param values	The values to count.
+ * @param count		The number of values to count.
+ * @return Non-zero integer value upon failure, \c 0 otherwise.
+ */
+int pms_native_observe(pms_native_t *self, const double *values, size_t count);
+
+#endif  // PROM_METRIC_SAMPLE_NATIVE_I_H
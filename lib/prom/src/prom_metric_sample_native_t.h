@@ -0,0 +1,52 @@
+/**
+ * Copyright 2021 Jens Elkner <jel+libprom@cs.uni-magdeburg.de>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef PROM_METRIC_SAMPLE_NATIVE_T_H
+#define PROM_METRIC_SAMPLE_NATIVE_T_H
+
+#include <pthread.h>
+#include <stdint.h>
+
+/**
+ * @brief PRIVATE The populated range of sparse buckets of one sign of a native
+ *	histogram. The bucket with index \c i covers the range
+ *	(2^((i-1)/2^schema), 2^(i/2^schema)] of the absolute values observed.
+ */
+typedef struct pms_native_buckets {
+	int32_t offset;		/**< bucket index of count[0] */
+	uint32_t len;		/**< number of buckets in use */
+	uint32_t cap;		/**< number of buckets allocated */
+	uint64_t *count;	/**< non-cumulative bucket counters */
+} pms_native_buckets_t;
+
+/**
+ * @brief PRIVATE The sparse exponential buckets of a native histogram sample.
+ *	Buckets get allocated on demand. If the populated range exceeds
+ *	\c max_buckets , the schema gets reduced, i.e. each pair of adjacent
+ *	buckets gets merged.
+ */
+typedef struct pms_native {
+	pthread_mutex_t lock;		/**< guards all but the constant members */
+	int schema;					/**< current schema */
+	int base_schema;			/**< schema used to calculate bucket indices */
+	unsigned int max_buckets;	/**< max. number of buckets to populate */
+	double zero_threshold;		/**< upper bound of the zero bucket */
+	uint64_t zero_count;		/**< number of values in the zero bucket */
+	pms_native_buckets_t pos;	/**< buckets for values > zero_threshold */
+	pms_native_buckets_t neg;	/**< buckets for values < -zero_threshold */
+} pms_native_t;
+
+#endif  // PROM_METRIC_SAMPLE_NATIVE_T_H
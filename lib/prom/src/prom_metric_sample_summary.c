@@ -0,0 +1,435 @@
+/**
+ * Copyright 2021 Jens Elkner <jel+libprom@cs.uni-magdeburg.de>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define PROM_ALLOC_SUBSYSTEM PROM_ALLOC_SAMPLE
+
+#include <math.h>
+#include <pthread.h>
+#include <string.h>
+#include <time.h>
+
+// Public
+#include "../include/prom_alloc.h"
+#include "../include/prom_summary.h"
+
+// Private
+#include "prom_assert.h"
+#include "prom_dtoa_i.h"
+#include "prom_errors.h"
+#include "../include/prom_log.h"
+#include "prom_metric_formatter_i.h"
+#include "prom_metric_sample_i.h"
+#include "prom_metric_sample_summary_i.h"
+
+/** @brief PRIVATE gamma = (1 + accuracy) / (1 - accuracy) */
+#define GAMMA ((1 + PROM_SUMMARY_ACCURACY) / (1 - PROM_SUMMARY_ACCURACY))
+
+static double log_gamma;
+
+static pthread_once_t log_gamma_once = PTHREAD_ONCE_INIT;
+
+static void
+init_log_gamma(void) {
+	log_gamma = log(GAMMA);
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// DDSketch
+//////////////////////////////////////////////////////////////////////////////
+
+/** @brief PRIVATE Get the index of the bin the given value > 0 belongs to. */
+static inline int32_t
+sketch_index(double value) {
+	return (int32_t) ceil(log(value) / log_gamma);
+}
+
+/**
+ * @brief PRIVATE Get the representative value of the given bin, i.e. the
+ *	value with the same relative distance to both bin bounds.
+ */
+static inline double
+sketch_value(int32_t index) {
+	return 2 * pow(GAMMA, index) / (GAMMA + 1);
+}
+
+/**
+ * @brief PRIVATE Merge all bins of the given store below \c lo into bin
+ *	\c lo .
+ */
+static void
+store_collapse(pms_sketch_store_t *s, int32_t lo) {
+	uint32_t k = lo - s->offset;
+	uint64_t c = 0;
+	for (uint32_t i = 0; i < k && i < s->len; i++)
+		c += s->count[i];
+	if (k < s->len) {
+		memmove(s->count, s->count + k, (s->len - k) * sizeof(uint64_t));
+		s->len -= k;
+		s->count[0] += c;
+	} else {
+		s->count[0] = c;
+		s->len = 1;
+	}
+	s->offset = lo;
+}
+
+/**
+ * @brief PRIVATE Add \c n to the bin with the given index. If the store would
+ *	exceed PMS_SKETCH_MAX_BINS bins, its lowest bins get collapsed.
+ */
+static int
+store_add(pms_sketch_store_t *s, int32_t idx, uint64_t n) {
+	int64_t span = 1;
+	if (s->len == 0) {
+		s->offset = idx;
+	} else {
+		int32_t top = s->offset + (int32_t) s->len - 1;
+		int32_t hi = (idx > top) ? idx : top;
+		int32_t lo = hi - PMS_SKETCH_MAX_BINS + 1;
+		if (idx < lo)
+			idx = lo;
+		if (s->offset < lo)
+			store_collapse(s, lo);
+		span = (int64_t) hi - ((idx < s->offset) ? idx : s->offset) + 1;
+	}
+	if (span > s->cap) {
+		uint32_t cap = (s->cap == 0) ? 16 : s->cap;
+		while (cap < span)
+			cap <<= 1;
+		uint64_t *c = (uint64_t *) prom_realloc(s->count, cap * sizeof(uint64_t));
+		if (c == NULL)
+			return 1;
+		s->count = c;
+		s->cap = cap;
+	}
+	if (s->len == 0) {
+		s->count[0] = 0;
+		s->len = 1;
+	} else if (idx < s->offset) {
+		uint32_t shift = s->offset - idx;
+		memmove(s->count + shift, s->count, s->len * sizeof(uint64_t));
+		memset(s->count, 0, shift * sizeof(uint64_t));
+		s->offset = idx;
+		s->len += shift;
+	} else if (idx >= s->offset + (int64_t) s->len) {
+		uint32_t end = idx - s->offset + 1;
+		memset(s->count + s->len, 0, (end - s->len) * sizeof(uint64_t));
+		s->len = end;
+	}
+	s->count[idx - s->offset] += n;
+	return 0;
+}
+
+static int
+sketch_add(pms_sketch_t *sk, double value) {
+	if (isnan(value) || isinf(value))
+		return 0;
+	sk->count++;
+	if (value > PMS_SKETCH_MIN_VALUE)
+		return store_add(&sk->pos, sketch_index(value), 1);
+	if (value < -PMS_SKETCH_MIN_VALUE)
+		return store_add(&sk->neg, sketch_index(-value), 1);
+	sk->zero++;
+	return 0;
+}
+
+static int
+sketch_merge(pms_sketch_t *dst, pms_sketch_t *src) {
+	int err = 0;
+	dst->count += src->count;
+	dst->zero += src->zero;
+	for (uint32_t i = 0; i < src->pos.len; i++)
+		if (src->pos.count[i] != 0)
+			err |= store_add(&dst->pos, src->pos.offset + i, src->pos.count[i]);
+	for (uint32_t i = 0; i < src->neg.len; i++)
+		if (src->neg.count[i] != 0)
+			err |= store_add(&dst->neg, src->neg.offset + i, src->neg.count[i]);
+	return err;
+}
+
+static void
+sketch_reset(pms_sketch_t *sk, int64_t epoch) {
+	sk->epoch = epoch;
+	sk->count = sk->zero = 0;
+	sk->pos.len = sk->neg.len = 0;
+}
+
+static void
+sketch_free(pms_sketch_t *sk) {
+	prom_free(sk->pos.count);
+	prom_free(sk->neg.count);
+	memset(sk, 0, sizeof(pms_sketch_t));
+}
+
+static double
+sketch_quantile(pms_sketch_t *sk, double q) {
+	if (sk->count == 0 || isnan(q) || q < 0 || q > 1)
+		return NaN;
+	double rank = q * (sk->count - 1);
+	uint64_t n = 0;
+	// most negative values first
+	for (uint32_t i = sk->neg.len; i > 0; i--) {
+		n += sk->neg.count[i - 1];
+		if (n > rank)
+			return -sketch_value(sk->neg.offset + i - 1);
+	}
+	n += sk->zero;
+	if (n > rank)
+		return 0;
+	for (uint32_t i = 0; i < sk->pos.len; i++) {
+		n += sk->pos.count[i];
+		if (n > rank)
+			return sketch_value(sk->pos.offset + i);
+	}
+	return sketch_value(sk->pos.offset + sk->pos.len - 1);
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// Summary sample
+//////////////////////////////////////////////////////////////////////////////
+
+static const char *
+l_value_for(const char *name, const char *suffix, size_t label_count,
+	const char **label_keys, const char **label_values, const char *quantile)
+{
+	const char *keys[label_count + 1];
+	const char *values[label_count + 1];
+	for (size_t i = 0; i < label_count; i++) {
+		keys[i] = label_keys[i];
+		values[i] = label_values[i];
+	}
+	if (quantile != NULL) {
+		keys[label_count] = "quantile";
+		values[label_count] = quantile;
+		label_count++;
+	}
+	return pmf_l_value_dup(name, suffix, label_count, keys, values);
+}
+
+pms_summary_t *
+pms_summary_new(const char *name, size_t quantile_count,
+	const double *quantiles, unsigned int max_age, size_t label_count,
+	const char **label_keys, const char **label_values)
+{
+	pthread_once(&log_gamma_once, init_log_gamma);
+
+	pms_summary_t *self = (pms_summary_t *) prom_malloc(sizeof(pms_summary_t));
+	if (self == NULL)
+		return NULL;
+	memset(self, 0, sizeof(pms_summary_t));
+	self->quantiles = quantiles;
+	self->quantile_count = quantile_count;
+	self->created = pms_now();
+	self->window = max_age / PROM_SUMMARY_AGE_BUCKETS;
+	if (self->window == 0)
+		self->window = 1;
+	for (int i = 0; i < PROM_SUMMARY_AGE_BUCKETS; i++)
+		self->sketch[i].epoch = -1;
+	if (pthread_mutex_init(&self->lock, NULL)) {
+		prom_free(self);
+		return NULL;
+	}
+
+	unsigned int n = pms_stripe_count();
+	if (n > PMS_SUMMARY_STRIPES_MAX)
+		n = PMS_SUMMARY_STRIPES_MAX;
+	self->stripe = (pms_summary_stripe_t *)
+		prom_aligned_alloc(PROM_CACHE_LINE, n * sizeof(pms_summary_stripe_t));
+	if (self->stripe == NULL)
+		goto fail;
+	memset(self->stripe, 0, n * sizeof(pms_summary_stripe_t));
+	for (unsigned int i = 0; i < n; i++) {
+		if (pthread_mutex_init(&self->stripe[i].lock, NULL))
+			goto fail;
+		self->stripe_mask = i;
+	}
+
+	self->l_value = (const char **)
+		prom_malloc((quantile_count + 2) * sizeof(char *));
+	if (self->l_value == NULL)
+		goto fail;
+	memset(self->l_value, 0, (quantile_count + 2) * sizeof(char *));
+	for (size_t i = 0; i < quantile_count; i++) {
+		char q[PROM_DTOA_SIZE];
+		prom_dtoa(q, quantiles[i]);
+		self->l_value[i] = l_value_for(name, NULL, label_count, label_keys,
+			label_values, q);
+	}
+	self->l_value[quantile_count] = l_value_for(name, "sum", label_count,
+		label_keys, label_values, NULL);
+	self->l_value[quantile_count + 1] = l_value_for(name, "count",
+		label_count, label_keys, label_values, NULL);
+	for (size_t i = 0; i < quantile_count + 2; i++)
+		if (self->l_value[i] == NULL)
+			goto fail;
+	return self;
+
+fail:
+	pms_summary_destroy(self);
+	return NULL;
+}
+
+int
+pms_summary_destroy(pms_summary_t *self) {
+	if (self == NULL)
+		return 0;
+	if (self->l_value != NULL) {
+		for (size_t i = 0; i < self->quantile_count + 2; i++)
+			prom_free((char *) self->l_value[i]);
+		prom_free(self->l_value);
+		self->l_value = NULL;
+	}
+	if (self->stripe != NULL) {
+		for (unsigned int i = 0; i <= self->stripe_mask; i++)
+			pthread_mutex_destroy(&self->stripe[i].lock);
+		prom_free(self->stripe);
+		self->stripe = NULL;
+	}
+	for (int i = 0; i < PROM_SUMMARY_AGE_BUCKETS; i++)
+		sketch_free(&self->sketch[i]);
+	pthread_mutex_destroy(&self->lock);
+	prom_free(self);
+	return 0;
+}
+
+void
+pms_summary_free_generic(void *gen) {
+	pms_summary_destroy((pms_summary_t *) gen);
+}
+
+/** @brief PRIVATE Get the number of the current time window. */
+static inline int64_t
+current_epoch(pms_summary_t *self) {
+	struct timespec ts;
+	// called per observation, the tick resolution is good enough
+	clock_gettime(CLOCK_MONOTONIC_COARSE, &ts);
+	return ts.tv_sec / self->window;
+}
+
+/**
+ * @brief PRIVATE Move the buffered values of the given stripe into the sketch
+ *	of the time window they got observed in. If its slot in the ring got
+ *	reused for a later window already, the values have expired and get
+ *	dropped. The stripe must be locked by the caller.
+ */
+static int
+flush(pms_summary_t *self, pms_summary_stripe_t *stripe) {
+	int err = 0;
+	if (stripe->n == 0)
+		return 0;
+	if (pthread_mutex_lock(&self->lock)) {
+		PROM_WARN(PROM_PTHREAD_MUTEX_LOCK_ERROR, NULL);
+		return 1;
+	}
+	pms_sketch_t *sk = &self->sketch[stripe->epoch % PROM_SUMMARY_AGE_BUCKETS];
+	if (sk->epoch < stripe->epoch)
+		sketch_reset(sk, stripe->epoch);
+	if (sk->epoch == stripe->epoch) {
+		for (uint32_t i = 0; i < stripe->n; i++)
+			err |= sketch_add(sk, stripe->buf[i]);
+	}
+	stripe->n = 0;
+	pthread_mutex_unlock(&self->lock);
+	return err;
+}
+
+int
+pms_summary_observe(pms_summary_t *self, double value) {
+	PROM_ASSERT(self != NULL);
+	int err = 0;
+	pms_summary_stripe_t *stripe =
+		&self->stripe[pms_stripe_index() & self->stripe_mask];
+	int64_t epoch = current_epoch(self);
+	if (pthread_mutex_lock(&stripe->lock)) {
+		PROM_WARN(PROM_PTHREAD_MUTEX_LOCK_ERROR, NULL);
+		return 1;
+	}
+	stripe->count++;
+	stripe->sum += value;
+	// a new window started: its values must not mix with older ones
+	if (stripe->n > 0 && stripe->epoch != epoch)
+		err = flush(self, stripe);
+	stripe->epoch = epoch;
+	stripe->buf[stripe->n++] = value;
+	if (stripe->n == PMS_SUMMARY_BUF)
+		err |= flush(self, stripe);
+	pthread_mutex_unlock(&stripe->lock);
+	pms_touch(NULL, &self->touched);
+	return err;
+}
+
+/**
+ * @brief PRIVATE Flush all stripes and merge the sketches of all time windows
+ *	not yet expired into the given sketch.
+ */
+static int
+merge(pms_summary_t *self, pms_sketch_t *dst, uint64_t *count, double *sum) {
+	int err = 0;
+	int64_t epoch = current_epoch(self);
+	uint64_t c = 0;
+	double s = 0;
+
+	for (unsigned int i = 0; i <= self->stripe_mask; i++) {
+		pms_summary_stripe_t *stripe = &self->stripe[i];
+		if (pthread_mutex_lock(&stripe->lock)) {
+			PROM_WARN(PROM_PTHREAD_MUTEX_LOCK_ERROR, NULL);
+			return 1;
+		}
+		err |= flush(self, stripe);
+		c += stripe->count;
+		s += stripe->sum;
+		pthread_mutex_unlock(&stripe->lock);
+	}
+	if (pthread_mutex_lock(&self->lock)) {
+		PROM_WARN(PROM_PTHREAD_MUTEX_LOCK_ERROR, NULL);
+		return 1;
+	}
+	for (int i = 0; i < PROM_SUMMARY_AGE_BUCKETS; i++) {
+		pms_sketch_t *sk = &self->sketch[i];
+		if (sk->epoch > epoch - PROM_SUMMARY_AGE_BUCKETS && sk->count > 0)
+			err |= sketch_merge(dst, sk);
+	}
+	pthread_mutex_unlock(&self->lock);
+	if (count != NULL)
+		*count = c;
+	if (sum != NULL)
+		*sum = s;
+	return err;
+}
+
+int
+pms_summary_collect(pms_summary_t *self, double *value, uint64_t *count,
+	double *sum)
+{
+	PROM_ASSERT(self != NULL);
+	pms_sketch_t sk;
+	memset(&sk, 0, sizeof(pms_sketch_t));
+	int err = merge(self, &sk, count, sum);
+	for (size_t i = 0; i < self->quantile_count; i++)
+		value[i] = sketch_quantile(&sk, self->quantiles[i]);
+	sketch_free(&sk);
+	return err;
+}
+
+double
+pms_summary_quantile(pms_summary_t *self, double q) {
+	PROM_ASSERT(self != NULL);
+	pms_sketch_t sk;
+	memset(&sk, 0, sizeof(pms_sketch_t));
+	double v = merge(self, &sk, NULL, NULL) ? NaN : sketch_quantile(&sk, q);
+	sketch_free(&sk);
+	return v;
+}
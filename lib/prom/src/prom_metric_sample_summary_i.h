@@ -0,0 +1,62 @@
+/**
+ * Copyright 2021 Jens Elkner <jel+libprom@cs.uni-magdeburg.de>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef PROM_METRIC_SAMPLE_SUMMARY_I_H
+#define PROM_METRIC_SAMPLE_SUMMARY_I_H
+
+#include <stdint.h>
+
+// Public
+#include "../include/prom_metric_sample_summary.h"
+
+// Private
+#include "prom_metric_sample_summary_t.h"
+
+/**
+ * @brief PRIVATE Create a pointer to a pms_summary_t
+ * @param name	The metric name.
+ * @param quantile_count	Number of quantiles to expose.
+ * @param quantiles	The quantiles to expose. Must stay valid until the sample
+ *	gets destroyed.
+ * @param max_age	Max. age of the values in seconds to consider when
+ *	estimating quantiles.
+ */
+pms_summary_t *pms_summary_new(const char *name, size_t quantile_count, const double *quantiles, unsigned int max_age, size_t label_count, const char **label_keys, const char **label_values);
+
+/**
+ * @brief PRIVATE Destroy a pms_summary_t
+ */
+int pms_summary_destroy(pms_summary_t *self);
+
+/**
+ * @brief PRIVATE A pll_free_item_fn to enable item destruction
+ *	within a linked list's destructor.
+ */
+void pms_summary_free_generic(void *gen);
+
+/**
+ * @brief PRIVATE Merge all buffered values into the sketch of the given
+ *	sample and estimate its quantiles.
+ * @param self	The sample to query.
+ * @param value	Where to store the estimated values of all quantiles of the
+ *	sample (i.e. quantile_count values).
+ * @param count	Where to store the number of values ever observed.
+ * @param sum	Where to store the sum of all values ever observed.
+ * @return Non-zero integer value upon failure, \c 0 otherwise.
+ */
+int pms_summary_collect(pms_summary_t *self, double *value, uint64_t *count, double *sum);
+
+#endif  // PROM_METRIC_SAMPLE_SUMMARY_I_H
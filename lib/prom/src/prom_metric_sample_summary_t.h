@@ -0,0 +1,105 @@
+/**
+ * Copyright 2021 Jens Elkner <jel+libprom@cs.uni-magdeburg.de>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef PROM_METRIC_SAMPLE_SUMMARY_T_H
+#define PROM_METRIC_SAMPLE_SUMMARY_T_H
+
+#include <pthread.h>
+#include <stdint.h>
+
+// Public
+#include "../include/prom_metric_sample_summary.h"
+#include "../include/prom_summary.h"
+
+// Private
+#include "prom_metric_sample_t.h"
+
+/** @brief PRIVATE Number of values a summary stripe buffers. */
+#define PMS_SUMMARY_BUF 64
+
+/**
+ * @brief PRIVATE Max. number of stripes per summary sample. Each one takes
+ *	about 600 bytes, and observing is cheap compared to a counter update, so
+ *	the stripes of a sample do not scale with the number of CPUs beyond.
+ */
+#define PMS_SUMMARY_STRIPES_MAX 8
+
+/**
+ * @brief PRIVATE Max. number of bins per sketch store. With the default
+ *	accuracy of 1% this covers values over 17 orders of magnitude, before the
+ *	lowest bins get collapsed.
+ */
+#define PMS_SKETCH_MAX_BINS 2048
+
+/**
+ * @brief PRIVATE Values with an absolute value below this threshold get
+ *	counted as 0 by a sketch.
+ */
+#define PMS_SKETCH_MIN_VALUE 1e-9
+
+/**
+ * @brief PRIVATE A dense range of DDSketch bins. Bin \c i counts the values
+ *	in (gamma^(i-1), gamma^i].
+ */
+typedef struct pms_sketch_store {
+	int32_t offset;		/**< bin index of count[0] */
+	uint32_t len;		/**< number of bins in use */
+	uint32_t cap;		/**< number of bins allocated */
+	uint64_t *count;	/**< bin counters */
+} pms_sketch_store_t;
+
+/**
+ * @brief PRIVATE A DDSketch of the values observed within one time window.
+ */
+typedef struct pms_sketch {
+	int64_t epoch;				/**< time window covered */
+	uint64_t count;				/**< number of values in the sketch */
+	uint64_t zero;				/**< number of values ~ 0 */
+	pms_sketch_store_t pos;		/**< bins of values > 0 */
+	pms_sketch_store_t neg;		/**< bins of values < 0 */
+} pms_sketch_t;
+
+/**
+ * @brief PRIVATE A buffer of observed values shared by the threads mapped to
+ *	it. Each stripe occupies its own cache lines, so threads using different
+ *	stripes do not contend. All buffered values belong to the same time
+ *	window: the buffer gets flushed, when a value of a later one arrives.
+ */
+typedef struct pms_summary_stripe {
+	pthread_mutex_t lock;			/**< guards the stripe */
+	uint32_t n;						/**< number of buffered values */
+	int64_t epoch;					/**< time window of the buffered values */
+	uint64_t count;					/**< number of values observed */
+	double sum;						/**< sum of values observed */
+	double buf[PMS_SUMMARY_BUF];	/**< values not yet in the sketch */
+} __attribute__((aligned(PROM_CACHE_LINE))) pms_summary_stripe_t;
+
+struct pms_summary {
+	const char **l_value;		/**< quantile_count + 2 l_values in exposition
+									 order: quantiles, sum, count */
+	const double *quantiles;	/**< quantiles to expose (owned by metric) */
+	double created;				/**< creation time (s since epoch) */
+	uint32_t id;				/**< id in the series store of the metric */
+	atomic_bool touched;		/**< set, when an observation gets added */
+	size_t quantile_count;		/**< number of quantiles */
+	unsigned int window;		/**< length of a time window in seconds */
+	pthread_mutex_t lock;		/**< guards the sketches */
+	pms_sketch_t sketch[PROM_SUMMARY_AGE_BUCKETS];	/**< ring of windows */
+	unsigned int stripe_mask;	/**< number of stripes - 1 */
+	pms_summary_stripe_t *stripe;	/**< per thread buffers */
+};
+
+#endif  // PROM_METRIC_SAMPLE_SUMMARY_T_H
@@ -20,11 +20,6 @@
 
 #include "../include/prom_metric_sample.h"
 #include "prom_metric_t.h"
-
-struct pms {
-	prom_metric_type_t type;	/**< metric type for the sample */
-	char *l_value;				/**< full metric name and label set as a str */
-	_Atomic double r_value;		/**< value of the metric sample */
-};
+#include "prom_series_t.h"
 
 #endif  // PROM_METRIC_SAMPLE_T_H
@@ -19,15 +19,19 @@
 #define PROM_METRIC_T_H
 
 #include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
 
 // Public
 #include "../include/prom_histogram_buckets.h"
 #include "../include/prom_metric.h"
 
 // Private
+#include "prom_linked_list_t.h"
 #include "prom_map_i.h"
 #include "prom_map_t.h"
-#include "prom_metric_formatter_t.h"
+#include "prom_metric_template_t.h"
+#include "prom_series_t.h"
 
 /**
  * @brief PRIVATE Contains metric type constants
@@ -47,19 +51,31 @@ extern const char *prom_metric_type_map[5];
 
 /**
  * @brief PRIVATE An opaque struct to users containing metric metadata; one or
- *	more metric samples; and a metric formatter for locating metric samples
- *	and exporting metric data
+ *	more metric samples; and a template for exporting metric data
  */
 struct prom_metric {
 	prom_metric_type_t type;	/**< metric type */
 	const char *name;			/**< metric name */
 	const char *help;			/**< metric help */
-	prom_map_t *samples;		/**< collected samples */
+	char *unit;					/**< NULL or the unit of the metric */
+	pss_t series;				/**< the series by id and l_value */
 	phb_t *buckets;				/**< histogram bucket upper bound values */
 	size_t label_key_count;		/**< number of labels */
-	pmf_t *formatter;			/**< metric formatter  */
-	pthread_rwlock_t *rwlock;	/**< lock support non-atomic ops */
+	pthread_rwlock_t rwlock;	/**< lock support non-atomic ops */
 	const char **label_keys;	/**< labels **/
+	bool integral;				/**< if true, samples store uint64_t values */
+	int native_schema;			/**< initial schema of native hist. samples */
+	unsigned int native_max_buckets;	/**< if > 0 hist. samples are native */
+	const double *quantiles;	/**< quantiles exposed by summary samples */
+	size_t quantile_count;		/**< number of quantiles */
+	unsigned int max_age;		/**< max. age of summary observations in s */
+	_Atomic(void *) unlabeled;	/**< the sample of a metric w/o labels */
+	unsigned long generation;	/**< bumped whenever samples get added or
+									removed */
+	unsigned int ttl;			/**< 0 or max. eviction passes w/o update */
+	pll_t *retired;				/**< NULL or removed, not yet freed samples */
+	pmt_t *tmpl;				/**< pre-rendered exposition */
+	atomic_bool dirty;			/**< set, when a sample gets modified */
 };
 
 #endif  // PROM_METRIC_T_H
@@ -0,0 +1,627 @@
+/**
+ * Copyright 2021 Jens Elkner <jel+libprom@cs.uni-magdeburg.de>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define PROM_ALLOC_SUBSYSTEM PROM_ALLOC_METRIC
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <string.h>
+
+// Public
+#include "../include/prom_alloc.h"
+
+// Private
+#include "prom_assert.h"
+#include "prom_compress_i.h"
+#include "prom_dtoa_i.h"
+#include "prom_errors.h"
+#include "prom_exemplar_i.h"
+#include "../include/prom_log.h"
+#include "prom_map_i.h"
+#include "prom_metric_sample_histogram_t.h"
+#include "prom_metric_sample_i.h"
+#include "prom_metric_sample_summary_i.h"
+#include "prom_metric_sample_t.h"
+#include "prom_metric_template_i.h"
+#include "prom_protobuf_i.h"
+#include "prom_series_i.h"
+
+/**
+ * @brief PRIVATE Templates with room for more entries than this get trimmed,
+ *	when less than a quarter of them is needed anymore.
+ */
+#define PMT_TRIM_MIN 64
+
+pmt_t *
+pmt_new(void) {
+	pmt_t *self = (pmt_t *) prom_malloc(sizeof(pmt_t));
+	if (self == NULL)
+		return NULL;
+	memset(self, 0, sizeof(pmt_t));
+	if (pthread_mutex_init(&self->lock, NULL)) {
+		prom_free(self);
+		return NULL;
+	}
+	return self;
+}
+
+int
+pmt_destroy(pmt_t *self) {
+	if (self == NULL)
+		return 0;
+	pthread_mutex_destroy(&self->lock);
+	for (int i = 0; i < PMT_LAYOUTS; i++) {
+		psb_destroy(self->layout[i].text);
+		prom_free(self->layout[i].chunk);
+	}
+	for (int i = 0; i < PMT_FORMATS; i++) {
+		psb_destroy(self->cache[i].raw);
+		psb_destroy(self->cache[i].z);
+	}
+	psb_destroy(self->pb);
+	prom_free(self->pb_label);
+	prom_free(self->entry);
+	prom_free(self->prefix);
+	prom_free(self);
+	return 0;
+}
+
+/**
+ * @brief PRIVATE Make sure, that chunk has room for the offsets of \c lines
+ *	value lines.
+ */
+static int
+reserve_lines(pmt_layout_t *y, size_t lines) {
+	if (lines + 2 <= y->cap)
+		return 0;
+	size_t cap = y->cap == 0 ? lines + 2 : y->cap;
+	while (cap < lines + 2)
+		cap <<= 1;
+	uint32_t *c = (uint32_t *) prom_realloc(y->chunk, cap * sizeof(uint32_t));
+	if (c == NULL)
+		return 1;
+	y->chunk = c;
+	y->cap = cap;
+	return 0;
+}
+
+/**
+ * @brief PRIVATE Append the static part of a value line to the layout text
+ *	and record where the next chunk starts.
+ * @param n	The number of value lines added so far.
+ * @param total	If not \c 0 , the offset in l_value where \c _total needs to
+ *	be inserted (OpenMetrics counter samples).
+ */
+static int
+add_line(pmt_layout_t *y, size_t *n, const char *prefix, const char *l_value,
+	size_t total)
+{
+	if (reserve_lines(y, *n + 1))
+		return 1;
+	if (*n > 0 && psb_add_char(y->text, '\n'))
+		return 2;
+	if (prefix != NULL && psb_add_str(y->text, prefix))
+		return 3;
+	if (total > 0 && (psb_add_strn(y->text, l_value, total)
+		|| psb_add_str(y->text, "_total")))
+	{
+		return 4;
+	}
+	if (psb_add_str(y->text, l_value + total) || psb_add_char(y->text, ' '))
+		return 4;
+	if (psb_len(y->text) > UINT32_MAX)
+		return 5;
+	y->chunk[++(*n)] = (uint32_t) psb_len(y->text);
+	return 0;
+}
+
+/**
+ * @brief PRIVATE Append the OpenMetrics \c _created line of the given entry
+ *	to the layout text. It becomes part of the chunk following the entry.
+ */
+static int
+add_created(psb_t *t, prom_metric_t *metric, pmt_entry_t *e,
+	const char *prefix, size_t flen)
+{
+	const char *l_value;
+	double created;
+	if (metric->type == PROM_HISTOGRAM) {
+		pms_histogram_t *h = (pms_histogram_t *) e->sample;
+		l_value = h->l_value[e->lines - 2];
+		created = h->created;
+	} else if (metric->type == PROM_SUMMARY) {
+		pms_summary_t *s = (pms_summary_t *) e->sample;
+		l_value = s->l_value[e->lines - 1];
+		created = s->created;
+	} else {
+		l_value = pss_l_value(&metric->series, e->id);
+		created = *pss_created(&metric->series, e->id);
+	}
+	const char *labels = strchr(l_value, '{');
+	char *p;
+	if (psb_add_char(t, '\n') || (prefix != NULL && psb_add_str(t, prefix))
+		|| psb_add_strn(t, metric->name, flen) || psb_add_str(t, "_created")
+		|| (labels != NULL && psb_add_str(t, labels)) || psb_add_char(t, ' ')
+		|| (p = psb_reserve(t, PROM_DTOA_SIZE)) == NULL)
+	{
+		return 1;
+	}
+	psb_commit(t, prom_dtoa(p, created));
+	return 0;
+}
+
+/**
+ * @brief PRIVATE Append a metadata line like \c "# TYPE name type" to the
+ *	given text.
+ */
+static inline int
+add_meta(psb_t *t, const char *what, const char *prefix, const char *name,
+	size_t len, const char *value)
+{
+	return psb_add_str(t, what) || (prefix != NULL && psb_add_str(t, prefix))
+		|| psb_add_strn(t, name, len) || psb_add_char(t, ' ')
+		|| psb_add_str(t, value) || psb_add_char(t, '\n');
+}
+
+/**
+ * @brief PRIVATE Build the Prometheus text (\c om == false ) or OpenMetrics
+ *	layout of the template. OpenMetrics names counter families without the
+ *	\c _total suffix, adds a \c _created line to each counter, histogram and
+ *	summary and does not separate families by an empty line. The caller must
+ *	hold the template lock and a read lock on the metric.
+ */
+static int
+build_layout(pmt_t *self, prom_metric_t *metric, bool om) {
+	pmt_layout_t *y = &self->layout[om ? 1 : 0];
+	const char *prefix = self->prefix;
+	size_t len = strlen(metric->name);
+	size_t flen = len;		// length of the family name
+	size_t total = 0;
+	bool created = false;
+
+	y->valid = false;
+	if (y->text == NULL && (y->text = psb_new()) == NULL)
+		return 1;
+	psb_truncate(y->text, 0);
+	if (reserve_lines(y, self->lines))
+		return 1;
+	y->chunk[0] = 0;
+	if (om) {
+		created = metric->type == PROM_COUNTER
+			|| metric->type == PROM_HISTOGRAM || metric->type == PROM_SUMMARY;
+		if (metric->type == PROM_COUNTER) {
+			if (len > 6 && strcmp(metric->name + len - 6, "_total") == 0)
+				flen = len - 6;
+			else
+				total = len;
+		}
+	}
+
+	psb_t *t = y->text;
+	if (!self->compact) {
+		if (metric->help != NULL
+			&& add_meta(t, "# HELP ", prefix, metric->name, flen, metric->help))
+		{
+			return 2;
+		}
+		if (add_meta(t, "# TYPE ", prefix, metric->name, flen,
+			(om && metric->type == PROM_UNTYPED)
+				? "unknown" : prom_metric_type_map[metric->type]))
+		{
+			return 3;
+		}
+		if (om && metric->unit != NULL
+			&& add_meta(t, "# UNIT ", prefix, metric->name, flen, metric->unit))
+		{
+			return 3;
+		}
+	}
+	size_t n = 0;
+	for (size_t k = 0; k < self->count; k++) {
+		pmt_entry_t *e = &self->entry[k];
+		const char **l_value, *simple;
+		if (metric->type == PROM_HISTOGRAM) {
+			l_value = ((pms_histogram_t *) e->sample)->l_value;
+		} else if (metric->type == PROM_SUMMARY) {
+			l_value = ((pms_summary_t *) e->sample)->l_value;
+		} else {
+			simple = pss_l_value(&metric->series, e->id);
+			l_value = &simple;
+		}
+		for (uint32_t i = 0; i < e->lines; i++) {
+			if (add_line(y, &n, prefix, l_value[i], total))
+				return 5;
+		}
+		if (created && add_created(t, metric, e, prefix, flen))
+			return 6;
+	}
+	if (n > 0 && psb_add_char(t, '\n'))
+		return 7;
+	if (!om && psb_add_char(t, '\n'))
+		return 8;
+	if (psb_len(t) > UINT32_MAX)
+		return 9;
+	y->chunk[n + 1] = (uint32_t) psb_len(t);
+	// the text stays as is until the next series gets added or removed
+	psb_trim(t);
+	y->valid = true;
+	return 0;
+}
+
+/**
+ * @brief PRIVATE Make sure, that there is room for \c count entries. The
+ *	first allocation is sized exactly, growing beyond doubles.
+ */
+static int
+reserve_entries(pmt_t *self, size_t count) {
+	if (count <= self->entry_cap)
+		return 0;
+	size_t cap = self->entry_cap == 0 ? count : self->entry_cap;
+	while (cap < count)
+		cap <<= 1;
+	pmt_entry_t *e = (pmt_entry_t *) prom_realloc(self->entry,
+		cap * sizeof(pmt_entry_t));
+	if (e == NULL)
+		return 1;
+	self->entry = e;
+	self->entry_cap = cap;
+	return 0;
+}
+
+/**
+ * @brief PRIVATE Append the given sample to the list of entries.
+ */
+static int
+add_entry(pmt_t *self, void *sample, uint32_t lines, size_t id) {
+	if (reserve_entries(self, self->count + 1))
+		return 1;
+	self->entry[self->count].sample = sample;
+	self->entry[self->count].lines = lines;
+	self->entry[self->count].id = (uint32_t) id;
+	self->count++;
+	return 0;
+}
+
+/**
+ * @brief PRIVATE Release all buffers of the given template. They get
+ *	allocated on demand again with the size needed, so that the memory of
+ *	deleted series gets reclaimed - buffers never shrink otherwise.
+ */
+static void
+pmt_trim(pmt_t *self) {
+	for (int i = 0; i < PMT_LAYOUTS; i++) {
+		psb_destroy(self->layout[i].text);
+		self->layout[i].text = NULL;
+		prom_free(self->layout[i].chunk);
+		self->layout[i].chunk = NULL;
+		self->layout[i].cap = 0;
+	}
+	for (int i = 0; i < PMT_FORMATS; i++) {
+		psb_destroy(self->cache[i].raw);
+		psb_destroy(self->cache[i].z);
+		self->cache[i].raw = self->cache[i].z = NULL;
+		self->cache[i].zencoding = 0;
+	}
+	psb_destroy(self->pb);
+	self->pb = NULL;
+	prom_free(self->pb_label);
+	self->pb_label = NULL;
+	prom_free(self->entry);
+	self->entry = NULL;
+	self->entry_cap = 0;
+}
+
+/**
+ * @brief PRIVATE Rebuild the template of the given metric. The caller must
+ *	hold the template lock and a read lock on the metric.
+ */
+static int
+pmt_build(pmt_t *self, prom_metric_t *metric, const char *prefix,
+	bool compact)
+{
+	self->valid = self->pb_valid = false;
+	for (int i = 0; i < PMT_LAYOUTS; i++)
+		self->layout[i].valid = false;
+	for (int i = 0; i < PMT_FORMATS; i++)
+		self->cache[i].valid = false;
+	self->lines = self->count = 0;
+	if (metric->series.count > UINT32_MAX)
+		return 1;
+	size_t n = pss_size(&metric->series);
+	if (self->entry_cap > PMT_TRIM_MIN && n < self->entry_cap / 4)
+		pmt_trim(self);
+	if (reserve_entries(self, n))
+		return 2;
+
+	// series ids are handed out in insertion order, ids of deleted series
+	// get reused
+	for (size_t id = 0; id < metric->series.count; id++) {
+		void *sample = pss_sample(&metric->series, id);
+		if (sample == NULL)
+			continue;
+		uint32_t lines;
+		if (metric->type == PROM_HISTOGRAM)
+			lines = phb_count(((pms_histogram_t *) sample)->buckets) + 3;
+		else if (metric->type == PROM_SUMMARY)
+			lines = ((pms_summary_t *) sample)->quantile_count + 2;
+		else
+			lines = 1;
+		if (add_entry(self, sample, lines, id))
+			return 2;
+		self->lines += lines;
+	}
+
+	prom_free(self->prefix);
+	self->prefix = NULL;
+	if (prefix != NULL && (self->prefix = prom_strdup(prefix)) == NULL)
+		return 3;
+	self->compact = compact;
+	self->generation = metric->generation;
+	self->valid = true;
+	return 0;
+}
+
+/**
+ * @brief PRIVATE Format the value of the given simple sample. Unless the
+ *	metric is striped, the value gets read from the series store directly,
+ *	so rendering all samples of a metric scans its values in order.
+ */
+static inline int
+put_sample(char *p, prom_metric_t *metric, pmt_entry_t *e) {
+	pss_value_t *value = pss_value(&metric->series, e->id);
+	if (!metric->integral) {
+		return prom_dtoa(p, (metric->series.stripes == 0)
+			? atomic_load_explicit(&value->r, memory_order_relaxed)
+			: pms_value(metric, e->id));
+	}
+	uint64_t v = atomic_load_explicit(&value->i, memory_order_relaxed);
+	if (v != PMS_INT_NAN)
+		return prom_utoa(p, v);
+	memcpy(p, "NaN", 4);
+	return 3;
+}
+
+/**
+ * @brief PRIVATE Get the exemplar slots stored in the given place, if the
+ *	remaining room for exemplars suffices for \c n slots.
+ */
+static inline pex_t *
+use_exemplars(_Atomic(pex_t *) *where, size_t *room, size_t n) {
+	pex_t *x = atomic_load_explicit(where, memory_order_acquire);
+	if (x == NULL || *room < n)
+		return NULL;
+	*room -= n;
+	return x;
+}
+
+/**
+ * @brief PRIVATE Render the exposition of the given metric using the given
+ *	layout of the template and append it to the given buffer. If \c om is
+ *	\c true , exemplars get appended to counter and histogram bucket lines.
+ *	The caller must hold the template lock and a read lock on the metric.
+ */
+static int
+render_text(pmt_t *self, prom_metric_t *metric, pmt_layout_t *y, bool om,
+	psb_t *dst)
+{
+	const char *text = psb_str(y->text);
+	const uint32_t *chunk = y->chunk;
+	// exemplars are rare: reserve room only for those which exist
+	size_t room = 0;
+	if (om && (metric->type == PROM_COUNTER || metric->type == PROM_HISTOGRAM)) {
+		for (size_t k = 0; k < self->count; k++) {
+			pmt_entry_t *e = &self->entry[k];
+			if (metric->type == PROM_COUNTER) {
+				if (atomic_load(pss_exemplar(&metric->series, e->id)) != NULL)
+					room++;
+			} else if (atomic_load(&((pms_histogram_t *) e->sample)->exemplar)
+				!= NULL)
+			{
+				room += self->entry[k].lines - 2;
+			}
+		}
+	}
+	char *start = psb_reserve(dst, chunk[self->lines + 1]
+		+ self->lines * PROM_DTOA_SIZE + room * PEX_SIZE);
+	if (start == NULL)
+		return 1;
+	char *p = start;
+	size_t l = 0;
+	for (size_t k = 0; k < self->count; k++) {
+		void *sample = self->entry[k].sample;
+		if (metric->type == PROM_HISTOGRAM) {
+			pms_histogram_t *h = (pms_histogram_t *) sample;
+			size_t count = self->entry[k].lines - 3;
+			pex_t *x = (room == 0)
+				? NULL : use_exemplars(&h->exemplar, &room, count + 1);
+			uint64_t cumulative = 0;
+			for (size_t i = 0; i <= count; i++, l++) {
+				cumulative += atomic_load_explicit(&h->bucket[i],
+					memory_order_relaxed);
+				memcpy(p, text + chunk[l], chunk[l + 1] - chunk[l]);
+				p += chunk[l + 1] - chunk[l];
+				p += prom_utoa(p, cumulative);
+				if (x != NULL)
+					p += pex_format(&x[i], p);
+			}
+			// +Inf bucket and count are the same
+			memcpy(p, text + chunk[l], chunk[l + 1] - chunk[l]);
+			p += chunk[l + 1] - chunk[l];
+			p += prom_utoa(p, cumulative);
+			l++;
+			memcpy(p, text + chunk[l], chunk[l + 1] - chunk[l]);
+			p += chunk[l + 1] - chunk[l];
+			p += prom_dtoa(p, atomic_load(&h->sum));
+			l++;
+		} else if (metric->type == PROM_SUMMARY) {
+			pms_summary_t *s = (pms_summary_t *) sample;
+			size_t n = s->quantile_count;
+			double value[n + 1];
+			uint64_t count;
+			if (pms_summary_collect(s, value, &count, &value[n]))
+				return 2;
+			for (size_t i = 0; i <= n; i++, l++) {
+				memcpy(p, text + chunk[l], chunk[l + 1] - chunk[l]);
+				p += chunk[l + 1] - chunk[l];
+				p += prom_dtoa(p, value[i]);
+			}
+			memcpy(p, text + chunk[l], chunk[l + 1] - chunk[l]);
+			p += chunk[l + 1] - chunk[l];
+			p += prom_utoa(p, count);
+			l++;
+		} else {
+			memcpy(p, text + chunk[l], chunk[l + 1] - chunk[l]);
+			p += chunk[l + 1] - chunk[l];
+			p += put_sample(p, metric, &self->entry[k]);
+			if (room > 0) {
+				pex_t *x = use_exemplars(
+					pss_exemplar(&metric->series, self->entry[k].id), &room, 1);
+				if (x != NULL)
+					p += pex_format(x, p);
+			}
+			l++;
+		}
+	}
+	memcpy(p, text + chunk[l], chunk[l + 1] - chunk[l]);
+	p += chunk[l + 1] - chunk[l];
+	psb_commit(dst, p - start);
+	return 0;
+}
+
+/**
+ * @brief PRIVATE Append the cached exposition compressed to the given
+ *	buffer. The compressed exposition gets cached as well, so that it needs
+ *	to be compressed again only if the exposition or the encoding changes.
+ */
+static int
+add_compressed(pmt_cache_t *c, psb_t *out, pcz_t *z) {
+	if (c->zencoding != (int) z->encoding) {
+		c->zencoding = PROM_ENCODING_IDENTITY;
+		psb_truncate(c->z, 0);
+		if (pcz_segment(z, psb_str(c->raw), psb_len(c->raw), c->z, &c->zcrc))
+			return 1;
+		c->zencoding = z->encoding;
+	}
+	if (psb_add_strn(out, psb_str(c->z), psb_len(c->z)))
+		return 2;
+	pcz_add(z, c->zcrc, psb_len(c->raw));
+	return 0;
+}
+
+int
+pmt_render(prom_metric_t *metric, const char *prefix, bool compact,
+	prom_format_t format, psb_t *out, bool *reused, pcz_t *z)
+{
+	PROM_ASSERT(metric != NULL);
+	PROM_ASSERT(format < PMT_FORMATS);
+	pmt_t *self = metric->tmpl;
+	pmt_cache_t *c = &self->cache[format];
+	int r = 0;
+
+	*reused = false;
+	if (pthread_mutex_lock(&self->lock)) {
+		PROM_WARN(PROM_PTHREAD_MUTEX_LOCK_ERROR, NULL);
+		return 1;
+	}
+	if (pthread_rwlock_rdlock(&metric->rwlock)) {
+		PROM_WARN(PROM_PTHREAD_RWLOCK_LOCK_ERROR, NULL);
+		pthread_mutex_unlock(&self->lock);
+		return 2;
+	}
+	if (!self->valid || self->generation != metric->generation
+		|| self->compact != compact
+		|| (prefix == NULL) != (self->prefix == NULL)
+		|| (prefix != NULL && strcmp(prefix, self->prefix) != 0))
+	{
+		if (pmt_build(self, metric, prefix, compact)) {
+			r = 3;
+			goto end;
+		}
+	}
+	if (c->raw == NULL) {
+		if ((c->raw = psb_new()) == NULL || (c->z = psb_new()) == NULL) {
+			r = 4;
+			goto end;
+		}
+	}
+	// Clear the flag before reading any value: a concurrent write either
+	// gets seen now or marks the metric dirty again. Writers order their
+	// seq_cst update before their flag check, the fence below orders the
+	// flag before the (relaxed) value loads (see pms_touch()). Summaries
+	// age out observations, so their values may change without any write.
+	if (atomic_exchange(&metric->dirty, false)) {
+		for (int i = 0; i < PMT_FORMATS; i++)
+			self->cache[i].valid = false;
+	}
+	atomic_thread_fence(memory_order_seq_cst);
+	if (c->valid && metric->type != PROM_SUMMARY) {
+		*reused = true;
+		if (z != NULL)
+			r = add_compressed(c, out, z) ? 5 : 0;
+		else
+			r = psb_add_strn(out, psb_str(c->raw), psb_len(c->raw)) ? 5 : 0;
+		goto end;
+	}
+	c->valid = false;
+	c->zencoding = PROM_ENCODING_IDENTITY;
+	bool om = format == PROM_FORMAT_OPENMETRICS;
+	pmt_layout_t *y = &self->layout[om ? 1 : 0];
+	if (format != PROM_FORMAT_PROTOBUF && !y->valid
+		&& build_layout(self, metric, om))
+	{
+		r = 3;
+		goto end;
+	}
+	if (format == PROM_FORMAT_TEXT && z == NULL) {
+		// the common case: render into the output and keep a copy
+		size_t start = psb_len(out);
+		if (render_text(self, metric, y, false, out)) {
+			r = 6;
+			goto end;
+		}
+		psb_truncate(c->raw, 0);
+		if (psb_add_strn(c->raw, psb_str(out) + start, psb_len(out) - start)
+			== 0)
+		{
+			// keeps the headroom for the next copy of about the same size
+			psb_trim(c->raw);
+			c->valid = true;
+		}
+		goto end;
+	}
+	psb_truncate(c->raw, 0);
+	if (format == PROM_FORMAT_PROTOBUF) {
+		if (!self->pb_valid && ppb_build(self, metric)) {
+			r = 7;
+			goto end;
+		}
+		r = ppb_render(self, metric, c->raw) ? 8 : 0;
+	} else {
+		r = render_text(self, metric, y, om, c->raw) ? 6 : 0;
+	}
+	if (r != 0)
+		goto end;
+	c->valid = true;
+	if (z != NULL)
+		r = add_compressed(c, out, z) ? 5 : 0;
+	else
+		r = psb_add_strn(out, psb_str(c->raw), psb_len(c->raw)) ? 5 : 0;
+
+end:
+	pthread_rwlock_unlock(&metric->rwlock);
+	pthread_mutex_unlock(&self->lock);
+	return r;
+}
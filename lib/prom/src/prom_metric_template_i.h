@@ -0,0 +1,62 @@
+/**
+ * Copyright 2021 Jens Elkner <jel+libprom@cs.uni-magdeburg.de>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef PROM_METRIC_TEMPLATE_I_H
+#define PROM_METRIC_TEMPLATE_I_H
+
+#include <stdbool.h>
+
+// Public
+#include "../include/prom_collector_registry.h"
+#include "../include/prom_string_builder.h"
+
+// Private
+#include "prom_compress_t.h"
+#include "prom_metric_t.h"
+#include "prom_metric_template_t.h"
+
+/**
+ * @brief PRIVATE Create a new, empty exposition template.
+ * @return \c NULL on error, the new template otherwise.
+ */
+pmt_t *pmt_new(void);
+
+/**
+ * @brief PRIVATE Destroy the given template.
+ */
+int pmt_destroy(pmt_t *self);
+
+/**
+ * @brief PRIVATE Append the exposition of the given metric in the given
+ *	format to the given string builder. The template of the metric gets
+ *	rebuilt if samples have been added or removed, or if \c prefix or
+ *	\c compact differ from the ones used last time. Otherwise only the
+ *	sample values get formatted. If none of the samples got modified since
+ *	the last call, the last rendered exposition gets appended as is. If a
+ *	compressor is given, the exposition gets appended as compressed segment,
+ *	which gets cached as well.
+ * @param metric	The metric to render.
+ * @param prefix	\c NULL or the prefix to prepend to each metric name.
+ * @param compact	If \c true , omit HELP and TYPE lines (protobuf: HELP only).
+ * @param format	The exposition format to use.
+ * @param out	Where to append the exposition.
+ * @param reused	Where to store, whether the last exposition got reused.
+ * @param z	\c NULL or the compressor to use.
+ * @return Non-zero integer value upon failure, \c 0 otherwise.
+ */
+int pmt_render(prom_metric_t *metric, const char *prefix, bool compact, prom_format_t format, psb_t *out, bool *reused, pcz_t *z);
+
+#endif  // PROM_METRIC_TEMPLATE_I_H
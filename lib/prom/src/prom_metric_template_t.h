@@ -0,0 +1,95 @@
+/**
+ * Copyright 2021 Jens Elkner <jel+libprom@cs.uni-magdeburg.de>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef PROM_METRIC_TEMPLATE_T_H
+#define PROM_METRIC_TEMPLATE_T_H
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+// Public
+#include "../include/prom_collector_registry.h"
+#include "../include/prom_string_builder.h"
+
+/**
+ * @brief PRIVATE A sample referenced by a template and the number of value
+ *	lines it contributes to the exposition.
+ */
+typedef struct pmt_entry {
+	void *sample;		/**< pms_histogram_t, pms_summary_t or metric */
+	uint32_t lines;		/**< number of lines of the sample */
+	uint32_t id;		/**< series id of the sample */
+} pmt_entry_t;
+
+/** @brief PRIVATE Number of exposition formats a template caches. */
+#define PMT_FORMATS 3
+
+/** @brief PRIVATE Number of text layouts: Prometheus text and OpenMetrics. */
+#define PMT_LAYOUTS 2
+
+/**
+ * @brief PRIVATE The static text of a metric family in one text format, see
+ *	\c pmt_t .
+ */
+typedef struct pmt_layout {
+	psb_t *text;			/**< the static text */
+	uint32_t *chunk;		/**< lines + 2 offsets of the chunks in text */
+	size_t cap;				/**< number of lines chunk has room for */
+	bool valid;				/**< true if text and chunk are usable */
+} pmt_layout_t;
+
+/**
+ * @brief PRIVATE The last rendered exposition of a metric family in one
+ *	format and its compressed variant.
+ */
+typedef struct pmt_cache {
+	psb_t *raw;			/**< NULL or the last rendered exposition */
+	psb_t *z;			/**< raw compressed as zencoding */
+	uint32_t zcrc;		/**< CRC32 of raw (gzip) */
+	int zencoding;		/**< prom_encoding_t of z, 0 if none */
+	bool valid;			/**< true if raw is usable */
+} pmt_cache_t;
+
+/**
+ * @brief PRIVATE The pre-rendered exposition of a metric family. The text
+ *	of a layout contains everything but the sample values, i.e.
+ *	\c lines + 1 chunks: the first one with HELP and TYPE lines and the
+ *	l_value of the first line, each following one with the newline of the
+ *	previous line and the l_value of the next one. The last chunk closes the
+ *	metric. Rendering a scrape boils down to copying chunk \c i followed by
+ *	the value of line \c i . The result gets cached per format and reused as
+ *	is as long as the metric is not dirty. Layouts and the static parts of
+ *	the protobuf exposition get built on demand, only.
+ */
+typedef struct pmt {
+	pthread_mutex_t lock;	/**< guards the template during rebuild/render */
+	pmt_layout_t layout[PMT_LAYOUTS];	/**< built on demand */
+	pmt_cache_t cache[PMT_FORMATS];	/**< per prom_format_t */
+	psb_t *pb;				/**< NULL or static protobuf parts */
+	uint32_t *pb_label;		/**< count + 1 offsets of the label pairs in pb */
+	size_t lines;			/**< number of value lines */
+	pmt_entry_t *entry;		/**< the samples in exposition order */
+	size_t count;			/**< number of entries */
+	size_t entry_cap;		/**< number of entries allocated */
+	unsigned long generation;	/**< metric generation of the template */
+	char *prefix;			/**< metric name prefix of the template */
+	bool compact;			/**< if true, HELP and TYPE have been omitted */
+	bool valid;				/**< false until the template has been built */
+	bool pb_valid;			/**< true if pb and pb_label are usable */
+} pmt_t;
+
+#endif  // PROM_METRIC_TEMPLATE_T_H
@@ -61,6 +61,9 @@ typedef enum fd_t {
 #define cup(what, val) \
 	prom_counter_reset(m[(what)], (val), lvals) ? 0 : 1 << (what)
 
+#define icup(what, val) \
+	prom_counter_reset_int(m[(what)], (val), lvals) ? 0 : 1 << (what)
+
 #define gup(what, val) \
 	prom_gauge_set(m[(what)], (val), lvals) ? 0 : 1 << (what)
 
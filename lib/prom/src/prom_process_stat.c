@@ -51,11 +51,11 @@ ppc_stats_new(prom_metric_t *m[]) {
 		return 0;
 
 	// /proc/self/stat Field 10
-	m[PM_MINFLT] = prom_counter_new("process_minor_pagefaults",
+	m[PM_MINFLT] = prom_counter_new_int("process_minor_pagefaults",
 		"Number of minor faults of the process "
 		"not caused a page load from disk", 0, NULL);
 	// /proc/self/stat Field 12
-	m[PM_MAJFLT] = prom_counter_new("process_major_pagefaults",
+	m[PM_MAJFLT] = prom_counter_new_int("process_major_pagefaults",
 		"Number of major faults of the process "
 		"caused a page load from disk", 0, NULL);
 #ifdef __sun
@@ -65,11 +65,11 @@ ppc_stats_new(prom_metric_t *m[]) {
 		"Percent of system memory used by process", 0, NULL);
 #else	// assume Linux
 	// /proc/self/stat Field 11
-	m[PM_CMINFLT] = prom_counter_new("process_children_minor_pagefaults",
+	m[PM_CMINFLT] = prom_counter_new_int("process_children_minor_pagefaults",
 		"Number of minor faults of the process waited-for children "
 		"not caused a page load from disk", 0, NULL);
 	// /proc/self/stat Field 13
-	m[PM_CMAJFLT] = prom_counter_new("process_children_major_pagefaults",
+	m[PM_CMAJFLT] = prom_counter_new_int("process_children_major_pagefaults",
 		"Number of major faults of the process's waited-for children "
 		"caused a page load from disk", 0, NULL);
 #endif
@@ -102,7 +102,7 @@ ppc_stats_new(prom_metric_t *m[]) {
 		"Number of threads in this process", 0, NULL);
 
 	// now - /proc/uptime + /proc/self/stat Field 22
-	m[PM_STARTTIME] = prom_counter_new("process_start_time_seconds",
+	m[PM_STARTTIME] = prom_counter_new_int("process_start_time_seconds",
 		"The time the process has been started in seconds elapsed since Epoch",
 		0, NULL);
 
@@ -114,13 +114,13 @@ ppc_stats_new(prom_metric_t *m[]) {
 		"Resident set size of memory in bytes", 0, NULL);
 
 #ifdef __sun
-	m[PM_VCTX] = prom_counter_new("process_voluntary_ctxsw_total",
+	m[PM_VCTX] = prom_counter_new_int("process_voluntary_ctxsw_total",
 		"Number of voluntary context switches", 0, NULL);
-	m[PM_ICTX] = prom_counter_new("process_involuntary_ctxsw_total",
+	m[PM_ICTX] = prom_counter_new_int("process_involuntary_ctxsw_total",
 		"Number of involuntary context switches", 0, NULL);
 #else // assume Linux
 	// /proc/self/stat Field 25
-	m[PM_BLKIO] = prom_counter_new("process_delayacct_blkio_ticks",
+	m[PM_BLKIO] = prom_counter_new_int("process_delayacct_blkio_ticks",
 		"Aggregated block I/O delays, measured in clock ticks (centiseconds)",
 		0, NULL);
 #endif
@@ -183,7 +183,7 @@ ppc_stats_update(int fd[], prom_metric_t *m[], const char **lvals) {
 		res |= gup(PM_RSS, NaN);
 		res |= gup(PM_CPU_UTIL, NaN);
 		res |= gup(PM_MEM_UTIL, NaN);
-		res |= cup(PM_STARTTIME, NaN);
+		res |= icup(PM_STARTTIME, PMS_INT_NAN);
 	} else {
 #ifdef CREATE_TESTFILES
 		FILE *f = fopen("/tmp/psinfo", "w+");
@@ -195,26 +195,26 @@ ppc_stats_update(int fd[], prom_metric_t *m[], const char **lvals) {
 		res |= gup(PM_RSS, psinfo.pr_rssize << 10);						// (24)
 		res |= gup(PM_CPU_UTIL, 100.0 * psinfo.pr_pctcpu / 0x8000);
 		res |= gup(PM_MEM_UTIL, 100.0 * psinfo.pr_pctmem / 0x8000);
-		res |= cup(PM_STARTTIME, psinfo.pr_start.tv_sec);				// (22)
+		res |= icup(PM_STARTTIME, psinfo.pr_start.tv_sec);				// (22)
 	}
 	if (fd[FD_USAGE] < 0
 		|| (pread(fd[FD_USAGE], &usage, sizeof(prusage_t), 0)) == -1)
 	{
 		perror("usage");
-		res |= cup(PM_MINFLT, NaN);
-		res |= cup(PM_MAJFLT, NaN);
-		res |= cup(PM_VCTX, NaN);
-		res |= cup(PM_ICTX, NaN);
+		res |= icup(PM_MINFLT, PMS_INT_NAN);
+		res |= icup(PM_MAJFLT, PMS_INT_NAN);
+		res |= icup(PM_VCTX, PMS_INT_NAN);
+		res |= icup(PM_ICTX, PMS_INT_NAN);
 	} else {
 #ifdef CREATE_TESTFILES
 		FILE *f = fopen("/tmp/usage", "w+");
 		fwrite(&status, sizeof(usage), 1, f);
 		fclose(f);
 #endif
-		res |= cup(PM_MINFLT, usage.pr_minf);							// (10)
-		res |= cup(PM_MAJFLT, usage.pr_majf);							// (12)
-		res |= cup(PM_VCTX, usage.pr_vctx);
-		res |= cup(PM_ICTX, usage.pr_ictx);
+		res |= icup(PM_MINFLT, usage.pr_minf);							// (10)
+		res |= icup(PM_MAJFLT, usage.pr_majf);							// (12)
+		res |= icup(PM_VCTX, usage.pr_vctx);
+		res |= icup(PM_ICTX, usage.pr_ictx);
 	}
 	return res;
 }
@@ -380,10 +380,10 @@ ppc_stats_update(int fd[], prom_metric_t *m[], const char **lvals) {
 		c = fill_stats(&stats, fd[FD_STAT]);
 
 	int res = 0;
-	res |= cup(PM_MINFLT, c ? NaN : stats.minflt);
-	res |= cup(PM_MAJFLT, c ? NaN : stats.majflt);
-	res |= cup(PM_CMINFLT, c ? NaN : stats.cminflt);
-	res |= cup(PM_CMAJFLT, c ? NaN : stats.cmajflt);
+	res |= icup(PM_MINFLT, c ? PMS_INT_NAN : stats.minflt);
+	res |= icup(PM_MAJFLT, c ? PMS_INT_NAN : stats.majflt);
+	res |= icup(PM_CMINFLT, c ? PMS_INT_NAN : stats.cminflt);
+	res |= icup(PM_CMAJFLT, c ? PMS_INT_NAN : stats.cmajflt);
 	res |= cup(PM_UTIME, c ? NaN : stats.utime);
 	res |= cup(PM_STIME, c ? NaN : stats.stime);
 	res |= cup(PM_TIME, c ? NaN : (stats.utime + stats.stime));
@@ -391,10 +391,10 @@ ppc_stats_update(int fd[], prom_metric_t *m[], const char **lvals) {
 	res |= cup(PM_CSTIME, c ? NaN : stats.cstime);
 	res |= cup(PM_CTIME, c ? NaN : (stats.cutime + stats.cstime));
 	res |= gup(PM_NUM_THREADS, c ? NaN : stats.num_threads);
-	res |= cup(PM_STARTTIME, c ? NaN : stats.starttime);
+	res |= icup(PM_STARTTIME, c ? PMS_INT_NAN : stats.starttime);
 	res |= gup(PM_VSIZE, c ? NaN : stats.vsize);
 	res |= gup(PM_RSS, c ? NaN : stats.rss);
-	res |= cup(PM_BLKIO, c ? NaN : stats.blkio);
+	res |= icup(PM_BLKIO, c ? PMS_INT_NAN : stats.blkio);
 
 	return res;
 }
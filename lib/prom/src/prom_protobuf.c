@@ -0,0 +1,413 @@
+/**
+ * Copyright 2021 Jens Elkner <jel+libprom@cs.uni-magdeburg.de>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Encodes metrics as io.prometheus.client.MetricFamily messages (see
+// https://github.com/prometheus/client_model/blob/master/io/prometheus/client/metrics.proto)
+// without any protobuf runtime: all messages are written directly into the
+// output buffer.
+
+#include <math.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <string.h>
+
+// Public
+#include "../include/prom_alloc.h"
+
+// Private
+#include "prom_assert.h"
+#include "prom_errors.h"
+#include "../include/prom_log.h"
+#include "prom_metric_sample_histogram_t.h"
+#include "prom_metric_sample_i.h"
+#include "prom_metric_sample_native_t.h"
+#include "prom_metric_sample_summary_i.h"
+#include "prom_metric_sample_t.h"
+#include "prom_protobuf_i.h"
+#include "prom_series_i.h"
+
+// MetricFamily
+#define PPB_FAMILY_NAME 1
+#define PPB_FAMILY_HELP 2
+#define PPB_FAMILY_TYPE 3
+#define PPB_FAMILY_METRIC 4
+// Metric
+#define PPB_METRIC_LABEL 1
+#define PPB_METRIC_GAUGE 2
+#define PPB_METRIC_COUNTER 3
+#define PPB_METRIC_SUMMARY 4
+#define PPB_METRIC_UNTYPED 5
+#define PPB_METRIC_HISTOGRAM 7
+// LabelPair
+#define PPB_LABEL_NAME 1
+#define PPB_LABEL_VALUE 2
+// Gauge, Counter, Untyped
+#define PPB_VALUE 1
+// Summary
+#define PPB_SUMMARY_COUNT 1
+#define PPB_SUMMARY_SUM 2
+#define PPB_SUMMARY_QUANTILE 3
+// Quantile
+#define PPB_QUANTILE_QUANTILE 1
+#define PPB_QUANTILE_VALUE 2
+// Histogram
+#define PPB_HISTOGRAM_COUNT 1
+#define PPB_HISTOGRAM_SUM 2
+#define PPB_HISTOGRAM_BUCKET 3
+#define PPB_HISTOGRAM_SCHEMA 5
+#define PPB_HISTOGRAM_ZERO_THRESHOLD 6
+#define PPB_HISTOGRAM_ZERO_COUNT 7
+#define PPB_HISTOGRAM_NEGATIVE_SPAN 9
+#define PPB_HISTOGRAM_NEGATIVE_DELTA 10
+#define PPB_HISTOGRAM_POSITIVE_SPAN 12
+#define PPB_HISTOGRAM_POSITIVE_DELTA 13
+// Bucket
+#define PPB_BUCKET_COUNT 1
+#define PPB_BUCKET_UPPER_BOUND 2
+// BucketSpan
+#define PPB_SPAN_OFFSET 1
+#define PPB_SPAN_LENGTH 2
+
+/**
+ * @brief PRIVATE Max. number of bytes a Metric message without its labels and
+ *	all nested headers need in addition to the values.
+ */
+#define PPB_METRIC_MAX 96
+
+/**
+ * @brief PRIVATE Max. number of bytes a classic bucket or quantile needs.
+ */
+#define PPB_BUCKET_MAX (2 + PPB_SLACK + 11 + 9)
+
+/**
+ * @brief PRIVATE Max. number of bytes a sparse bucket needs: a span of its
+ *	own and a delta.
+ */
+#define PPB_SPARSE_MAX (2 + PPB_SLACK + 12 + 10)
+
+/** @brief PRIVATE Maps prom_metric_type_t to MetricType. */
+static const uint8_t type_map[] = {
+	[PROM_COUNTER] = 0,
+	[PROM_GAUGE] = 1,
+	[PROM_HISTOGRAM] = 4,
+	[PROM_SUMMARY] = 2,
+	[PROM_UNTYPED] = 3,
+};
+
+/**
+ * @brief PRIVATE Get the l_value of the given sample which contains its
+ *	labels without any additional ones (like \c le or \c quantile ).
+ */
+static const char *
+plain_l_value(prom_metric_t *metric, pmt_entry_t *e) {
+	if (metric->type == PROM_HISTOGRAM)
+		return ((pms_histogram_t *) e->sample)->l_value[e->lines - 2];
+	if (metric->type == PROM_SUMMARY)
+		return ((pms_summary_t *) e->sample)->l_value[e->lines - 1];
+	return pss_l_value(&metric->series, e->id);
+}
+
+/**
+ * @brief PRIVATE Append the LabelPair messages of the given l_value to the
+ *	given buffer. Label values are not escaped in l_values, so the end of a
+ *	value gets determined by the key of the next label.
+ */
+static int
+add_labels(psb_t *pb, prom_metric_t *metric, const char *l_value) {
+	const char *s = strchr(l_value, '{');
+	if (s == NULL || metric->label_key_count == 0)
+		return 0;
+	size_t len = strlen(l_value);
+	char *start = psb_reserve(pb, len + metric->label_key_count * 24);
+	if (start == NULL)
+		return 1;
+	char *p = start;
+	s++;
+	for (size_t i = 0; i < metric->label_key_count; i++) {
+		const char *key = metric->label_keys[i];
+		size_t klen = strlen(key);
+		if (strncmp(s, key, klen) != 0 || s[klen] != '=' || s[klen + 1] != '"')
+			return 2;
+		const char *v = s + klen + 2;
+		const char *e;
+		if (i + 1 == metric->label_key_count) {
+			e = l_value + len - 2;
+			if (e < v)
+				return 3;
+		} else {
+			const char *next = metric->label_keys[i + 1];
+			size_t nlen = strlen(next);
+			for (e = strstr(v, "\","); e != NULL; e = strstr(e + 1, "\",")) {
+				if (strncmp(e + 2, next, nlen) == 0 && e[nlen + 2] == '='
+					&& e[nlen + 3] == '"')
+				{
+					break;
+				}
+			}
+			if (e == NULL)
+				return 3;
+		}
+		char *pair = ppb_open(p, PPB_METRIC_LABEL);
+		p = ppb_bytes(pair, PPB_LABEL_NAME, key, klen);
+		p = ppb_bytes(p, PPB_LABEL_VALUE, v, e - v);
+		p = ppb_close(pair, p);
+		s = e + 2;
+	}
+	psb_commit(pb, p - start);
+	return 0;
+}
+
+int
+ppb_build(pmt_t *tmpl, prom_metric_t *metric) {
+	PROM_ASSERT(tmpl != NULL && tmpl->valid);
+	tmpl->pb_valid = false;
+	if (tmpl->pb == NULL && (tmpl->pb = psb_new()) == NULL)
+		return 1;
+	uint32_t *l = (uint32_t *) prom_realloc(tmpl->pb_label,
+		(tmpl->count + 1) * sizeof(uint32_t));
+	if (l == NULL)
+		return 2;
+	tmpl->pb_label = l;
+
+	psb_t *pb = tmpl->pb;
+	psb_truncate(pb, 0);
+	size_t plen = (tmpl->prefix == NULL) ? 0 : strlen(tmpl->prefix);
+	size_t nlen = strlen(metric->name);
+	size_t hlen = (tmpl->compact || metric->help == NULL)
+		? 0 : strlen(metric->help);
+	char *start = psb_reserve(pb, plen + nlen + hlen + 32);
+	if (start == NULL)
+		return 3;
+	char *p = ppb_varint(ppb_tag(start, PPB_FAMILY_NAME, PPB_LEN), plen + nlen);
+	if (plen > 0)
+		memcpy(p, tmpl->prefix, plen);
+	memcpy(p + plen, metric->name, nlen);
+	p += plen + nlen;
+	if (hlen > 0)
+		p = ppb_bytes(p, PPB_FAMILY_HELP, metric->help, hlen);
+	p = ppb_uint(p, PPB_FAMILY_TYPE, type_map[metric->type]);
+	psb_commit(pb, p - start);
+
+	l[0] = psb_len(pb);
+	for (size_t k = 0; k < tmpl->count; k++) {
+		const char *l_value = plain_l_value(metric, &tmpl->entry[k]);
+		if (add_labels(pb, metric, l_value)) {
+			PROM_WARN("Unable to extract the labels of '%s'", l_value);
+			return 4;
+		}
+		if (psb_len(pb) > UINT32_MAX)
+			return 5;
+		l[k + 1] = psb_len(pb);
+	}
+	tmpl->pb_valid = true;
+	return 0;
+}
+
+/**
+ * @brief PRIVATE Find the next span of sparse buckets starting at index
+ *	\c *i . Like the Go client, gaps of up to 2 empty buckets get included
+ *	into a span, larger ones start a new span.
+ * @return \c false if there are no more populated buckets, \c true
+ *	otherwise. The span covers [*i, *j].
+ */
+static bool
+next_span(pms_native_buckets_t *b, uint32_t *i, uint32_t *j) {
+	uint32_t k = *i;
+	while (k < b->len && b->count[k] == 0)
+		k++;
+	if (k == b->len)
+		return false;
+	*i = k;
+	uint32_t last = k;
+	for (k++; k < b->len && k - last <= 3; k++) {
+		if (b->count[k] != 0)
+			last = k;
+	}
+	*j = last;
+	return true;
+}
+
+/**
+ * @brief PRIVATE Write the spans and the deltas of the given sparse buckets.
+ */
+static char *
+add_sparse(char *p, pms_native_buckets_t *b, unsigned int span_field,
+	unsigned int delta_field)
+{
+	uint32_t i = 0, j = 0;
+	int64_t end = 0;
+	bool first = true;
+
+	while (next_span(b, &i, &j)) {
+		int64_t offset = b->offset + (int64_t) i;
+		char *span = ppb_open(p, span_field);
+		p = ppb_sint(span, PPB_SPAN_OFFSET, first ? offset : offset - end);
+		p = ppb_uint(p, PPB_SPAN_LENGTH, j - i + 1);
+		p = ppb_close(span, p);
+		end = b->offset + (int64_t) j + 1;
+		first = false;
+		i = j + 1;
+	}
+	if (first)
+		return p;
+	// packed sint64
+	char *delta = ppb_open(p, delta_field);
+	int64_t prev = 0;
+	p = delta;
+	for (i = 0; next_span(b, &i, &j); i = j + 1) {
+		for (uint32_t k = i; k <= j; k++) {
+			int64_t v = (int64_t) b->count[k] - prev;
+			p = ppb_varint(p, ((uint64_t) v << 1) ^ (uint64_t) (v >> 63));
+			prev = (int64_t) b->count[k];
+		}
+	}
+	return ppb_close(delta, p);
+}
+
+/**
+ * @brief PRIVATE Get the value of the given simple sample from the series
+ *	store of its metric, see \c put_sample() of the text exposition.
+ */
+static inline double
+sample_value(prom_metric_t *metric, pmt_entry_t *e) {
+	pss_value_t *value = pss_value(&metric->series, e->id);
+	if (!metric->integral) {
+		return (metric->series.stripes == 0)
+			? atomic_load_explicit(&value->r, memory_order_relaxed)
+			: pms_value(metric, e->id);
+	}
+	uint64_t v = atomic_load_explicit(&value->i, memory_order_relaxed);
+	return (v == PMS_INT_NAN) ? NAN : (double) v;
+}
+
+int
+ppb_render(pmt_t *tmpl, prom_metric_t *metric, psb_t *out) {
+	PROM_ASSERT(tmpl != NULL && tmpl->pb_valid);
+	const char *pb = psb_str(tmpl->pb);
+	const uint32_t *label = tmpl->pb_label;
+	size_t base = psb_len(out);
+
+	// like the Go client, omit families without any metric
+	if (tmpl->count == 0)
+		return 0;
+
+	// room for the length of the family, fixed up at the end
+	char *p = psb_reserve(out, label[0] + 10);
+	if (p == NULL)
+		return 1;
+	memcpy(p + 10, pb, label[0]);
+	psb_commit(out, label[0] + 10);
+
+	for (size_t k = 0; k < tmpl->count; k++) {
+		void *sample = tmpl->entry[k].sample;
+		size_t llen = label[k + 1] - label[k];
+		size_t max = llen + PPB_METRIC_MAX;
+		pms_native_t *native = NULL;
+
+		if (metric->type == PROM_HISTOGRAM) {
+			pms_histogram_t *h = (pms_histogram_t *) sample;
+			max += phb_count(h->buckets) * PPB_BUCKET_MAX;
+			native = h->native;
+			if (native != NULL) {
+				if (pthread_mutex_lock(&native->lock)) {
+					PROM_WARN(PROM_PTHREAD_MUTEX_LOCK_ERROR, NULL);
+					return 2;
+				}
+				max += (native->pos.len + native->neg.len) * PPB_SPARSE_MAX;
+			}
+		} else if (metric->type == PROM_SUMMARY) {
+			max += ((pms_summary_t *) sample)->quantile_count * PPB_BUCKET_MAX;
+		}
+		char *start = psb_reserve(out, max);
+		if (start == NULL) {
+			if (native != NULL)
+				pthread_mutex_unlock(&native->lock);
+			return 3;
+		}
+		char *m = ppb_open(start, PPB_FAMILY_METRIC);
+		memcpy(m, pb + label[k], llen);
+		p = m + llen;
+		if (metric->type == PROM_HISTOGRAM) {
+			pms_histogram_t *h = (pms_histogram_t *) sample;
+			size_t count = phb_count(h->buckets);
+			uint64_t cumulative = 0;
+			char *v = ppb_open(p, PPB_METRIC_HISTOGRAM);
+			p = v;
+			// the +Inf bucket is implied by the sample count
+			for (size_t i = 0; i < count; i++) {
+				cumulative += atomic_load_explicit(&h->bucket[i],
+					memory_order_relaxed);
+				char *b = ppb_open(p, PPB_HISTOGRAM_BUCKET);
+				p = ppb_uint(b, PPB_BUCKET_COUNT, cumulative);
+				p = ppb_double(p, PPB_BUCKET_UPPER_BOUND,
+					h->buckets->upper_bound[i]);
+				p = ppb_close(b, p);
+			}
+			cumulative += atomic_load_explicit(&h->bucket[count],
+				memory_order_relaxed);
+			p = ppb_uint(p, PPB_HISTOGRAM_COUNT, cumulative);
+			p = ppb_double(p, PPB_HISTOGRAM_SUM, atomic_load(&h->sum));
+			if (native != NULL) {
+				p = ppb_sint(p, PPB_HISTOGRAM_SCHEMA, native->schema);
+				p = ppb_double(p, PPB_HISTOGRAM_ZERO_THRESHOLD,
+					native->zero_threshold);
+				p = ppb_uint(p, PPB_HISTOGRAM_ZERO_COUNT, native->zero_count);
+				p = add_sparse(p, &native->neg, PPB_HISTOGRAM_NEGATIVE_SPAN,
+					PPB_HISTOGRAM_NEGATIVE_DELTA);
+				p = add_sparse(p, &native->pos, PPB_HISTOGRAM_POSITIVE_SPAN,
+					PPB_HISTOGRAM_POSITIVE_DELTA);
+				pthread_mutex_unlock(&native->lock);
+			}
+			p = ppb_close(v, p);
+		} else if (metric->type == PROM_SUMMARY) {
+			pms_summary_t *s = (pms_summary_t *) sample;
+			size_t n = s->quantile_count;
+			double value[n + 1];
+			uint64_t count;
+			if (pms_summary_collect(s, value, &count, &value[n]))
+				return 4;
+			char *v = ppb_open(p, PPB_METRIC_SUMMARY);
+			p = ppb_uint(v, PPB_SUMMARY_COUNT, count);
+			p = ppb_double(p, PPB_SUMMARY_SUM, value[n]);
+			for (size_t i = 0; i < n; i++) {
+				char *q = ppb_open(p, PPB_SUMMARY_QUANTILE);
+				p = ppb_double(q, PPB_QUANTILE_QUANTILE, s->quantiles[i]);
+				p = ppb_double(p, PPB_QUANTILE_VALUE, value[i]);
+				p = ppb_close(q, p);
+			}
+			p = ppb_close(v, p);
+		} else {
+			unsigned int field = (metric->type == PROM_COUNTER)
+				? PPB_METRIC_COUNTER
+				: (metric->type == PROM_GAUGE)
+					? PPB_METRIC_GAUGE
+					: PPB_METRIC_UNTYPED;
+			char *v = ppb_open(p, field);
+			p = ppb_double(v, PPB_VALUE, sample_value(metric, &tmpl->entry[k]));
+			p = ppb_close(v, p);
+		}
+		p = ppb_close(m, p);
+		psb_commit(out, p - start);
+	}
+
+	// prepend the length and drop the unused part of its room
+	char *s = psb_str(out) + base;
+	size_t len = psb_len(out) - base - 10;
+	size_t n = ppb_varint_size(len);
+	memmove(s + n, s + 10, len);
+	ppb_varint(s, len);
+	return psb_truncate(out, base + n + len);
+}
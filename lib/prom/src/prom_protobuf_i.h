@@ -0,0 +1,169 @@
+/**
+ * Copyright 2021 Jens Elkner <jel+libprom@cs.uni-magdeburg.de>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef PROM_PROTOBUF_I_H
+#define PROM_PROTOBUF_I_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+// Public
+#include "../include/prom_string_builder.h"
+
+// Private
+#include "prom_metric_t.h"
+#include "prom_metric_template_t.h"
+
+/** @brief PRIVATE protobuf wire type of varints. */
+#define PPB_VARINT 0
+/** @brief PRIVATE protobuf wire type of 64 bit fixed size values. */
+#define PPB_I64 1
+/** @brief PRIVATE protobuf wire type of length delimited values. */
+#define PPB_LEN 2
+
+/**
+ * @brief PRIVATE Bytes to reserve in addition to the 1 byte length
+ *	placeholder written by \c ppb_open() , so that \c ppb_close() may grow
+ *	it to the final varint.
+ */
+#define PPB_SLACK 4
+
+/**
+ * @brief PRIVATE Write the given value as varint.
+ * @return The position right after the written bytes.
+ */
+static inline char *
+ppb_varint(char *p, uint64_t v) {
+	while (v >= 0x80) {
+		*p++ = (char) (v | 0x80);
+		v >>= 7;
+	}
+	*p++ = (char) v;
+	return p;
+}
+
+/**
+ * @brief PRIVATE Get the number of bytes the given value needs as varint.
+ */
+static inline size_t
+ppb_varint_size(uint64_t v) {
+	size_t n = 1;
+	while (v >= 0x80) {
+		v >>= 7;
+		n++;
+	}
+	return n;
+}
+
+/**
+ * @brief PRIVATE Write the key of the given field.
+ */
+static inline char *
+ppb_tag(char *p, unsigned int field, unsigned int wire) {
+	return ppb_varint(p, (field << 3) | wire);
+}
+
+/**
+ * @brief PRIVATE Write the given field as uint32/uint64.
+ */
+static inline char *
+ppb_uint(char *p, unsigned int field, uint64_t v) {
+	return ppb_varint(ppb_tag(p, field, PPB_VARINT), v);
+}
+
+/**
+ * @brief PRIVATE Write the given field as sint32/sint64 (zigzag encoded).
+ */
+static inline char *
+ppb_sint(char *p, unsigned int field, int64_t v) {
+	return ppb_uint(p, field, ((uint64_t) v << 1) ^ (uint64_t) (v >> 63));
+}
+
+/**
+ * @brief PRIVATE Write the given field as double.
+ */
+static inline char *
+ppb_double(char *p, unsigned int field, double v) {
+	uint64_t u;
+	memcpy(&u, &v, sizeof(u));
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+	u = __builtin_bswap64(u);
+#endif
+	p = ppb_tag(p, field, PPB_I64);
+	memcpy(p, &u, sizeof(u));
+	return p + sizeof(u);
+}
+
+/**
+ * @brief PRIVATE Write the given field as string/bytes.
+ */
+static inline char *
+ppb_bytes(char *p, unsigned int field, const char *s, size_t len) {
+	p = ppb_varint(ppb_tag(p, field, PPB_LEN), len);
+	memcpy(p, s, len);
+	return p + len;
+}
+
+/**
+ * @brief PRIVATE Start the given embedded message field. Its length is not
+ *	known yet, so a 1 byte placeholder gets written.
+ * @return Where the content of the message starts.
+ */
+static inline char *
+ppb_open(char *p, unsigned int field) {
+	return ppb_tag(p, field, PPB_LEN) + 1;
+}
+
+/**
+ * @brief PRIVATE Finish the embedded message started by \c ppb_open() , i.e.
+ *	write its length. If it needs more than 1 byte, the content gets moved,
+ *	which requires PPB_SLACK spare bytes after \c end .
+ * @param body	The value returned by \c ppb_open() .
+ * @param end	Where the content of the message ends.
+ * @return The new end of the message.
+ */
+static inline char *
+ppb_close(char *body, char *end) {
+	size_t len = end - body;
+	if (len < 0x80) {
+		body[-1] = (char) len;
+		return end;
+	}
+	size_t n = ppb_varint_size(len);
+	memmove(body + n - 1, body, len);
+	ppb_varint(body - 1, len);
+	return end + n - 1;
+}
+
+/**
+ * @brief PRIVATE Build the static parts of the protobuf exposition of the
+ *	given metric, i.e. the MetricFamily header and the label pairs of each
+ *	sample of its template. The template itself must be valid. The caller
+ *	must hold the template lock and a read lock on the metric.
+ * @return Non-zero integer value upon failure, \c 0 otherwise.
+ */
+int ppb_build(pmt_t *tmpl, prom_metric_t *metric);
+
+/**
+ * @brief PRIVATE Append the given metric as length delimited MetricFamily
+ *	message to the given buffer. The caller must hold the template lock and a
+ *	read lock on the metric.
+ * @return Non-zero integer value upon failure, \c 0 otherwise.
+ */
+int ppb_render(pmt_t *tmpl, prom_metric_t *metric, psb_t *out);
+
+#endif  // PROM_PROTOBUF_I_H
@@ -0,0 +1,270 @@
+/**
+ * Copyright 2021 Jens Elkner <jel+libprom@cs.uni-magdeburg.de>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define PROM_ALLOC_SUBSYSTEM PROM_ALLOC_SAMPLE
+
+#include <string.h>
+
+// Public
+#include "../include/prom_alloc.h"
+
+// Private
+#include "prom_assert.h"
+#include "prom_exemplar_t.h"
+#include "prom_map_i.h"
+#include "prom_series_i.h"
+
+/** Max. number of blocks, i.e. enough for all ids a size_t can hold. */
+#define PSS_MAX_BLOCKS (64 - PSS_FIRST_SHIFT + 1)
+
+/** Min. number of index slots. */
+#define PSS_INDEX_MIN 4
+
+/** Bytes per series of all columns of a block but the stripes. */
+#define PSS_COLUMNS_SIZE (sizeof(pss_value_t) + sizeof(char *) + sizeof(pms_t) \
+	+ sizeof(pex_t *) + sizeof(double) + sizeof(uint16_t) + sizeof(atomic_bool))
+
+void
+pss_init(pss_t *self) {
+	PROM_ASSERT(self != NULL);
+	atomic_init(&self->block, NULL);
+	atomic_init(&self->blocks, 0);
+	self->stripes = 0;
+	self->count = 0;
+	self->free = 0;
+	self->index = NULL;
+	self->index_size = 0;
+	self->size = 0;
+}
+
+/**
+ * @brief PRIVATE Get the number of blocks the given array of blocks has
+ *	room for: arrays double in size, each one has an extra slot at its end,
+ *	which refers to the array it replaced.
+ */
+static unsigned int
+pss_capacity(unsigned int blocks) {
+	unsigned int c = 1;
+	while (c < blocks)
+		c <<= 1;
+	return c;
+}
+
+void
+pss_destroy(pss_t *self) {
+	if (self == NULL)
+		return;
+	unsigned int blocks = atomic_load(&self->blocks);
+	pss_value_t **block = atomic_load(&self->block);
+	for (unsigned int b = 0; b < blocks; b++) {
+		size_t n = pss_block_size(b);
+		const char **l_value = pss_block_l_value(block[b], n);
+		_Atomic(pex_t *) *exemplar = pss_block_exemplar(block[b], n);
+		if (pss_block_start(b) + n > self->count)
+			n = self->count - pss_block_start(b);
+		for (size_t i = 0; i < n; i++) {
+			prom_free((char *) l_value[i]);
+			prom_free(atomic_load(&exemplar[i]));
+		}
+		prom_free((pms_stripe_t *) block[b]
+			- pss_block_size(b) * self->stripes);
+	}
+	for (unsigned int c = pss_capacity(blocks); block != NULL; c >>= 1) {
+		pss_value_t **prev = (pss_value_t **) block[c];
+		prom_free(block);
+		block = prev;
+	}
+	prom_free(self->index);
+	pss_init(self);
+}
+
+/**
+ * @brief PRIVATE Append a block to the given store. Its stripes and columns
+ *	get allocated in one go, zeroed. If the stripes or values fill at least
+ *	a cache line, the values start at a cache line boundary.
+ */
+static int
+pss_grow(pss_t *self) {
+	unsigned int blocks = atomic_load_explicit(&self->blocks,
+		memory_order_relaxed);
+	if (blocks == PSS_MAX_BLOCKS)
+		return 1;
+	size_t n = pss_block_size(blocks);
+	size_t stripes = n * self->stripes * sizeof(pms_stripe_t);
+	size_t size = stripes + n * PSS_COLUMNS_SIZE;
+	char *p = (stripes == 0 && n * sizeof(pss_value_t) < PROM_CACHE_LINE)
+		? (char *) prom_malloc(size)
+		: (char *) prom_aligned_alloc(PROM_CACHE_LINE, size);
+	if (p == NULL)
+		return 2;
+	memset(p, 0, size);
+
+	pss_value_t **block = atomic_load_explicit(&self->block,
+		memory_order_relaxed);
+	unsigned int c = pss_capacity(blocks);
+	if (block == NULL || blocks == c) {
+		// updates may still use the old array, so keep it
+		unsigned int nc = (block == NULL) ? 1 : c << 1;
+		pss_value_t **a = (pss_value_t **)
+			prom_malloc((nc + 1) * sizeof(pss_value_t *));
+		if (a == NULL) {
+			prom_free(p);
+			return 3;
+		}
+		memset(a, 0, (nc + 1) * sizeof(pss_value_t *));
+		if (block != NULL)
+			memcpy(a, block, blocks * sizeof(pss_value_t *));
+		a[nc] = (pss_value_t *) block;
+		atomic_store_explicit(&self->block, a, memory_order_release);
+		block = a;
+	}
+	block[blocks] = (pss_value_t *) (p + stripes);
+	atomic_store_explicit(&self->blocks, blocks + 1, memory_order_release);
+	return 0;
+}
+
+/**
+ * @brief PRIVATE Get the index slot of the given l_value in the given store:
+ *	either the one referring to its series or the empty one ending the
+ *	probe sequence.
+ */
+static size_t
+pss_probe(pss_t *self, const char *l_value) {
+	size_t mask = self->index_size - 1;
+	size_t k = prom_map_hash(l_value) & mask;
+	for (; self->index[k] != 0; k = (k + 1) & mask) {
+		if (strcmp(pss_l_value(self, self->index[k] - 1), l_value) == 0)
+			break;
+	}
+	return k;
+}
+
+/**
+ * @brief PRIVATE Double the number of slots of the index of the given store.
+ */
+static int
+pss_rehash(pss_t *self) {
+	size_t size = (self->index_size == 0)
+		? PSS_INDEX_MIN
+		: self->index_size << 1;
+	uint32_t *index = (uint32_t *) prom_malloc(size * sizeof(uint32_t));
+	if (index == NULL)
+		return 1;
+	memset(index, 0, size * sizeof(uint32_t));
+	uint32_t *old = self->index;
+	size_t old_size = self->index_size;
+	self->index = index;
+	self->index_size = size;
+	for (size_t k = 0; k < old_size; k++) {
+		if (old[k] != 0)
+			index[pss_probe(self, pss_l_value(self, old[k] - 1))] = old[k];
+	}
+	prom_free(old);
+	return 0;
+}
+
+int
+pss_find(pss_t *self, const char *l_value, size_t *id) {
+	PROM_ASSERT(self != NULL && l_value != NULL && id != NULL);
+	if (self->size == 0)
+		return 1;
+	size_t k = pss_probe(self, l_value);
+	if (self->index[k] == 0)
+		return 1;
+	*id = self->index[k] - 1;
+	return 0;
+}
+
+int
+pss_add(pss_t *self, const char *l_value, size_t *id) {
+	PROM_ASSERT(self != NULL && l_value != NULL && id != NULL);
+	// ids must fit into the uint32_t of the index and template entries
+	if (self->free == 0 && self->count == UINT32_MAX)
+		return 1;
+	if (self->free == 0 && pss_block_of(self->count) == self->blocks
+		&& pss_grow(self))
+	{
+		return 1;
+	}
+	// keep the load of the index at most 50 %
+	if ((self->size + 1) * 2 > self->index_size && pss_rehash(self))
+		return 1;
+	char *l = prom_strdup(l_value);
+	if (l == NULL)
+		return 2;
+	size_t n;
+	if (self->free != 0) {
+		n = self->free - 1;
+		self->free = atomic_load(&pss_value(self, n)->i);
+	} else {
+		n = self->count++;
+	}
+	unsigned int b = pss_block_of(n);
+	size_t size = pss_block_size(b), i = n - pss_block_start(b);
+	pss_value_t *v = pss_block(self, b);
+	atomic_init(&v[i].i, 0);
+	pss_block_l_value(v, size)[i] = l;
+	atomic_init(&pss_block_slot(v, size)[i].ref, NULL);
+	atomic_init(&pss_block_exemplar(v, size)[i], NULL);
+	pss_block_created(v, size)[i] = 0;
+	pss_block_idle(v, size)[i] = 0;
+	atomic_init(&pss_block_touched(v, size)[i], false);
+	pms_stripe_t *s = pss_stripes(self, n);
+	for (unsigned int k = 0; k < self->stripes; k++)
+		atomic_init(&s[k].value, 0.0);
+	self->index[pss_probe(self, l)] = n + 1;
+	self->size++;
+	*id = n;
+	return 0;
+}
+
+void
+pss_unlink(pss_t *self, size_t id) {
+	PROM_ASSERT(self != NULL && id < self->count);
+	size_t mask = self->index_size - 1;
+	size_t k = pss_probe(self, pss_l_value(self, id));
+	if (self->index[k] != id + 1)
+		return;
+	// shift back the following entries of the probe sequence, which would
+	// not be found anymore otherwise
+	for (size_t j = (k + 1) & mask; self->index[j] != 0; j = (j + 1) & mask) {
+		size_t home = prom_map_hash(pss_l_value(self, self->index[j] - 1))
+			& mask;
+		if (((j - home) & mask) >= ((j - k) & mask)) {
+			self->index[k] = self->index[j];
+			k = j;
+		}
+	}
+	self->index[k] = 0;
+	self->size--;
+}
+
+void
+pss_remove(pss_t *self, size_t id) {
+	PROM_ASSERT(self != NULL && id < self->count);
+	unsigned int b = pss_block_of(id);
+	size_t size = pss_block_size(b), i = id - pss_block_start(b);
+	pss_value_t *v = pss_block(self, b);
+	const char **l_value = pss_block_l_value(v, size);
+	_Atomic(pex_t *) *exemplar = pss_block_exemplar(v, size);
+	prom_free((char *) l_value[i]);
+	l_value[i] = NULL;
+	prom_free(atomic_load(&exemplar[i]));
+	atomic_store(&exemplar[i], NULL);
+	atomic_store(&pss_block_slot(v, size)[i].ref, NULL);
+	atomic_store(&v[i].i, self->free);
+	self->free = id + 1;
+}
@@ -0,0 +1,293 @@
+/**
+ * Copyright 2021 Jens Elkner <jel+libprom@cs.uni-magdeburg.de>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef PROM_SERIES_I_H
+#define PROM_SERIES_I_H
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Public
+#include "../include/prom_metric_sample.h"
+
+// Private
+#include "prom_series_t.h"
+
+/** @brief PRIVATE log2 of the number of series block 0 has room for. */
+#define PSS_FIRST_SHIFT 1
+
+/** @brief PRIVATE Number of series block 0 has room for. */
+#define PSS_FIRST_SIZE (1U << PSS_FIRST_SHIFT)
+
+struct pex;
+
+/**
+ * @brief PRIVATE Initialize the given series store.
+ */
+void pss_init(pss_t *self);
+
+/**
+ * @brief PRIVATE Release all blocks, l_values and exemplars of the given
+ *	series store. Sample objects referred to by its slots are left as is.
+ */
+void pss_destroy(pss_t *self);
+
+/**
+ * @brief PRIVATE Add a series with the given l_value, a zero value and an
+ *	empty slot to the given store and its index. The id of a removed series
+ *	gets reused, if any. The caller must hold the write lock of the metric.
+ * @param l_value	Gets copied.
+ * @param id	Where to store the id of the new series.
+ * @return \c 0 on success, a non-zero integer value otherwise.
+ */
+int pss_add(pss_t *self, const char *l_value, size_t *id);
+
+/**
+ * @brief PRIVATE Find the series with the given l_value in the index of the
+ *	given store. The caller must hold a lock of the metric.
+ * @param id	Where to store the id of the series found.
+ * @return \c 0 if found, a non-zero integer value otherwise.
+ */
+int pss_find(pss_t *self, const char *l_value, size_t *id);
+
+/**
+ * @brief PRIVATE Drop the series with the given id from the index of the
+ *	given store, so that it cannot be found anymore. Its slots stay as they
+ *	are. The caller must hold the write lock of the metric.
+ */
+void pss_unlink(pss_t *self, size_t id);
+
+/**
+ * @brief PRIVATE Remove the series with the given id from the given store,
+ *	i.e. release its l_value and exemplar and make its id available for
+ *	reuse. It must have been dropped from the index already and nobody may
+ *	use its slots anymore. The caller must hold the write lock of the metric.
+ */
+void pss_remove(pss_t *self, size_t id);
+
+/**
+ * @brief PRIVATE Get the number of series in the index of the given store.
+ */
+static inline size_t
+pss_size(pss_t *self) {
+	return self->size;
+}
+
+/**
+ * @brief PRIVATE Get the number of the block containing the given id.
+ */
+static inline unsigned int
+pss_block_of(size_t id) {
+	return (id < PSS_FIRST_SIZE)
+		? 0
+		: 63 - __builtin_clzll(id) - PSS_FIRST_SHIFT + 1;
+}
+
+/**
+ * @brief PRIVATE Get the first id of the given block.
+ */
+static inline size_t
+pss_block_start(unsigned int block) {
+	return (block == 0) ? 0 : (size_t) 1 << (block + PSS_FIRST_SHIFT - 1);
+}
+
+/**
+ * @brief PRIVATE Get the number of series the given block has room for.
+ */
+static inline size_t
+pss_block_size(unsigned int block) {
+	return (block == 0) ? PSS_FIRST_SIZE : pss_block_start(block);
+}
+
+/**
+ * @brief PRIVATE Get the values of the given block. May be called without
+ *	holding a lock for any block containing an id handed out before.
+ */
+static inline pss_value_t *
+pss_block(pss_t *self, unsigned int block) {
+	return atomic_load_explicit(&self->block, memory_order_acquire)[block];
+}
+
+/**
+ * @brief PRIVATE Get the l_values of the block with the given values and
+ *	size, which follow its values.
+ */
+static inline const char **
+pss_block_l_value(pss_value_t *values, size_t size) {
+	return (const char **) (values + size);
+}
+
+/**
+ * @brief PRIVATE Get the sample slots of the block with the given values and
+ *	size, which follow its l_values.
+ */
+static inline pms_t *
+pss_block_slot(pss_value_t *values, size_t size) {
+	return (pms_t *) (pss_block_l_value(values, size) + size);
+}
+
+/**
+ * @brief PRIVATE Get the exemplars of the block with the given values and
+ *	size, which follow its slots.
+ */
+static inline _Atomic(struct pex *) *
+pss_block_exemplar(pss_value_t *values, size_t size) {
+	return (_Atomic(struct pex *) *) (pss_block_slot(values, size) + size);
+}
+
+/**
+ * @brief PRIVATE Get the creation times of the block with the given values
+ *	and size, which follow its exemplars.
+ */
+static inline double *
+pss_block_created(pss_value_t *values, size_t size) {
+	return (double *) (pss_block_exemplar(values, size) + size);
+}
+
+/**
+ * @brief PRIVATE Get the idle counters of the block with the given values
+ *	and size, which follow its creation times.
+ */
+static inline uint16_t *
+pss_block_idle(pss_value_t *values, size_t size) {
+	return (uint16_t *) (pss_block_created(values, size) + size);
+}
+
+/**
+ * @brief PRIVATE Get the touched flags of the block with the given values
+ *	and size, which follow its idle counters.
+ */
+static inline atomic_bool *
+pss_block_touched(pss_value_t *values, size_t size) {
+	return (atomic_bool *) (pss_block_idle(values, size) + size);
+}
+
+/**
+ * @brief PRIVATE Get the id of the series with the given slot. May be called
+ *	without holding a lock. The last block holds half of all ids, so the
+ *	search starts there.
+ */
+static inline size_t
+pss_id(pss_t *self, const pms_t *slot) {
+	unsigned int b = atomic_load_explicit(&self->blocks, memory_order_acquire);
+	pss_value_t **block = atomic_load_explicit(&self->block,
+		memory_order_acquire);
+	for (;;) {
+		b--;
+		size_t n = pss_block_size(b);
+		const pms_t *first = pss_block_slot(block[b], n);
+		if (slot >= first && slot < first + n)
+			return pss_block_start(b) + (slot - first);
+	}
+}
+
+/**
+ * @brief PRIVATE Get the value slot of the series with the given id.
+ */
+static inline pss_value_t *
+pss_value(pss_t *self, size_t id) {
+	unsigned int b = pss_block_of(id);
+	return pss_block(self, b) + (id - pss_block_start(b));
+}
+
+/**
+ * @brief PRIVATE Get the stripes of the series with the given id.
+ * @return \c NULL if the store is not striped, the first of its
+ *	\c stripes stripes otherwise.
+ */
+static inline pms_stripe_t *
+pss_stripes(pss_t *self, size_t id) {
+	if (self->stripes == 0)
+		return NULL;
+	unsigned int b = pss_block_of(id);
+	size_t n = pss_block_size(b);
+	return (pms_stripe_t *) pss_block(self, b)
+		- (n - (id - pss_block_start(b))) * self->stripes;
+}
+
+/**
+ * @brief PRIVATE Get the l_value of the series with the given id.
+ */
+static inline const char *
+pss_l_value(pss_t *self, size_t id) {
+	unsigned int b = pss_block_of(id);
+	return pss_block_l_value(pss_block(self, b), pss_block_size(b))
+		[id - pss_block_start(b)];
+}
+
+/**
+ * @brief PRIVATE Get the sample slot of the series with the given id.
+ */
+static inline pms_t *
+pss_slot(pss_t *self, size_t id) {
+	unsigned int b = pss_block_of(id);
+	return pss_block_slot(pss_block(self, b), pss_block_size(b))
+		+ (id - pss_block_start(b));
+}
+
+/**
+ * @brief PRIVATE Get what the slot of the series with the given id refers to.
+ * @return \c NULL if the slot is unused or the series got removed, the
+ *	metric or sample object otherwise.
+ */
+static inline void *
+pss_sample(pss_t *self, size_t id) {
+	return atomic_load(&pss_slot(self, id)->ref);
+}
+
+/**
+ * @brief PRIVATE Get the exemplar slot of the series with the given id.
+ */
+static inline _Atomic(struct pex *) *
+pss_exemplar(pss_t *self, size_t id) {
+	unsigned int b = pss_block_of(id);
+	return pss_block_exemplar(pss_block(self, b), pss_block_size(b))
+		+ (id - pss_block_start(b));
+}
+
+/**
+ * @brief PRIVATE Get the creation time of the series with the given id.
+ */
+static inline double *
+pss_created(pss_t *self, size_t id) {
+	unsigned int b = pss_block_of(id);
+	return pss_block_created(pss_block(self, b), pss_block_size(b))
+		+ (id - pss_block_start(b));
+}
+
+/**
+ * @brief PRIVATE Get the idle counter of the series with the given id.
+ */
+static inline uint16_t *
+pss_idle(pss_t *self, size_t id) {
+	unsigned int b = pss_block_of(id);
+	return pss_block_idle(pss_block(self, b), pss_block_size(b))
+		+ (id - pss_block_start(b));
+}
+
+/**
+ * @brief PRIVATE Get the touched flag of the series with the given id.
+ */
+static inline atomic_bool *
+pss_touched(pss_t *self, size_t id) {
+	unsigned int b = pss_block_of(id);
+	return pss_block_touched(pss_block(self, b), pss_block_size(b))
+		+ (id - pss_block_start(b));
+}
+
+#endif  // PROM_SERIES_I_H
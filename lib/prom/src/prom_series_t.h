@@ -0,0 +1,83 @@
+/**
+ * Copyright 2021 Jens Elkner <jel+libprom@cs.uni-magdeburg.de>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef PROM_SERIES_T_H
+#define PROM_SERIES_T_H
+
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/** @brief PRIVATE Assumed size of a CPU cache line in bytes. */
+#define PROM_CACHE_LINE 64
+
+/**
+ * @brief PRIVATE The value of a simple series: a double or, for integral
+ *	metrics, an unsigned integer.
+ */
+typedef union pss_value {
+	_Atomic double r;		/**< value of a non-integral series */
+	_Atomic uint64_t i;		/**< value of an integral series */
+} pss_value_t;
+
+/**
+ * @brief PRIVATE A single addend of a striped series. Each stripe occupies its
+ *	own cache line, so that threads updating different stripes do not contend.
+ */
+typedef struct pms_stripe {
+	_Atomic double value;
+	char pad[PROM_CACHE_LINE - sizeof(double)];
+} __attribute__((aligned(PROM_CACHE_LINE))) pms_stripe_t;
+
+/**
+ * @brief PRIVATE The sample slot of a series. A counter or gauge series
+ *	lives in the columns of the store only, so its slot refers to the metric
+ *	and its address is what \c pms_from_labels() hands out. The slot of a
+ *	histogram or summary series refers to its sample object.
+ */
+struct pms {
+	_Atomic(void *) ref;	/**< NULL if unused or removed, the metric or the
+								sample object otherwise */
+};
+
+/**
+ * @brief PRIVATE The series of a metric stored as struct of arrays indexed by
+ *	series id: the values, l_values, sample slots, exemplars, creation times,
+ *	idle counters and touched flags of all series are kept in parallel
+ *	arrays, so that exposing a metric is a linear scan over its values. The
+ *	arrays are split into blocks: block 0 holds the first \c PSS_FIRST_SIZE
+ *	series, each following block as many as all before it. Blocks never
+ *	move, so pointers to the slots of a series stay valid, and the few
+ *	series of small metrics do not waste any room. The values of a block
+ *	start at a cache line boundary, the stripes of its series (if any)
+ *	precede them. Updates find the blocks without holding a lock, so an
+ *	array of blocks replaced by a larger one stays allocated as long as the
+ *	store. Ids of removed series get reused: their slots form a free list
+ *	linked via their values. Series get found by l_value via an open
+ *	addressing hash index of their ids.
+ */
+typedef struct pss {
+	_Atomic(pss_value_t **) block;	/**< NULL or the values of each block */
+	_Atomic unsigned int blocks;	/**< number of blocks allocated */
+	unsigned int stripes;	/**< 0 or the number of stripes per series */
+	size_t count;			/**< number of ids handed out so far */
+	size_t free;			/**< 0 or 1 + id of the first removed series */
+	uint32_t *index;		/**< NULL or 1 + id per slot, 0 if empty */
+	size_t index_size;		/**< number of index slots, a power of 2 */
+	size_t size;			/**< number of series in the index */
+} pss_t;
+
+#endif  // PROM_SERIES_T_H
@@ -0,0 +1,191 @@
+/**
+ * Copyright 2021 Jens Elkner <jel+libprom@cs.uni-magdeburg.de>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <pthread.h>
+#include <stdalign.h>
+#include <stdbool.h>
+
+// Public
+#include "../include/prom_alloc.h"
+
+// Private
+#include "prom_linked_list_t.h"
+#include "prom_map_t.h"
+#include "prom_slab_i.h"
+
+/** Number of objects a thread cache gets refilled with respectively returns
+	to the shared pool at once. */
+#define PSL_BATCH 32
+
+/** Round up to a multiple of the given power of 2. */
+#define PSL_ROUND(n, a) (((n) + (a) - 1) & ~((size_t) (a) - 1))
+
+/** Size of an object slot, large enough for the free list link. */
+#define PSL_SLOT(type) PSL_ROUND(sizeof(type) > sizeof(void *) \
+	? sizeof(type) : sizeof(void *), alignof(type) > alignof(void *) \
+	? alignof(type) : alignof(void *))
+
+/** Released objects get linked via their first word. */
+typedef struct psl_free_obj {
+	struct psl_free_obj *next;
+} psl_free_obj_t;
+
+/** Slabs of a pool get linked via their first slot. */
+typedef struct psl_slab {
+	struct psl_slab *next;
+} psl_slab_t;
+
+/** The shared pool of a kind. */
+typedef struct psl_pool {
+	pthread_mutex_t lock;
+	size_t slot;				/**< size of an object slot in bytes */
+	prom_alloc_subsystem_t subsystem;	/**< where slabs get accounted */
+	psl_free_obj_t *free;		/**< released objects */
+	char *next;					/**< next unused slot of the current slab */
+	char *end;					/**< end of the current slab */
+	psl_slab_t *slabs;			/**< all slabs allocated */
+} psl_pool_t;
+
+/** The cache of a kind per thread. */
+typedef struct psl_cache {
+	psl_free_obj_t *head;
+	unsigned int count;
+} psl_cache_t;
+
+#define PSL_POOL(type, sub) { PTHREAD_MUTEX_INITIALIZER, PSL_SLOT(type), \
+	(sub), NULL, NULL, NULL, NULL }
+
+static psl_pool_t pool[PSL_KINDS] = {
+	[PSL_LIST_NODE] = PSL_POOL(pll_node_t, PROM_ALLOC_LIST),
+	[PSL_LIST] = PSL_POOL(pll_t, PROM_ALLOC_LIST),
+	[PSL_MAP_NODE] = PSL_POOL(prom_map_node_t, PROM_ALLOC_MAP),
+};
+
+static __thread psl_cache_t cache[PSL_KINDS];
+static __thread bool cache_registered;
+
+static pthread_once_t key_once = PTHREAD_ONCE_INIT;
+static pthread_key_t key;
+
+/** Move up to n objects from the given list to the shared pool. */
+static void
+psl_give(psl_pool_t *p, psl_cache_t *c, unsigned int n) {
+	if (c->head == NULL)
+		return;
+	psl_free_obj_t *first = c->head, *last = c->head;
+	unsigned int k = 1;
+	for (; k < n && last->next != NULL; k++)
+		last = last->next;
+	c->head = last->next;
+	c->count -= k;
+	pthread_mutex_lock(&p->lock);
+	last->next = p->free;
+	p->free = first;
+	pthread_mutex_unlock(&p->lock);
+}
+
+static void
+psl_flush(void *arg) {
+	psl_cache_t *c = (psl_cache_t *) arg;
+	for (int i = 0; i < PSL_KINDS; i++)
+		while (c[i].head != NULL)
+			psl_give(&pool[i], &c[i], PSL_BATCH);
+	cache_registered = false;
+}
+
+static void
+psl_key_create(void) {
+	pthread_key_create(&key, psl_flush);
+}
+
+/** Return the cached objects to the pool when the calling thread exits. */
+static inline void
+psl_register(void) {
+	if (cache_registered)
+		return;
+	pthread_once(&key_once, psl_key_create);
+	pthread_setspecific(key, cache);
+	cache_registered = true;
+}
+
+/** Move up to PSL_BATCH objects from the shared pool to the given cache. */
+static int
+psl_take(psl_pool_t *p, psl_cache_t *c) {
+	unsigned int n = 0;
+
+	pthread_mutex_lock(&p->lock);
+	while (n < PSL_BATCH && p->free != NULL) {
+		psl_free_obj_t *o = p->free;
+		p->free = o->next;
+		o->next = c->head;
+		c->head = o;
+		n++;
+	}
+	if (n == 0) {
+		// carve the batch in reverse order, so that it gets handed out
+		// in address order
+		if (p->next == p->end) {
+			psl_slab_t *s = prom_alloc_malloc(PSL_SLAB_SIZE, p->subsystem);
+			if (s == NULL) {
+				pthread_mutex_unlock(&p->lock);
+				return 1;
+			}
+			s->next = p->slabs;
+			p->slabs = s;
+			// the slab link occupies the first slot
+			p->next = (char *) s + p->slot;
+			p->end = p->next + (PSL_SLAB_SIZE / p->slot - 1) * p->slot;
+		}
+		size_t avail = (p->end - p->next) / p->slot;
+		n = avail < PSL_BATCH ? avail : PSL_BATCH;
+		for (unsigned int i = n; i > 0; i--) {
+			psl_free_obj_t *o = (psl_free_obj_t *) (p->next + (i-1) * p->slot);
+			o->next = c->head;
+			c->head = o;
+		}
+		p->next += n * p->slot;
+	}
+	pthread_mutex_unlock(&p->lock);
+	c->count += n;
+	return 0;
+}
+
+void *
+psl_alloc(psl_kind_t kind) {
+	psl_cache_t *c = &cache[kind];
+	if (c->head == NULL) {
+		psl_register();
+		if (psl_take(&pool[kind], c))
+			return NULL;
+	}
+	psl_free_obj_t *o = c->head;
+	c->head = o->next;
+	c->count--;
+	return o;
+}
+
+void
+psl_free(psl_kind_t kind, void *obj) {
+	if (obj == NULL)
+		return;
+	psl_register();
+	psl_cache_t *c = &cache[kind];
+	psl_free_obj_t *o = (psl_free_obj_t *) obj;
+	o->next = c->head;
+	c->head = o;
+	if (++c->count > 2 * PSL_BATCH)
+		psl_give(&pool[kind], c, PSL_BATCH);
+}
@@ -0,0 +1,54 @@
+/**
+ * Copyright 2021 Jens Elkner <jel+libprom@cs.uni-magdeburg.de>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef PROM_SLAB_I_H
+#define PROM_SLAB_I_H
+
+/**
+ * @brief PRIVATE The kinds of small fixed-size objects, libprom allocates
+ *	from slab pools instead of the allocator. Objects of the same kind are
+ *	carved out of slabs of \c PSL_SLAB_SIZE bytes one after another, so that
+ *	objects allocated in sequence, e.g. the nodes of a map filled while a
+ *	metric gets populated, are adjacent in memory.
+ */
+typedef enum psl_kind {
+	PSL_LIST_NODE = 0,	/**< pll_node_t */
+	PSL_LIST,			/**< pll_t */
+	PSL_MAP_NODE,		/**< prom_map_node_t */
+	PSL_KINDS			/**< number of kinds - required to be last */
+} psl_kind_t;
+
+/** @brief PRIVATE Size of a slab in bytes. */
+#define PSL_SLAB_SIZE (16 * 1024)
+
+/**
+ * @brief PRIVATE Allocate an object of the given kind. Served from the
+ *	calling thread's cache, which gets refilled from the shared pool in
+ *	batches.
+ * @return \c NULL if out of memory, the uninitialized object otherwise.
+ */
+void *psl_alloc(psl_kind_t kind);
+
+/**
+ * @brief PRIVATE Release an object allocated via \c psl_alloc() with the same
+ *	kind. It gets cached by the calling thread for reuse, excess objects and
+ *	the cache of an exiting thread get returned to the shared pool. Slabs are
+ *	never returned to the allocator.
+ * @param obj	The object to release. May be \c NULL .
+ */
+void psl_free(psl_kind_t kind, void *obj);
+
+#endif  // PROM_SLAB_I_H
@@ -15,26 +15,28 @@
  * limitations under the License.
  */
 
+#define PROM_ALLOC_SUBSYSTEM PROM_ALLOC_STRING
+
 #include <stddef.h>
+#include <stdlib.h>
 
 // Public
 #include "../include/prom_alloc.h"
 
 // Private
+#include "prom_alloc_i.h"
 #include "prom_assert.h"
 #include "../include/prom_string_builder.h"
 
 // The initial capacity of the string builder.
 #define PROM_STRING_BUILDER_INIT_SIZE 128
 
-// prom_string_builder_init prototype declaration
-static int psb_init(psb_t *self);
-
+// The buffer gets allocated via the C library, so that the application can
+// free() strings handed over via psb_detach() or psb_dump().
 struct psb {
-	char *str;			/**< the target string  */
+	char *str;			/**< the target string or NULL if unused or detached */
 	size_t allocated;	/**< the size allocated to the string in bytes */
 	size_t len;			/**< the length of str */
-	size_t init_size;	/**< the initialize size of space to allocate */
 };
 
 psb_t *
@@ -42,32 +44,20 @@ psb_new(void) {
 	psb_t *self = (psb_t *) prom_malloc(sizeof(psb_t));
 	if (self == NULL)
 		return NULL;
-	self->init_size = PROM_STRING_BUILDER_INIT_SIZE;
-	if (psb_init(self)) {
-		psb_destroy(self);
-		return NULL;
-	}
-	return self;
-}
-
-static int
-psb_init(psb_t *self) {
-	PROM_ASSERT(self != NULL);
-	self->str = (char *) prom_malloc(self->init_size);
-	if (self->str == NULL)
-		return 1;
-	*self->str = '\0';
-	self->allocated = self->init_size;
+	// the buffer gets allocated on first use: many builders never get any
+	self->str = NULL;
+	self->allocated = PROM_STRING_BUILDER_INIT_SIZE;
 	self->len = 0;
-	return 0;
+	return self;
 }
 
 int
 psb_clear(psb_t *self) {
 	PROM_ASSERT(self != NULL);
-	prom_free(self->str);
-	self->str = NULL;
-	return psb_init(self);
+	self->len = 0;
+	if (self->str != NULL)
+		*self->str = '\0';
+	return 0;
 }
 
 int
@@ -85,32 +75,40 @@ int
 psb_destroy(psb_t *self) {
 	if (self == NULL)
 		return 0;
-	prom_free(self->str);
+	if (self->str != NULL) {
+		free(self->str);
+		prom_alloc_account(PROM_ALLOC_SUBSYSTEM, self->allocated, 0);
+	}
 	self->str = NULL;
 	prom_free(self);
 	return 0;
 }
 
 /**
- * @brief PRIVATE Grows the size of the string given the val we want to add
+ * @brief PRIVATE Make sure, that the buffer has room for \c add_len more
+ *	bytes plus the terminating \c '\0' .
  *
- * The method continuously shifts left until the new size is large enough to
- * accommodate add_len. This private method is called in methods that need to
- * add one or more characters to the underlying string.
+ * The capacity gets doubled until it is large enough. A detached string
+ * builder gets a new buffer with at least the capacity of the old one.
  */
 static int
 psb_ensure_space(psb_t *self, size_t add_len) {
 	PROM_ASSERT(self != NULL);
-	if (add_len == 0 || self->allocated >= self->len + add_len + 1)
+	if (self->str != NULL && self->allocated >= self->len + add_len + 1)
 		return 0;
 
 	size_t sz = self->allocated;
 	while (sz < self->len + add_len + 1)
 		sz <<= 1;
-	char *str = (char *) prom_realloc(self->str, sz);
+	char *str = (char *) realloc(self->str, sz);
 	if (str == NULL)
 		return 1;
+	prom_alloc_account(PROM_ALLOC_SUBSYSTEM,
+		(self->str == NULL) ? 0 : self->allocated, sz);
+	if (self->str == NULL)
+		*str = '\0';
 	self->str = str;
+	self->allocated = sz;
 	return 0;
 }
 
@@ -130,6 +128,20 @@ psb_add_str(psb_t *self, const char *str) {
 	return 0;
 }
 
+int
+psb_add_strn(psb_t *self, const char *str, size_t len) {
+	PROM_ASSERT(self != NULL);
+	if (len == 0)
+		return 0;
+	if (psb_ensure_space(self, len))
+		return 1;
+
+	memcpy(self->str + self->len, str, len);
+	self->len += len;
+	self->str[self->len] = '\0';
+	return 0;
+}
+
 int
 psb_add_char(psb_t *self, char c) {
 	PROM_ASSERT(self != NULL);
@@ -142,6 +154,35 @@ psb_add_char(psb_t *self, char c) {
 	return 0;
 }
 
+char *
+psb_reserve(psb_t *self, size_t len) {
+	PROM_ASSERT(self != NULL);
+	return psb_ensure_space(self, len) ? NULL : self->str + self->len;
+}
+
+int
+psb_trim(psb_t *self) {
+	PROM_ASSERT(self != NULL);
+	size_t sz = self->len + 1 + (self->len >> 3);
+	if (self->str == NULL || self->allocated <= sz + (sz >> 3))
+		return 0;
+	char *str = (char *) realloc(self->str, sz);
+	if (str == NULL)
+		return 1;
+	prom_alloc_account(PROM_ALLOC_SUBSYSTEM, self->allocated, sz);
+	self->str = str;
+	self->allocated = sz;
+	return 0;
+}
+
+int
+psb_commit(psb_t *self, size_t len) {
+	PROM_ASSERT(self != NULL);
+	self->len += len;
+	self->str[self->len] = '\0';
+	return 0;
+}
+
 size_t
 psb_len(psb_t *self) {
 	PROM_ASSERT(self != NULL);
@@ -152,11 +193,28 @@ char *
 psb_dump(psb_t *self) {
 	PROM_ASSERT(self != NULL);
 	// +1 to accommodate \0
-	char *out = (char *) prom_malloc((self->len + 1) * sizeof(char));
-	memcpy(out, self->str, self->len + 1);
+	char *out = (char *) malloc((self->len + 1) * sizeof(char));
+	if (out == NULL)
+		return NULL;
+	if (self->len > 0)
+		memcpy(out, self->str, self->len);
+	out[self->len] = '\0';
 	return out;
 }
 
+char *
+psb_detach(psb_t *self, size_t *len) {
+	PROM_ASSERT(self != NULL);
+	char *str = self->str;
+	if (str != NULL)
+		prom_alloc_account(PROM_ALLOC_SUBSYSTEM, self->allocated, 0);
+	if (len != NULL)
+		*len = self->len;
+	self->str = NULL;
+	self->len = 0;
+	return str;
+}
+
 char *
 psb_str(psb_t *self) {
 	PROM_ASSERT(self != NULL);
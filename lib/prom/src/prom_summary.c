@@ -0,0 +1,89 @@
+/**
+ * Copyright 2021 Jens Elkner <jel+libprom@cs.uni-magdeburg.de>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define PROM_ALLOC_SUBSYSTEM PROM_ALLOC_METRIC
+
+#include <string.h>
+
+// Public
+#include "../include/prom_summary.h"
+
+#include "../include/prom_alloc.h"
+
+// Private
+#include "prom_assert.h"
+#include "prom_epoch_i.h"
+#include "prom_errors.h"
+#include "../include/prom_log.h"
+#include "prom_metric_i.h"
+#include "prom_metric_sample_summary_i.h"
+#include "prom_metric_t.h"
+
+static const double default_quantiles[] = { 0.5, 0.9, 0.99, 0.999 };
+
+prom_summary_t *
+prom_summary_new(const char *name, const char *help, size_t quantile_count,
+	const double *quantiles, unsigned int max_age, size_t label_key_count,
+	const char **label_keys)
+{
+	if (quantile_count == 0 || quantiles == NULL) {
+		quantiles = default_quantiles;
+		quantile_count = sizeof(default_quantiles) / sizeof(double);
+	}
+	for (size_t i = 0; i < quantile_count; i++) {
+		if (!(quantiles[i] >= 0 && quantiles[i] <= 1)) {
+			PROM_WARN("quantile must be in [0, 1] (%g)", quantiles[i]);
+			return NULL;
+		}
+	}
+	prom_summary_t *self = (prom_summary_t *)
+		prom_metric_new(PROM_SUMMARY, name, help, label_key_count, label_keys);
+	if (self == NULL)
+		return NULL;
+	double *q = (double *) prom_malloc(quantile_count * sizeof(double));
+	if (q == NULL) {
+		prom_metric_destroy(self);
+		return NULL;
+	}
+	memcpy(q, quantiles, quantile_count * sizeof(double));
+	self->quantiles = q;
+	self->quantile_count = quantile_count;
+	self->max_age = (max_age == 0) ? PROM_SUMMARY_MAX_AGE : max_age;
+	return self;
+}
+
+int
+prom_summary_destroy(prom_summary_t *self) {
+	return (self == NULL) ? 0 : prom_metric_destroy(self);
+}
+
+int
+prom_summary_observe(prom_summary_t *self, double value,
+	const char **label_vals)
+{
+	if (self == NULL)
+		return 1;
+	if (self->type != PROM_SUMMARY) {
+		PROM_WARN(PROM_METRIC_INCORRECT_TYPE " (%d) - %s",
+			self->type, self->name);
+		return 1;
+	}
+	unsigned int guard = pep_enter();
+	pms_summary_t *s = pms_summary_from_labels(self, label_vals);
+	int err = (s == NULL) ? 1 : pms_summary_observe(s, value);
+	pep_leave(guard);
+	return err;
+}
@@ -24,6 +24,7 @@
  * https://www.gnu.org/software/libmicrohttpd/manual/libmicrohttpd.html#index-MHD_005fResult
  */
 
+#include <stdbool.h>
 #include <string.h>
 
 #include "microhttpd.h"
@@ -38,6 +39,23 @@
  */
 void promhttp_set_active_collector_registry(pcr_t *registry);
 
+/**
+ * @brief Let /metrics requests, which arrive while the export of the active
+ *	registry gets rendered for another request in the same format, wait for
+ *	it and share the result (single-flight). This needs a daemon running
+ *	more than one thread and the whole export gets kept in memory instead of
+ *	being streamed. Requests answered with the export of another one get
+ *	counted by the \c promhttp_coalesced_requests_total counter, which gets
+ *	registered with the default collector of the active registry.
+ * @param enable	If \c false , every request renders its own export.
+ * @param min_interval_ms	Answer requests with the last export as long as it
+ *	is younger than this (milliseconds), so that a burst of scrapes costs a
+ *	single collection. \c 0 shares exports in flight, only.
+ * @return A non-zero integer value upon failure, \c 0 otherwise.
+ * @note	The active registry MUST be set before.
+ */
+int promhttp_set_coalescing(bool enable, unsigned int min_interval_ms);
+
 /**
  *  @brief Start a daemon in the background and return a reference to it.
  *
@@ -48,6 +66,37 @@ void promhttp_set_active_collector_registry(pcr_t *registry);
  */
 struct MHD_Daemon *promhttp_start_daemon(unsigned int flags, unsigned short port, MHD_AcceptPolicyCallback apc, void *apc_cls);
 
+/**
+ * @brief Settings of a daemon started via \c promhttp_start_daemon_config() .
+ *	Zero values select the libmicrohttpd defaults.
+ */
+typedef struct promhttp_config {
+	/** \c NULL or the numeric IPv4 or IPv6 address to listen on. */
+	const char *address;
+	/** The TCP port to listen on. */
+	unsigned short port;
+	/** MHD_USE_* flags, e.g. \c MHD_USE_EPOLL_INTERNALLY . */
+	unsigned int flags;
+	/** Size of the internal thread pool, \c 0 or \c 1 for none. */
+	unsigned int threads;
+	/** Max. number of concurrent connections. */
+	unsigned int connection_limit;
+	/** Max. number of concurrent connections per client IP address. */
+	unsigned int per_ip_limit;
+	/** Seconds after which an idle connection gets closed. */
+	unsigned int timeout;
+} promhttp_config_t;
+
+/**
+ * @brief Same as \c promhttp_start_daemon() , but with the listen address,
+ *	threading model and connection limits taken from the given config.
+ * @param config	The settings to use.
+ * @param apc	\c NULL or the accept policy callback.
+ * @param apc_cls	Argument passed to \c apc .
+ * @return \c NULL on error, a reference to the started daemon otherwise.
+ */
+struct MHD_Daemon *promhttp_start_daemon_config(const promhttp_config_t *config, MHD_AcceptPolicyCallback apc, void *apc_cls);
+
 /**
  * @brief Shutdown the given HTTP daemon. This is actually just a 1:1 wrapper
  *	around MHD_stop_daemon(daemon). Thus applications using just 
@@ -15,11 +15,22 @@
  * limitations under the License.
  */
 
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdlib.h>
 #include <string.h>
+#include <strings.h>
+#include <time.h>
 
 #include "microhttpd.h"
 #include "prom.h"
 #include "prom_log.h"
+#include "promhttp.h"
+
+/** @brief Size of the buffer libmicrohttpd uses to stream /metrics. */
+#define PROMHTTP_BLOCK_SIZE (64 * 1024)
 
 pcr_t *PROM_ACTIVE_REGISTRY;
 
@@ -32,6 +43,345 @@ promhttp_set_active_collector_registry(pcr_t *registry) {
 		PROM_WARN("No registry set to answer http requests", "");
 }
 
+/**
+ * @brief Fill the given buffer with the next part of the /metrics response.
+ */
+static ssize_t
+stream_reader(void *cls, uint64_t pos, char *buf, size_t max) {
+	ssize_t n = pcr_stream_read((pcr_stream_t *) cls, buf, max);
+	if (n == 0)
+		return MHD_CONTENT_READER_END_OF_STREAM;
+	return (n < 0) ? MHD_CONTENT_READER_END_WITH_ERROR : n;
+}
+
+/**
+ * @brief Release the stream of a finished or aborted /metrics response.
+ */
+static void
+stream_free(void *cls) {
+	pcr_stream_destroy((pcr_stream_t *) cls);
+}
+
+/** @brief Name of the counter of coalesced /metrics requests. */
+#define PROMHTTP_COALESCED "promhttp_coalesced_requests_total"
+
+/**
+ * @brief A complete /metrics body shared by coalesced requests. It gets freed
+ *	when neither a response nor the cache refers to it anymore.
+ */
+typedef struct promhttp_flight {
+	char *body;			/**< the rendered export */
+	size_t len;			/**< length of body in bytes */
+	unsigned int refs;	/**< number of references */
+	uint64_t done_ns;	/**< when rendering finished, 0 while in flight */
+} promhttp_flight_t;
+
+/** @brief Guards coalescing settings and the cache of flights. */
+static pthread_mutex_t flight_lock = PTHREAD_MUTEX_INITIALIZER;
+/** @brief Signaled whenever a flight landed or crashed. */
+static pthread_cond_t flight_cond = PTHREAD_COND_INITIALIZER;
+/** @brief The last flight per prom_format_t and prom_encoding_t. */
+static promhttp_flight_t *flight[3][3];
+/** @brief If true, simultaneous /metrics requests share one export. */
+static bool coalesce = false;
+/** @brief How long a finished export gets reused for new requests. */
+static uint64_t min_interval_ns = 0;
+/** @brief NULL or the counter of coalesced requests. */
+static prom_counter_t *coalesced = NULL;
+
+/**
+ * @brief Get a monotonic timestamp in nanoseconds.
+ */
+static uint64_t
+now_ns(void) {
+	struct timespec ts;
+	if (clock_gettime(CLOCK_MONOTONIC, &ts))
+		return 0;
+	return (uint64_t) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+int
+promhttp_set_coalescing(bool enable, unsigned int min_interval_ms) {
+	if (enable && coalesced == NULL) {
+		prom_collector_t *c = pcr_get(PROM_ACTIVE_REGISTRY,
+			COLLECTOR_NAME_DEFAULT);
+		if (c == NULL)
+			return 1;
+		coalesced = prom_counter_new_int(PROMHTTP_COALESCED, "Number of "
+			"/metrics requests answered with the export of another one",
+			0, NULL);
+		if (coalesced == NULL)
+			return 2;
+		if (prom_collector_add_metric(c, coalesced)) {
+			prom_counter_destroy(coalesced);
+			coalesced = NULL;
+			return 3;
+		}
+	}
+	pthread_mutex_lock(&flight_lock);
+	coalesce = enable;
+	min_interval_ns = min_interval_ms * 1000000ULL;
+	pthread_mutex_unlock(&flight_lock);
+	return 0;
+}
+
+/**
+ * @brief Drop a reference to the given flight. The caller must hold the
+ *	flight lock.
+ */
+static void
+flight_release(promhttp_flight_t *f) {
+	if (--f->refs > 0)
+		return;
+	free(f->body);
+	free(f);
+}
+
+/**
+ * @brief Render the whole export in the given format into the given flight.
+ * @return Non-zero integer value upon failure, \c 0 otherwise.
+ */
+static int
+flight_render(promhttp_flight_t *f, prom_format_t format,
+	prom_encoding_t encoding)
+{
+	pcr_stream_t *stream = pcr_stream_new_format(PROM_ACTIVE_REGISTRY,
+		format, encoding);
+	if (stream == NULL)
+		return 1;
+	size_t cap = PROMHTTP_BLOCK_SIZE;
+	ssize_t n;
+	f->len = 0;
+	if ((f->body = malloc(cap)) == NULL) {
+		pcr_stream_destroy(stream);
+		return 2;
+	}
+	while ((n = pcr_stream_read(stream, f->body + f->len, cap - f->len)) > 0) {
+		f->len += n;
+		if (f->len == cap) {
+			char *b = realloc(f->body, cap <<= 1);
+			if (b == NULL) {
+				n = -1;
+				break;
+			}
+			f->body = b;
+		}
+	}
+	pcr_stream_destroy(stream);
+	return (n < 0) ? 3 : 0;
+}
+
+/**
+ * @brief Get the export of the active registry in the given format, which
+ *	gets rendered only if no other request is rendering it right now and the
+ *	last one is older than the minimal re-render interval. Requests arriving
+ *	meanwhile wait for the result and share it.
+ * @return \c NULL on error, a flight the caller holds a reference of
+ *	otherwise.
+ */
+static promhttp_flight_t *
+flight_join(prom_format_t format, prom_encoding_t encoding) {
+	promhttp_flight_t **slot = &flight[format][encoding];
+	promhttp_flight_t *f;
+	bool waited = false;
+
+	pthread_mutex_lock(&flight_lock);
+	while ((f = *slot) != NULL && f->done_ns == 0) {
+		pthread_cond_wait(&flight_cond, &flight_lock);
+		waited = true;
+	}
+	if (f != NULL && (waited || now_ns() - f->done_ns < min_interval_ns)) {
+		f->refs++;
+		pthread_mutex_unlock(&flight_lock);
+		prom_counter_inc(coalesced, NULL);
+		return f;
+	}
+	if (f != NULL)
+		flight_release(f);
+	*slot = f = (promhttp_flight_t *) calloc(1, sizeof(promhttp_flight_t));
+	if (f != NULL)
+		f->refs = 2;	// the slot and the caller
+	pthread_mutex_unlock(&flight_lock);
+	if (f == NULL)
+		return NULL;
+
+	int err = flight_render(f, format, encoding);
+	pthread_mutex_lock(&flight_lock);
+	if (err) {
+		// let the next one waiting try again
+		*slot = NULL;
+		flight_release(f);
+		flight_release(f);
+		f = NULL;
+	} else {
+		f->done_ns = now_ns();
+	}
+	pthread_cond_broadcast(&flight_cond);
+	pthread_mutex_unlock(&flight_lock);
+	return f;
+}
+
+/**
+ * @brief Copy the next part of a coalesced /metrics response into the given
+ *	buffer.
+ */
+static ssize_t
+flight_reader(void *cls, uint64_t pos, char *buf, size_t max) {
+	promhttp_flight_t *f = (promhttp_flight_t *) cls;
+	if (pos >= f->len)
+		return MHD_CONTENT_READER_END_OF_STREAM;
+	if (max > f->len - pos)
+		max = f->len - pos;
+	memcpy(buf, f->body + pos, max);
+	return max;
+}
+
+/**
+ * @brief Release the flight of a finished or aborted /metrics response.
+ */
+static void
+flight_free(void *cls) {
+	pthread_mutex_lock(&flight_lock);
+	flight_release((promhttp_flight_t *) cls);
+	pthread_mutex_unlock(&flight_lock);
+}
+
+/** @brief Content-Type of the text exposition format. */
+#define PROMHTTP_TEXT_TYPE "text/plain; version=0.0.4; charset=utf-8"
+/** @brief Media type of the protobuf exposition format. */
+#define PROMHTTP_PROTOBUF "application/vnd.google.protobuf"
+/** @brief Content-Type of the protobuf exposition format. */
+#define PROMHTTP_PROTOBUF_TYPE PROMHTTP_PROTOBUF \
+	"; proto=io.prometheus.client.MetricFamily; encoding=delimited"
+/** @brief Media type of the OpenMetrics exposition format. */
+#define PROMHTTP_OPENMETRICS "application/openmetrics-text"
+/** @brief Content-Type of the OpenMetrics exposition format. */
+#define PROMHTTP_OPENMETRICS_TYPE PROMHTTP_OPENMETRICS \
+	"; version=1.0.0; charset=utf-8"
+
+/**
+ * @brief Check whether the parameters of a list element in [p, end) contain
+ *	the given one.
+ */
+static bool
+has_param(const char *p, const char *end, const char *param) {
+	size_t len = strlen(param);
+
+	for (; p < end; p++) {
+		if (*p != ';')
+			continue;
+		while (p + 1 < end && (p[1] == ' ' || p[1] == '\t'))
+			p++;
+		if ((size_t) (end - p - 1) >= len
+			&& strncasecmp(p + 1, param, len) == 0
+			&& (p + 1 + len == end || p[1 + len] == ';' || p[1 + len] == ' '
+				|| p[1 + len] == '\t'))
+		{
+			return true;
+		}
+	}
+	return false;
+}
+
+/**
+ * @brief Get the quality the given Accept or Accept-Encoding header value
+ *	assigns to the given token.
+ * @param header	The value of the header.
+ * @param token	The content coding or media type to look for.
+ * @param params	\c NULL or a \c NULL terminated list of parameters the
+ *	token must have to match, e.g. "encoding=delimited".
+ * @return \c -1 if not listed, its "q" value otherwise (\c 1 if not given).
+ */
+static double
+quality(const char *header, const char *token, const char **params) {
+	size_t tlen = strlen(token);
+	const char *p = header;
+
+	while (*p != '\0') {
+		while (*p == ' ' || *p == '\t' || *p == ',')
+			p++;
+		const char *t = p;
+		while (*p != '\0' && *p != ',' && *p != ';' && *p != ' '
+			&& *p != '\t')
+		{
+			p++;
+		}
+		bool match = ((size_t) (p - t) == tlen
+			&& strncasecmp(t, token, tlen) == 0);
+		const char *start = p;
+		while (*p != '\0' && *p != ',')
+			p++;
+		if (!match)
+			continue;
+		for (int i = 0; params != NULL && params[i] != NULL; i++) {
+			if (!has_param(start, p, params[i]))
+				match = false;
+		}
+		if (!match)
+			continue;
+		double q = 1;
+		for (const char *s = start; s < p; s++) {
+			if (*s == ';') {
+				while (s[1] == ' ' || s[1] == '\t')
+					s++;
+				if (s[1] == 'q' && s[2] == '=')
+					q = strtod(s + 3, NULL);
+			}
+		}
+		return q;
+	}
+	return -1;
+}
+
+/**
+ * @brief Pick the exposition format for the /metrics response of the given
+ *	request: the one the scraper prefers, text if it does not tell. On equal
+ *	preference protobuf wins over OpenMetrics, which wins over text.
+ */
+static prom_format_t
+choose_format(struct MHD_Connection *connection) {
+	const char *header = MHD_lookup_connection_value(connection,
+		MHD_HEADER_KIND, MHD_HTTP_HEADER_ACCEPT);
+	static const char *params[] = {
+		"proto=io.prometheus.client.MetricFamily", "encoding=delimited", NULL
+	};
+
+	if (header == NULL)
+		return PROM_FORMAT_TEXT;
+	double q = quality(header, "text/plain", NULL);
+	prom_format_t format = PROM_FORMAT_TEXT;
+	double q_om = quality(header, PROMHTTP_OPENMETRICS, NULL);
+	if (q_om > 0 && q_om >= q) {
+		format = PROM_FORMAT_OPENMETRICS;
+		q = q_om;
+	}
+	double q_pb = quality(header, PROMHTTP_PROTOBUF, params);
+	if (q_pb > 0 && q_pb >= q)
+		format = PROM_FORMAT_PROTOBUF;
+	return format;
+}
+
+/**
+ * @brief Pick the content coding for the /metrics response of the given
+ *	request: zstd if available, gzip or no compression at all.
+ */
+static prom_encoding_t
+choose_encoding(struct MHD_Connection *connection) {
+	const char *header = MHD_lookup_connection_value(connection,
+		MHD_HEADER_KIND, MHD_HTTP_HEADER_ACCEPT_ENCODING);
+
+	if (header == NULL)
+		return PROM_ENCODING_IDENTITY;
+	if (pcr_stream_supports(PROM_ENCODING_ZSTD)
+		&& quality(header, "zstd", NULL) > 0)
+	{
+		return PROM_ENCODING_ZSTD;
+	}
+	if (quality(header, "gzip", NULL) > 0)
+		return PROM_ENCODING_GZIP;
+	return PROM_ENCODING_IDENTITY;
+}
+
 #if MHD_VERSION >= 0x00097500
 	enum MHD_Result
 #else
@@ -41,8 +391,8 @@ promhttp_handler(void *cls, struct MHD_Connection *connection, const char *url,
 	const char *method, const char *version, const char *upload_data,
 	size_t *upload_data_size, void **con_cls)
 {
-	char *body;
-	struct MHD_Response *response;
+	char *body = NULL;
+	struct MHD_Response *response = NULL;
 	enum MHD_ResponseMemoryMode mode = MHD_RESPMEM_PERSISTENT;
 	unsigned int status = MHD_HTTP_BAD_REQUEST;
 
@@ -58,17 +408,54 @@ promhttp_handler(void *cls, struct MHD_Connection *connection, const char *url,
 		body = "<html><body>See <a href='/metrics'>/metrics</a>.\r\n";
 		status = MHD_HTTP_OK;
 	} else if (strcmp(url, "/metrics") == 0) {
-		body = pcr_bridge(PROM_ACTIVE_REGISTRY);
-		mode = MHD_RESPMEM_MUST_FREE;
+		prom_format_t format = choose_format(connection);
+		prom_encoding_t encoding = choose_encoding(connection);
+		pthread_mutex_lock(&flight_lock);
+		bool shared = coalesce;
+		pthread_mutex_unlock(&flight_lock);
+		if (shared) {
+			promhttp_flight_t *f = flight_join(format, encoding);
+			if (f == NULL)
+				return MHD_NO;
+			response = MHD_create_response_from_callback(f->len,
+				PROMHTTP_BLOCK_SIZE, &flight_reader, f, &flight_free);
+			if (response == NULL) {
+				flight_free(f);
+				return MHD_NO;
+			}
+		} else {
+			// Render metric by metric while libmicrohttpd sends the
+			// response, so that the whole exposition never needs to be in
+			// memory at once.
+			pcr_stream_t *stream = pcr_stream_new_format(PROM_ACTIVE_REGISTRY,
+				format, encoding);
+			if (stream == NULL)
+				return MHD_NO;
+			response = MHD_create_response_from_callback(MHD_SIZE_UNKNOWN,
+				PROMHTTP_BLOCK_SIZE, &stream_reader, stream, &stream_free);
+			if (response == NULL) {
+				pcr_stream_destroy(stream);
+				return MHD_NO;
+			}
+		}
+		if (encoding != PROM_ENCODING_IDENTITY) {
+			MHD_add_response_header(response, MHD_HTTP_HEADER_CONTENT_ENCODING,
+				encoding == PROM_ENCODING_GZIP ? "gzip" : "zstd");
+		}
+		MHD_add_response_header(response, MHD_HTTP_HEADER_CONTENT_TYPE,
+			format == PROM_FORMAT_PROTOBUF ? PROMHTTP_PROTOBUF_TYPE
+				: format == PROM_FORMAT_OPENMETRICS ? PROMHTTP_OPENMETRICS_TYPE
+				: PROMHTTP_TEXT_TYPE);
+		MHD_add_response_header(response, MHD_HTTP_HEADER_VARY,
+			MHD_HTTP_HEADER_ACCEPT ", " MHD_HTTP_HEADER_ACCEPT_ENCODING);
 		status = MHD_HTTP_OK;
 	} else {
 		body = "Bad Request\n";
 	}
 
-	response = MHD_create_response_from_buffer(strlen(body), body, mode);
+	if (response == NULL)
+		response = MHD_create_response_from_buffer(strlen(body), body, mode);
 	if (response == NULL) {
-		if (mode == MHD_RESPMEM_MUST_FREE)
-			free(body);
 		ret = MHD_NO;
 	} else {
 		ret = MHD_queue_response(connection, status, response);
@@ -84,6 +471,59 @@ promhttp_start_daemon(unsigned int flags, unsigned short port,
 	return MHD_start_daemon(flags, port, apc, apc_cls, &promhttp_handler, NULL, MHD_OPTION_END);
 }
 
+struct MHD_Daemon *
+promhttp_start_daemon_config(const promhttp_config_t *config,
+	MHD_AcceptPolicyCallback apc, void *apc_cls)
+{
+	struct MHD_OptionItem option[6];
+	struct sockaddr_in in4;
+	struct sockaddr_in6 in6;
+	unsigned int flags;
+	int n = 0;
+
+	if (config == NULL)
+		return NULL;
+	flags = config->flags;
+	if (config->address != NULL && config->address[0] != '\0') {
+		memset(&in4, 0, sizeof(in4));
+		memset(&in6, 0, sizeof(in6));
+		if (inet_pton(AF_INET, config->address, &in4.sin_addr) == 1) {
+			in4.sin_family = AF_INET;
+			in4.sin_port = htons(config->port);
+			option[n++] = (struct MHD_OptionItem)
+				{ MHD_OPTION_SOCK_ADDR, 0, &in4 };
+		} else if (inet_pton(AF_INET6, config->address, &in6.sin6_addr) == 1) {
+			in6.sin6_family = AF_INET6;
+			in6.sin6_port = htons(config->port);
+			flags |= MHD_USE_IPv6;
+			option[n++] = (struct MHD_OptionItem)
+				{ MHD_OPTION_SOCK_ADDR, 0, &in6 };
+		} else {
+			PROM_WARN("Invalid listen address '%s'", config->address);
+			return NULL;
+		}
+	}
+	if (config->threads > 1) {
+		option[n++] = (struct MHD_OptionItem)
+			{ MHD_OPTION_THREAD_POOL_SIZE, config->threads, NULL };
+	}
+	if (config->connection_limit > 0) {
+		option[n++] = (struct MHD_OptionItem)
+			{ MHD_OPTION_CONNECTION_LIMIT, config->connection_limit, NULL };
+	}
+	if (config->per_ip_limit > 0) {
+		option[n++] = (struct MHD_OptionItem)
+			{ MHD_OPTION_PER_IP_CONNECTION_LIMIT, config->per_ip_limit, NULL };
+	}
+	if (config->timeout > 0) {
+		option[n++] = (struct MHD_OptionItem)
+			{ MHD_OPTION_CONNECTION_TIMEOUT, config->timeout, NULL };
+	}
+	option[n] = (struct MHD_OptionItem) { MHD_OPTION_END, 0, NULL };
+	return MHD_start_daemon(flags, config->port, apc, apc_cls,
+		&promhttp_handler, NULL, MHD_OPTION_ARRAY, option, MHD_OPTION_END);
+}
+
 void promhttp_stop_daemon(struct MHD_Daemon *daemon) {
 	MHD_stop_daemon(daemon);
 }
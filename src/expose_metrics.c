@@ -15,6 +15,8 @@ static prom_gauge_t* network_metrics[N_NET_METRICS];
 static prom_gauge_t* processes_count[N_PROC_COUNT];
 /** Configuration data array. Gets value in main.c */
 extern unsigned char config[];
+/** HTTP server settings. Gets value in main.c */
+extern promhttp_config_t http_config;
 /** Estado general del programa (métricas) para reporte via SIGUSR1
  * 0 - cpu_usage_percentage
  * 1 - memory_used_percentage
@@ -127,11 +129,11 @@ void* expose_metrics(void* arg)
     // Aseguramos que el manejador HTTP esté adjunto al registro por defecto
     promhttp_set_active_collector_registry(NULL);
 
-    // Iniciamos el servidor HTTP en el puerto 8000
-    struct MHD_Daemon* daemon = promhttp_start_daemon(MHD_USE_SELECT_INTERNALLY, 8000, NULL, NULL);
+    // Iniciamos el servidor HTTP en el puerto configurado (8000 por defecto)
+    struct MHD_Daemon* daemon = promhttp_start_daemon_config(&http_config, NULL, NULL);
     if (daemon == NULL)
     {
-        fprintf(stderr, "Error al iniciar el servidor HTTP\n");
+        fprintf(stderr, "Error al iniciar el servidor HTTP en el puerto %hu\n", http_config.port);
         return NULL;
     }
 
@@ -155,8 +157,9 @@ int init_metrics(void)
         return EXIT_FAILURE;
     }
 
-    // Inicializamos el registro de coleccionistas de Prometheus
-    if (pcr_default_init() != 0)
+    // Inicializamos el registro de coleccionistas de Prometheus, incl. las
+    // estadísticas de asignación de memoria de libprom por subsistema
+    if (pcr_init(PROM_PROCESS | PROM_SCRAPETIME | PROM_ALLOC_STATS, METRIC_LABEL_SCRAPE "_") != 0)
     {
         fprintf(stderr, "Error al inicializar el registro de Prometheus\n");
         return EXIT_FAILURE;
@@ -25,6 +25,10 @@
  * - 5: procs (take or not metric).
  */
 #define JSON_ENTRIES_DEF_VAL {1, 1, 1, 1, 1, 1}
+//! \brief Max. length of the listen address in the JSON config file.
+#define HTTP_ADDRESS_LEN 64
+//! \brief Max. length of the serving mode in the JSON config file.
+#define HTTP_MODE_LEN 24
 
 /* GLOBAL VARIABLES */
 static pthread_t tid;
@@ -32,6 +36,20 @@ static pthread_t tid;
 extern unsigned char g_status[G_STATUS_N_METRICS_TRACKED];
 //! \brief Configuration data array.
 unsigned char config[N_JSON_ENTRIES] = JSON_ENTRIES_DEF_VAL;
+//! \brief Listen address of the HTTP server, empty for any (the default).
+static char http_address[HTTP_ADDRESS_LEN];
+/**
+ * \brief HTTP server settings, optionally set by the "http" object of the JSON config file.
+ * If the object is given, all of its keys are required, in exactly this order:
+ * - address: numeric IPv4/IPv6 address to listen on, e.g. "0.0.0.0" for any IPv4 one, "" for any.
+ * - port: TCP port.
+ * - mode: "select", "poll", "epoll" or "thread_per_connection".
+ * - threads: size of the internal thread pool (0 or 1 for none; not with thread_per_connection).
+ * - connection_limit, per_ip_limit: max. concurrent connections in total/per client (0 for default).
+ * - timeout: seconds after which idle connections get closed (0 for never).
+ */
+promhttp_config_t http_config = {
+    .address = http_address, .port = 8000, .flags = MHD_USE_SELECT_INTERNALLY};
 
 /* FUNCTIONS PROTOTYPE */
 //! \brief Handler ante syscalls SIGINT y SIGTERM.
@@ -42,17 +60,14 @@ void handle_sigusr1(int sig, siginfo_t *info, void *context);
 void register_signal_handlers(void);
 //! \brief Method only called if a path to certain config file was provided to this program. Sets the config glob var.
 void set_configuration(char* path_to_config_file);
+//! \brief Parse the optional "http" object of the given config file. Sets the http_config glob var.
+void set_http_configuration(FILE* file);
 
 /* FUNCTIONS DECLARATION */
 void handle_sigint_and_sigterm(int sig)
 {
     // Unused arg
     (void)sig;
-    // Cierre de archivo temporal, usado por update_processes_gauge() en caso de que existe
-    if (access(TEMP_PROC_METRICS_FILE, F_OK) == 0)
-    {
-        remove(TEMP_PROC_METRICS_FILE);
-    }
     // Destrucción de mutex y terminación de thread del servidor Prometheus
     destroy_mutex();
     pthread_cancel(tid);
@@ -113,7 +128,7 @@ void set_configuration(char* path_to_config_file)
     if (fscanf(
                file,
                "{ \"update_interval\": %hhu, \"metrics\": { \"cpu\": %[truefals], \"mem\": %[truefals], "
-               "\"hdd\": %[truefals], \"net\": %[truefals], \"procs\": %[truefals] } } ",
+               "\"hdd\": %[truefals], \"net\": %[truefals], \"procs\": %[truefals] }",
                config, temp[0], temp[1], temp[2], temp[3], temp[4]
               ) != 6)
     {
@@ -135,9 +150,73 @@ void set_configuration(char* path_to_config_file)
         }
     }
 
+    set_http_configuration(file);
     fclose(file);
 }
 
+void set_http_configuration(FILE* file)
+{
+    char address[HTTP_ADDRESS_LEN];
+    char mode[HTTP_MODE_LEN];
+    promhttp_config_t c = http_config;
+
+    // The whole object is optional, but if given, all keys are required in a fixed order
+    int n = -1;
+    if (fscanf(file, " , \"http\": {%n", &n) == EOF || n < 0)
+    {
+        return;
+    }
+    // %[ doesn't match an empty string, so the address gets scanned on its own
+    n = -1;
+    if (fscanf(file, " \"address\": \"%n", &n) == EOF || n < 0)
+    {
+        fprintf(stderr, "ERROR: Config file wrongly parsed (http).\n");
+        return;
+    }
+    if (fscanf(file, "%63[^\"]", address) != 1)
+    {
+        address[0] = '\0';
+    }
+    n = -1;
+    if (fscanf(file,
+               "\", \"port\": %hu, \"mode\": \"%23[^\"]\", \"threads\": %u, \"connection_limit\": %u, "
+               "\"per_ip_limit\": %u, \"timeout\": %u }%n",
+               &c.port, mode, &c.threads, &c.connection_limit, &c.per_ip_limit, &c.timeout, &n) != 6
+        || n < 0)
+    {
+        fprintf(stderr, "ERROR: Config file wrongly parsed (http).\n");
+        return;
+    }
+
+    if (strcmp(mode, "select") == 0)
+    {
+        c.flags = MHD_USE_SELECT_INTERNALLY;
+    }
+    else if (strcmp(mode, "poll") == 0)
+    {
+        c.flags = MHD_USE_POLL_INTERNALLY;
+    }
+    else if (strcmp(mode, "epoll") == 0)
+    {
+        c.flags = MHD_USE_EPOLL_INTERNALLY;
+    }
+    else if (strcmp(mode, "thread_per_connection") == 0)
+    {
+        c.flags = MHD_USE_THREAD_PER_CONNECTION | MHD_USE_INTERNAL_POLLING_THREAD;
+        if (c.threads > 1)
+        {
+            fprintf(stderr, "ERROR: A thread pool can't be used with thread_per_connection.\n");
+            c.threads = 0;
+        }
+    }
+    else
+    {
+        fprintf(stderr, "ERROR: Unknown HTTP mode '%s', using select.\n", mode);
+    }
+    strcpy(http_address, address);
+    http_config = c;
+}
+
 //! \brief Main function of the program.
 int main(int argc, char* argv[])
 {
@@ -146,6 +225,12 @@ int main(int argc, char* argv[])
         // Potentially a path to a JSON configuration file was passed
         set_configuration(argv[1]);
     }
+    // Leer /proc desde otra raíz, p.ej. un snapshot reproducido por bench/procsnap
+    const char* fs_root = getenv(FS_ROOT_ENV);
+    if (fs_root != NULL && set_fs_root(fs_root) != 0)
+    {
+        return EXIT_FAILURE;
+    }
 
     // Creamos un hilo para exponer las métricas vía HTTP
     if (pthread_create(&tid, NULL, expose_metrics, NULL) != 0)
@@ -165,6 +250,8 @@ int main(int argc, char* argv[])
         if (config[3]) update_disk_gauges();
         if (config[4]) update_network_gauges();
         if (config[5]) update_processes_gauge();
+        // Libera las series borradas (prom_metric_delete) o vencidas por TTL
+        pcr_evict(PROM_COLLECTOR_REGISTRY);
         sleep(config[0]);
     }
 
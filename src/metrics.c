@@ -1,5 +1,46 @@
 #include "metrics.h"
 
+//! \brief Directory the absolute procfs/sysfs paths get resolved against, empty for "/".
+static char fs_root[PATH_LEN] = DEFAULT_FS_ROOT;
+
+int set_fs_root(const char* root)
+{
+    size_t len = strlen(root);
+    // Sin '/' final, así "<root>/proc/..." queda bien formado
+    while (len > 0 && root[len - 1] == '/')
+    {
+        len--;
+    }
+    if (len >= PATH_LEN / 2)
+    {
+        fprintf(stderr, "ERROR: File system root '%s' is too long\n", root);
+        return -1;
+    }
+    memcpy(fs_root, root, len);
+    fs_root[len] = '\0';
+    return 0;
+}
+
+char* fs_path(char* buf, size_t size, const char* path)
+{
+    if ((size_t)snprintf(buf, size, "%s%s", fs_root, path) >= size)
+    {
+        return NULL;
+    }
+    return buf;
+}
+
+FILE* open_fs_file(const char* path)
+{
+    char buf[PATH_LEN];
+    if (fs_path(buf, sizeof(buf), path) == NULL)
+    {
+        errno = ENAMETOOLONG;
+        return NULL;
+    }
+    return fopen(buf, "r");
+}
+
 double* get_memory_usage(void)
 {
     FILE* fp;
@@ -7,7 +48,7 @@ double* get_memory_usage(void)
     unsigned long long total_mem = 0, free_mem = 0;
 
     // Abrir el archivo /proc/meminfo
-    fp = fopen("/proc/meminfo", "r");
+    fp = open_fs_file("/proc/meminfo");
     if (fp == NULL)
     {
         perror("Error al abrir /proc/meminfo");
@@ -57,7 +98,7 @@ double get_cpu_usage(void)
     double cpu_usage_percent;
 
     // Abrir el archivo /proc/stat
-    FILE* fp = fopen("/proc/stat", "r");
+    FILE* fp = open_fs_file("/proc/stat");
     if (fp == NULL)
     {
         perror("Error al abrir /proc/stat");
@@ -124,7 +165,7 @@ double* get_disk_usage(void)
     unsigned long long sectors_read = 0, time_spent_reading = 0, sectors_written = 0, time_spent_writting = 0;
 
     // Abrir el archivo /proc/diskstats
-    fp = fopen("/proc/diskstats", "r");
+    fp = open_fs_file("/proc/diskstats");
     if (fp == NULL)
     {
         perror("Error al abrir /proc/diskstats");
@@ -166,7 +207,7 @@ double* get_network_usage(void)
                        tx_packets_dropped = 0;
 
     // Abrir el archivo /proc/net/dev
-    fp = fopen("/proc/net/dev", "r");
+    fp = open_fs_file("/proc/net/dev");
     if (fp == NULL)
     {
         perror("Error al abrir /proc/net/dev");
@@ -209,74 +250,46 @@ double* get_network_usage(void)
 
 double* get_processes_usage(void)
 {
-    pid_t pid = fork();
-    if (pid < 0)
+    char path[PATH_LEN];
+    char buffer[BUFFER_SIZE * 2];
+    unsigned int existing_processes = 0, running_processes = 0;
+
+    // Cada directorio numérico de /proc corresponde a un proceso, tal como los cuenta `top`
+    DIR* dir = fs_path(path, sizeof(path), "/proc") == NULL ? NULL : opendir(path);
+    if (dir == NULL)
     {
-        fprintf(stderr, "No fué posible crear proceso hijo con fork() en get_processes_usage()\n");
+        perror("Error al abrir /proc");
         return NULL;
     }
-    else if (pid == 0)
+    struct dirent* entry;
+    while ((entry = readdir(dir)) != NULL)
     {
-        int tmp_fd = open(TEMP_PROC_METRICS_FILE, O_WRONLY | O_CREAT | O_TRUNC, 0666);
-        if (tmp_fd == -1)
+        if (entry->d_name[0] < '1' || entry->d_name[0] > '9')
         {
-            fprintf(stderr, "Error creando archivo temporal en get_processes_usage()\n");
-            exit(-1);
+            continue;
         }
-        // Se redirige STDOUT al archivo temporal
-        if (dup2(tmp_fd, STDOUT_FILENO) == -1)
+        snprintf(path, sizeof(path), "/proc/%.32s/stat", entry->d_name);
+        FILE* fp = open_fs_file(path);
+        if (fp == NULL)
         {
-            fprintf(stderr, "Error redirigiendo STDOUT en get_processes_usage()\n");
-            exit(-1);
+            continue; // El proceso ya terminó
         }
-        // Cierre del archivo recientemente creado
-        close(tmp_fd);
-        // Se ejecuta el comando `top` de manera tal que se pueda obtener info relacionada a los procesos del sistema
-        execlp("top", "top", "-b", "-n", "1", (char*)NULL);
-        // Nunca debería llegar a la sig. linea este proceso; si lo hace, es porque la linea anterior falló
-        exit(-1);
-    }
-    // Esperar por el proceso hijo a que finalice lo que debe hacer
-    int status;
-    if (waitpid(pid, &status, 0) == -1)
-    {
-        fprintf(stderr, "Error en waitpid() en get_processes_usage()\n");
-        return NULL;
-    }
-    if (WEXITSTATUS(status) == -1)
-    {
-        fprintf(stderr, "Error en proceso forked en get_processes_usage()\n");
-        return NULL;
-    }
-
-    // Parte scraping el archivo temporal
-    FILE* fp;
-    char buffer[BUFFER_SIZE];
-    unsigned int existing_processes = 0, running_processes = 0;
-
-    // Abrir el archivo temporal
-    fp = fopen(TEMP_PROC_METRICS_FILE, "r");
-    if (fp == NULL)
-    {
-        perror("Error al abrir TEMP_PROC_METRICS_FILE");
-        return NULL;
-    }
-
-    // Lectura de los valores de interés
-    while (fgets(buffer, sizeof(buffer), fp) != NULL)
-    {
-        if (sscanf(buffer, "Tasks: %u total, %u", &existing_processes, &running_processes) == 2)
+        char* line = fgets(buffer, sizeof(buffer), fp);
+        fclose(fp);
+        existing_processes++;
+        // El estado sigue al nombre del comando, que puede contener espacios y paréntesis
+        char* state = line == NULL ? NULL : strrchr(line, ')');
+        if (state != NULL && state[1] == ' ' && state[2] == 'R')
         {
-            break; // Datos de procesos encontrados, podemos dejar de leer
+            running_processes++;
         }
     }
-
-    fclose(fp);
+    closedir(dir);
 
     // Verificar si se encontraron los valores
-    if (existing_processes == 0 || running_processes == 0)
+    if (existing_processes == 0)
     {
-        fprintf(stderr, "Error al leer la información de procesos desde TEMP_PROC_METRICS_FILE\n");
+        fprintf(stderr, "Error al leer la información de procesos desde /proc\n");
         return NULL;
     }
 